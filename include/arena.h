@@ -0,0 +1,27 @@
+#pragma once
+#include <uefi.h>
+
+// Default size of the first block of an arena
+#define ARENA_DEFAULT_SIZE (EFI_PAGE_SIZE * 4)
+
+// A block of pages that the arena hands out memory from
+typedef struct arena_block_s
+{
+    struct arena_block_s* next;
+    uintn_t pages; // Size of the block in pages
+    uintn_t used; // Bytes in use, including the block header
+} arena_block_s;
+
+// An arena hands out memory linearly from page blocks, every allocation is
+// released at once with ArenaReset or ArenaDestroy instead of being freed one by one
+typedef struct arena_s
+{
+    arena_block_s* first; // The block that is kept when the arena is reset
+    arena_block_s* current; // The block that allocations are currently served from
+} arena_s;
+
+arena_s* ArenaCreate(uintn_t initialSize);
+void* ArenaAlloc(arena_s* arena, uintn_t size);
+char_t* ArenaStrndup(arena_s* arena, const char_t* str, uintn_t len);
+void ArenaReset(arena_s* arena);
+void ArenaDestroy(arena_s* arena);
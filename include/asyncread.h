@@ -0,0 +1,52 @@
+#pragma once
+#include <uefi.h>
+#include "extentmap.h"
+
+// Size of a single read request, every file has at most one request in flight
+#define ASYNC_READ_CHUNK_SIZE (1024 * 1024)
+// The maximum number of files that AsyncReadAll reads at once
+#define ASYNC_MAX_READS (8)
+// A ring of this size holds the chunk the callback works on and the one that is being read
+#define ASYNC_RING_SIZE (2 * ASYNC_READ_CHUNK_SIZE)
+
+typedef enum async_read_state_t
+{
+    ASYNC_READ_IDLE, // Waiting for the next chunk to be submitted
+    ASYNC_READ_IN_FLIGHT,
+    ASYNC_READ_DONE
+} async_read_state_t;
+
+typedef struct async_read_s async_read_s;
+
+// Called after every chunk that was read, chunks arrive in file order
+// With ReadEx the next chunk is already being read while the callback runs
+typedef void (*async_chunk_callback_t)(async_read_s* read, const uint8_t* chunk, uintn_t len, void* context);
+// Called once the read is done, read->status tells if it succeeded
+typedef void (*async_complete_callback_t)(async_read_s* read, void* context);
+
+// Reads size bytes from the current position of a file into buffer
+// The callbacks and context are optional and can be set after AsyncReadInit
+// With an extent map the file is read from the disk instead, see AsyncReadInitExtents
+struct async_read_s
+{
+    efi_file_handle_t* file;
+    const extent_map_s* extents;
+    uint8_t* buffer;
+    uint64_t size;
+    uint64_t done; // Bytes that were read so far
+    uint64_t ringSize; // 0 if the buffer holds the whole file, otherwise ASYNC_RING_SIZE and the chunks wrap around it
+
+    async_read_state_t state;
+    efi_status_t status;
+    boolean_t useReadEx; // FALSE if the file protocol can't read asynchronously
+    efi_file_io_token_t token;
+    efi_disk_io2_token_t diskToken; // Only used by asynchronous reads from the disk
+
+    async_chunk_callback_t onChunk;
+    async_complete_callback_t onComplete;
+    void* context;
+};
+
+void AsyncReadInit(async_read_s* read, efi_file_handle_t* file, void* buffer, uint64_t size);
+void AsyncReadInitExtents(async_read_s* read, const extent_map_s* extents, void* buffer);
+efi_status_t AsyncReadAll(async_read_s* reads, uintn_t count);
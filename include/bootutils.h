@@ -17,6 +17,7 @@ wchar_t* StringToWideString(char_t* str);
 
 efi_handle_t GetFileDeviceHandle(char_t* path);
 efi_status_t GetFileInfo(efi_file_handle_t* fileHandle, efi_file_info_t* fileInfo);
+efi_status_t RenameFile(const char_t* path, const char_t* newName);
 efi_status_t ReadFile(efi_file_handle_t* fileHandle, uintn_t fileSize, char_t** buffer);
 
 char_t* GetFileContent(char_t* path, uint64_t* outFileSize);
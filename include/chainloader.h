@@ -1,4 +1,5 @@
 #pragma once
 #include <uefi.h>
+#include "config.h"
 
-void ChainloadImage(char_t* path, char_t* args);
+efi_status_t ChainloadImage(boot_entry_s* entry, boolean_t* digestMismatch);
@@ -0,0 +1,11 @@
+#pragma once
+#include <uefi.h>
+
+#define US_IN_SECOND        (1000000)
+#define US_IN_MILLISECOND   (1000)
+
+boolean_t InitClock(void);
+uint64_t ReadClockTicks(void);
+uint64_t GetClockFrequency(void);
+uint64_t GetMicrosecondsSinceInit(void);
+uint64_t TicksToMicroseconds(uint64_t ticks);
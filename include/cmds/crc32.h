@@ -0,0 +1,7 @@
+#pragma once
+#include <uefi.h>
+#include "commanddefs.h"
+
+boolean_t Crc32Cmd(cmd_args_s** args, char_t** currPathPtr);
+const char_t* Crc32Brief(void);
+const char_t* Crc32Long(void);
@@ -0,0 +1,7 @@
+#pragma once
+#include <uefi.h>
+#include "commanddefs.h"
+
+boolean_t FindCmd(cmd_args_s** args, char_t** currPathPtr);
+const char_t* FindBrief(void);
+const char_t* FindLong(void);
@@ -0,0 +1,7 @@
+#pragma once
+#include <uefi.h>
+#include "commanddefs.h"
+
+boolean_t Sha256sumCmd(cmd_args_s** args, char_t** currPathPtr);
+const char_t* Sha256sumBrief(void);
+const char_t* Sha256sumLong(void);
@@ -0,0 +1,7 @@
+#pragma once
+#include <uefi.h>
+#include "commanddefs.h"
+
+boolean_t SmpCmd(cmd_args_s** args, char_t** currPathPtr);
+const char_t* SmpBrief(void);
+const char_t* SmpLong(void);
@@ -1,5 +1,7 @@
 #pragma once
 #include <uefi.h>
+#include "arena.h"
+#include "hash.h"
 
 typedef struct kernel_scan_info_s
 {
@@ -7,6 +9,13 @@ typedef struct kernel_scan_info_s
     char_t* kernelVersionString;
 } kernel_scan_info_s;
 
+typedef struct initrd_entry_s
+{
+    char_t* path;
+    boolean_t verify; // TRUE if a sha256 digest was given for this initrd
+    uint8_t sha256[SHA256_DIGEST_SIZE];
+} initrd_entry_s;
+
 typedef struct boot_entry_s
 {
     char_t* name; // Name in the menu
@@ -18,6 +27,14 @@ typedef struct boot_entry_s
     // avoid having to edit the config file with every kernel version update
     boolean_t isDirectoryToKernel;
     kernel_scan_info_s* kernelScanInfo;
+
+    // The image is hashed while it is read and it isn't loaded if the digest doesn't match
+    boolean_t verifyImage;
+    uint8_t imgSha256[SHA256_DIGEST_SIZE];
+
+    // Every initrd is also passed in the args, the list is used to verify them
+    initrd_entry_s* initrds;
+    int32_t numOfInitrds;
 } boot_entry_s;
 
 typedef struct boot_entry_array_s
@@ -27,5 +44,5 @@ typedef struct boot_entry_array_s
 } boot_entry_array_s;
 
 boot_entry_array_s ParseConfig(void);
-boolean_t ParseKeyValuePair(char_t* token, const char_t delimiter, char_t** key, char_t** value);
+boolean_t ParseKeyValuePair(arena_s* arena, char_t* token, const char_t delimiter, char_t** key, char_t** value);
 void FreeConfigEntries(boot_entry_array_s* entryArr);
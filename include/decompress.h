@@ -0,0 +1,43 @@
+#pragma once
+#include <uefi.h>
+
+// The most bytes DetectCompression and GuessDecompressedSize look at from the start of a file
+#define COMPRESSION_HEADER_SIZE (32)
+// GuessDecompressedSize looks at this many bytes from the end of a file
+#define COMPRESSION_TRAILER_SIZE (4)
+
+typedef enum compression_t
+{
+    COMPRESSION_NONE,
+    COMPRESSION_GZIP,
+    COMPRESSION_ZSTD,
+} compression_t;
+
+// Decompresses a file that arrives in chunks, in file order, into a single page aligned buffer
+// The buffer is allocated with the size from the file's header and only grows if that size was wrong
+typedef struct decompress_s
+{
+    compression_t compression;
+    void* state; // The decoder's own state, it keeps whatever it needs between the chunks
+
+    uint8_t* output; // Freed by DecompressFree
+    uint64_t outputCapacity;
+    uint64_t outputSize; // Bytes decompressed so far
+    uint64_t inputSize; // Compressed bytes that were passed in so far
+
+    uint64_t decodeTicks; // Time spent in the decoder, the reads aren't counted
+    efi_status_t status; // The first error, the chunks after it are ignored
+} decompress_s;
+
+compression_t DetectCompression(const uint8_t* header, uintn_t length);
+const char_t* CompressionName(compression_t compression);
+uint64_t GuessDecompressedSize(compression_t compression, const uint8_t* header, uintn_t headerLength,
+    const uint8_t trailer[COMPRESSION_TRAILER_SIZE], uint64_t fileSize);
+
+efi_status_t DecompressInit(decompress_s* dec, compression_t compression, uint64_t sizeHint);
+efi_status_t DecompressChunk(decompress_s* dec, const uint8_t* chunk, uintn_t length, boolean_t last);
+void DecompressFree(decompress_s* dec);
+
+// For the decoders
+boolean_t DecompressReserve(decompress_s* dec, uint64_t length);
+void DecompressFail(decompress_s* dec, efi_status_t status, const char_t* reason);
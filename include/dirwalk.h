@@ -0,0 +1,41 @@
+#pragma once
+#include <uefi.h>
+
+// Deeper trees are not walked, one directory handle is kept open per level
+#define DIR_WALK_MAX_DEPTH (32)
+// The walk path is only kept for messages, longer paths are cut at the last name that fits
+#define DIR_WALK_PATH_SIZE (1024)
+
+// Flags for WalkDirectory
+#define DIR_WALK_WRITABLE (1 << 0) // Open the directories with write access, needed to delete them
+
+typedef enum walk_event_t
+{
+    WALK_FILE, // A file in the current directory
+    WALK_DIR_ENTER, // A directory was opened, returning FALSE skips its content
+    WALK_DIR_LEAVE, // All the entries of the current directory were walked
+    WALK_DIR_ERROR, // A directory couldn't be opened, errno is set
+} walk_event_t;
+
+typedef struct dir_walk_s dir_walk_s;
+
+// Returning FALSE marks the walk as failed, but the walk goes on with the next entry
+typedef boolean_t (*dir_walk_callback_t)(dir_walk_s* walk, walk_event_t event, const char_t* name);
+
+// Entries are opened relative to the directory handle of their parent,
+// so no path has to be resolved from the root of the volume while walking
+struct dir_walk_s
+{
+    DIR* dirs[DIR_WALK_MAX_DEPTH]; // dirs[0] is the root of the walk, dirs[depth] is the current directory
+    uint32_t depth;
+    uint32_t flags;
+    char_t path[DIR_WALK_PATH_SIZE]; // Path of the current entry
+    uintn_t pathLengths[DIR_WALK_MAX_DEPTH]; // Length of the path of every open directory
+    const struct dirent* entry; // Entry of the reported file or directory, NULL for the root and on WALK_DIR_LEAVE
+    dir_walk_callback_t callback;
+    void* context;
+};
+
+boolean_t WalkDirectory(DIR* root, const char_t* rootPath, uint32_t flags, dir_walk_callback_t callback, void* context);
+boolean_t WalkDeleteFile(dir_walk_s* walk, const char_t* name);
+boolean_t WalkDeleteDirectory(dir_walk_s* walk);
@@ -1,5 +1,6 @@
 #pragma once
 #include <uefi.h>
+#include "arena.h"
 
 // Used in the input processing function
 #define UP_ARROW_SCANCODE       (0x01)
@@ -21,10 +22,14 @@
 #define F2_KEY_SCANCODE         (0x0C)
 
 // Generic buffer struct
+// If arena is set the buffer grows inside of it and is released when the arena is reset,
+// otherwise it is a heap buffer that has to be freed with FreeBuffer
 typedef struct buffer_s
 {
     char_t* b;
     int32_t len;
+    int32_t cap;
+    arena_s* arena;
 } buffer_s;
 
 int8_t StartEditor(char_t* filename);
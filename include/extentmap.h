@@ -0,0 +1,36 @@
+#pragma once
+#include <uefi.h>
+
+// A file with more fragments than this is always read through the file system
+#define MAX_FILE_EXTENTS (64)
+
+// A contiguous part of a file on the partition, in bytes from the start of the partition
+typedef struct file_extent_s
+{
+    uint64_t offset;
+    uint64_t length;
+} file_extent_s;
+
+// Where a file is on the disk of the boot manager's volume, and the protocols that read it from there
+// The extents are in file order and their lengths add up to the size of the file
+typedef struct extent_map_s
+{
+    efi_block_io_t* blockIo;
+    efi_disk_io2_protocol_t* diskIo2; // NULL if the disk can't be read asynchronously
+    uint32_t mediaId;
+    uint32_t blockSize;
+
+    uint64_t fileSize;
+    uint32_t extentCount;
+    file_extent_s extents[MAX_FILE_EXTENTS];
+} extent_map_s;
+
+void SetExtentCacheEnabled(boolean_t enabled);
+boolean_t IsExtentCacheEnabled(void);
+
+boolean_t LoadExtentMap(const char_t* path, efi_file_handle_t* file, extent_map_s* map);
+void RecordExtentMap(const char_t* path, efi_file_handle_t* file);
+void DropExtentMap(const char_t* path);
+void SaveExtentCache(void);
+
+uint64_t ExtentMapLookup(const extent_map_s* map, uint64_t position, uint64_t* contiguous);
@@ -0,0 +1,9 @@
+#pragma once
+#include <uefi.h>
+
+// Flags for CopyFileEx
+#define COPY_SHOW_PROGRESS  (1 << 0) // Show a progress indicator and the throughput for large files
+#define COPY_VERIFY         (1 << 1) // Read the copy back and compare its checksums with the source
+
+int32_t CopyFileEx(const char_t* src, const char_t* dest, uint32_t flags);
+int32_t CopyFileStreams(FILE* srcFP, FILE* destFP, uint32_t flags);
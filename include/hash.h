@@ -0,0 +1,37 @@
+#pragma once
+#include <uefi.h>
+
+#define SHA256_BLOCK_SIZE   (64)
+#define SHA256_DIGEST_SIZE  (32)
+// Tree mode hashes the data in chunks of this size, the digest is the SHA-256 of the chunk digests in order
+#define SHA256_TREE_CHUNK_SIZE (1024 * 1024)
+
+typedef enum hash_algorithm_t
+{
+    HASH_SHA256,
+    HASH_CRC32C,
+} hash_algorithm_t;
+
+// A SHA-256 computed over any number of Sha256Update calls
+typedef struct sha256_ctx_s
+{
+    uint32_t state[8];
+    uint64_t length; // Bytes hashed so far
+    uint8_t block[SHA256_BLOCK_SIZE]; // The part of a block that is still waiting for more data
+    uintn_t blockLength;
+} sha256_ctx_s;
+
+boolean_t InitHash(void);
+
+void Sha256Init(sha256_ctx_s* ctx);
+void Sha256Update(sha256_ctx_s* ctx, const void* data, uintn_t length);
+void Sha256Final(sha256_ctx_s* ctx, uint8_t digest[SHA256_DIGEST_SIZE]);
+void Sha256ToString(const uint8_t digest[SHA256_DIGEST_SIZE], char_t str[SHA256_DIGEST_SIZE * 2 + 1]);
+boolean_t Sha256FromString(const char_t* str, uint8_t digest[SHA256_DIGEST_SIZE]);
+void Sha256TreeUpdate(sha256_ctx_s* root, const void* data, uintn_t length);
+
+uint32_t Crc32c(uint32_t crc, const void* data, uintn_t length);
+uint32_t Crc32(uint32_t crc, const void* data, uintn_t length);
+
+boolean_t HashSelfTest(hash_algorithm_t algorithm, boolean_t verbose);
+void HashBenchmark(hash_algorithm_t algorithm);
@@ -0,0 +1,15 @@
+#pragma once
+#include <uefi.h>
+
+// The most initrds that can be served at once
+#define MAX_INITRD_PARTS (8)
+
+// One initrd in memory, the kernel gets all of them as one, in order
+typedef struct initrd_part_s
+{
+    const void* data;
+    uint64_t size;
+} initrd_part_s;
+
+efi_status_t InstallInitrd(const initrd_part_s* parts, uintn_t count);
+void UninstallInitrd(void);
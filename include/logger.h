@@ -1,5 +1,6 @@
 #pragma once
 #include <uefi.h>
+#include "logviewer.h"
 
 typedef enum log_level_t
 {
@@ -8,10 +9,56 @@ typedef enum log_level_t
     LL_ERROR
 } log_level_t;
 
+// Records below this level are removed at compile time
+// Release builds keep warnings and errors, debug builds keep everything
+#ifndef LOG_MIN_LEVEL
+#ifdef LUCIDLOADER_DEBUG
+#define LOG_MIN_LEVEL (LL_INFO)
+#else
+#define LOG_MIN_LEVEL (LL_WARNING)
+#endif
+#endif
+
+// Records below this level are dropped before they are formatted, set by the "loglevel" config key
+extern log_level_t runtimeLogLevel;
+
+#define Log(loglevel, status, ...) \
+    do \
+    { \
+        if ((loglevel) >= LOG_MIN_LEVEL && (loglevel) >= runtimeLogLevel) \
+        { \
+            LogMessage((loglevel), (status), __VA_ARGS__); \
+        } \
+    } while (0)
+
+typedef enum log_mode_t
+{
+    LOG_MODE_FILE,
+    LOG_MODE_MEMORY
+} log_mode_t;
+
+// Vendor GUID of the LucidLoaderLog variable that holds the log in memory mode
+#define LOG_VARIABLE_GUID { 0x3fb2581c, 0xd6cd, 0x4e32, {0x9b, 0x38, 0xa8, 0xf0, 0x86, 0x41, 0xc8, 0x98} }
+
 int8_t InitLogger(void);
-void Log(log_level_t loglevel, efi_status_t status, const char_t* fmtMessage, ...);
+void LogMessage(log_level_t loglevel, efi_status_t status, const char_t* fmtMessage, ...);
+boolean_t LogFlush(void);
+boolean_t LogFlushToFile(void);
+void LogHandOff(void);
+void SetLogMode(log_mode_t mode);
+log_mode_t GetLogMode(void);
+void SetLogRetention(uint32_t count);
+void SetLogMaxSize(uint64_t maxSize);
 const char_t* LogLevelString(log_level_t loglevel);
 const char_t* EfiErrorString(efi_status_t status);
-time_t GetSecondsSinceInit(void);
 
-void PrintLogFile(void);
+int32_t ViewLogFile(log_filter_t filter);
+
+// Debug builds report buffers that were allocated after a checkpoint and never freed
+#ifdef LUCIDLOADER_DEBUG
+uint64_t HeapCheckpoint(void);
+void LogHeapLeaks(uint64_t checkpoint, const char_t* scope);
+#else
+#define HeapCheckpoint() (0)
+#define LogHeapLeaks(checkpoint, scope) ((void)(checkpoint))
+#endif
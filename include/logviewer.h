@@ -0,0 +1,12 @@
+#pragma once
+#include <uefi.h>
+
+typedef enum log_filter_t
+{
+    LOG_FILTER_ALL,
+    LOG_FILTER_WARNINGS, // Warnings and errors
+    LOG_FILTER_ERRORS
+} log_filter_t;
+
+int32_t StartLogViewer(char_t* path, log_filter_t filter);
+int32_t StartLogViewerInMemory(const char_t* name, const char_t* data, uint64_t size, log_filter_t filter);
@@ -0,0 +1,11 @@
+#pragma once
+#include <uefi.h>
+
+// Processes one item of a job, it may run on any processor at the same time as the other items
+// It must not call boot services or allocate memory, and the stacks of the other processors are small
+typedef void (*mp_job_item_t)(void* context, uintn_t item);
+
+boolean_t InitMpJobs(void);
+uintn_t GetMpWorkerCount(void);
+void RunMpJob(mp_job_item_t function, void* context, uintn_t itemCount);
+void MpZeroMemory(void* buffer, uint64_t size);
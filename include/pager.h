@@ -0,0 +1,23 @@
+#pragma once
+#include <uefi.h>
+
+// Characters collected before they are sent to the console in one call
+#define PAGER_BUFFER_SIZE (1024)
+
+// Buffers console output and optionally stops after every screen until a key is pressed
+typedef struct pager_s
+{
+    wchar_t buffer[PAGER_BUFFER_SIZE + 3]; // Room for a line break and the terminator
+    uintn_t length;
+    boolean_t paged;
+    boolean_t quit; // The user quit from the prompt, nothing is printed anymore
+    uintn_t rows; // Full rows printed since the last prompt
+    uintn_t column;
+    uintn_t screenRows;
+    uintn_t screenCols;
+} pager_s;
+
+void PagerInit(pager_s* pager, boolean_t paged);
+boolean_t PagerWrite(pager_s* pager, const char_t* data, uintn_t length);
+boolean_t PagerWriteText(pager_s* pager, const char_t* text, uintn_t length);
+void PagerFlush(pager_s* pager);
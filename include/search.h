@@ -0,0 +1,16 @@
+#pragma once
+#include <uefi.h>
+
+#define SEARCH_MAX_PATTERN_LENGTH (256)
+
+// A substring search prepared once and run over any amount of data
+typedef struct search_pattern_s
+{
+    uint8_t pattern[SEARCH_MAX_PATTERN_LENGTH]; // Lowercased when the search ignores case
+    uintn_t length;
+    boolean_t ignoreCase; // Only ASCII letters are folded
+    uint16_t shift[256]; // Horspool shift for the byte under the last position of the window
+} search_pattern_s;
+
+boolean_t SearchInit(search_pattern_s* search, const char_t* pattern, boolean_t ignoreCase);
+const char_t* SearchFind(const search_pattern_s* search, const char_t* data, uintn_t length);
@@ -20,6 +20,12 @@
 #define CMD_EFI_FAIL (50)
 #define CMD_MISSING_SRC_FILE_OPERAND (51)
 #define CMD_MISSING_DST_FILE_OPERAND (52)
+#define CMD_VERIFY_FAIL (53)
+#define CMD_DIR_TOO_DEEP (54)
+#define CMD_NO_PATTERN_SPECIFIED (55)
+#define CMD_PATTERN_TOO_LONG (56)
+#define CMD_MISSING_OPTION_VALUE (57)
+#define CMD_INVALID_OPTION_VALUE (58)
 
 const char_t* GetCommandErrorInfo(const uint8_t error);
 void PrintCommandError(const char_t* cmd, const char_t* args, const uint8_t error);
@@ -2,6 +2,10 @@
 #include <uefi.h>
 #include "commanddefs.h"
 
+// Flags for PrintFileContent
+#define PRINT_LINE_NUMBERS  (1 << 0) // Number every line
+#define PRINT_PAGED         (1 << 1) // Stop after every screen until a key is pressed
+
 char_t* ConcatPaths(const char_t* lhs, const char_t* rhs);
 uint8_t NormalizePath(char_t** path);
 void CleanPath(char_t** path);
@@ -17,10 +21,12 @@ void RemoveRepeatedChars(char_t* str, char_t toRemove);
 int32_t GetValueOffset(char_t* line, const char_t delimiter);
 
 boolean_t FindFlagAndDelete(cmd_args_s** argsHead, const char_t* flagStr);
+boolean_t FindOptionAndDelete(cmd_args_s** argsHead, const char_t* optionStr, char_t** value);
 cmd_args_s* GetLastArg(cmd_args_s* head);
 
-int32_t PrintFileContent(char_t* path);
+int32_t PrintFileContent(char_t* path, uint32_t flags);
 int32_t CreateDirectory(char_t* path);
+int32_t CreateDirectoryAt(DIR* parent, const char_t* name, DIR** outDir);
 int32_t CopyFile(const char_t* src, const char_t* dest);
 
 char_t* StringReplace(const char_t* orig, const char_t* pattern, const char_t* replacement);
@@ -0,0 +1,8 @@
+#pragma once
+#include <uefi.h>
+#include "decompress.h"
+
+void* ZstdCreate(void);
+void ZstdDestroy(void* state);
+efi_status_t ZstdDecode(decompress_s* dec, const uint8_t* data, uintn_t length, boolean_t last);
+uint64_t ZstdSizeHint(const uint8_t* header, uintn_t headerLength, const uint8_t trailer[COMPRESSION_TRAILER_SIZE]);
@@ -20,4 +20,4 @@ mcopy -i fat.img add-to-image/* ::/EFI/lucidloader
 cp fat.img iso
 xorriso -as mkisofs -R -f -e fat.img -no-emul-boot -o cdimage.iso iso
 rm -rf iso
-qemu-system-x86_64 -cpu qemu64 -bios ovmf/OVMF.fd -drive file=cdimage.iso,if=ide -net none -enable-kvm
+qemu-system-x86_64 -cpu qemu64 -smp 4 -bios ovmf/OVMF.fd -drive file=cdimage.iso,if=ide -net none -enable-kvm
@@ -0,0 +1,136 @@
+#include "arena.h"
+#include "logger.h"
+
+// Every allocation is aligned to this value
+#define ARENA_ALIGNMENT (16)
+#define ALIGN_UP(x, a) (((x) + ((a) - 1)) & ~((uintn_t)(a) - 1))
+
+#define ARENA_HEADER_SIZE (ALIGN_UP(sizeof(arena_block_s), ARENA_ALIGNMENT))
+
+static arena_block_s* AllocateArenaBlock(uintn_t minSize);
+static void FreeArenaBlock(arena_block_s* block);
+
+
+// Creates an arena with a first block that can hold at least initialSize bytes
+// The arena struct itself is stored in the first block, so only one page allocation is made
+arena_s* ArenaCreate(uintn_t initialSize)
+{
+    const uintn_t arenaSize = ALIGN_UP(sizeof(arena_s), ARENA_ALIGNMENT);
+
+    arena_block_s* block = AllocateArenaBlock(initialSize + arenaSize);
+    if (block == NULL)
+    {
+        return NULL;
+    }
+
+    arena_s* arena = (arena_s*)((uint8_t*)block + block->used);
+    block->used += arenaSize;
+
+    arena->first = block;
+    arena->current = block;
+    return arena;
+}
+
+// Returns memory that stays valid until the arena is reset or destroyed
+void* ArenaAlloc(arena_s* arena, uintn_t size)
+{
+    if (arena == NULL)
+    {
+        return NULL;
+    }
+    size = ALIGN_UP(size, ARENA_ALIGNMENT);
+
+    arena_block_s* block = arena->current;
+    if (block->used + size > block->pages * EFI_PAGE_SIZE)
+    {
+        // Blocks grow together with the arena to keep the amount of page allocations low
+        uintn_t newSize = block->pages * EFI_PAGE_SIZE * 2;
+        if (newSize < size + ARENA_HEADER_SIZE)
+        {
+            newSize = size + ARENA_HEADER_SIZE;
+        }
+
+        arena_block_s* newBlock = AllocateArenaBlock(newSize);
+        if (newBlock == NULL)
+        {
+            Log(LL_ERROR, 0, "Failed to grow the arena by %d bytes.", newSize);
+            return NULL;
+        }
+        block->next = newBlock;
+        arena->current = newBlock;
+        block = newBlock;
+    }
+
+    void* mem = (uint8_t*)block + block->used;
+    block->used += size;
+    return mem;
+}
+
+// Copies len characters of str into the arena and null terminates the copy
+char_t* ArenaStrndup(arena_s* arena, const char_t* str, uintn_t len)
+{
+    char_t* copy = ArenaAlloc(arena, len + 1);
+    if (copy != NULL)
+    {
+        memcpy(copy, str, len);
+        copy[len] = CHAR_NULL;
+    }
+    return copy;
+}
+
+// Releases every allocation at once, the first block is kept for reuse
+void ArenaReset(arena_s* arena)
+{
+    if (arena == NULL)
+    {
+        return;
+    }
+    arena_block_s* first = arena->first;
+
+    arena_block_s* block = first->next;
+    while (block != NULL)
+    {
+        arena_block_s* next = block->next;
+        FreeArenaBlock(block);
+        block = next;
+    }
+
+    first->next = NULL;
+    first->used = ARENA_HEADER_SIZE + ALIGN_UP(sizeof(arena_s), ARENA_ALIGNMENT);
+    arena->current = first;
+}
+
+void ArenaDestroy(arena_s* arena)
+{
+    if (arena == NULL)
+    {
+        return;
+    }
+    ArenaReset(arena);
+    // The arena struct lives in the first block so it is freed last
+    FreeArenaBlock(arena->first);
+}
+
+static arena_block_s* AllocateArenaBlock(uintn_t minSize)
+{
+    uintn_t pages = EFI_SIZE_TO_PAGES(minSize + ARENA_HEADER_SIZE);
+    efi_physical_address_t addr = 0;
+
+    efi_status_t status = BS->AllocatePages(AllocateAnyPages, EfiLoaderData, pages, &addr);
+    if (EFI_ERROR(status))
+    {
+        Log(LL_ERROR, status, "Failed to allocate %d pages for an arena block.", pages);
+        return NULL;
+    }
+
+    arena_block_s* block = (arena_block_s*)addr;
+    block->next = NULL;
+    block->pages = pages;
+    block->used = ARENA_HEADER_SIZE;
+    return block;
+}
+
+static void FreeArenaBlock(arena_block_s* block)
+{
+    BS->FreePages((efi_physical_address_t)block, block->pages);
+}
@@ -0,0 +1,316 @@
+#include "asyncread.h"
+#include "bootutils.h"
+#include "logger.h"
+
+static void StartRead(async_read_s* read);
+static uint64_t BufferOffset(async_read_s* read);
+static void PrepareChunkToken(async_read_s* read);
+static efi_status_t SubmitAsyncChunk(async_read_s* read);
+static efi_status_t SubmitDiskChunk(async_read_s* read);
+static efi_status_t ReadDiskChunk(async_read_s* read);
+static void SubmitChunk(async_read_s* read);
+static void CompleteChunk(async_read_s* read);
+static void FinishRead(async_read_s* read, efi_status_t status);
+
+
+void AsyncReadInit(async_read_s* read, efi_file_handle_t* file, void* buffer, uint64_t size)
+{
+    memset(read, 0, sizeof(async_read_s));
+    read->file = file;
+    read->buffer = buffer;
+    read->size = size;
+}
+
+// Reads the whole file from the disk, the buffer has to be page aligned
+// and have room for the file rounded up to whole blocks
+void AsyncReadInitExtents(async_read_s* read, const extent_map_s* extents, void* buffer)
+{
+    memset(read, 0, sizeof(async_read_s));
+    read->extents = extents;
+    read->buffer = buffer;
+    read->size = extents->fileSize;
+}
+
+// Reads every file to the end with one chunk request in flight per file, so the requests
+// of different files overlap. Files whose protocol doesn't support ReadEx are read synchronously,
+// one chunk at a time between the asynchronous ones
+// Returns the first error of the reads, every read has its own status too
+efi_status_t AsyncReadAll(async_read_s* reads, uintn_t count)
+{
+    if (count > ASYNC_MAX_READS)
+    {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    for (uintn_t i = 0; i < count; i++)
+    {
+        StartRead(&reads[i]);
+    }
+
+    while (TRUE)
+    {
+        efi_event_t events[ASYNC_MAX_READS];
+        async_read_s* owners[ASYNC_MAX_READS];
+        uintn_t inFlight = 0;
+        boolean_t syncReads = FALSE;
+
+        for (uintn_t i = 0; i < count; i++)
+        {
+            async_read_s* read = &reads[i];
+            if (read->state == ASYNC_READ_IDLE)
+            {
+                SubmitChunk(read);
+                syncReads = syncReads || !read->useReadEx;
+            }
+
+            if (read->state == ASYNC_READ_IN_FLIGHT)
+            {
+                events[inFlight] = read->token.Event;
+                owners[inFlight] = read;
+                inFlight++;
+            }
+        }
+
+        if (inFlight == 0)
+        {
+            if (!syncReads)
+            {
+                break;
+            }
+            continue;
+        }
+
+        if (syncReads)
+        {
+            // Don't block while there are synchronous reads to make progress on
+            for (uintn_t i = 0; i < inFlight; i++)
+            {
+                if (BS->CheckEvent(events[i]) == EFI_SUCCESS)
+                {
+                    CompleteChunk(owners[i]);
+                }
+            }
+        }
+        else
+        {
+            uintn_t idx = 0;
+            efi_status_t status = BS->WaitForEvent(inFlight, events, &idx);
+            if (EFI_ERROR(status))
+            {
+                Log(LL_ERROR, status, "Failed to wait for a file read.");
+                // The requests can't be cancelled, so wait for each of them in turn
+                for (uintn_t i = 0; i < inFlight; i++)
+                {
+                    while (BS->CheckEvent(events[i]) == EFI_NOT_READY);
+                    FinishRead(owners[i], status);
+                }
+                break;
+            }
+            CompleteChunk(owners[idx]);
+        }
+    }
+
+    for (uintn_t i = 0; i < count; i++)
+    {
+        if (EFI_ERROR(reads[i].status))
+        {
+            return reads[i].status;
+        }
+    }
+    return EFI_SUCCESS;
+}
+
+static void StartRead(async_read_s* read)
+{
+    read->done = 0;
+    read->status = EFI_SUCCESS;
+    read->state = ASYNC_READ_IDLE;
+    read->token.Event = NULL;
+
+    if (read->extents != NULL)
+    {
+        read->useReadEx = read->extents->diskIo2 != NULL;
+    }
+    else
+    {
+        read->useReadEx = read->file->Revision >= EFI_FILE_PROTOCOL_REVISION2 && read->file->ReadEx != NULL;
+    }
+    if (read->useReadEx)
+    {
+        // A plain event that the firmware signals when a request completes
+        efi_status_t status = BS->CreateEvent(0, 0, NULL, NULL, &read->token.Event);
+        if (EFI_ERROR(status))
+        {
+            read->useReadEx = FALSE;
+            read->token.Event = NULL;
+        }
+    }
+
+    if (read->size == 0)
+    {
+        FinishRead(read, EFI_SUCCESS);
+    }
+}
+
+// Where the next chunk goes, a chunk in a ring never wraps around its end
+static uint64_t BufferOffset(async_read_s* read)
+{
+    return read->ringSize != 0 ? read->done % read->ringSize : read->done;
+}
+
+static void PrepareChunkToken(async_read_s* read)
+{
+    uint64_t offset = BufferOffset(read);
+    uint64_t remaining = read->size - read->done;
+    if (read->ringSize != 0 && remaining > read->ringSize - offset)
+    {
+        remaining = read->ringSize - offset;
+    }
+    if (read->extents != NULL)
+    {
+        // A request reads one contiguous part of the disk
+        uint64_t contiguous = 0;
+        ExtentMapLookup(read->extents, read->done, &contiguous);
+        if (remaining > contiguous)
+        {
+            remaining = contiguous;
+        }
+    }
+    read->token.Status = EFI_SUCCESS;
+    read->token.BufferSize = remaining < ASYNC_READ_CHUNK_SIZE ? remaining : ASYNC_READ_CHUNK_SIZE;
+    read->token.Buffer = read->buffer + offset;
+}
+
+// Queues the next chunk with ReadEx, EFI_UNSUPPORTED means it has to be read synchronously instead
+static efi_status_t SubmitAsyncChunk(async_read_s* read)
+{
+    PrepareChunkToken(read);
+    efi_status_t status = read->extents != NULL ? SubmitDiskChunk(read) : read->file->ReadEx(read->file, &read->token);
+    if (!EFI_ERROR(status))
+    {
+        read->state = ASYNC_READ_IN_FLIGHT;
+    }
+    else if (status == EFI_UNSUPPORTED)
+    {
+        // Some drivers report a newer revision without implementing it, read the rest synchronously
+        BS->CloseEvent(read->token.Event);
+        read->token.Event = NULL;
+        read->useReadEx = FALSE;
+    }
+    return status;
+}
+
+// Disk IO 2 signals the same event as ReadEx, but reports the result in its own token
+static efi_status_t SubmitDiskChunk(async_read_s* read)
+{
+    const extent_map_s* map = read->extents;
+    uint64_t contiguous = 0;
+    uint64_t offset = ExtentMapLookup(map, read->done, &contiguous);
+    read->diskToken.Event = read->token.Event;
+    read->diskToken.TransactionStatus = EFI_SUCCESS;
+    return map->diskIo2->ReadDiskEx(map->diskIo2, map->mediaId, offset, &read->diskToken, read->token.BufferSize,
+        read->token.Buffer);
+}
+
+// Block IO only reads whole blocks, so the last chunk of the file is rounded up into the room at the end of the buffer
+static efi_status_t ReadDiskChunk(async_read_s* read)
+{
+    const extent_map_s* map = read->extents;
+    uint64_t contiguous = 0;
+    uint64_t offset = ExtentMapLookup(map, read->done, &contiguous);
+    uintn_t size = (read->token.BufferSize + map->blockSize - 1) / map->blockSize * map->blockSize;
+    return map->blockIo->ReadBlocks(map->blockIo, map->mediaId, offset / map->blockSize, size, read->token.Buffer);
+}
+
+static void SubmitChunk(async_read_s* read)
+{
+    if (read->useReadEx)
+    {
+        efi_status_t status = SubmitAsyncChunk(read);
+        if (status != EFI_UNSUPPORTED)
+        {
+            if (EFI_ERROR(status))
+            {
+                FinishRead(read, status);
+            }
+            return;
+        }
+    }
+
+    PrepareChunkToken(read);
+    if (read->extents != NULL)
+    {
+        read->token.Status = ReadDiskChunk(read);
+    }
+    else
+    {
+        read->token.Status = read->file->Read(read->file, &read->token.BufferSize, read->token.Buffer);
+    }
+    CompleteChunk(read);
+}
+
+static void CompleteChunk(async_read_s* read)
+{
+    if (read->extents != NULL && read->state == ASYNC_READ_IN_FLIGHT)
+    {
+        read->token.Status = read->diskToken.TransactionStatus;
+    }
+    if (EFI_ERROR(read->token.Status))
+    {
+        FinishRead(read, read->token.Status);
+        return;
+    }
+
+    uintn_t len = read->token.BufferSize;
+    if (len == 0)
+    {
+        // The file is shorter than expected
+        FinishRead(read, EFI_END_OF_FILE);
+        return;
+    }
+
+    const uint8_t* chunk = read->buffer + BufferOffset(read);
+    read->done += len;
+
+    efi_status_t submitStatus = EFI_SUCCESS;
+    if (read->done < read->size)
+    {
+        read->state = ASYNC_READ_IDLE;
+        // The next request is queued before the chunk is handed to the callback,
+        // so whatever the callback does with it overlaps with the read
+        if (read->useReadEx)
+        {
+            submitStatus = SubmitAsyncChunk(read);
+        }
+    }
+
+    if (read->onChunk != NULL)
+    {
+        read->onChunk(read, chunk, len, read->context);
+    }
+
+    if (read->done >= read->size)
+    {
+        FinishRead(read, EFI_SUCCESS);
+    }
+    else if (EFI_ERROR(submitStatus) && submitStatus != EFI_UNSUPPORTED)
+    {
+        FinishRead(read, submitStatus);
+    }
+}
+
+static void FinishRead(async_read_s* read, efi_status_t status)
+{
+    read->state = ASYNC_READ_DONE;
+    read->status = status;
+    if (read->token.Event != NULL)
+    {
+        BS->CloseEvent(read->token.Event);
+        read->token.Event = NULL;
+    }
+
+    if (read->onComplete != NULL)
+    {
+        read->onComplete(read, read->context);
+    }
+}
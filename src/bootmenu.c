@@ -8,6 +8,7 @@
 #include "editor.h"
 #include "shellutils.h"
 #include "screen.h"
+#include "clock.h"
 
 #define F5_KEY_SCANCODE (0x0F) // Used to refresh the menu (reparse config)
 
@@ -16,6 +17,7 @@
 
 #define BAD_CONFIGURATION_ERR_MSG ("An error has occurred while parsing the config file.")
 #define FAILED_BOOT_ERR_MSG ("An error has occurred during the booting process.")
+#define FAILED_VERIFICATION_ERR_MSG ("The boot files don't match the sha256 digests in the config file, they were not loaded.")
 
 /* Menu functions */
 static void BootMenu(boot_entry_array_s* entryArr);
@@ -27,7 +29,7 @@ static inline void PrintHighlightedEntryInfo(boot_entry_array_s* entryArr);
 
 /* Etc */
 static void InitBootMenuConfig(void);
-static void BootEntry(boot_entry_s* selectedEntry);
+static void BootEntry(boot_entry_s* selectedEntry, boolean_t* digestMismatch);
 static void PrintEntryInfo(boot_entry_s* selectedEntry);
 static void ScrollEntryList(void);
 
@@ -186,27 +188,42 @@ static void PrintBootMenu(boot_entry_array_s* entryArr)
 
 static void BootMenu(boot_entry_array_s* entryArr)
 {
+    // The countdown follows a deadline so the time spent redrawing the menu doesn't add up
+    uint64_t deadline = 0;
+
     while (TRUE)
     {
         PrintBootMenu(entryArr);
 
         if (!bmcfg.timeoutCancelled)
         {
-            if (bmcfg.bootImmediately)
+            uint64_t now = GetMicrosecondsSinceInit();
+            if (deadline == 0)
+            {
+                deadline = now + (uint64_t)bmcfg.timeoutSeconds * US_IN_SECOND;
+            }
+
+            if (bmcfg.bootImmediately || now >= deadline)
             {
                 BootHighlightedEntry(entryArr);
                 return;
             }
 
-            int32_t timerStatus = WaitForInput(1000);
+            // Wake up when the number of remaining seconds changes
+            uint64_t untilNextSecond = (deadline - now) % US_IN_SECOND;
+            if (untilNextSecond == 0)
+            {
+                untilNextSecond = US_IN_SECOND;
+            }
+
+            int32_t timerStatus = WaitForInput((untilNextSecond + US_IN_MILLISECOND - 1) / US_IN_MILLISECOND);
             if (timerStatus == INPUT_TIMER_TIMEOUT)
             {
-                bmcfg.timeoutSeconds--;
-                // Boot the selected entry if the timer ends
-                if (bmcfg.timeoutSeconds == 0)
+                // Round up so the last second is shown as 1 and not 0
+                now = GetMicrosecondsSinceInit();
+                if (now < deadline)
                 {
-                    BootHighlightedEntry(entryArr);
-                    return;
+                    bmcfg.timeoutSeconds = (deadline - now + US_IN_SECOND - 1) / US_IN_SECOND;
                 }
                 continue;
             }
@@ -290,6 +307,21 @@ static void PrintEntryInfo(boot_entry_s* selectedEntry)
         printf("Kernel version string: %s\n", selectedEntry->kernelScanInfo->kernelVersionString);
     }
 
+    char_t digestStr[SHA256_DIGEST_SIZE * 2 + 1];
+    if (selectedEntry->verifyImage)
+    {
+        Sha256ToString(selectedEntry->imgSha256, digestStr);
+        printf("\nSHA-256: %s\n", digestStr);
+    }
+    for (int32_t i = 0; i < selectedEntry->numOfInitrds; i++)
+    {
+        if (selectedEntry->initrds[i].verify)
+        {
+            Sha256ToString(selectedEntry->initrds[i].sha256, digestStr);
+            printf("Initrd SHA-256: %s (%s)\n", digestStr, selectedEntry->initrds[i].path);
+        }
+    }
+
     printf("\nPress any key to return...");
     GetInputKey();
     ST->ConOut->ClearScreen(ST->ConOut);
@@ -302,12 +334,13 @@ static inline void PrintHighlightedEntryInfo(boot_entry_array_s* entryArr)
 
 static inline void BootHighlightedEntry(boot_entry_array_s* entryArr)
 {
-    BootEntry(&entryArr->entries[bmcfg.selectedEntryIndex]);
+    boolean_t digestMismatch = FALSE;
+    BootEntry(&entryArr->entries[bmcfg.selectedEntryIndex], &digestMismatch);
     // If booting fails we will end up here
-    FailMenu(FAILED_BOOT_ERR_MSG);
+    FailMenu(digestMismatch ? FAILED_VERIFICATION_ERR_MSG : FAILED_BOOT_ERR_MSG);
 }
 
-static void BootEntry(boot_entry_s* selectedEntry)
+static void BootEntry(boot_entry_s* selectedEntry, boolean_t* digestMismatch)
 {
     // Printing info before booting
     ST->ConOut->ClearScreen(ST->ConOut);
@@ -316,11 +349,15 @@ static void BootEntry(boot_entry_s* selectedEntry)
             "- args: `%s`\n\n",
             selectedEntry->name, selectedEntry->imgToLoad, selectedEntry->imgArgs);
 
-    ChainloadImage(selectedEntry->imgToLoad, selectedEntry->imgArgs);
+    ChainloadImage(selectedEntry, digestMismatch);
 
     // Block the flow because there may be errors written on screen
-    printf("\nFailed to boot.\n"
-            "Press any key to return...");
+    printf("\nFailed to boot.\n");
+    if (*digestMismatch)
+    {
+        printf("The image or an initrd doesn't match its sha256 digest, see the log for details.\n");
+    }
+    printf("Press any key to return...");
     GetInputKey();
 }
 
@@ -329,6 +366,10 @@ static void FailMenu(const char_t* errorMsg)
     bmcfg.timeoutCancelled = TRUE;
     boolean_t returnToMainMenu = FALSE;
 
+    // Write the errors that brought us here before anything else can go wrong
+    // A memory only log is not worth keeping off the disk after a failure, but the mode stays for the next boot
+    LogFlushToFile();
+
     while (!returnToMainMenu)
     {
         ST->ConOut->ClearScreen(ST->ConOut);
@@ -379,10 +420,11 @@ static void FailMenu(const char_t* errorMsg)
 
 void ShowLogFile(void)
 {
-    ST->ConOut->ClearScreen(ST->ConOut);
-
-    PrintLogFile();
-
-    printf("\nPress any key to return...");
-    GetInputKey();
+    if (ViewLogFile(LOG_FILTER_ALL) != 0)
+    {
+        ST->ConOut->ClearScreen(ST->ConOut);
+        printf("Failed to open log file!\n");
+        printf("\nPress any key to return...");
+        GetInputKey();
+    }
 }
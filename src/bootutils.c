@@ -7,18 +7,16 @@
 
 wchar_t* StringToWideString(char_t* str)
 {
-    // The size has to be multiplied by the size of wchar_t 
-    // because wchar_t is 2 bytes, while char_t is 1 byte
-    const size_t size = strlen(str) * sizeof(wchar_t);
-    wchar_t* wpath = malloc(size + 1);
+    // Every UTF-8 sequence becomes at most one wide character, plus the null terminator
+    const size_t len = strlen(str);
+    wchar_t* wpath = malloc((len + 1) * sizeof(wchar_t));
     if (wpath == NULL)
     {
         Log(LL_ERROR, 0, "Failed to allocate memory during string conversion.");
         return NULL;
     }
 
-    wpath[size] = 0;
-    mbstowcs(wpath, str, size);
+    utf8_to_ucs2(wpath, len + 1, str, len);
     return wpath;
 }
 
@@ -47,6 +45,7 @@ efi_handle_t GetFileDeviceHandle(char_t* path)
     if (EFI_ERROR(status))
     {
         Log(LL_ERROR, status, "Unable to locate the simple file system protocol handles.");
+        free(handles);
         return NULL;
     }
 
@@ -70,7 +69,6 @@ efi_handle_t GetFileDeviceHandle(char_t* path)
             if (i + 1 == numHandles) 
             {
                 Log(LL_ERROR, status, "Failed to obtain the simple file system protocol.");
-                return NULL;
             }
             continue;
         }
@@ -81,7 +79,6 @@ efi_handle_t GetFileDeviceHandle(char_t* path)
             if (i + 1 == numHandles)
             {
                 Log(LL_ERROR, status, "Failed to obtain the device path protocol.");
-                return NULL;
             }
             continue;
         }
@@ -99,22 +96,27 @@ efi_handle_t GetFileDeviceHandle(char_t* path)
 
         // Check if the file exists
         wchar_t* wpath = StringToWideString(path);
+        if (wpath == NULL)
+        {
+            rootDir->Close(rootDir);
+            break;
+        }
         status = rootDir->Open(rootDir, &fileHandle, wpath, EFI_FILE_MODE_READ, EFI_FILE_READ_ONLY);
 
         rootDir->Close(rootDir);
         free(wpath);
         if (!EFI_ERROR(status))
         {
-            // Break if the file was found
+            // Break if the file was found, the handle was only needed for the check
+            fileHandle->Close(fileHandle);
             devHandle = handle;
             break;
         }
     }
     free(handles);
-    if (fileHandle == NULL)
+    if (devHandle == NULL)
     {
         Log(LL_ERROR, 0, "Failed to find the file '%s' on the machine.", path);
-        return NULL;
     }
     return devHandle;
 }
@@ -126,23 +128,50 @@ efi_status_t GetFileInfo(efi_file_handle_t* fileHandle, efi_file_info_t* fileInf
     return fileHandle->GetInfo(fileHandle, &infGuid, &size, (void*)fileInfo);
 }
 
-// Returns the size of a file in bytes
-uint64_t GetFileSize(FILE* file)
+// Renames a file in place through SetInfo, without copying its content
+// newName is only the new file name, the file stays in the same directory
+efi_status_t RenameFile(const char_t* path, const char_t* newName)
 {
+    // Write access is needed to change the file info
+    FILE* file = fopen(path, "r+");
     if (file == NULL)
     {
-        return 0;
+        return EFI_NOT_FOUND;
     }
 
     efi_file_info_t info;
-    efi_status_t status = GetFileInfo(file, &info);
-    if (EFI_ERROR(status))
+    efi_status_t status = GetFileInfo(file->handle, &info);
+    if (!EFI_ERROR(status))
+    {
+        size_t nameLen = utf8_to_ucs2(info.FileName, FILENAME_MAX, newName, (size_t)-1);
+        if (nameLen == (size_t)-1)
+        {
+            status = EFI_INVALID_PARAMETER;
+        }
+        else
+        {
+            // The info struct ends with the name, so its size depends on the length of the new name
+            info.Size = __builtin_offsetof(efi_file_info_t, FileName) + (nameLen + 1) * sizeof(wchar_t);
+
+            efi_guid_t infGuid = EFI_FILE_INFO_GUID;
+            status = file->handle->SetInfo(file->handle, &infGuid, info.Size, (void*)&info);
+        }
+    }
+
+    fclose(file);
+    return status;
+}
+
+// Returns the size of a file in bytes
+uint64_t GetFileSize(FILE* file)
+{
+    if (file == NULL)
     {
-        Log(LL_ERROR, status, "Failed to get file info when getting file size.");
         return 0;
     }
 
-    return info.FileSize;
+    // The size is cached by fopen and kept up to date by the writes, so no firmware call is needed
+    return file->size;
 }
 
 // The function reads the file content into a dynamically allocated buffer (null terminated)
@@ -222,11 +251,13 @@ efi_status_t RebootDevice(boolean_t rebootToFirmware)
         }
 
         Log(LL_INFO, 0, "Rebooting device into firmware settings...");
+        LogFlush();
         status = RT->ResetSystem(EfiResetCold, EFI_SUCCESS, 0, NULL);
     }
     else
     {
         Log(LL_INFO, 0, "Rebooting device...");
+        LogFlush();
         status = RT->ResetSystem(EfiResetCold, EFI_SUCCESS, 0, NULL);
     }
 
@@ -240,6 +271,7 @@ efi_status_t ShutdownDevice(void)
     ST->ConOut->ClearScreen(ST->ConOut);
 
     Log(LL_INFO, 0, "Shutting down device...");
+    LogFlush();
     efi_status_t status = RT->ResetSystem(EfiResetShutdown, EFI_SUCCESS, 0, NULL);
 
     // Will be reached only if shutting down failed
@@ -259,6 +291,9 @@ int32_t WaitForInput(uint32_t timeoutms)
     efi_event_t* timerEvent = events;  // Index 0 (Timer)
     events[1] = ST->ConIn->WaitForKey; // Index 1 (Input)
 
+    // Write the pending log records while idle
+    LogFlush();
+
     efi_status_t status = BS->CreateEvent(EVT_TIMER, 0, NULL, NULL, timerEvent);
     if (EFI_ERROR(status))
     {
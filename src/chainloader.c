@@ -1,16 +1,68 @@
 #include "chainloader.h"
 #include "logger.h"
 #include "bootutils.h"
+#include "clock.h"
+#include "asyncread.h"
+#include "hash.h"
+#include "initrd.h"
+#include "decompress.h"
+#include "extentmap.h"
 
-void ChainloadImage(char_t* path, char_t* args)
+// The initrds are read together with the image, one read each
+#define MAX_READ_INITRDS (ASYNC_MAX_READS - 1)
+#define BYTES_IN_MIB     (1024 * 1024)
+
+// A file that is read for booting, it is hashed chunk by chunk while the next chunk is being read
+// A compressed file is decompressed the same way, it is read through a ring and only its output is kept
+typedef struct boot_file_s
+{
+    const char_t* path;
+    FILE* file;
+    uint64_t size; // As stored, the digest is of the compressed file
+    const uint8_t* expectedSha256; // NULL if the file isn't verified
+    sha256_ctx_s sha256;
+
+    compression_t compression;
+    decompress_s dec;
+    uint8_t* buffer; // The whole file, or the ring of a compressed file
+    uintn_t bufferPages; // Not 0 if the buffer was allocated in pages, to read the disk straight into it
+    uint8_t* data; // What is loaded, the buffer or the decompressed output
+    uint64_t dataSize;
+
+    boolean_t useExtents; // Read from the disk through the cached extents instead of the file system
+    extent_map_s extents;
+} boot_file_s;
+
+static efi_status_t ReadBootFiles(boot_entry_s* entry, boot_file_s* files, uintn_t* count, boolean_t* digestMismatch);
+static boolean_t OpenBootFile(boot_file_s* bootFile, const char_t* path, const uint8_t* expectedSha256);
+static boolean_t DetectBootFileCompression(boot_file_s* bootFile);
+static boolean_t SetupBootFileRead(boot_file_s* bootFile, async_read_s* read);
+static void ProcessBootFileChunk(async_read_s* read, const uint8_t* chunk, uintn_t len, void* context);
+static efi_status_t CheckBootFileRead(boot_file_s* bootFile, async_read_s* read, boolean_t* digestMismatch);
+static boolean_t CheckBootFileDigest(boot_file_s* bootFile);
+static boolean_t FinishDecompression(boot_file_s* bootFile);
+static void RecordBootFileExtents(boot_file_s* files, uintn_t count);
+static void FreeBootFileBuffer(boot_file_s* bootFile);
+static boolean_t ReopenBootFile(boot_file_s* bootFile);
+static void FreeBootFiles(boot_file_s* files, uintn_t count);
+static boolean_t HasVerifiedInitrd(boot_entry_s* entry);
+
+
+// digestMismatch is set if a file doesn't match its digest in the config, nothing is loaded then
+// It is separate from the status, the firmware returns EFI_SECURITY_VIOLATION itself when Secure Boot rejects the image
+efi_status_t ChainloadImage(boot_entry_s* entry, boolean_t* digestMismatch)
 {
+    *digestMismatch = FALSE;
+    char_t* path = entry->imgToLoad;
+    char_t* args = entry->imgArgs;
+
     // Device handle must be passed to the loaded image protocol because of
     // the way we call LoadImage()
     efi_handle_t devHandle = GetFileDeviceHandle(path);
     if (devHandle == NULL)
     {
         Log(LL_ERROR, 0, "Failed to file device handle for chainloading '%s'.", path);
-        return;
+        return EFI_NOT_FOUND;
     }
 
     efi_device_path_t* devPath = NULL;
@@ -19,29 +71,55 @@ void ChainloadImage(char_t* path, char_t* args)
     if (EFI_ERROR(status))
     {
         Log(LL_ERROR, status, "Failed to handle device path.");
-        return;
+        return status;
     }
 
-    // Read the file data into a buffer
-    uintn_t imgFileSize = 0;
-    char_t* imgData = GetFileContent(path, &imgFileSize);
-    if (imgData == NULL)
+    // Read the file data into a buffer, the digests are checked and the files decompressed during the same read
+    uint64_t loadStart = GetMicrosecondsSinceInit();
+    boot_file_s files[ASYNC_MAX_READS];
+    uintn_t fileCount = 0;
+    status = ReadBootFiles(entry, files, &fileCount, digestMismatch);
+    if (*digestMismatch)
     {
-        Log(LL_ERROR, 0, "Failed to read file '%s' for chainloading.", path);
-        return;
+        Log(LL_ERROR, 0, "Refusing to load '%s', it doesn't match the sha256 digests in the config.", path);
+        return status;
+    }
+    else if (EFI_ERROR(status))
+    {
+        Log(LL_ERROR, status, "Failed to read file '%s' for chainloading.", path);
+        return status;
     }
 
-    // Load the image
     efi_handle_t imgHandle;
-    status = BS->LoadImage(FALSE, IM, devPath, imgData, imgFileSize, &imgHandle);
+    efi_loaded_image_protocol_t* imgProtocol = NULL;
+
+    // The kernel gets the verified initrds from memory, so they aren't read from the disk a second time
+    if (fileCount > 1)
+    {
+        initrd_part_s parts[MAX_READ_INITRDS];
+        for (uintn_t i = 1; i < fileCount; i++)
+        {
+            parts[i - 1].data = files[i].data;
+            parts[i - 1].size = files[i].dataSize;
+        }
+        status = InstallInitrd(parts, fileCount - 1);
+        if (EFI_ERROR(status))
+        {
+            goto cleanup;
+        }
+    }
+
+    // Load the image
+    status = BS->LoadImage(FALSE, IM, devPath, files[0].data, files[0].dataSize, &imgHandle);
     if (EFI_ERROR(status))
     {
         Log(LL_ERROR, status, "Failed to load the image for chainloading '%s'.", path);
         goto cleanup;
     }
+    Log(LL_INFO, 0, "Read and loaded %d bytes in %d ms.", files[0].dataSize,
+        (GetMicrosecondsSinceInit() - loadStart) / US_IN_MILLISECOND);
 
     efi_guid_t loadedImageGuid = EFI_LOADED_IMAGE_PROTOCOL_GUID;
-    efi_loaded_image_protocol_t* imgProtocol = NULL;
     status = BS->HandleProtocol(imgHandle, &loadedImageGuid, (void**)&imgProtocol);
     if (EFI_ERROR(status))
     {
@@ -64,6 +142,8 @@ void ChainloadImage(char_t* path, char_t* args)
     }
 
     Log(LL_INFO, 0, "Chainloading image '%s'...", path);
+    // The image may never return, so this is the last chance to write or publish the log
+    LogHandOff();
     status = BS->StartImage(imgHandle, NULL, NULL);
     if (EFI_ERROR(status))
     {
@@ -72,9 +152,396 @@ void ChainloadImage(char_t* path, char_t* args)
 
 cleanup:
     // We shouldn't reach this, but in case the chainload fails we don't want memory leaks
-    if (args != NULL)
+    // The loaded image protocol is only available if LoadImage() succeeded
+    if (args != NULL && imgProtocol != NULL)
     {
         free(imgProtocol->LoadOptions);
     }
-    free(imgData);
+    UninstallInitrd();
+    FreeBootFiles(files, fileCount);
+    return status;
+}
+
+// Reads the image and, when one of them is verified, the initrds, all the reads overlap
+// Every file gets its own buffer, the initrds are handed to the kernel in the order of the config
+// Nothing is kept if a file fails, count is 0 then
+static efi_status_t ReadBootFiles(boot_entry_s* entry, boot_file_s* files, uintn_t* count, boolean_t* digestMismatch)
+{
+    async_read_s reads[ASYNC_MAX_READS];
+    efi_status_t status = EFI_SUCCESS;
+    *count = 0;
+
+    // Without a digest the kernel reads its initrds itself
+    boolean_t readInitrds = HasVerifiedInitrd(entry);
+    if (readInitrds && entry->numOfInitrds > MAX_READ_INITRDS)
+    {
+        Log(LL_ERROR, 0, "At most %d initrds can be verified, the entry has %d.", MAX_READ_INITRDS, entry->numOfInitrds);
+        return EFI_UNSUPPORTED;
+    }
+
+    if (!OpenBootFile(&files[0], entry->imgToLoad, entry->verifyImage ? entry->imgSha256 : NULL))
+    {
+        FreeBootFiles(files, 1);
+        return EFI_NOT_FOUND;
+    }
+    *count = 1;
+
+    for (int32_t i = 0; readInitrds && i < entry->numOfInitrds; i++)
+    {
+        initrd_entry_s* initrd = &entry->initrds[i];
+        boolean_t opened = OpenBootFile(&files[*count], initrd->path, initrd->verify ? initrd->sha256 : NULL);
+        (*count)++;
+        if (!opened)
+        {
+            status = EFI_NOT_FOUND;
+            goto cleanup;
+        }
+    }
+
+    for (uintn_t i = 0; i < *count; i++)
+    {
+        if (!SetupBootFileRead(&files[i], &reads[i]))
+        {
+            status = EFI_OUT_OF_RESOURCES;
+            goto cleanup;
+        }
+    }
+
+    // A file read through its cached extents gets a second read through the file system if it fails,
+    // only the second result counts then
+    AsyncReadAll(reads, *count);
+    async_read_s retryReads[ASYNC_MAX_READS];
+    boot_file_s* retryFiles[ASYNC_MAX_READS];
+    uintn_t retryCount = 0;
+    for (uintn_t i = 0; i < *count; i++)
+    {
+        boolean_t mismatch = FALSE;
+        efi_status_t fileStatus = CheckBootFileRead(&files[i], &reads[i], &mismatch);
+        if (!EFI_ERROR(fileStatus))
+        {
+            continue;
+        }
+        if (!files[i].useExtents)
+        {
+            *digestMismatch = *digestMismatch || mismatch;
+            status = EFI_ERROR(status) ? status : fileStatus;
+        }
+        else if (!EFI_ERROR(status))
+        {
+            if (!ReopenBootFile(&files[i]))
+            {
+                status = EFI_NOT_FOUND;
+            }
+            else if (!SetupBootFileRead(&files[i], &retryReads[retryCount]))
+            {
+                status = EFI_OUT_OF_RESOURCES;
+            }
+            retryFiles[retryCount++] = &files[i];
+        }
+    }
+    if (retryCount != 0 && !EFI_ERROR(status))
+    {
+        AsyncReadAll(retryReads, retryCount);
+        for (uintn_t i = 0; i < retryCount; i++)
+        {
+            efi_status_t fileStatus = CheckBootFileRead(retryFiles[i], &retryReads[i], digestMismatch);
+            status = EFI_ERROR(status) ? status : fileStatus;
+        }
+    }
+    if (!EFI_ERROR(status))
+    {
+        RecordBootFileExtents(files, *count);
+    }
+
+cleanup:
+    if (EFI_ERROR(status))
+    {
+        FreeBootFiles(files, *count);
+        *count = 0;
+        return status;
+    }
+    for (uintn_t i = 0; i < *count; i++)
+    {
+        fclose(files[i].file);
+        files[i].file = NULL;
+    }
+    return status;
+}
+
+// Every field is set, so FreeBootFiles can free the file even if this fails
+static boolean_t OpenBootFile(boot_file_s* bootFile, const char_t* path, const uint8_t* expectedSha256)
+{
+    memset(bootFile, 0, sizeof(boot_file_s));
+    bootFile->path = path;
+    bootFile->file = fopen(path, "r");
+    if (bootFile->file == NULL)
+    {
+        Log(LL_ERROR, 0, "Failed to open '%s'.", path);
+        return FALSE;
+    }
+    bootFile->size = GetFileSize(bootFile->file);
+    bootFile->expectedSha256 = expectedSha256;
+    Sha256Init(&bootFile->sha256);
+    return DetectBootFileCompression(bootFile);
+}
+
+// Compressed files are recognized by their magic, the output is sized from their headers or trailers
+// The file is read with its handle, the stdio buffer would move it ahead of the async read
+static boolean_t DetectBootFileCompression(boot_file_s* bootFile)
+{
+    efi_file_handle_t* handle = bootFile->file->handle;
+    uint8_t header[COMPRESSION_HEADER_SIZE];
+    uint8_t trailer[COMPRESSION_TRAILER_SIZE] = {0};
+    uintn_t headerSize = sizeof(header);
+    efi_status_t status = handle->Read(handle, &headerSize, header);
+    if (!EFI_ERROR(status))
+    {
+        bootFile->compression = DetectCompression(header, headerSize);
+    }
+    if (!EFI_ERROR(status) && bootFile->compression != COMPRESSION_NONE && bootFile->size >= sizeof(trailer))
+    {
+        uintn_t trailerSize = sizeof(trailer);
+        status = handle->SetPosition(handle, bootFile->size - sizeof(trailer));
+        if (!EFI_ERROR(status))
+        {
+            status = handle->Read(handle, &trailerSize, trailer);
+        }
+    }
+    if (!EFI_ERROR(status))
+    {
+        status = handle->SetPosition(handle, 0);
+    }
+    if (EFI_ERROR(status))
+    {
+        Log(LL_ERROR, status, "Failed to read the header of '%s'.", bootFile->path);
+        return FALSE;
+    }
+    if (bootFile->compression == COMPRESSION_NONE)
+    {
+        return TRUE;
+    }
+
+    uint64_t sizeHint = GuessDecompressedSize(bootFile->compression, header, headerSize, trailer, bootFile->size);
+    status = DecompressInit(&bootFile->dec, bootFile->compression, sizeHint);
+    if (EFI_ERROR(status))
+    {
+        Log(LL_ERROR, status, "Failed to allocate %d bytes to decompress '%s'.", sizeHint, bootFile->path);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// A compressed file larger than the ring is read through it, the chunks are decompressed before they are overwritten
+// With the extent cache a file whose extents are still valid is read from the disk, the file system is skipped
+static boolean_t SetupBootFileRead(boot_file_s* bootFile, async_read_s* read)
+{
+    boolean_t compressed = bootFile->compression != COMPRESSION_NONE;
+    boolean_t useRing = compressed && bootFile->size > ASYNC_RING_SIZE;
+    uint64_t bufferSize = useRing ? ASYNC_RING_SIZE : bootFile->size + 1;
+    bootFile->useExtents = IsExtentCacheEnabled() &&
+        LoadExtentMap(bootFile->path, bootFile->file->handle, &bootFile->extents);
+    if (bootFile->useExtents)
+    {
+        // Whole pages leave room for the last chunk to be read in whole blocks
+        efi_physical_address_t addr = 0;
+        if (!EFI_ERROR(BS->AllocatePages(AllocateAnyPages, EfiLoaderData, EFI_SIZE_TO_PAGES(bufferSize), &addr)))
+        {
+            bootFile->buffer = (uint8_t*)addr;
+            bootFile->bufferPages = EFI_SIZE_TO_PAGES(bufferSize);
+        }
+    }
+    else
+    {
+        bootFile->buffer = malloc(bufferSize);
+    }
+    if (bootFile->buffer == NULL)
+    {
+        Log(LL_ERROR, 0, "Failed to allocate %d bytes to read '%s'.", bufferSize, bootFile->path);
+        return FALSE;
+    }
+    if (!compressed)
+    {
+        bootFile->data = bootFile->buffer;
+        bootFile->dataSize = bootFile->size;
+    }
+
+    if (bootFile->useExtents)
+    {
+        Log(LL_INFO, 0, "Reading '%s' from %d cached extents on the disk.", bootFile->path,
+            bootFile->extents.extentCount);
+        AsyncReadInitExtents(read, &bootFile->extents, bootFile->buffer);
+    }
+    else
+    {
+        AsyncReadInit(read, bootFile->file->handle, bootFile->buffer, bootFile->size);
+    }
+    read->ringSize = useRing ? ASYNC_RING_SIZE : 0;
+    if (bootFile->expectedSha256 != NULL || compressed)
+    {
+        read->onChunk = ProcessBootFileChunk;
+        read->context = bootFile;
+    }
+    return TRUE;
+}
+
+// The next chunk is already being read, so hashing and decompressing this one doesn't add to the read time
+static void ProcessBootFileChunk(async_read_s* read, const uint8_t* chunk, uintn_t len, void* context)
+{
+    boot_file_s* bootFile = context;
+    if (bootFile->expectedSha256 != NULL)
+    {
+        Sha256Update(&bootFile->sha256, chunk, len);
+    }
+    if (bootFile->compression != COMPRESSION_NONE)
+    {
+        DecompressChunk(&bootFile->dec, chunk, len, read->done >= read->size);
+    }
+}
+
+// The digest is checked before the file is decompressed, digestMismatch is only set when it doesn't match
+static efi_status_t CheckBootFileRead(boot_file_s* bootFile, async_read_s* read, boolean_t* digestMismatch)
+{
+    if (EFI_ERROR(read->status))
+    {
+        Log(LL_ERROR, read->status, "Failed to read %d bytes from '%s'.", bootFile->size, bootFile->path);
+        return read->status;
+    }
+    if (!CheckBootFileDigest(bootFile))
+    {
+        *digestMismatch = TRUE;
+        return EFI_SECURITY_VIOLATION;
+    }
+    if (!FinishDecompression(bootFile))
+    {
+        return bootFile->dec.status;
+    }
+    return EFI_SUCCESS;
+}
+
+static boolean_t CheckBootFileDigest(boot_file_s* bootFile)
+{
+    if (bootFile->expectedSha256 == NULL)
+    {
+        return TRUE;
+    }
+
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    Sha256Final(&bootFile->sha256, digest);
+    if (memcmp(digest, bootFile->expectedSha256, SHA256_DIGEST_SIZE) != 0)
+    {
+        char_t expectedStr[SHA256_DIGEST_SIZE * 2 + 1];
+        char_t actualStr[SHA256_DIGEST_SIZE * 2 + 1];
+        Sha256ToString(bootFile->expectedSha256, expectedStr);
+        Sha256ToString(digest, actualStr);
+        Log(LL_ERROR, 0, "The sha256 digest of '%s' doesn't match the config. (expected=%s, actual=%s)",
+            bootFile->path, expectedStr, actualStr);
+        return FALSE;
+    }
+
+    Log(LL_INFO, 0, "Verified the sha256 digest of '%s'.", bootFile->path);
+    return TRUE;
+}
+
+// The ring isn't needed anymore, the output takes its place
+static boolean_t FinishDecompression(boot_file_s* bootFile)
+{
+    if (bootFile->compression == COMPRESSION_NONE)
+    {
+        return TRUE;
+    }
+    FreeBootFileBuffer(bootFile);
+    if (EFI_ERROR(bootFile->dec.status))
+    {
+        Log(LL_ERROR, bootFile->dec.status, "Failed to decompress '%s'.", bootFile->path);
+        return FALSE;
+    }
+
+    bootFile->data = bootFile->dec.output;
+    bootFile->dataSize = bootFile->dec.outputSize;
+
+    // The sizes and the speed are always logged, like the version at startup, release builds leave out Log(LL_INFO)
+    uint64_t decodeUs = TicksToMicroseconds(bootFile->dec.decodeTicks);
+    if (decodeUs == 0)
+    {
+        LogMessage(LL_INFO, 0, "Decompressed '%s' (%s) from %d to %d bytes.", bootFile->path,
+            CompressionName(bootFile->compression), bootFile->size, bootFile->dataSize);
+        return TRUE;
+    }
+    LogMessage(LL_INFO, 0, "Decompressed '%s' (%s) from %d to %d bytes in %d ms, %d MiB/s.", bootFile->path,
+        CompressionName(bootFile->compression), bootFile->size, bootFile->dataSize, decodeUs / US_IN_MILLISECOND,
+        bootFile->dataSize * US_IN_SECOND / decodeUs / BYTES_IN_MIB);
+    return TRUE;
+}
+
+// The disk under the cached extents doesn't hold the file anymore, or the record was wrong
+// The record is dropped and saved right away, so the next boot doesn't read the same sectors if this one fails
+static boolean_t ReopenBootFile(boot_file_s* bootFile)
+{
+    const char_t* path = bootFile->path;
+    const uint8_t* expectedSha256 = bootFile->expectedSha256;
+    Log(LL_WARNING, 0, "Reading '%s' again through the file system, its cached extents were out of date.", path);
+    DropExtentMap(path);
+    SaveExtentCache();
+    FreeBootFiles(bootFile, 1);
+    return OpenBootFile(bootFile, path, expectedSha256);
+}
+
+static void FreeBootFiles(boot_file_s* files, uintn_t count)
+{
+    for (uintn_t i = 0; i < count; i++)
+    {
+        if (files[i].file != NULL)
+        {
+            fclose(files[i].file);
+        }
+        if (files[i].compression != COMPRESSION_NONE)
+        {
+            DecompressFree(&files[i].dec);
+        }
+        FreeBootFileBuffer(&files[i]);
+    }
+}
+
+// The files that were read through the file system are mapped now, so the next boot can read them from the disk
+static void RecordBootFileExtents(boot_file_s* files, uintn_t count)
+{
+    if (!IsExtentCacheEnabled())
+    {
+        return;
+    }
+    for (uintn_t i = 0; i < count; i++)
+    {
+        if (!files[i].useExtents)
+        {
+            RecordExtentMap(files[i].path, files[i].file->handle);
+        }
+    }
+    // Also saves the records that were dropped because their files changed
+    SaveExtentCache();
+}
+
+static void FreeBootFileBuffer(boot_file_s* bootFile)
+{
+    if (bootFile->bufferPages != 0)
+    {
+        BS->FreePages((efi_physical_address_t)bootFile->buffer, bootFile->bufferPages);
+    }
+    else
+    {
+        free(bootFile->buffer);
+    }
+    bootFile->buffer = NULL;
+    bootFile->bufferPages = 0;
+}
+
+static boolean_t HasVerifiedInitrd(boot_entry_s* entry)
+{
+    for (int32_t i = 0; i < entry->numOfInitrds; i++)
+    {
+        if (entry->initrds[i].verify)
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
 }
@@ -0,0 +1,94 @@
+#include "clock.h"
+#include "bootutils.h"
+
+// How long the TSC is measured against Stall() when calibrating
+#define CALIBRATION_US (10000)
+
+// CPUID leaf and bit that report an invariant TSC
+#define CPUID_ADVANCED_POWER_MANAGEMENT (0x80000007)
+#define CPUID_INVARIANT_TSC_BIT (1 << 8)
+
+static uint64_t clockFrequency = 0; // Ticks per second, 0 if the counter is unusable
+static uint64_t ticksAtInit = 0;
+static time_t secondsAtInit = 0; // Used when there is no usable counter
+
+static boolean_t CalibrateClock(void);
+
+
+// Sets up the monotonic clock, it must be called before anything that measures time
+// Returns FALSE if only the slow one second resolution fallback is available
+boolean_t InitClock(void)
+{
+    secondsAtInit = time(NULL);
+    boolean_t success = CalibrateClock();
+    ticksAtInit = ReadClockTicks();
+    return success;
+}
+
+// Reads the raw counter, it is cheap enough to be called on every log record
+uint64_t ReadClockTicks(void)
+{
+#if defined(__x86_64__)
+    uint32_t low, high;
+    __asm__ __volatile__ ("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    __asm__ __volatile__ ("isb; mrs %0, cntvct_el0" : "=r"(ticks) :: "memory");
+    return ticks;
+#else
+    return 0;
+#endif
+}
+
+uint64_t GetClockFrequency(void)
+{
+    return clockFrequency;
+}
+
+uint64_t TicksToMicroseconds(uint64_t ticks)
+{
+    if (clockFrequency == 0)
+    {
+        return 0;
+    }
+    // Split the conversion to avoid overflowing when multiplying large tick counts
+    return (ticks / clockFrequency) * US_IN_SECOND + (ticks % clockFrequency) * US_IN_SECOND / clockFrequency;
+}
+
+uint64_t GetMicrosecondsSinceInit(void)
+{
+    if (clockFrequency == 0)
+    {
+        return (uint64_t)(time(NULL) - secondsAtInit) * US_IN_SECOND;
+    }
+    return TicksToMicroseconds(ReadClockTicks() - ticksAtInit);
+}
+
+static boolean_t CalibrateClock(void)
+{
+#if defined(__x86_64__)
+    uint32_t eax = CPUID_ADVANCED_POWER_MANAGEMENT, ebx = 0, ecx = 0, edx = 0;
+    __asm__ __volatile__ ("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+    // A TSC that isn't invariant is still monotonic while the firmware runs,
+    // only its frequency may drift with power states
+    boolean_t invariant = (edx & CPUID_INVARIANT_TSC_BIT) != 0;
+
+    uint64_t start = ReadClockTicks();
+    efi_status_t status = BS->Stall(CALIBRATION_US);
+    uint64_t end = ReadClockTicks();
+    if (EFI_ERROR(status) || end <= start)
+    {
+        return FALSE;
+    }
+
+    clockFrequency = (end - start) * (US_IN_SECOND / CALIBRATION_US);
+    return invariant;
+#elif defined(__aarch64__)
+    // The generic timer reports its own frequency
+    __asm__ __volatile__ ("mrs %0, cntfrq_el0" : "=r"(clockFrequency));
+    return clockFrequency != 0;
+#else
+    return FALSE;
+#endif
+}
@@ -3,9 +3,22 @@
 #include "shellerr.h"
 #include "bootutils.h"
 
+#define LINE_NUMBERS_FLAG   ("-n")
+#define PAGED_FLAG          ("-p")
+
 boolean_t CatCmd(cmd_args_s** args, char_t** currPathPtr)
 {
     cmd_args_s* cmdArg = *args;
+
+    uint32_t printFlags = 0;
+    if (FindFlagAndDelete(args, LINE_NUMBERS_FLAG))
+    {
+        printFlags |= PRINT_LINE_NUMBERS;
+    }
+    if (FindFlagAndDelete(args, PAGED_FLAG))
+    {
+        printFlags |= PRINT_PAGED;
+    }
     cmd_args_s* arg = cmdArg->next;
 
     if (arg == NULL)
@@ -28,7 +41,7 @@ boolean_t CatCmd(cmd_args_s** args, char_t** currPathPtr)
             return FALSE;
         }
 
-        int32_t res = PrintFileContent(filePath);
+        int32_t res = PrintFileContent(filePath, printFlags);
         if (res != CMD_SUCCESS)
         {
             PrintCommandError(cmdArg->argString, arg->argString, res);
@@ -51,5 +64,7 @@ const char_t* CatBrief(void)
 
 const char_t* CatLong(void)
 {
-    return "Usage: cat <file1> [file2] [file3] ...";
+    return "Usage: cat [-n] [-p] <file1> [file2] [file3] ...\n"
+           "-n - number the lines\n"
+           "-p - stop after every screen, space shows the next page, enter the next line and q quits";
 }
@@ -0,0 +1,159 @@
+#include "cmds/cmp.h"
+#include "shellutils.h"
+#include "shellerr.h"
+#include "bootutils.h"
+
+// Both files are read in chunks of this size
+#define CMP_CHUNK_SIZE (1024 * 1024)
+// memcmp narrows a difference down to a block of this size before the bytes are compared one by one
+#define CMP_BLOCK_SIZE (64)
+
+static FILE* OpenCmpFile(cmd_args_s* cmdArg, cmd_args_s* arg, char_t* currPath);
+static uintn_t FindFirstDifference(const uint8_t* a, const uint8_t* b, uintn_t length);
+static uint64_t CountLines(const uint8_t* data, uintn_t length);
+
+
+boolean_t CmpCmd(cmd_args_s** args, char_t** currPathPtr)
+{
+    cmd_args_s* cmdArg = *args;
+    cmd_args_s* firstArg = cmdArg->next;
+    if (firstArg == NULL || firstArg->next == NULL)
+    {
+        PrintCommandError(cmdArg->argString, NULL, CMD_NO_FILE_SPECIFIED);
+        return FALSE;
+    }
+    cmd_args_s* secondArg = firstArg->next;
+
+    FILE* firstFP = OpenCmpFile(cmdArg, firstArg, *currPathPtr);
+    if (firstFP == NULL)
+    {
+        return FALSE;
+    }
+    FILE* secondFP = OpenCmpFile(cmdArg, secondArg, *currPathPtr);
+    if (secondFP == NULL)
+    {
+        fclose(firstFP);
+        return FALSE;
+    }
+
+    boolean_t identical = FALSE;
+    int32_t res = CMD_SUCCESS;
+    uint8_t* firstChunk = malloc(CMP_CHUNK_SIZE);
+    uint8_t* secondChunk = malloc(CMP_CHUNK_SIZE);
+    if (firstChunk == NULL || secondChunk == NULL)
+    {
+        res = CMD_OUT_OF_MEMORY;
+        goto cleanup;
+    }
+
+    uint64_t offset = 0;
+    uint64_t line = 1;
+    while (TRUE)
+    {
+        uintn_t firstRead = fread(firstChunk, 1, CMP_CHUNK_SIZE, firstFP);
+        uintn_t secondRead = fread(secondChunk, 1, CMP_CHUNK_SIZE, secondFP);
+        if ((firstRead == 0 && !feof(firstFP)) || (secondRead == 0 && !feof(secondFP)))
+        {
+            res = errno != 0 ? errno : EIO;
+            break;
+        }
+
+        uintn_t common = firstRead < secondRead ? firstRead : secondRead;
+        // The whole chunk is compared at once, the vectorized memcmp is the fast path
+        if (memcmp(firstChunk, secondChunk, common) != 0)
+        {
+            uintn_t diff = FindFirstDifference(firstChunk, secondChunk, common);
+            printf("%s %s differ: byte %d, line %d\n", firstArg->argString, secondArg->argString,
+                offset + diff + 1, line + CountLines(firstChunk, diff));
+            break;
+        }
+        offset += common;
+
+        if (firstRead != secondRead)
+        {
+            printf("cmp: EOF on %s after byte %d\n",
+                firstRead < secondRead ? firstArg->argString : secondArg->argString, offset);
+            break;
+        }
+        if (firstRead == 0)
+        {
+            identical = TRUE;
+            printf("The files are identical, %d bytes.\n", offset);
+            break;
+        }
+        line += CountLines(firstChunk, common);
+    }
+
+cleanup:
+    free(firstChunk);
+    free(secondChunk);
+    fclose(firstFP);
+    fclose(secondFP);
+    if (res != CMD_SUCCESS)
+    {
+        PrintCommandError(cmdArg->argString, NULL, res);
+        return FALSE;
+    }
+    return identical;
+}
+
+static FILE* OpenCmpFile(cmd_args_s* cmdArg, cmd_args_s* arg, char_t* currPath)
+{
+    boolean_t isDynamicMemory = FALSE;
+    char_t* filePath = MakeFullPath(arg->argString, currPath, &isDynamicMemory);
+    if (filePath == NULL)
+    {
+        PrintCommandError(cmdArg->argString, NULL, CMD_NO_FILE_SPECIFIED);
+        return NULL;
+    }
+
+    FILE* fp = fopen(filePath, "r");
+    if (fp == NULL)
+    {
+        PrintCommandError(cmdArg->argString, arg->argString, errno);
+    }
+
+    if (isDynamicMemory)
+    {
+        free(filePath);
+    }
+    return fp;
+}
+
+// Returns the index of the first differing byte, the buffers must differ
+static uintn_t FindFirstDifference(const uint8_t* a, const uint8_t* b, uintn_t length)
+{
+    uintn_t i = 0;
+    while (length - i > CMP_BLOCK_SIZE && memcmp(a + i, b + i, CMP_BLOCK_SIZE) == 0)
+    {
+        i += CMP_BLOCK_SIZE;
+    }
+    while (a[i] == b[i])
+    {
+        i++;
+    }
+    return i;
+}
+
+static uint64_t CountLines(const uint8_t* data, uintn_t length)
+{
+    uint64_t count = 0;
+    const uint8_t* end = data + length;
+    while ((data = memchr(data, '\n', end - data)) != NULL)
+    {
+        count++;
+        data++;
+    }
+    return count;
+}
+
+const char_t* CmpBrief(void)
+{
+    return "Compare two files byte by byte.";
+}
+
+const char_t* CmpLong(void)
+{
+    return "Usage: cmp <file1> <file2>\n"
+           "Prints the first byte and line where the files differ.";
+}
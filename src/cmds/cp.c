@@ -2,11 +2,24 @@
 #include "shellerr.h"
 #include "shellutils.h"
 #include "bootutils.h"
+#include "filecopy.h"
+#include "dirwalk.h"
 
 #define RECURSIVE_FLAG ("-r")
+#define VERIFY_FLAG ("-v")
 
-static int32_t CopyFileIntoDir(char_t* srcFile, char_t* dstDir);
-static boolean_t CopyRecursively(char_t* mainPath, char_t* dstPath, cmd_args_s* cmdArg);
+typedef struct copy_walk_s
+{
+    cmd_args_s* cmdArg;
+    uint32_t copyFlags;
+    // dstDirs[0] is the destination given to cp, dstDirs[depth + 1] mirrors the walked directory
+    DIR* dstDirs[DIR_WALK_MAX_DEPTH + 1];
+} copy_walk_s;
+
+static int32_t CopyFileIntoDir(char_t* srcFile, char_t* dstDir, uint32_t copyFlags);
+static boolean_t CopyRecursively(char_t* mainPath, char_t* dstPath, cmd_args_s* cmdArg, uint32_t copyFlags);
+static boolean_t CopyWalkCallback(dir_walk_s* walk, walk_event_t event, const char_t* name);
+static int32_t CopyFileAt(DIR* srcDir, DIR* dstDir, const char_t* name, uint32_t copyFlags);
 
 
 boolean_t CpCmd(cmd_args_s** args, char_t** currPathPtr)
@@ -14,6 +27,12 @@ boolean_t CpCmd(cmd_args_s** args, char_t** currPathPtr)
     cmd_args_s* cmdArg = *args;
 
     boolean_t recursiveFlag = FindFlagAndDelete(args, RECURSIVE_FLAG);
+
+    uint32_t copyFlags = COPY_SHOW_PROGRESS;
+    if (FindFlagAndDelete(args, VERIFY_FLAG))
+    {
+        copyFlags |= COPY_VERIFY;
+    }
     cmd_args_s* srcBegin = cmdArg->next;
 
     if (srcBegin == NULL)
@@ -59,7 +78,7 @@ boolean_t CpCmd(cmd_args_s** args, char_t** currPathPtr)
                 return FALSE;
             }
 
-            if (CopyRecursively(fullPath, dstPath, cmdArg) == FALSE)
+            if (CopyRecursively(fullPath, dstPath, cmdArg, copyFlags) == FALSE)
             {
                 cmdSuccess = FALSE;
             }
@@ -97,7 +116,7 @@ boolean_t CpCmd(cmd_args_s** args, char_t** currPathPtr)
                 fclose(fp);
             }
 
-            int32_t res = CopyFile(srcPath, fullDstPath);
+            int32_t res = CopyFileEx(srcPath, fullDstPath, copyFlags);
             if (res != 0)
             {
                 PrintCommandError(cmdArg->argString, srcBegin->argString, res);
@@ -142,7 +161,7 @@ boolean_t CpCmd(cmd_args_s** args, char_t** currPathPtr)
                     return FALSE;
                 }
 
-                int32_t res = CopyFileIntoDir(srcPath, dstPath);
+                int32_t res = CopyFileIntoDir(srcPath, dstPath, copyFlags);
                 if (res != 0)
                 {
                     PrintCommandError(cmdArg->argString, currSrc->argString, res);
@@ -164,17 +183,17 @@ boolean_t CpCmd(cmd_args_s** args, char_t** currPathPtr)
     return cmdSuccess;
 }
 
-static int32_t CopyFileIntoDir(char_t* srcFile, char_t* dstDir)
+static int32_t CopyFileIntoDir(char_t* srcFile, char_t* dstDir, uint32_t copyFlags)
 {
     char_t* fileName = strrchr(srcFile, '\\') + 1;
     char_t* fullCopyPath = ConcatPaths(dstDir, fileName);
 
-    int32_t res = CopyFile(srcFile, fullCopyPath);
+    int32_t res = CopyFileEx(srcFile, fullCopyPath, copyFlags);
     free(fullCopyPath);
     return res;
 }
 
-static boolean_t CopyRecursively(char_t* mainPath, char_t* dstPath, cmd_args_s* cmdArg)
+static boolean_t CopyRecursively(char_t* mainPath, char_t* dstPath, cmd_args_s* cmdArg, uint32_t copyFlags)
 {
     DIR* dir = opendir(mainPath);
     // Allow copying normal files with the recursive flag on
@@ -187,7 +206,7 @@ static boolean_t CopyRecursively(char_t* mainPath, char_t* dstPath, cmd_args_s*
             return FALSE;
         }
 
-        res = CopyFileIntoDir(mainPath, dstPath);
+        res = CopyFileIntoDir(mainPath, dstPath, copyFlags);
         if (res != 0)
         {
             PrintCommandError(cmdArg->argString, mainPath, res);
@@ -206,58 +225,83 @@ static boolean_t CopyRecursively(char_t* mainPath, char_t* dstPath, cmd_args_s*
     if (dstPathRes != CMD_DIR_ALREADY_EXISTS && dstPathRes != CMD_SUCCESS)
     {
         PrintCommandError(cmdArg->argString, dstPath, dstPathRes);
+        closedir(dir);
         return FALSE;
     }
 
-    // Use the new destination
-    char_t* newDstPath = ConcatPaths(dstPath, strrchr(mainPath, '\\') + 1);
-    dstPathRes = CreateDirectory(newDstPath);
-    if (dstPathRes != CMD_DIR_ALREADY_EXISTS && dstPathRes != CMD_SUCCESS)
+    copy_walk_s copyWalk;
+    copyWalk.cmdArg = cmdArg;
+    copyWalk.copyFlags = copyFlags;
+    copyWalk.dstDirs[0] = opendir(dstPath);
+    if (copyWalk.dstDirs[0] == NULL)
     {
-        PrintCommandError(cmdArg->argString, newDstPath, dstPathRes);
+        PrintCommandError(cmdArg->argString, dstPath, errno);
+        closedir(dir);
         return FALSE;
     }
 
-    boolean_t funcSuccess = TRUE;
-    struct dirent* de;
-    while ((de = readdir(dir)) != NULL)
-    {
-        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
-        {
-            // Skip the current and previous directories
-            continue;
-        }
+    // The source directory itself is copied into the destination
+    boolean_t funcSuccess = WalkDirectory(dir, mainPath, 0, CopyWalkCallback, &copyWalk);
+    closedir(copyWalk.dstDirs[0]);
+    return funcSuccess;
+}
 
-        boolean_t isDynamicMemory = FALSE;
-        // Concatenate the current directory path with the name of the file to copy
-        char_t* filePath = MakeFullPath(de->d_name, mainPath, &isDynamicMemory);
+// Mirrors the walked tree in the destination, every file and directory is opened relative to its parent
+static boolean_t CopyWalkCallback(dir_walk_s* walk, walk_event_t event, const char_t* name)
+{
+    copy_walk_s* copyWalk = walk->context;
+    DIR* dstDir = copyWalk->dstDirs[walk->depth];
 
-        // If we find a directory, descend into it and copy everything in it
-        if (de->d_type == DT_DIR)
-        {
-            if (CopyRecursively(filePath, newDstPath, cmdArg) == FALSE)
-            {
-                funcSuccess = FALSE;
-            }
-        }
-        else
-        {
-            int32_t res = CopyFileIntoDir(filePath, newDstPath);
-            if (res != 0)
+    int32_t res = CMD_SUCCESS;
+    switch (event)
+    {
+        case WALK_DIR_ENTER:
+            res = CreateDirectoryAt(dstDir, name, &copyWalk->dstDirs[walk->depth + 1]);
+            if (res == CMD_DIR_ALREADY_EXISTS)
             {
-                PrintCommandError(cmdArg->argString, filePath, res);
-                funcSuccess = FALSE;
+                res = CMD_SUCCESS;
             }
-        }
+            break;
 
-        if (isDynamicMemory)
-        {
-            free(filePath);
-        }
+        case WALK_DIR_LEAVE:
+            closedir(copyWalk->dstDirs[walk->depth + 1]);
+            break;
+
+        case WALK_FILE:
+            res = CopyFileAt(walk->dirs[walk->depth], copyWalk->dstDirs[walk->depth + 1], name, copyWalk->copyFlags);
+            break;
+
+        case WALK_DIR_ERROR:
+            res = errno;
+            break;
     }
-    closedir(dir);
-    free(newDstPath);
-    return funcSuccess;
+
+    if (res != CMD_SUCCESS)
+    {
+        PrintCommandError(copyWalk->cmdArg->argString, walk->path, res);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static int32_t CopyFileAt(DIR* srcDir, DIR* dstDir, const char_t* name, uint32_t copyFlags)
+{
+    FILE* srcFP = fopenat(srcDir, name, "r");
+    if (srcFP == NULL)
+    {
+        return errno;
+    }
+    FILE* dstFP = fopenat(dstDir, name, "w");
+    if (dstFP == NULL)
+    {
+        fclose(srcFP);
+        return errno;
+    }
+
+    int32_t res = CopyFileStreams(srcFP, dstFP, copyFlags);
+    fclose(dstFP);
+    fclose(srcFP);
+    return res;
 }
 
 const char_t* CpBrief(void)
@@ -267,5 +311,7 @@ const char_t* CpBrief(void)
 
 const char_t* CpLong(void)
 {
-    return "Usage: cp [-r] <src1> [src2]... <dst>";
+    return "Usage: cp [-r] [-v] <src1> [src2]... <dst>\n"
+           "-r - copy directories recursively\n"
+           "-v - verify every copy against its source with checksums";
 }
@@ -0,0 +1,108 @@
+#include "cmds/crc32.h"
+#include "shellutils.h"
+#include "shellerr.h"
+#include "bootutils.h"
+#include "hash.h"
+
+#define TEST_FLAG ("-t")
+
+// Files are hashed in chunks of this size
+#define CRC32_CHUNK_SIZE (1024 * 1024)
+
+static int32_t ChecksumFile(FILE* fp, uint8_t* chunk, uint32_t* crc);
+
+
+boolean_t Crc32Cmd(cmd_args_s** args, char_t** currPathPtr)
+{
+    cmd_args_s* cmdArg = *args;
+
+    if (FindFlagAndDelete(args, TEST_FLAG))
+    {
+        boolean_t passed = HashSelfTest(HASH_CRC32C, TRUE);
+        HashBenchmark(HASH_CRC32C);
+        return passed;
+    }
+
+    cmd_args_s* arg = cmdArg->next;
+    if (arg == NULL)
+    {
+        PrintCommandError(cmdArg->argString, NULL, CMD_NO_FILE_SPECIFIED);
+        return FALSE;
+    }
+
+    uint8_t* chunk = malloc(CRC32_CHUNK_SIZE);
+    if (chunk == NULL)
+    {
+        PrintCommandError(cmdArg->argString, NULL, CMD_OUT_OF_MEMORY);
+        return FALSE;
+    }
+
+    boolean_t cmdSuccess = TRUE;
+    for (; arg != NULL; arg = arg->next)
+    {
+        boolean_t isDynamicMemory = FALSE;
+        char_t* filePath = MakeFullPath(arg->argString, *currPathPtr, &isDynamicMemory);
+        if (filePath == NULL)
+        {
+            PrintCommandError(cmdArg->argString, NULL, CMD_NO_FILE_SPECIFIED);
+            cmdSuccess = FALSE;
+            continue;
+        }
+        FILE* fp = fopen(filePath, "r");
+        if (isDynamicMemory)
+        {
+            free(filePath);
+        }
+        if (fp == NULL)
+        {
+            PrintCommandError(cmdArg->argString, arg->argString, errno);
+            cmdSuccess = FALSE;
+            continue;
+        }
+
+        uint32_t crc = 0;
+        int32_t res = ChecksumFile(fp, chunk, &crc);
+        fclose(fp);
+        if (res != CMD_SUCCESS)
+        {
+            PrintCommandError(cmdArg->argString, arg->argString, res);
+            cmdSuccess = FALSE;
+            continue;
+        }
+
+        printf("%08x  %s\n", (uint64_t)crc, arg->argString);
+    }
+
+    free(chunk);
+    return cmdSuccess;
+}
+
+static int32_t ChecksumFile(FILE* fp, uint8_t* chunk, uint32_t* crc)
+{
+    while (TRUE)
+    {
+        uintn_t bytesRead = fread(chunk, 1, CRC32_CHUNK_SIZE, fp);
+        if (bytesRead == 0)
+        {
+            if (!feof(fp))
+            {
+                return errno != 0 ? errno : EIO;
+            }
+            break;
+        }
+        *crc = Crc32c(*crc, chunk, bytesRead);
+    }
+    return CMD_SUCCESS;
+}
+
+const char_t* Crc32Brief(void)
+{
+    return "Print the CRC32C checksum of files.";
+}
+
+const char_t* Crc32Long(void)
+{
+    return "Usage: crc32 [-t] <file1> <file2> ...\n"
+           "The checksum uses the Castagnoli polynomial, like iSCSI, ext4 and btrfs.\n"
+           "-t - test every CRC32C implementation the CPU supports and measure its speed";
+}
@@ -0,0 +1,374 @@
+#include "cmds/find.h"
+#include "shellutils.h"
+#include "shellerr.h"
+#include "bootutils.h"
+#include "dirwalk.h"
+#include "pager.h"
+
+#define NAME_OPTION     ("-name")
+#define TYPE_OPTION     ("-type")
+#define SIZE_OPTION     ("-size")
+#define NEWER_OPTION    ("-newer")
+
+#define BYTES_IN_KIB (1024)
+
+typedef enum size_compare_t
+{
+    SIZE_ANY,
+    SIZE_SMALLER,
+    SIZE_EQUAL,
+    SIZE_LARGER,
+} size_compare_t;
+
+typedef struct find_s
+{
+    const char_t* namePattern; // NULL matches every name
+    uint8_t type; // DT_REG, DT_DIR or 0 for both
+    size_compare_t sizeCompare;
+    uint64_t size;
+    boolean_t checkNewer;
+    time_t newerThan;
+    cmd_args_s* cmdArg;
+    pager_s pager;
+} find_s;
+
+static int32_t ParseFindOptions(cmd_args_s** args, char_t* currPath, find_s* find);
+static boolean_t ParseSize(const char_t* str, find_s* find);
+static boolean_t FindInPath(find_s* find, char_t* path);
+static boolean_t FindWalkCallback(dir_walk_s* walk, walk_event_t event, const char_t* name);
+static boolean_t MatchesPredicates(find_s* find, const char_t* name, uint8_t type, uint64_t size, time_t mtime);
+static boolean_t MatchesGlob(const char_t* pattern, const char_t* name);
+static char_t FoldChar(char_t c);
+static void PrintFound(find_s* find, const char_t* path);
+
+
+boolean_t FindCmd(cmd_args_s** args, char_t** currPathPtr)
+{
+    cmd_args_s* cmdArg = *args;
+
+    find_s* find = malloc(sizeof(find_s));
+    if (find == NULL)
+    {
+        PrintCommandError(cmdArg->argString, NULL, CMD_OUT_OF_MEMORY);
+        return FALSE;
+    }
+    find->cmdArg = cmdArg;
+
+    int32_t res = ParseFindOptions(args, *currPathPtr, find);
+    if (res != CMD_SUCCESS)
+    {
+        free(find);
+        PrintCommandError(cmdArg->argString, NULL, res);
+        return FALSE;
+    }
+    PagerInit(&find->pager, FALSE);
+
+    boolean_t cmdSuccess = TRUE;
+    // Without a path the current directory is searched
+    cmd_args_s* arg = cmdArg->next;
+    do
+    {
+        boolean_t isDynamicMemory = FALSE;
+        char_t* path = MakeFullPath(arg != NULL ? arg->argString : ".", *currPathPtr, &isDynamicMemory);
+        if (path == NULL)
+        {
+            PrintCommandError(cmdArg->argString, arg != NULL ? arg->argString : NULL, CMD_NO_DIR_SPEFICIED);
+            cmdSuccess = FALSE;
+            break;
+        }
+
+        if (!FindInPath(find, path))
+        {
+            cmdSuccess = FALSE;
+        }
+
+        if (isDynamicMemory)
+        {
+            free(path);
+        }
+        arg = arg != NULL ? arg->next : NULL;
+    } while (arg != NULL);
+
+    PagerFlush(&find->pager);
+    free(find);
+    return cmdSuccess;
+}
+
+// Takes the options out of the argument list, so only the paths are left
+static int32_t ParseFindOptions(cmd_args_s** args, char_t* currPath, find_s* find)
+{
+    find->namePattern = NULL;
+    find->type = 0;
+    find->sizeCompare = SIZE_ANY;
+    find->size = 0;
+    find->checkNewer = FALSE;
+    find->newerThan = 0;
+
+    char_t* value = NULL;
+    if (FindOptionAndDelete(args, NAME_OPTION, &value))
+    {
+        if (value == NULL)
+        {
+            return CMD_MISSING_OPTION_VALUE;
+        }
+        find->namePattern = value;
+    }
+
+    if (FindOptionAndDelete(args, TYPE_OPTION, &value))
+    {
+        if (value == NULL)
+        {
+            return CMD_MISSING_OPTION_VALUE;
+        }
+        if (strcmp(value, "f") == 0)
+        {
+            find->type = DT_REG;
+        }
+        else if (strcmp(value, "d") == 0)
+        {
+            find->type = DT_DIR;
+        }
+        else
+        {
+            return CMD_INVALID_OPTION_VALUE;
+        }
+    }
+
+    if (FindOptionAndDelete(args, SIZE_OPTION, &value))
+    {
+        if (value == NULL)
+        {
+            return CMD_MISSING_OPTION_VALUE;
+        }
+        if (!ParseSize(value, find))
+        {
+            return CMD_INVALID_OPTION_VALUE;
+        }
+    }
+
+    if (FindOptionAndDelete(args, NEWER_OPTION, &value))
+    {
+        if (value == NULL)
+        {
+            return CMD_MISSING_OPTION_VALUE;
+        }
+
+        boolean_t isDynamicMemory = FALSE;
+        char_t* refPath = MakeFullPath(value, currPath, &isDynamicMemory);
+        if (refPath == NULL)
+        {
+            return CMD_NO_FILE_SPECIFIED;
+        }
+
+        struct stat st;
+        int statRes = stat(refPath, &st);
+        if (isDynamicMemory)
+        {
+            free(refPath);
+        }
+        if (statRes != 0)
+        {
+            return errno;
+        }
+        find->checkNewer = TRUE;
+        find->newerThan = st.st_mtime;
+    }
+    return CMD_SUCCESS;
+}
+
+// Parses [+|-]N[k|M|G], + means larger than and - means smaller than
+static boolean_t ParseSize(const char_t* str, find_s* find)
+{
+    find->sizeCompare = SIZE_EQUAL;
+    if (*str == '+')
+    {
+        find->sizeCompare = SIZE_LARGER;
+        str++;
+    }
+    else if (*str == '-')
+    {
+        find->sizeCompare = SIZE_SMALLER;
+        str++;
+    }
+
+    char_t* end = NULL;
+    int64_t size = strtol(str, &end, 10);
+    if (end == str || size < 0)
+    {
+        return FALSE;
+    }
+
+    switch (*end)
+    {
+        case CHAR_NULL:
+            break;
+
+        case 'k':
+        case 'K':
+            size *= BYTES_IN_KIB;
+            end++;
+            break;
+
+        case 'M':
+            size *= BYTES_IN_KIB * BYTES_IN_KIB;
+            end++;
+            break;
+
+        case 'G':
+            size *= BYTES_IN_KIB * BYTES_IN_KIB * BYTES_IN_KIB;
+            end++;
+            break;
+
+        default:
+            return FALSE;
+    }
+    find->size = (uint64_t)size;
+    return *end == CHAR_NULL;
+}
+
+static boolean_t FindInPath(find_s* find, char_t* path)
+{
+    DIR* dir = opendir(path);
+    if (dir == NULL && errno == ENOTDIR)
+    {
+        // A file is only tested itself
+        struct stat st;
+        if (stat(path, &st) != 0)
+        {
+            PrintCommandError(find->cmdArg->argString, path, errno);
+            return FALSE;
+        }
+        const char_t* name = strrchr(path, '\\');
+        if (MatchesPredicates(find, name != NULL ? name + 1 : path, DT_REG, st.st_size, st.st_mtime))
+        {
+            PrintFound(find, path);
+        }
+        return TRUE;
+    }
+    else if (dir == NULL)
+    {
+        PrintCommandError(find->cmdArg->argString, path, errno);
+        return FALSE;
+    }
+
+    return WalkDirectory(dir, path, 0, FindWalkCallback, find);
+}
+
+// Every entry is tested with the name, size and time of its directory entry, nothing is opened for it
+static boolean_t FindWalkCallback(dir_walk_s* walk, walk_event_t event, const char_t* name)
+{
+    find_s* find = walk->context;
+    if (event == WALK_DIR_ERROR)
+    {
+        PagerFlush(&find->pager);
+        PrintCommandError(find->cmdArg->argString, walk->path, errno);
+        return FALSE;
+    }
+    else if (event == WALK_DIR_LEAVE)
+    {
+        return TRUE;
+    }
+
+    boolean_t matches = FALSE;
+    if (walk->entry != NULL)
+    {
+        matches = MatchesPredicates(find, name, walk->entry->d_type, walk->entry->d_size, walk->entry->d_mtime);
+    }
+    else
+    {
+        // The root of the walk has no directory entry, but its info is cached in the open directory
+        struct stat st;
+        fstat(walk->dirs[0], &st);
+        matches = MatchesPredicates(find, name, DT_DIR, st.st_size, st.st_mtime);
+    }
+
+    if (matches)
+    {
+        PrintFound(find, walk->path);
+    }
+    return TRUE;
+}
+
+static boolean_t MatchesPredicates(find_s* find, const char_t* name, uint8_t type, uint64_t size, time_t mtime)
+{
+    if (find->type != 0 && find->type != type)
+    {
+        return FALSE;
+    }
+    if ((find->sizeCompare == SIZE_SMALLER && size >= find->size) ||
+        (find->sizeCompare == SIZE_EQUAL && size != find->size) ||
+        (find->sizeCompare == SIZE_LARGER && size <= find->size))
+    {
+        return FALSE;
+    }
+    if (find->checkNewer && mtime <= find->newerThan)
+    {
+        return FALSE;
+    }
+    return find->namePattern == NULL || MatchesGlob(find->namePattern, name);
+}
+
+// Matches '*' and '?' wildcards, ignoring the case of ASCII letters like the FAT file system does
+static boolean_t MatchesGlob(const char_t* pattern, const char_t* name)
+{
+    // Where to continue from when the characters after the last '*' stop matching
+    const char_t* starPattern = NULL;
+    const char_t* starName = NULL;
+
+    while (*name != CHAR_NULL)
+    {
+        if (*pattern == '*')
+        {
+            starPattern = ++pattern;
+            starName = name;
+        }
+        else if (*pattern == '?' || (*pattern != CHAR_NULL && FoldChar(*pattern) == FoldChar(*name)))
+        {
+            pattern++;
+            name++;
+        }
+        else if (starPattern != NULL)
+        {
+            // Let the star take one more character
+            pattern = starPattern;
+            name = ++starName;
+        }
+        else
+        {
+            return FALSE;
+        }
+    }
+
+    while (*pattern == '*')
+    {
+        pattern++;
+    }
+    return *pattern == CHAR_NULL;
+}
+
+static char_t FoldChar(char_t c)
+{
+    return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+static void PrintFound(find_s* find, const char_t* path)
+{
+    // The names from readdir are UTF-8
+    PagerWriteText(&find->pager, path, strlen(path));
+    PagerWrite(&find->pager, "\n", 1);
+}
+
+const char_t* FindBrief(void)
+{
+    return "Search for files by name, type, size and time.";
+}
+
+const char_t* FindLong(void)
+{
+    return "Usage: find [path1] [path2] ... [-name <glob>] [-type f|d] [-size [+|-]N[k|M|G]] [-newer <file>]\n"
+           "Prints every file and directory under the paths that matches all the options.\n"
+           "-name - the name matches the pattern, '*' matches any text and '?' any character\n"
+           "-type - f for files, d for directories\n"
+           "-size - exactly N bytes, +N larger than N, -N smaller than N\n"
+           "-newer - modified after the given file";
+}
@@ -0,0 +1,352 @@
+#include "cmds/grep.h"
+#include "shellutils.h"
+#include "shellerr.h"
+#include "bootutils.h"
+#include "search.h"
+#include "dirwalk.h"
+#include "pager.h"
+
+#define RECURSIVE_FLAG      ("-r")
+#define IGNORE_CASE_FLAG    ("-i")
+#define LINE_NUMBERS_FLAG   ("-n")
+#define COUNT_FLAG          ("-c")
+
+// Files are read in chunks of this size, longer lines are searched in pieces
+#define GREP_BUFFER_SIZE (64 * 1024)
+
+typedef struct grep_s
+{
+    search_pattern_s search;
+    boolean_t lineNumbers;
+    boolean_t countOnly;
+    boolean_t showNames; // Prefix the matches with the file name, when more than one file is searched
+    cmd_args_s* cmdArg;
+    char_t* buffer;
+    pager_s pager;
+} grep_s;
+
+static boolean_t GrepPath(grep_s* grep, char_t* path, const char_t* displayName, boolean_t recursive);
+static boolean_t GrepWalkCallback(dir_walk_s* walk, walk_event_t event, const char_t* name);
+static int32_t GrepFile(grep_s* grep, FILE* fp, const char_t* name);
+static boolean_t GrepLine(grep_s* grep, const char_t* name, const char_t* line, uintn_t length, uint64_t lineNumber);
+static void PrintMatchPrefix(grep_s* grep, const char_t* name, uint64_t lineNumber);
+static void ReportError(grep_s* grep, const char_t* name, int32_t error);
+
+
+boolean_t GrepCmd(cmd_args_s** args, char_t** currPathPtr)
+{
+    cmd_args_s* cmdArg = *args;
+
+    boolean_t recursive = FindFlagAndDelete(args, RECURSIVE_FLAG);
+    boolean_t ignoreCase = FindFlagAndDelete(args, IGNORE_CASE_FLAG);
+    boolean_t lineNumbers = FindFlagAndDelete(args, LINE_NUMBERS_FLAG);
+    boolean_t countOnly = FindFlagAndDelete(args, COUNT_FLAG);
+
+    cmd_args_s* patternArg = cmdArg->next;
+    if (patternArg == NULL || strlen(patternArg->argString) == 0)
+    {
+        PrintCommandError(cmdArg->argString, NULL, CMD_NO_PATTERN_SPECIFIED);
+        return FALSE;
+    }
+    if (patternArg->next == NULL)
+    {
+        PrintCommandError(cmdArg->argString, NULL, CMD_NO_FILE_SPECIFIED);
+        return FALSE;
+    }
+
+    grep_s* grep = malloc(sizeof(grep_s));
+    char_t* buffer = malloc(GREP_BUFFER_SIZE);
+    if (grep == NULL || buffer == NULL)
+    {
+        free(grep);
+        free(buffer);
+        PrintCommandError(cmdArg->argString, NULL, CMD_OUT_OF_MEMORY);
+        return FALSE;
+    }
+
+    if (!SearchInit(&grep->search, patternArg->argString, ignoreCase))
+    {
+        free(grep);
+        free(buffer);
+        PrintCommandError(cmdArg->argString, patternArg->argString, CMD_PATTERN_TOO_LONG);
+        return FALSE;
+    }
+    grep->lineNumbers = lineNumbers;
+    grep->countOnly = countOnly;
+    grep->showNames = recursive || patternArg->next->next != NULL;
+    grep->cmdArg = cmdArg;
+    grep->buffer = buffer;
+    PagerInit(&grep->pager, FALSE);
+
+    boolean_t cmdSuccess = TRUE;
+    cmd_args_s* arg = patternArg->next;
+    while (arg != NULL)
+    {
+        boolean_t isDynamicMemory = FALSE;
+        char_t* filePath = MakeFullPath(arg->argString, *currPathPtr, &isDynamicMemory);
+        if (filePath == NULL)
+        {
+            PrintCommandError(cmdArg->argString, arg->argString, CMD_NO_FILE_SPECIFIED);
+            cmdSuccess = FALSE;
+            break;
+        }
+
+        if (!GrepPath(grep, filePath, arg->argString, recursive))
+        {
+            cmdSuccess = FALSE;
+        }
+
+        if (isDynamicMemory)
+        {
+            free(filePath);
+        }
+        arg = arg->next;
+    }
+
+    PagerFlush(&grep->pager);
+    free(buffer);
+    free(grep);
+    return cmdSuccess;
+}
+
+static boolean_t GrepPath(grep_s* grep, char_t* path, const char_t* displayName, boolean_t recursive)
+{
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL && errno == EISDIR && recursive)
+    {
+        DIR* dir = opendir(path);
+        if (dir == NULL)
+        {
+            ReportError(grep, displayName, errno);
+            return FALSE;
+        }
+        return WalkDirectory(dir, path, 0, GrepWalkCallback, grep);
+    }
+    else if (fp == NULL)
+    {
+        ReportError(grep, displayName, errno);
+        return FALSE;
+    }
+
+    int32_t res = GrepFile(grep, fp, displayName);
+    fclose(fp);
+    if (res != CMD_SUCCESS)
+    {
+        ReportError(grep, displayName, res);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static boolean_t GrepWalkCallback(dir_walk_s* walk, walk_event_t event, const char_t* name)
+{
+    grep_s* grep = walk->context;
+    if (event == WALK_DIR_ERROR)
+    {
+        ReportError(grep, walk->path, errno);
+        return FALSE;
+    }
+    else if (event != WALK_FILE)
+    {
+        return TRUE;
+    }
+
+    FILE* fp = fopenat(walk->dirs[walk->depth], name, "r");
+    if (fp == NULL)
+    {
+        ReportError(grep, walk->path, errno);
+        return FALSE;
+    }
+
+    int32_t res = GrepFile(grep, fp, walk->path);
+    fclose(fp);
+    if (res != CMD_SUCCESS)
+    {
+        ReportError(grep, walk->path, res);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Searches a file line by line with a fixed size buffer
+// Files with a null byte in their first chunk are binary, only the fact that they match is printed
+static int32_t GrepFile(grep_s* grep, FILE* fp, const char_t* name)
+{
+    char_t* buffer = grep->buffer;
+    const uintn_t overlap = grep->search.length - 1;
+
+    uintn_t filled = 0;
+    uint64_t lineNumber = 1;
+    uint64_t matchCount = 0;
+    boolean_t endOfFile = FALSE;
+    boolean_t firstChunk = TRUE;
+    boolean_t binary = FALSE;
+    // Set when a line that is longer than the buffer already matched
+    boolean_t skipRestOfLine = FALSE;
+
+    while (TRUE)
+    {
+        if (!endOfFile)
+        {
+            uintn_t bytesRead = fread(buffer + filled, 1, GREP_BUFFER_SIZE - filled, fp);
+            if (bytesRead == 0)
+            {
+                if (!feof(fp))
+                {
+                    return errno != 0 ? errno : EIO;
+                }
+                endOfFile = TRUE;
+            }
+            filled += bytesRead;
+        }
+        if (firstChunk)
+        {
+            binary = memchr(buffer, CHAR_NULL, filled) != NULL;
+            firstChunk = FALSE;
+        }
+        if (filled == 0)
+        {
+            break;
+        }
+
+        if (binary)
+        {
+            if (SearchFind(&grep->search, buffer, filled) != NULL)
+            {
+                matchCount++;
+                break;
+            }
+            if (endOfFile)
+            {
+                break;
+            }
+            // Keep the end of the chunk, a match can start in it and continue in the next one
+            uintn_t keep = filled < overlap ? filled : overlap;
+            memmove(buffer, buffer + filled - keep, keep);
+            filled = keep;
+            continue;
+        }
+
+        // Search the complete lines, the last one may continue in the next chunk
+        uintn_t pos = 0;
+        while (pos < filled)
+        {
+            char_t* newline = memchr(buffer + pos, '\n', filled - pos);
+            if (newline == NULL && !endOfFile)
+            {
+                break;
+            }
+
+            uintn_t end = newline != NULL ? (uintn_t)(newline - buffer) : filled;
+            if (!skipRestOfLine && GrepLine(grep, name, buffer + pos, end - pos, lineNumber))
+            {
+                matchCount++;
+            }
+            skipRestOfLine = FALSE;
+            lineNumber++;
+            pos = newline != NULL ? end + 1 : filled;
+        }
+        if (endOfFile)
+        {
+            break;
+        }
+
+        if (pos == 0 && filled == GREP_BUFFER_SIZE)
+        {
+            // The line doesn't fit, search the part that was read
+            // Only the end is kept, for a match that continues in the next chunk
+            if (!skipRestOfLine && GrepLine(grep, name, buffer, filled, lineNumber))
+            {
+                matchCount++;
+                skipRestOfLine = TRUE;
+            }
+            uintn_t keep = skipRestOfLine ? 0 : overlap;
+            memmove(buffer, buffer + filled - keep, keep);
+            filled = keep;
+            continue;
+        }
+
+        memmove(buffer, buffer + pos, filled - pos);
+        filled -= pos;
+    }
+
+    if (grep->countOnly)
+    {
+        char_t countStr[24];
+        if (grep->showNames)
+        {
+            PagerWriteText(&grep->pager, name, strlen(name));
+            PagerWrite(&grep->pager, ":", 1);
+        }
+        snprintf(countStr, sizeof(countStr), "%d\n", matchCount);
+        PagerWrite(&grep->pager, countStr, strlen(countStr));
+    }
+    else if (binary && matchCount > 0)
+    {
+        PagerWrite(&grep->pager, "Binary file ", strlen("Binary file "));
+        PagerWriteText(&grep->pager, name, strlen(name));
+        PagerWrite(&grep->pager, " matches\n", strlen(" matches\n"));
+    }
+    return CMD_SUCCESS;
+}
+
+// Returns TRUE if the line matches, and prints it unless only the matches are counted
+static boolean_t GrepLine(grep_s* grep, const char_t* name, const char_t* line, uintn_t length, uint64_t lineNumber)
+{
+    if (SearchFind(&grep->search, line, length) == NULL)
+    {
+        return FALSE;
+    }
+    if (grep->countOnly)
+    {
+        return TRUE;
+    }
+
+    if (length > 0 && line[length - 1] == '\r')
+    {
+        length--;
+    }
+    PrintMatchPrefix(grep, name, lineNumber);
+    // Only lines of text files are printed, binary files are reported by name
+    PagerWriteText(&grep->pager, line, length);
+    PagerWrite(&grep->pager, "\n", 1);
+    return TRUE;
+}
+
+static void PrintMatchPrefix(grep_s* grep, const char_t* name, uint64_t lineNumber)
+{
+    if (grep->showNames)
+    {
+        // The names from readdir are UTF-8
+        PagerWriteText(&grep->pager, name, strlen(name));
+        PagerWrite(&grep->pager, ":", 1);
+    }
+    if (grep->lineNumbers)
+    {
+        char_t numberStr[24];
+        snprintf(numberStr, sizeof(numberStr), "%d:", lineNumber);
+        PagerWrite(&grep->pager, numberStr, strlen(numberStr));
+    }
+}
+
+// The pending matches are printed first, so the error shows up in order
+static void ReportError(grep_s* grep, const char_t* name, int32_t error)
+{
+    PagerFlush(&grep->pager);
+    PrintCommandError(grep->cmdArg->argString, name, error);
+}
+
+const char_t* GrepBrief(void)
+{
+    return "Search files for a string.";
+}
+
+const char_t* GrepLong(void)
+{
+    return "Usage: grep [-r] [-i] [-n] [-c] <pattern> <path1> [path2] ...\n"
+           "Prints the lines that contain the pattern, binary files are only reported as matching.\n"
+           "-r - search directories recursively\n"
+           "-i - ignore the case of ASCII letters\n"
+           "-n - print the line numbers\n"
+           "-c - only print the amount of matching lines";
+}
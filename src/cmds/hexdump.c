@@ -0,0 +1,197 @@
+#include "cmds/hexdump.h"
+#include "shellutils.h"
+#include "shellerr.h"
+#include "bootutils.h"
+#include "pager.h"
+
+#define OFFSET_OPTION   ("-s")
+#define LENGTH_OPTION   ("-n")
+
+#define BYTES_PER_LINE (16)
+// Only this much of the file is in memory at once, a multiple of BYTES_PER_LINE
+#define HEXDUMP_CHUNK_SIZE (BYTES_PER_LINE * 256)
+// "00000000  xx xx xx xx xx xx xx xx  xx xx xx xx xx xx xx xx  |................|"
+#define HEXDUMP_LINE_SIZE (96)
+
+static boolean_t ParseNumber(const char_t* str, uint64_t* number);
+static void PrintHexLine(pager_s* pager, uint64_t offset, const uint8_t* data, uintn_t length);
+
+
+boolean_t HexdumpCmd(cmd_args_s** args, char_t** currPathPtr)
+{
+    cmd_args_s* cmdArg = *args;
+
+    uint64_t offset = 0;
+    uint64_t length = (uint64_t)-1;
+    char_t* value = NULL;
+    if (FindOptionAndDelete(args, OFFSET_OPTION, &value) && (value == NULL || !ParseNumber(value, &offset)))
+    {
+        PrintCommandError(cmdArg->argString, OFFSET_OPTION, value == NULL ? CMD_MISSING_OPTION_VALUE : CMD_INVALID_OPTION_VALUE);
+        return FALSE;
+    }
+    if (FindOptionAndDelete(args, LENGTH_OPTION, &value) && (value == NULL || !ParseNumber(value, &length)))
+    {
+        PrintCommandError(cmdArg->argString, LENGTH_OPTION, value == NULL ? CMD_MISSING_OPTION_VALUE : CMD_INVALID_OPTION_VALUE);
+        return FALSE;
+    }
+
+    cmd_args_s* arg = cmdArg->next;
+    if (arg == NULL)
+    {
+        PrintCommandError(cmdArg->argString, NULL, CMD_NO_FILE_SPECIFIED);
+        return FALSE;
+    }
+
+    boolean_t isDynamicMemory = FALSE;
+    char_t* filePath = MakeFullPath(arg->argString, *currPathPtr, &isDynamicMemory);
+    if (filePath == NULL)
+    {
+        PrintCommandError(cmdArg->argString, NULL, CMD_NO_FILE_SPECIFIED);
+        return FALSE;
+    }
+    FILE* fp = fopen(filePath, "r");
+    if (isDynamicMemory)
+    {
+        free(filePath);
+    }
+    if (fp == NULL)
+    {
+        PrintCommandError(cmdArg->argString, arg->argString, errno);
+        return FALSE;
+    }
+
+    // Only the requested range is read
+    uint64_t fileSize = GetFileSize(fp);
+    if (offset > fileSize)
+    {
+        offset = fileSize;
+    }
+    if (length > fileSize - offset)
+    {
+        length = fileSize - offset;
+    }
+
+    uint8_t* chunk = malloc(HEXDUMP_CHUNK_SIZE);
+    pager_s* pager = malloc(sizeof(pager_s));
+    int32_t res = CMD_SUCCESS;
+    if (chunk == NULL || pager == NULL)
+    {
+        res = CMD_OUT_OF_MEMORY;
+        goto cleanup;
+    }
+    if (fseek(fp, offset, SEEK_SET) != 0)
+    {
+        res = errno;
+        goto cleanup;
+    }
+    PagerInit(pager, FALSE);
+
+    for (uint64_t done = 0; done < length;)
+    {
+        uintn_t bytesToRead = length - done < HEXDUMP_CHUNK_SIZE ? length - done : HEXDUMP_CHUNK_SIZE;
+        if (fread(chunk, 1, bytesToRead, fp) != bytesToRead)
+        {
+            res = errno != 0 ? errno : EIO;
+            break;
+        }
+
+        for (uintn_t i = 0; i < bytesToRead; i += BYTES_PER_LINE)
+        {
+            uintn_t lineLength = bytesToRead - i < BYTES_PER_LINE ? bytesToRead - i : BYTES_PER_LINE;
+            PrintHexLine(pager, offset + done + i, chunk + i, lineLength);
+        }
+        done += bytesToRead;
+    }
+
+    // The offset after the last byte, like hexdump -C
+    if (res == CMD_SUCCESS)
+    {
+        char_t endStr[24];
+        snprintf(endStr, sizeof(endStr), "%08x\n", offset + length);
+        PagerWrite(pager, endStr, strlen(endStr));
+    }
+    PagerFlush(pager);
+
+cleanup:
+    free(chunk);
+    free(pager);
+    fclose(fp);
+    if (res != CMD_SUCCESS)
+    {
+        PrintCommandError(cmdArg->argString, arg->argString, res);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Accepts decimal numbers and hexadecimal ones with a 0x prefix
+static boolean_t ParseNumber(const char_t* str, uint64_t* number)
+{
+    int32_t base = 10;
+    if (str[0] == '0' && (str[1] == 'x' || str[1] == 'X'))
+    {
+        base = 16;
+        str += 2;
+    }
+
+    char_t* end = NULL;
+    int64_t value = strtol(str, &end, base);
+    if (end == str || *end != CHAR_NULL || value < 0)
+    {
+        return FALSE;
+    }
+    *number = (uint64_t)value;
+    return TRUE;
+}
+
+// The line is formatted by hand, it is printed for every 16 bytes
+static void PrintHexLine(pager_s* pager, uint64_t offset, const uint8_t* data, uintn_t length)
+{
+    static const char_t hexDigits[] = "0123456789abcdef";
+    char_t line[HEXDUMP_LINE_SIZE];
+
+    snprintf(line, sizeof(line), "%08x  ", offset);
+    uintn_t pos = strlen(line);
+    for (uintn_t i = 0; i < BYTES_PER_LINE; i++)
+    {
+        if (i < length)
+        {
+            line[pos++] = hexDigits[data[i] >> 4];
+            line[pos++] = hexDigits[data[i] & 0xf];
+        }
+        else
+        {
+            line[pos++] = ' ';
+            line[pos++] = ' ';
+        }
+        line[pos++] = ' ';
+        // An extra space splits the two halves
+        if (i == BYTES_PER_LINE / 2 - 1)
+        {
+            line[pos++] = ' ';
+        }
+    }
+
+    line[pos++] = ' ';
+    line[pos++] = '|';
+    for (uintn_t i = 0; i < length; i++)
+    {
+        line[pos++] = (data[i] >= 0x20 && data[i] < 0x7f) ? (char_t)data[i] : '.';
+    }
+    line[pos++] = '|';
+    line[pos++] = '\n';
+    PagerWrite(pager, line, pos);
+}
+
+const char_t* HexdumpBrief(void)
+{
+    return "Print the bytes of a file in hex and ASCII.";
+}
+
+const char_t* HexdumpLong(void)
+{
+    return "Usage: hexdump [-s offset] [-n length] <file>\n"
+           "The numbers can be decimal or hexadecimal with a 0x prefix.\n"
+           "-s - skip this many bytes from the start of the file\n"
+           "-n - print only this many bytes";
+}
@@ -0,0 +1,71 @@
+#include "cmds/log.h"
+#include "shellutils.h"
+#include "shellerr.h"
+#include "bootutils.h"
+#include "logger.h"
+
+#define WARNINGS_FLAG   ("-w")
+#define ERRORS_FLAG     ("-e")
+
+boolean_t LogCmd(cmd_args_s** args, char_t** currPathPtr)
+{
+    cmd_args_s* cmdArg = *args;
+
+    log_filter_t filter = LOG_FILTER_ALL;
+    if (FindFlagAndDelete(args, WARNINGS_FLAG))
+    {
+        filter = LOG_FILTER_WARNINGS;
+    }
+    if (FindFlagAndDelete(args, ERRORS_FLAG))
+    {
+        filter = LOG_FILTER_ERRORS;
+    }
+
+    cmd_args_s* arg = cmdArg->next;
+    int32_t res = CMD_SUCCESS;
+    if (arg == NULL)
+    {
+        res = ViewLogFile(filter);
+    }
+    else
+    {
+        // Old logs can be viewed too
+        boolean_t isDynamicMemory = FALSE;
+        char_t* filePath = MakeFullPath(arg->argString, *currPathPtr, &isDynamicMemory);
+        if (filePath == NULL)
+        {
+            PrintCommandError(cmdArg->argString, NULL, CMD_NO_FILE_SPECIFIED);
+            return FALSE;
+        }
+
+        res = StartLogViewer(filePath, filter);
+
+        if (isDynamicMemory)
+        {
+            free(filePath);
+        }
+    }
+
+    if (res != CMD_SUCCESS)
+    {
+        PrintCommandError(cmdArg->argString, arg != NULL ? arg->argString : NULL, res);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+const char_t* LogBrief(void)
+{
+    return "View the log of the boot manager.";
+}
+
+const char_t* LogLong(void)
+{
+    return "Usage: log [-w | -e] [file]\n"
+           "Opens the current log, or the given log file, in a paged viewer.\n"
+           "In the memory log mode the current log is shown from memory, not from log.txt.\n"
+           "-w - show only warnings and errors\n"
+           "-e - show only errors\n"
+           "Keys: arrows/j/k scroll, PgUp/PgDn/b/space page, Home/End/g/G top and end,\n"
+           "a/w/e change the filter, t jumps to a time since launch, q/ESC quits";
+}
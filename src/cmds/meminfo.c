@@ -0,0 +1,183 @@
+#include "cmds/meminfo.h"
+#include "shellutils.h"
+#include "shellerr.h"
+#include "bootutils.h"
+
+#define LIST_FLAG ("-l")
+
+// The memory map may grow between the size query and the actual call
+#define EXTRA_MEMORY_DESCRIPTORS (4)
+
+#define PAGES_TO_KIB(pages) ((pages) * (EFI_PAGE_SIZE / 1024))
+
+static void PrintHeapStats(void);
+static void PrintLiveBuffer(void* ptr, size_t size, const char* file, int line, void* data);
+static int32_t PrintMemoryMapSummary(void);
+static const char_t* MemoryTypeString(uint32_t type);
+
+
+boolean_t MeminfoCmd(cmd_args_s** args, char_t** currPathPtr)
+{
+    cmd_args_s* cmdArg = *args;
+    boolean_t listFlag = FindFlagAndDelete(args, LIST_FLAG);
+
+    PrintHeapStats();
+    if (listFlag)
+    {
+        printf("\nLive buffers (newest first):\n");
+        heap_walk(0, PrintLiveBuffer, NULL);
+    }
+
+    putchar('\n');
+    int32_t res = PrintMemoryMapSummary();
+    if (res != CMD_SUCCESS)
+    {
+        PrintCommandError(cmdArg->argString, NULL, res);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void PrintHeapStats(void)
+{
+    heap_stats_t stats;
+    heap_stats(&stats);
+
+    printf("Heap:\n");
+    printf("  In use:     %d bytes in %d buffers\n", stats.live_bytes, stats.live_allocs);
+    printf("  Peak:       %d bytes\n", stats.peak_bytes);
+    printf("  Allocs:     %d (frees: %d)\n", stats.total_allocs, stats.total_frees);
+    printf("  Pool calls: %d\n", stats.pool_calls);
+}
+
+static void PrintLiveBuffer(void* ptr, size_t size, const char* file, int line, void* data)
+{
+    // Call sites are only recorded in debug builds
+    if (file == NULL)
+    {
+        printf("  %p: %d bytes\n", ptr, size);
+    }
+    else
+    {
+        printf("  %p: %d bytes (%s:%d)\n", ptr, size, file, line);
+    }
+}
+
+// Sums the pages of every memory type in the firmware memory map
+static int32_t PrintMemoryMapSummary(void)
+{
+    uintn_t mapSize = 0;
+    uintn_t mapKey = 0;
+    uintn_t descSize = 0;
+    uint32_t descVersion = 0;
+
+    efi_status_t status = BS->GetMemoryMap(&mapSize, NULL, &mapKey, &descSize, &descVersion);
+    if (status != EFI_BUFFER_TOO_SMALL || descSize == 0)
+    {
+        return CMD_EFI_FAIL;
+    }
+
+    mapSize += EXTRA_MEMORY_DESCRIPTORS * descSize;
+    efi_memory_descriptor_t* map = malloc(mapSize);
+    if (map == NULL)
+    {
+        return CMD_OUT_OF_MEMORY;
+    }
+
+    status = BS->GetMemoryMap(&mapSize, map, &mapKey, &descSize, &descVersion);
+    if (EFI_ERROR(status))
+    {
+        free(map);
+        return CMD_EFI_FAIL;
+    }
+
+    uint64_t pagesPerType[EfiMaxMemoryType + 1] = {0};
+    uint64_t totalPages = 0;
+    uintn_t numDescriptors = mapSize / descSize;
+
+    efi_memory_descriptor_t* desc = map;
+    for (uintn_t i = 0; i < numDescriptors; i++)
+    {
+        // Unknown and OEM types are counted together
+        uint32_t type = desc->Type < EfiMaxMemoryType ? desc->Type : EfiMaxMemoryType;
+        pagesPerType[type] += desc->NumberOfPages;
+        totalPages += desc->NumberOfPages;
+
+        desc = NextMemoryDescriptor(desc, descSize);
+    }
+    free(map);
+
+    printf("Memory map (%d descriptors):\n", numDescriptors);
+    for (uint32_t type = 0; type <= EfiMaxMemoryType; type++)
+    {
+        if (pagesPerType[type] != 0)
+        {
+            printf("  %s: %d pages (%d KiB)\n", MemoryTypeString(type), 
+                pagesPerType[type], PAGES_TO_KIB(pagesPerType[type]));
+        }
+    }
+    printf("  Total: %d pages (%d KiB)\n", totalPages, PAGES_TO_KIB(totalPages));
+    return CMD_SUCCESS;
+}
+
+static const char_t* MemoryTypeString(uint32_t type)
+{
+    switch (type)
+    {
+        case EfiReservedMemoryType:
+        return "Reserved";
+
+        case EfiLoaderCode:
+        return "Loader code";
+
+        case EfiLoaderData:
+        return "Loader data";
+
+        case EfiBootServicesCode:
+        return "Boot services code";
+
+        case EfiBootServicesData:
+        return "Boot services data";
+
+        case EfiRuntimeServicesCode:
+        return "Runtime services code";
+
+        case EfiRuntimeServicesData:
+        return "Runtime services data";
+
+        case EfiConventionalMemory:
+        return "Free (conventional)";
+
+        case EfiUnusableMemory:
+        return "Unusable";
+
+        case EfiACPIReclaimMemory:
+        return "ACPI reclaimable";
+
+        case EfiACPIMemoryNVS:
+        return "ACPI NVS";
+
+        case EfiMemoryMappedIO:
+        return "MMIO";
+
+        case EfiMemoryMappedIOPortSpace:
+        return "MMIO port space";
+
+        case EfiPalCode:
+        return "PAL code";
+
+        default:
+        return "Other";
+    }
+}
+
+const char_t* MeminfoBrief(void)
+{
+    return "Show heap statistics and a summary of the firmware memory map.";
+}
+
+const char_t* MeminfoLong(void)
+{
+    return "Usage: meminfo [-l]\n"
+           "-l - list the buffers that are currently allocated (with their call sites in debug builds)";
+}
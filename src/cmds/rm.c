@@ -2,10 +2,12 @@
 #include "shellerr.h"
 #include "shellutils.h"
 #include "bootutils.h"
+#include "dirwalk.h"
 
 #define RECURSIVE_FLAG ("-r")
 
 static boolean_t RemoveRecursively(char_t* mainPath, cmd_args_s* cmdArg);
+static boolean_t RemoveWalkCallback(dir_walk_s* walk, walk_event_t event, const char_t* name);
 
 
 boolean_t RmCmd(cmd_args_s** args, char_t** currPathPtr)
@@ -68,60 +70,60 @@ boolean_t RmCmd(cmd_args_s** args, char_t** currPathPtr)
 
 static boolean_t RemoveRecursively(char_t* mainPath, cmd_args_s* cmdArg)
 {
-    DIR* dir = opendir(mainPath);
-    // Allow deleting normal files with the recursive flag on
-    if (dir == NULL && errno == ENOTDIR)
-    {
-        return (remove(mainPath) == 0);
-    }
-    else if (dir == NULL)
+    // Write access is needed to delete through the open handle
+    FILE* fp = fopen(mainPath, "*");
+    if (fp == NULL)
     {
+        PrintCommandError(cmdArg->argString, mainPath, errno);
         return FALSE;
     }
 
-    boolean_t funcSuccess = TRUE;
-    struct dirent* de;
-    // This loop looks similar to the loop in the main RmCmd function, but it's in fact different
-    while ((de = readdir(dir)) != NULL)
+    struct stat st;
+    fstat(fp, &st);
+    // Allow deleting normal files with the recursive flag on
+    if (!S_ISDIR(st.st_mode))
     {
-        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+        if (fdelete(fp) != 0)
         {
-            // Skip the current and previous directories
-            continue;
+            PrintCommandError(cmdArg->argString, mainPath, errno);
+            return FALSE;
         }
+        return TRUE;
+    }
 
-        boolean_t isDynamicMemory = FALSE;
-        // Concatenate the current directory path with the name of the file to delete
-        char_t* filePath = MakeFullPath(de->d_name, mainPath, &isDynamicMemory);
+    return WalkDirectory((DIR*)fp, mainPath, DIR_WALK_WRITABLE, RemoveWalkCallback, cmdArg);
+}
 
-        // If we find a directory, we descend into it and delete everything in it
-        if (de->d_type == DT_DIR)
-        {
-            if (RemoveRecursively(filePath, cmdArg) == FALSE)
-            {
-                funcSuccess = FALSE;
-            }
-        }
-        else
-        {
-            if (remove(filePath) != 0)
-            {
-                PrintCommandError(cmdArg->argString, filePath, errno);
-            }
-        }
+// Everything is deleted through the handles of the walk, without resolving paths
+static boolean_t RemoveWalkCallback(dir_walk_s* walk, walk_event_t event, const char_t* name)
+{
+    cmd_args_s* cmdArg = walk->context;
 
-        if (isDynamicMemory)
-        {
-            free(filePath);
-        }
+    boolean_t success = TRUE;
+    switch (event)
+    {
+        case WALK_FILE:
+            success = WalkDeleteFile(walk, name);
+            break;
+
+        case WALK_DIR_LEAVE:
+            // The directory is empty by now
+            success = WalkDeleteDirectory(walk);
+            break;
+
+        case WALK_DIR_ERROR:
+            success = FALSE;
+            break;
+
+        default:
+            break;
     }
-    closedir(dir);
-    // Remove the parent directory
-    if (remove(mainPath) != 0)
+
+    if (!success)
     {
-        funcSuccess = FALSE;
+        PrintCommandError(cmdArg->argString, walk->path, errno);
     }
-    return funcSuccess;
+    return success;
 }
 
 const char_t* RmBrief(void)
@@ -0,0 +1,137 @@
+#include "cmds/sha256sum.h"
+#include "shellutils.h"
+#include "shellerr.h"
+#include "bootutils.h"
+#include "hash.h"
+
+#define TEST_FLAG ("-t")
+#define TREE_FLAG ("-p")
+
+// Files are hashed in chunks of this size
+#define SHA256SUM_CHUNK_SIZE (1024 * 1024)
+// In tree mode enough leaves are read at once to keep every processor busy
+#define SHA256SUM_TREE_READ_SIZE (64 * SHA256_TREE_CHUNK_SIZE)
+
+static int32_t HashFile(FILE* fp, uint8_t* chunk, boolean_t tree, uint8_t digest[SHA256_DIGEST_SIZE]);
+
+
+boolean_t Sha256sumCmd(cmd_args_s** args, char_t** currPathPtr)
+{
+    cmd_args_s* cmdArg = *args;
+
+    if (FindFlagAndDelete(args, TEST_FLAG))
+    {
+        boolean_t passed = HashSelfTest(HASH_SHA256, TRUE);
+        HashBenchmark(HASH_SHA256);
+        return passed;
+    }
+    boolean_t tree = FindFlagAndDelete(args, TREE_FLAG);
+
+    cmd_args_s* arg = cmdArg->next;
+    if (arg == NULL)
+    {
+        PrintCommandError(cmdArg->argString, NULL, CMD_NO_FILE_SPECIFIED);
+        return FALSE;
+    }
+
+    uint8_t* chunk = malloc(tree ? SHA256SUM_TREE_READ_SIZE : SHA256SUM_CHUNK_SIZE);
+    if (chunk == NULL)
+    {
+        PrintCommandError(cmdArg->argString, NULL, CMD_OUT_OF_MEMORY);
+        return FALSE;
+    }
+
+    boolean_t cmdSuccess = TRUE;
+    for (; arg != NULL; arg = arg->next)
+    {
+        boolean_t isDynamicMemory = FALSE;
+        char_t* filePath = MakeFullPath(arg->argString, *currPathPtr, &isDynamicMemory);
+        if (filePath == NULL)
+        {
+            PrintCommandError(cmdArg->argString, NULL, CMD_NO_FILE_SPECIFIED);
+            cmdSuccess = FALSE;
+            continue;
+        }
+        FILE* fp = fopen(filePath, "r");
+        if (isDynamicMemory)
+        {
+            free(filePath);
+        }
+        if (fp == NULL)
+        {
+            PrintCommandError(cmdArg->argString, arg->argString, errno);
+            cmdSuccess = FALSE;
+            continue;
+        }
+
+        uint8_t digest[SHA256_DIGEST_SIZE];
+        int32_t res = HashFile(fp, chunk, tree, digest);
+        fclose(fp);
+        if (res != CMD_SUCCESS)
+        {
+            PrintCommandError(cmdArg->argString, arg->argString, res);
+            cmdSuccess = FALSE;
+            continue;
+        }
+
+        char_t digestStr[SHA256_DIGEST_SIZE * 2 + 1];
+        Sha256ToString(digest, digestStr);
+        printf("%s  %s\n", digestStr, arg->argString);
+    }
+
+    free(chunk);
+    return cmdSuccess;
+}
+
+static int32_t HashFile(FILE* fp, uint8_t* chunk, boolean_t tree, uint8_t digest[SHA256_DIGEST_SIZE])
+{
+    uintn_t chunkSize = tree ? SHA256SUM_TREE_READ_SIZE : SHA256SUM_CHUNK_SIZE;
+    sha256_ctx_s ctx;
+    Sha256Init(&ctx);
+    while (TRUE)
+    {
+        // A tree leaf can't span two reads, so the chunk is filled completely unless the file ends
+        uintn_t bytesRead = 0;
+        while (bytesRead < chunkSize)
+        {
+            uintn_t res = fread(chunk + bytesRead, 1, chunkSize - bytesRead, fp);
+            if (res == 0)
+            {
+                break;
+            }
+            bytesRead += res;
+        }
+        if (bytesRead < chunkSize && !feof(fp))
+        {
+            return errno != 0 ? errno : EIO;
+        }
+
+        if (tree)
+        {
+            Sha256TreeUpdate(&ctx, chunk, bytesRead);
+        }
+        else
+        {
+            Sha256Update(&ctx, chunk, bytesRead);
+        }
+        if (bytesRead < chunkSize)
+        {
+            break;
+        }
+    }
+    Sha256Final(&ctx, digest);
+    return CMD_SUCCESS;
+}
+
+const char_t* Sha256sumBrief(void)
+{
+    return "Print the SHA-256 hash of files.";
+}
+
+const char_t* Sha256sumLong(void)
+{
+    return "Usage: sha256sum [-t] [-p] <file1> <file2> ...\n"
+           "-p - print the tree digest, hashed on all the processors: every 1 MiB of the file is hashed\n"
+           "     on its own and the digest is the SHA-256 of those hashes in order\n"
+           "-t - test every SHA-256 implementation the CPU supports and measure its speed";
+}
@@ -0,0 +1,139 @@
+#include "cmds/smp.h"
+#include "shellutils.h"
+#include "shellerr.h"
+#include "bootutils.h"
+#include "mpjobs.h"
+#include "hash.h"
+#include "clock.h"
+
+#define TEST_FLAG ("-t")
+
+// Large enough that starting the processors is a small part of the time
+#define SMP_TEST_SIZE (64 * 1024 * 1024)
+#define BYTES_IN_MIB  (1024 * 1024)
+
+static boolean_t RunSmpTest(void);
+static void PrintThroughput(const char_t* name, uint64_t startTicks);
+static void SerialTreeDigest(const uint8_t* data, uintn_t length, uint8_t digest[SHA256_DIGEST_SIZE]);
+
+
+boolean_t SmpCmd(cmd_args_s** args, char_t** currPathPtr)
+{
+    boolean_t runTest = FindFlagAndDelete(args, TEST_FLAG);
+
+    printf("Jobs run on %d processors.\n", GetMpWorkerCount());
+    if (!runTest)
+    {
+        return TRUE;
+    }
+
+    if (GetClockFrequency() == 0)
+    {
+        printf("The test needs a calibrated clock.\n");
+        return FALSE;
+    }
+    return RunSmpTest();
+}
+
+// Times every job against the same work done on the BSP alone, and checks the parallel results
+static boolean_t RunSmpTest(void)
+{
+    uint8_t* buffer = malloc(SMP_TEST_SIZE);
+    if (buffer == NULL)
+    {
+        printf("Not enough memory for the test.\n");
+        return FALSE;
+    }
+
+    uint64_t start = ReadClockTicks();
+    memset(buffer, 0, SMP_TEST_SIZE);
+    PrintThroughput("memset", start);
+
+    memset(buffer, 0xff, SMP_TEST_SIZE);
+    start = ReadClockTicks();
+    MpZeroMemory(buffer, SMP_TEST_SIZE);
+    PrintThroughput("MpZeroMemory", start);
+
+    boolean_t passed = TRUE;
+    for (uintn_t i = 0; i < SMP_TEST_SIZE; i++)
+    {
+        if (buffer[i] != 0)
+        {
+            printf("MpZeroMemory left a byte at offset %d.\n", i);
+            passed = FALSE;
+            break;
+        }
+    }
+
+    // Every byte of the data differs from its neighbours, so a leaf in the wrong place changes the digest
+    for (uintn_t i = 0; i < SMP_TEST_SIZE; i++)
+    {
+        buffer[i] = (uint8_t)(i ^ (i >> 8) ^ (i >> 16));
+    }
+
+    sha256_ctx_s ctx;
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    start = ReadClockTicks();
+    Sha256Init(&ctx);
+    Sha256Update(&ctx, buffer, SMP_TEST_SIZE);
+    Sha256Final(&ctx, digest);
+    PrintThroughput("SHA-256", start);
+
+    uint8_t treeDigest[SHA256_DIGEST_SIZE];
+    start = ReadClockTicks();
+    Sha256Init(&ctx);
+    Sha256TreeUpdate(&ctx, buffer, SMP_TEST_SIZE);
+    Sha256Final(&ctx, treeDigest);
+    PrintThroughput("SHA-256 tree", start);
+
+    uint8_t serialDigest[SHA256_DIGEST_SIZE];
+    SerialTreeDigest(buffer, SMP_TEST_SIZE, serialDigest);
+    if (memcmp(treeDigest, serialDigest, SHA256_DIGEST_SIZE) != 0)
+    {
+        printf("The SHA-256 tree digest differs from the one computed on the BSP.\n");
+        passed = FALSE;
+    }
+
+    free(buffer);
+    printf(passed ? "All the jobs returned the right results.\n" : "The test failed.\n");
+    return passed;
+}
+
+static void PrintThroughput(const char_t* name, uint64_t startTicks)
+{
+    uint64_t elapsedUs = TicksToMicroseconds(ReadClockTicks() - startTicks);
+    if (elapsedUs == 0)
+    {
+        elapsedUs = 1;
+    }
+    printf("%s: %d MiB/s\n", name, (uint64_t)SMP_TEST_SIZE * US_IN_SECOND / elapsedUs / BYTES_IN_MIB);
+}
+
+// The same tree as Sha256TreeUpdate, built one leaf after the other
+static void SerialTreeDigest(const uint8_t* data, uintn_t length, uint8_t digest[SHA256_DIGEST_SIZE])
+{
+    sha256_ctx_s root;
+    Sha256Init(&root);
+    for (uintn_t offset = 0; offset < length; offset += SHA256_TREE_CHUNK_SIZE)
+    {
+        sha256_ctx_s leafCtx;
+        uint8_t leaf[SHA256_DIGEST_SIZE];
+        Sha256Init(&leafCtx);
+        Sha256Update(&leafCtx, data + offset, length - offset < SHA256_TREE_CHUNK_SIZE ? length - offset : SHA256_TREE_CHUNK_SIZE);
+        Sha256Final(&leafCtx, leaf);
+        Sha256Update(&root, leaf, SHA256_DIGEST_SIZE);
+    }
+    Sha256Final(&root, digest);
+}
+
+const char_t* SmpBrief(void)
+{
+    return "Show the processors that run jobs in parallel.";
+}
+
+const char_t* SmpLong(void)
+{
+    return "Usage: smp [-t]\n"
+           "Jobs like clearing memory and tree hashing are split between all the processors.\n"
+           "-t - time the parallel jobs against the BSP alone and check their results";
+}
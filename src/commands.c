@@ -18,6 +18,15 @@
 #include "cmds/passwd.h"
 #include "cmds/cp.h"
 #include "cmds/about.h"
+#include "cmds/meminfo.h"
+#include "cmds/log.h"
+#include "cmds/grep.h"
+#include "cmds/find.h"
+#include "cmds/hexdump.h"
+#include "cmds/cmp.h"
+#include "cmds/sha256sum.h"
+#include "cmds/crc32.h"
+#include "cmds/smp.h"
 
 // List of all the commands
 const shell_cmd_s commands[] = {
@@ -36,6 +45,15 @@ const shell_cmd_s commands[] = {
 { "passwd",   PasswdCmd,   PasswdBrief,   PasswdLong },
 { "cp",       CpCmd,       CpBrief,       CpLong },
 { "about",    AboutCmd,    AboutBrief,    NULL },
+{ "meminfo",  MeminfoCmd,  MeminfoBrief,  MeminfoLong },
+{ "log",      LogCmd,      LogBrief,      LogLong },
+{ "grep",     GrepCmd,     GrepBrief,     GrepLong },
+{ "find",     FindCmd,     FindBrief,     FindLong },
+{ "hexdump",  HexdumpCmd,  HexdumpBrief,  HexdumpLong },
+{ "cmp",      CmpCmd,      CmpBrief,      CmpLong },
+{ "sha256sum", Sha256sumCmd, Sha256sumBrief, Sha256sumLong },
+{ "crc32",    Crc32Cmd,    Crc32Brief,    Crc32Long },
+{ "smp",      SmpCmd,      SmpBrief,      SmpLong },
 { "", NULL, NULL, NULL } // Has to be here in order to terminate the command counter
 };
 
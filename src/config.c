@@ -4,6 +4,9 @@
 #include "shellutils.h"
 #include "bootmenu.h"
 #include "shellerr.h"
+#include "arena.h"
+#include "clock.h"
+#include "extentmap.h"
 
 // Entries config path
 #define CFG_PATH ("\\EFI\\lucidloader\\config.cfg")
@@ -15,16 +18,18 @@
 
 #define MAX_ENTRY_NAME_LEN (70)
 
-#define BOOT_ENTRY_INIT { NULL, NULL, NULL, FALSE, NULL }
+#define BOOT_ENTRY_INIT { NULL, NULL, NULL, FALSE, NULL, FALSE, {0}, NULL, 0 }
 #define BOOT_ENTRY_ARR_INIT { NULL, 0 }
 
 #define LINUX_KERNEL_IDENTIFIER_STR ("vmlinuz")
 #define STR_TO_SUBSTITUTE_WITH_VERSION ("%v")
 
 #define INITRD_ARG_STR ("initrd=")
+// Separates the path of an initrd from its optional digest, like in 'initrd: \\initramfs.img sha256:<digest>'
+#define INITRD_SHA256_STR (" sha256:")
 
 /* Basic config parser functions */
-static boolean_t AssignValueToEntry(const char_t* key, char_t* value, boot_entry_s* entry);
+static void AssignValueToEntry(const char_t* key, char_t* value, boot_entry_s* entry);
 static boolean_t ValidateEntry(boot_entry_s* newEntry);
 static void AppendEntry(boot_entry_array_s* bootEntryArr, boot_entry_s* entry);
 static boolean_t EditRuntimeConfig(const char_t* key, char_t* value);
@@ -38,16 +43,23 @@ static void FreeConfigEntry(boot_entry_s* entry);
 static inline void LogKeyRedefinition(const char_t* key, const char_t* curr, const char_t* ignored);
 
 static void AppendToArgs(boot_entry_s* entry, char_t* value);
+static void AppendInitrd(boot_entry_s* entry, const char_t* path, initrd_entry_s* initrd);
 
 static boolean_t ignoreEntryWarnings;
+// The log mode is set once the whole config is parsed, the logger holds its records until then
+static log_mode_t configLogMode;
+// An entry with a digest that can't be parsed or kept is dropped, so it is never booted unverified
+static boolean_t entryIsInvalid;
 
 // Returns a pointer to the head of a linked list of boot entries
 // Every pointer in the linked list was allocated dynamically
 boot_entry_array_s ParseConfig(void)
 {
     Log(LL_INFO, 0, "Parsing config file...");
+    uint64_t parseStart = GetMicrosecondsSinceInit();
 
     boot_entry_array_s bootEntryArr = BOOT_ENTRY_ARR_INIT;
+    configLogMode = LOG_MODE_FILE;
 
     uint64_t fileSize = 0;
     char_t* configData = GetFileContent(CFG_PATH, &fileSize);
@@ -57,30 +69,42 @@ boot_entry_array_s ParseConfig(void)
         return bootEntryArr;
     }
 
+    // Holds the temporary strings of a single entry block, it is reset after every block
+    arena_s* parseArena = ArenaCreate(ARENA_DEFAULT_SIZE);
+    if (parseArena == NULL)
+    {
+        Log(LL_ERROR, 0, "Failed to create the config parser arena.");
+        free(configData);
+        return bootEntryArr;
+    }
+
     // Tracks where we currently are in the config
     char_t* filePtr = configData;
+    const char_t* configEnd = configData + fileSize;
+    const size_t entryDelimiterLen = strlen(CFG_ENTRY_DELIMITER);
 
     // Gets blocks of text from the config in a loop
-    // Once (filePtr >= configData + fileSize) it means that we have finished reading the entire file
-    while (filePtr < configData + fileSize)
+    // Once (filePtr >= configEnd) it means that we have finished reading the entire file
+    while (filePtr < configEnd)
     {
         boot_entry_s entry = BOOT_ENTRY_INIT;
         ignoreEntryWarnings = FALSE;
+        entryIsInvalid = FALSE;
 
-        // Gets a pointer to the end of an entry text block
-        char_t* configEntryEnd = strstr(filePtr, CFG_ENTRY_DELIMITER);
+        // Gets a pointer to the end of an entry text block, only the rest of the file is searched
+        char_t* configEntryEnd = memmem(filePtr, configEnd - filePtr, CFG_ENTRY_DELIMITER, entryDelimiterLen);
 
         size_t entryStrLen = 0;
         size_t ptrIncrement = 0; // Used to increment filePtr
         if (configEntryEnd == NULL) // This means that we have reached the last entry
         {
-            entryStrLen = strlen(filePtr);
+            entryStrLen = configEnd - filePtr;
             ptrIncrement = entryStrLen;
         }
         else
         {
             entryStrLen = configEntryEnd - filePtr;
-            ptrIncrement = entryStrLen + strlen(CFG_ENTRY_DELIMITER);
+            ptrIncrement = entryStrLen + entryDelimiterLen;
         }
 
         // Increment the file pointer and skip empty lines
@@ -91,18 +115,13 @@ boot_entry_array_s ParseConfig(void)
         }
 
         // Holds only the current entry text block
-        char_t* strippedEntry = malloc(entryStrLen + 1);
-        if (strippedEntry == NULL)
+        char_t* entryCopy = ArenaStrndup(parseArena, filePtr, entryStrLen);
+        if (entryCopy == NULL)
         {
             Log(LL_ERROR, 0, "Failed to allocate memory for an entry block.");
-            free(configData);
-            return bootEntryArr;
+            break;
         }
-        strncpy(strippedEntry, filePtr, entryStrLen);
 
-        // We create a copy because we need to keep the original pointer to free it
-        // since strtok modifies the pointer
-        char_t* entryCopy = strippedEntry;
         char_t* line = NULL;
         // Gets lines from the blocks of text and parses them
         while ((line = strtok_r(entryCopy, CFG_LINE_DELIMITER, &entryCopy)) != NULL)
@@ -116,24 +135,18 @@ boot_entry_array_s ParseConfig(void)
             // Get the key and value pair in this line
             char_t* key = NULL;
             char_t* value = NULL;
-            if (ParseKeyValuePair(line, CFG_KEY_VALUE_DELIMITER, &key, &value) == FALSE)
+            if (ParseKeyValuePair(parseArena, line, CFG_KEY_VALUE_DELIMITER, &key, &value) == FALSE)
             {
-                free(key);
-                free(value);
                 continue;
             }
 
             // Trim all the spaces before passing into AssignValueToEntry
             const char_t* trimmedKey = TrimSpaces(key);
             char_t* trimmedValue = TrimSpaces(value);
-            if (!AssignValueToEntry(trimmedKey, trimmedValue, &entry))
-            {
-                // Free the value if it wasn't assigned to the entry
-                free(value);
-            }
-            free(key); // Keys are not needed in the end
+            AssignValueToEntry(trimmedKey, trimmedValue, &entry);
         }
-        free(strippedEntry);
+        // The key and value strings of this block are not needed anymore
+        ArenaReset(parseArena);
 
         // Fill the necessary data like kernel path, kernel version and args
         if (entry.isDirectoryToKernel)
@@ -153,11 +166,18 @@ boot_entry_array_s ParseConfig(void)
         filePtr += ptrIncrement; // Move the pointer to the next entry block
     }
 
+    ArenaDestroy(parseArena);
     free(configData);
+    SetLogMode(configLogMode);
     if (bootEntryArr.numOfEntries == 0)
     {
         Log(LL_ERROR, 0, "The configuration file is empty or has incorrect entries.");
     }
+    else
+    {
+        Log(LL_INFO, 0, "Parsed %d entries in %d ms.", bootEntryArr.numOfEntries,
+            (GetMicrosecondsSinceInit() - parseStart) / US_IN_MILLISECOND);
+    }
     return bootEntryArr;
 }
 
@@ -169,6 +189,12 @@ static boolean_t ValidateEntry(boot_entry_s* newEntry)
         return FALSE;
     }
 
+    if (entryIsInvalid)
+    {
+        Log(LL_ERROR, 0, "Ignoring entry that failed to parse. (entry name: %s)", newEntry->name);
+        return FALSE;
+    }
+
     if (strlen(newEntry->name) == 0)
     {   
         if (!ignoreEntryWarnings)
@@ -213,15 +239,38 @@ static void AppendToArgs(boot_entry_s* entry, char_t* value)
     strncpy(entry->imgArgs + argsLen, value, valueLen);
 }
 
-// FALSE means the value wasn't assigned and should be freed
-// TRUE means that value is in use and should not be freed
-static boolean_t AssignValueToEntry(const char_t* key, char_t* value, boot_entry_s* entry)
+// Records an initrd of the entry, the path is copied
+// It is already in the args, so the entry is dropped if it can't be recorded, a digest would never be checked
+static void AppendInitrd(boot_entry_s* entry, const char_t* path, initrd_entry_s* initrd)
+{
+    initrd_entry_s* initrds = realloc(entry->initrds, sizeof(initrd_entry_s) * (entry->numOfInitrds + 1));
+    if (initrds == NULL)
+    {
+        Log(LL_ERROR, 0, "Failed to allocate memory for the initrd '%s'.", path);
+        entryIsInvalid = TRUE;
+        return;
+    }
+    entry->initrds = initrds;
+
+    initrd->path = strdup(path);
+    if (initrd->path == NULL)
+    {
+        Log(LL_ERROR, 0, "Failed to allocate memory for the initrd '%s'.", path);
+        entryIsInvalid = TRUE;
+        return;
+    }
+    entry->initrds[entry->numOfInitrds] = *initrd;
+    entry->numOfInitrds++;
+}
+
+// The value lives in the parse arena, so values that are kept in the entry are copied
+static void AssignValueToEntry(const char_t* key, char_t* value, boot_entry_s* entry)
 {
     // Ignore empty values
     if (value[0] == CHAR_NULL)
     {
         Log(LL_WARNING, 0, "Ignoring empty value given to key '%s'.", key);
-        return FALSE;
+        return;
     }
 
     if (strcmp(key, "name") == 0)
@@ -229,7 +278,7 @@ static boolean_t AssignValueToEntry(const char_t* key, char_t* value, boot_entry
         if (entry->name != NULL)
         {
             LogKeyRedefinition(key, entry->name, value);
-            return FALSE;
+            return;
         }
 
         // Truncate the name if it's too long
@@ -237,7 +286,12 @@ static boolean_t AssignValueToEntry(const char_t* key, char_t* value, boot_entry
         {
             value[MAX_ENTRY_NAME_LEN] = CHAR_NULL;
         }
-        entry->name = value;
+        entry->name = strdup(value);
+        if (entry->name == NULL)
+        {
+            Log(LL_ERROR, 0, "Failed to allocate memory for the entry name '%s'.", value);
+            entryIsInvalid = TRUE;
+        }
     }
     else if (strcmp(key, "path") == 0) 
     {
@@ -245,14 +299,19 @@ static boolean_t AssignValueToEntry(const char_t* key, char_t* value, boot_entry
         {
             Log(LL_WARNING, 0, "'%s' and 'kerneldir' defined in the same entry. (where kerneldir=%s)",
                 key, entry->kernelScanInfo->kernelDirectory);
-            return FALSE;
+            return;
         }
         if (entry->imgToLoad != NULL)
         {
             LogKeyRedefinition(key, entry->imgToLoad, value);
-            return FALSE;
+            return;
+        }
+        entry->imgToLoad = strdup(value);
+        if (entry->imgToLoad == NULL)
+        {
+            Log(LL_ERROR, 0, "Failed to allocate memory for the path '%s'.", value);
+            entryIsInvalid = TRUE;
         }
-        entry->imgToLoad = value;
     }
     else if (strcmp(key, "kerneldir") == 0)
     {
@@ -260,18 +319,46 @@ static boolean_t AssignValueToEntry(const char_t* key, char_t* value, boot_entry
         {
             Log(LL_WARNING, 0, "'%s' and 'path' are defined in the same entry. (where path=%s)",
                 key, entry->imgToLoad);
-            return FALSE;
+            return;
         }
         if (entry->isDirectoryToKernel)
         {
             LogKeyRedefinition(key, entry->kernelScanInfo->kernelDirectory, value);
-            return FALSE;
+            return;
         }
 
-        entry->kernelScanInfo = malloc(sizeof(kernel_scan_info_s));
-        entry->kernelScanInfo->kernelDirectory = value;
+        // The scan info is only freed with the entry once isDirectoryToKernel is set
+        kernel_scan_info_s* scanInfo = malloc(sizeof(kernel_scan_info_s));
+        char_t* kernelDirectory = strdup(value);
+        if (scanInfo == NULL || kernelDirectory == NULL)
+        {
+            Log(LL_ERROR, 0, "Failed to allocate memory for the kernel directory '%s'.", value);
+            free(scanInfo);
+            free(kernelDirectory);
+            entryIsInvalid = TRUE;
+            return;
+        }
+        scanInfo->kernelDirectory = kernelDirectory;
+        entry->kernelScanInfo = scanInfo;
         entry->isDirectoryToKernel = TRUE;
     }
+    else if (strcmp(key, "sha256") == 0)
+    {
+        if (entry->verifyImage)
+        {
+            char_t currStr[SHA256_DIGEST_SIZE * 2 + 1];
+            Sha256ToString(entry->imgSha256, currStr);
+            LogKeyRedefinition(key, currStr, value);
+            return;
+        }
+        if (!Sha256FromString(value, entry->imgSha256))
+        {
+            Log(LL_ERROR, 0, "Invalid sha256 digest '%s', expected 64 hex digits.", value);
+            entryIsInvalid = TRUE;
+            return;
+        }
+        entry->verifyImage = TRUE;
+    }
     // Concatenates args
     else if (strcmp(key, "args") == 0)
     {
@@ -280,6 +367,24 @@ static boolean_t AssignValueToEntry(const char_t* key, char_t* value, boot_entry
     // This key simplifies the configuration but it just takes the value and adds it to the args
     else if (strcmp(key, "initrd") == 0)
     {
+        initrd_entry_s initrd = { NULL, FALSE, {0} };
+        char_t* digestStr = strstr(value, INITRD_SHA256_STR);
+        if (digestStr != NULL)
+        {
+            // The digest isn't part of the path
+            *digestStr = CHAR_NULL;
+            digestStr = TrimSpaces(digestStr + strlen(INITRD_SHA256_STR));
+            if (!Sha256FromString(digestStr, initrd.sha256))
+            {
+                Log(LL_ERROR, 0, "Invalid sha256 digest '%s' for the initrd '%s', expected 64 hex digits.",
+                    digestStr, value);
+                entryIsInvalid = TRUE;
+                return;
+            }
+            initrd.verify = TRUE;
+            value = TrimSpaces(value);
+        }
+
         size_t initrdLen = strlen(INITRD_ARG_STR);
         size_t valueLen = strlen(value);
         size_t totalLen = initrdLen + valueLen + 1;
@@ -288,8 +393,10 @@ static boolean_t AssignValueToEntry(const char_t* key, char_t* value, boot_entry
         char_t argStr[totalLen];
         strncpy(argStr, INITRD_ARG_STR, initrdLen);
         strncpy(argStr + initrdLen, value, valueLen);
+        argStr[totalLen - 1] = CHAR_NULL;
 
         AppendToArgs(entry, argStr);
+        AppendInitrd(entry, value, &initrd);
     }
     else
     {
@@ -303,9 +410,7 @@ static boolean_t AssignValueToEntry(const char_t* key, char_t* value, boot_entry
             // Avoid false warnings when runtime config keys are on their own
             ignoreEntryWarnings = TRUE;
         }
-        return FALSE;
     }
-    return TRUE;
 }
 
 // Special keys that control the settings of the boot manager during runtime
@@ -314,7 +419,7 @@ static boolean_t EditRuntimeConfig(const char_t* key, char_t* value)
     if (strcmp(key, "timeout") == 0)
     {
         bmcfg.timeoutSeconds = atoi(value);
-        if (bmcfg.timeoutSeconds == -1)
+        if (bmcfg.timeoutSeconds < 0)
         {
             bmcfg.timeoutCancelled = TRUE;
         }
@@ -324,12 +429,91 @@ static boolean_t EditRuntimeConfig(const char_t* key, char_t* value)
         }
         return TRUE;
     }
+    else if (strcmp(key, "logmode") == 0)
+    {
+        if (strcmp(value, "memory") == 0)
+        {
+            configLogMode = LOG_MODE_MEMORY;
+        }
+        else if (strcmp(value, "file") == 0)
+        {
+            configLogMode = LOG_MODE_FILE;
+        }
+        else
+        {
+            Log(LL_WARNING, 0, "Unknown log mode '%s', expected 'file' or 'memory'.", value);
+        }
+        return TRUE;
+    }
+    else if (strcmp(key, "loglevel") == 0)
+    {
+        if (strcmp(value, "info") == 0)
+        {
+            runtimeLogLevel = LL_INFO;
+        }
+        else if (strcmp(value, "warning") == 0)
+        {
+            runtimeLogLevel = LL_WARNING;
+        }
+        else if (strcmp(value, "error") == 0)
+        {
+            runtimeLogLevel = LL_ERROR;
+        }
+        else
+        {
+            Log(LL_WARNING, 0, "Unknown log level '%s', expected 'info', 'warning' or 'error'.", value);
+        }
+        return TRUE;
+    }
+    else if (strcmp(key, "logretention") == 0)
+    {
+        int32_t count = atoi(value);
+        if (count < 0)
+        {
+            Log(LL_WARNING, 0, "Invalid log retention '%s'.", value);
+        }
+        else
+        {
+            SetLogRetention(count);
+        }
+        return TRUE;
+    }
+    else if (strcmp(key, "logmaxsize") == 0)
+    {
+        // The value is in KiB
+        int32_t maxSize = atoi(value);
+        if (maxSize < 0)
+        {
+            Log(LL_WARNING, 0, "Invalid log size limit '%s'.", value);
+        }
+        else
+        {
+            SetLogMaxSize((uint64_t)maxSize * 1024);
+        }
+        return TRUE;
+    }
+    else if (strcmp(key, "extentcache") == 0)
+    {
+        if (strcmp(value, "true") == 0)
+        {
+            SetExtentCacheEnabled(TRUE);
+        }
+        else if (strcmp(value, "false") == 0)
+        {
+            SetExtentCacheEnabled(FALSE);
+        }
+        else
+        {
+            Log(LL_WARNING, 0, "Unknown extent cache setting '%s', expected 'true' or 'false'.", value);
+        }
+        return TRUE;
+    }
     return FALSE;
 }
 
 // Stores the key and value in separate strings, key and value are OUTPUT parameters
-// Return value of FALSE means that there was a failure and the caller may have to free the key or value
-boolean_t ParseKeyValuePair(char_t* token, const char_t delimiter, char_t** key, char_t** value)
+// Both strings are allocated in the given arena and are released together with it
+boolean_t ParseKeyValuePair(arena_s* arena, char_t* token, const char_t delimiter, char_t** key, char_t** value)
 {
     int32_t valueOffset = GetValueOffset(token, delimiter);
     if (valueOffset == -1)
@@ -345,21 +529,18 @@ boolean_t ParseKeyValuePair(char_t* token, const char_t delimiter, char_t** key,
         return FALSE;
     }
 
-    *key = malloc(valueOffset);
+    *key = ArenaStrndup(arena, token, valueOffset - 1);
     if (*key == NULL)
     {
         Log(LL_ERROR, 0, "Failed to allocate memory for the key string.");
         return FALSE;
     }
-    *value = malloc(valueLength + 1);
+    *value = ArenaStrndup(arena, token + valueOffset, valueLength);
     if (*value == NULL)
     {
         Log(LL_ERROR, 0, "Failed to allocate memory for the value string.");
         return FALSE;
     }
-
-    strncpy(*key, token, valueOffset - 1);
-    strncpy(*value, token + valueOffset, valueLength);
     return TRUE;
 }
 
@@ -387,6 +568,11 @@ static void AppendEntry(boot_entry_array_s* bootEntryArr, boot_entry_s* entry)
         newEntry->kernelScanInfo = NULL;
     }
 
+    newEntry->verifyImage = entry->verifyImage;
+    memcpy(newEntry->imgSha256, entry->imgSha256, SHA256_DIGEST_SIZE);
+    newEntry->initrds = entry->initrds;
+    newEntry->numOfInitrds = entry->numOfInitrds;
+
     bootEntryArr->numOfEntries++;
 }
 
@@ -409,6 +595,18 @@ static void PrepareKernelDirEntry(boot_entry_s* entry)
             free(entry->imgArgs);
             entry->imgArgs = newArgs;
         }
+
+        // The initrds are read from these paths when they are verified
+        for (int32_t i = 0; i < entry->numOfInitrds; i++)
+        {
+            char_t* newPath = StringReplace(entry->initrds[i].path, STR_TO_SUBSTITUTE_WITH_VERSION,
+                scanInfo->kernelVersionString);
+            if (newPath != NULL)
+            {
+                free(entry->initrds[i].path);
+                entry->initrds[i].path = newPath;
+            }
+        }
     }
     else
     {
@@ -502,6 +700,12 @@ static void FreeConfigEntry(boot_entry_s* entry)
     free(entry->imgToLoad);
     free(entry->imgArgs);
 
+    for (int32_t i = 0; i < entry->numOfInitrds; i++)
+    {
+        free(entry->initrds[i].path);
+    }
+    free(entry->initrds);
+
     if (entry->isDirectoryToKernel)
     {
         free(entry->kernelScanInfo->kernelDirectory);
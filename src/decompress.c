@@ -0,0 +1,172 @@
+#include "decompress.h"
+#include "bootutils.h"
+#include "logger.h"
+#include "clock.h"
+#include "gzip.h"
+#include "zstd.h"
+
+// Used when the header doesn't have the size, most boot files compress to less than a quarter
+#define UNKNOWN_SIZE_RATIO (4)
+// A size from the header that is this much larger than the file is taken for a damaged header
+#define MAX_SIZE_RATIO (1024)
+// The output never starts smaller than this
+#define MIN_OUTPUT_CAPACITY (64 * 1024)
+
+typedef struct decompress_format_s
+{
+    const char_t* name;
+    uint8_t magic[4];
+    uintn_t magicLength;
+    void* (*create)(void);
+    void (*destroy)(void* state);
+    efi_status_t (*decode)(decompress_s* dec, const uint8_t* data, uintn_t length, boolean_t last);
+    uint64_t (*sizeHint)(const uint8_t* header, uintn_t headerLength, const uint8_t trailer[COMPRESSION_TRAILER_SIZE]);
+} decompress_format_s;
+
+static uint8_t* AllocateOutput(uint64_t* capacity);
+static void FreeOutput(uint8_t* output, uint64_t capacity);
+
+// Indexed by compression_t
+static const decompress_format_s formats[] = {
+    {"none", {0}, 0, NULL, NULL, NULL, NULL},
+    {"gzip", {0x1f, 0x8b, 0x08}, 3, GzipCreate, GzipDestroy, GzipDecode, GzipSizeHint},
+    {"zstd", {0x28, 0xb5, 0x2f, 0xfd}, 4, ZstdCreate, ZstdDestroy, ZstdDecode, ZstdSizeHint},
+};
+
+
+// Files are recognized by their magic numbers, the extension doesn't matter
+compression_t DetectCompression(const uint8_t* header, uintn_t length)
+{
+    for (uintn_t i = COMPRESSION_GZIP; i < sizeof(formats) / sizeof(formats[0]); i++)
+    {
+        if (length >= formats[i].magicLength && memcmp(header, formats[i].magic, formats[i].magicLength) == 0)
+        {
+            return (compression_t)i;
+        }
+    }
+    return COMPRESSION_NONE;
+}
+
+const char_t* CompressionName(compression_t compression)
+{
+    return formats[compression].name;
+}
+
+// The size from the headers when it is there, otherwise a guess, the output grows if it is wrong
+uint64_t GuessDecompressedSize(compression_t compression, const uint8_t* header, uintn_t headerLength,
+    const uint8_t trailer[COMPRESSION_TRAILER_SIZE], uint64_t fileSize)
+{
+    uint64_t size = formats[compression].sizeHint(header, headerLength, trailer);
+    if (size == 0 || size / MAX_SIZE_RATIO > fileSize)
+    {
+        return fileSize * UNKNOWN_SIZE_RATIO;
+    }
+    return size;
+}
+
+efi_status_t DecompressInit(decompress_s* dec, compression_t compression, uint64_t sizeHint)
+{
+    memset(dec, 0, sizeof(decompress_s));
+    dec->compression = compression;
+    dec->outputCapacity = sizeHint > MIN_OUTPUT_CAPACITY ? sizeHint : MIN_OUTPUT_CAPACITY;
+    dec->output = AllocateOutput(&dec->outputCapacity);
+    dec->state = formats[compression].create();
+    if (dec->output == NULL || dec->state == NULL)
+    {
+        DecompressFree(dec);
+        dec->status = EFI_OUT_OF_RESOURCES;
+    }
+    return dec->status;
+}
+
+// The last chunk has to be passed with last set, so the decoder can tell a truncated stream from a finished one
+// The decoder's state is freed after it, only the output is kept
+efi_status_t DecompressChunk(decompress_s* dec, const uint8_t* chunk, uintn_t length, boolean_t last)
+{
+    if (EFI_ERROR(dec->status))
+    {
+        return dec->status;
+    }
+
+    uint64_t start = ReadClockTicks();
+    dec->inputSize += length;
+    formats[dec->compression].decode(dec, chunk, length, last);
+    dec->decodeTicks += ReadClockTicks() - start;
+    if (last || EFI_ERROR(dec->status))
+    {
+        formats[dec->compression].destroy(dec->state);
+        dec->state = NULL;
+    }
+    return dec->status;
+}
+
+void DecompressFree(decompress_s* dec)
+{
+    if (dec->state != NULL)
+    {
+        formats[dec->compression].destroy(dec->state);
+        dec->state = NULL;
+    }
+    FreeOutput(dec->output, dec->outputCapacity);
+    dec->output = NULL;
+    dec->outputCapacity = 0;
+    dec->outputSize = 0;
+}
+
+// Makes room for length more bytes of output, the output moves if it has to grow
+boolean_t DecompressReserve(decompress_s* dec, uint64_t length)
+{
+    if (dec->outputSize + length <= dec->outputCapacity)
+    {
+        return TRUE;
+    }
+
+    uint64_t capacity = dec->outputCapacity * 2;
+    if (capacity < dec->outputSize + length)
+    {
+        capacity = dec->outputSize + length;
+    }
+    uint8_t* output = AllocateOutput(&capacity);
+    if (output == NULL)
+    {
+        DecompressFail(dec, EFI_OUT_OF_RESOURCES, "Not enough memory for the decompressed data.");
+        return FALSE;
+    }
+    memcpy(output, dec->output, dec->outputSize);
+    FreeOutput(dec->output, dec->outputCapacity);
+    dec->output = output;
+    dec->outputCapacity = capacity;
+    return TRUE;
+}
+
+// Only the first error is kept, the decoders stop at it
+void DecompressFail(decompress_s* dec, efi_status_t status, const char_t* reason)
+{
+    if (EFI_ERROR(dec->status))
+    {
+        return;
+    }
+    Log(LL_ERROR, status, "%s (read=%d)", reason, dec->inputSize);
+    dec->status = status;
+}
+
+// The output is in whole pages, so an image is page aligned when it goes to LoadImage
+static uint8_t* AllocateOutput(uint64_t* capacity)
+{
+    efi_physical_address_t addr = 0;
+    efi_status_t status = BS->AllocatePages(AllocateAnyPages, EfiLoaderData, EFI_SIZE_TO_PAGES(*capacity), &addr);
+    if (EFI_ERROR(status))
+    {
+        return NULL;
+    }
+    *capacity = EFI_SIZE_TO_PAGES(*capacity) * EFI_PAGE_SIZE;
+    return (uint8_t*)addr;
+}
+
+static void FreeOutput(uint8_t* output, uint64_t capacity)
+{
+    if (output != NULL)
+    {
+        BS->FreePages((efi_physical_address_t)output, EFI_SIZE_TO_PAGES(capacity));
+    }
+}
@@ -0,0 +1,159 @@
+#include "dirwalk.h"
+#include "bootutils.h"
+#include "shellerr.h"
+
+static void AppendWalkPath(dir_walk_s* walk, const char_t* name);
+static const char_t* GetCurrentDirName(dir_walk_s* walk);
+static void CloseWalkDirectory(dir_walk_s* walk);
+
+
+// Walks a directory tree depth first, the files of a directory are reported before it is left
+// The walk takes ownership of the root directory and closes it at the end
+// Returns FALSE if any callback returned FALSE or a directory couldn't be opened
+boolean_t WalkDirectory(DIR* root, const char_t* rootPath, uint32_t flags, dir_walk_callback_t callback, void* context)
+{
+    dir_walk_s walk;
+    walk.dirs[0] = root;
+    walk.depth = 0;
+    walk.flags = flags;
+    walk.entry = NULL;
+    walk.callback = callback;
+    walk.context = context;
+
+    walk.pathLengths[0] = strlen(rootPath) < DIR_WALK_PATH_SIZE ? strlen(rootPath) : DIR_WALK_PATH_SIZE - 1;
+    memcpy(walk.path, rootPath, walk.pathLengths[0]);
+    walk.path[walk.pathLengths[0]] = CHAR_NULL;
+
+    if (!callback(&walk, WALK_DIR_ENTER, GetCurrentDirName(&walk)))
+    {
+        closedir(root);
+        return FALSE;
+    }
+
+    boolean_t walkSuccess = TRUE;
+    while (TRUE)
+    {
+        DIR* dir = walk.dirs[walk.depth];
+        struct dirent* de = readdir(dir);
+        walk.entry = de;
+        if (de == NULL)
+        {
+            if (!callback(&walk, WALK_DIR_LEAVE, GetCurrentDirName(&walk)))
+            {
+                walkSuccess = FALSE;
+            }
+            CloseWalkDirectory(&walk);
+
+            if (walk.depth == 0)
+            {
+                break;
+            }
+            walk.depth--;
+            continue;
+        }
+
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+        {
+            continue;
+        }
+        AppendWalkPath(&walk, de->d_name);
+
+        if (de->d_type != DT_DIR)
+        {
+            if (!callback(&walk, WALK_FILE, de->d_name))
+            {
+                walkSuccess = FALSE;
+            }
+            continue;
+        }
+
+        if (walk.depth + 1 >= DIR_WALK_MAX_DEPTH)
+        {
+            errno = CMD_DIR_TOO_DEEP;
+            callback(&walk, WALK_DIR_ERROR, de->d_name);
+            walkSuccess = FALSE;
+            continue;
+        }
+
+        // Only one open, relative to the handle of the parent
+        DIR* child = (DIR*)fopenat(dir, de->d_name, (flags & DIR_WALK_WRITABLE) ? "*" : "rd");
+        if (child == NULL)
+        {
+            callback(&walk, WALK_DIR_ERROR, de->d_name);
+            walkSuccess = FALSE;
+            continue;
+        }
+
+        walk.depth++;
+        walk.dirs[walk.depth] = child;
+        walk.pathLengths[walk.depth] = strlen(walk.path);
+        if (!callback(&walk, WALK_DIR_ENTER, de->d_name))
+        {
+            walkSuccess = FALSE;
+            CloseWalkDirectory(&walk);
+            walk.depth--;
+        }
+    }
+    return walkSuccess;
+}
+
+// Deletes a file of the current directory
+boolean_t WalkDeleteFile(dir_walk_s* walk, const char_t* name)
+{
+    FILE* fp = fopenat(walk->dirs[walk->depth], name, "*");
+    if (fp == NULL)
+    {
+        return FALSE;
+    }
+    return fdelete(fp) == 0;
+}
+
+// Deletes the current directory through the handle the walk holds
+// Only valid on WALK_DIR_LEAVE, with the walk opened with DIR_WALK_WRITABLE
+boolean_t WalkDeleteDirectory(dir_walk_s* walk)
+{
+    DIR* dir = walk->dirs[walk->depth];
+    // The handle is closed by the deletion
+    walk->dirs[walk->depth] = NULL;
+    return fdelete((FILE*)dir) == 0;
+}
+
+// Makes the walk path point to an entry of the current directory
+// A name that doesn't fit is left out, the path is only used for messages
+static void AppendWalkPath(dir_walk_s* walk, const char_t* name)
+{
+    uintn_t len = walk->pathLengths[walk->depth];
+    uintn_t nameLen = strlen(name);
+
+    walk->path[len] = CHAR_NULL;
+    if (len > 0 && walk->path[len - 1] != '\\')
+    {
+        if (len + 1 >= DIR_WALK_PATH_SIZE)
+        {
+            return;
+        }
+        walk->path[len++] = '\\';
+    }
+    if (len + nameLen >= DIR_WALK_PATH_SIZE)
+    {
+        walk->path[walk->pathLengths[walk->depth]] = CHAR_NULL;
+        return;
+    }
+    memcpy(walk->path + len, name, nameLen + 1);
+}
+
+static const char_t* GetCurrentDirName(dir_walk_s* walk)
+{
+    walk->path[walk->pathLengths[walk->depth]] = CHAR_NULL;
+    char_t* name = strrchr(walk->path, '\\');
+    return name != NULL ? name + 1 : walk->path;
+}
+
+static void CloseWalkDirectory(dir_walk_s* walk)
+{
+    if (walk->dirs[walk->depth] != NULL)
+    {
+        closedir(walk->dirs[walk->depth]);
+        walk->dirs[walk->depth] = NULL;
+    }
+}
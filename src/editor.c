@@ -37,6 +37,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "bootutils.h"
 #include "logger.h"
 #include "screen.h"
+#include "clock.h"
 
 #define EDITOR_STATUS_MSG_ARR_SIZE (80)
 #define EDITOR_WELCOME_MSG_ARR_SIZE (80)
@@ -48,7 +49,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 // Status bar
 #define EDITOR_INITIAL_STATUS_MSG ("HELP: ESC = quit | F1 = save | F2 = find")
-#define EDITOR_STATUS_MSG_TIMEOUT (5)
+#define EDITOR_STATUS_MSG_TIMEOUT (5 * US_IN_SECOND)
 
 // How many spaces to replace TABs with
 #define EDITOR_TAB_SIZE (4)
@@ -90,11 +91,13 @@ typedef struct editor_config_s
     char_t* fullFilePath; // The full path of the file
     char_t* filename; // Rendered filename string
     char_t statusmsg[EDITOR_STATUS_MSG_ARR_SIZE];
-    time_t statusmsgTime;
+    uint64_t statusmsgTime; // Microseconds since init
     boolean_t dirty; // Modified without saving
+
+    arena_s* frameArena; // Holds the screen buffer of a single refresh
 } editor_config_s;
 
-#define BUF_INIT {NULL, 0} // Used for initializing the buffer
+#define BUF_INIT {NULL, 0, 0, NULL} // Used for initializing the buffer
 
 /*** Static declarations ***/
 /* Row operations */
@@ -145,7 +148,14 @@ static editor_config_s cfg;
 
 int8_t StartEditor(char_t* filename)
 {
+    uint64_t heapCheckpoint = HeapCheckpoint();
     InitEditorConfig();
+
+    cfg.frameArena = ArenaCreate(ARENA_DEFAULT_SIZE);
+    if (cfg.frameArena == NULL)
+    {
+        return CMD_OUT_OF_MEMORY;
+    }
     
     if (filename != NULL)
     {
@@ -165,6 +175,7 @@ int8_t StartEditor(char_t* filename)
     } while (ProcessEditorInput());
     
     FreeEditorMemory();
+    LogHeapLeaks(heapCheckpoint, "editor");
     ST->ConOut->ClearScreen(ST->ConOut);
     return 0;
 }
@@ -172,6 +183,9 @@ int8_t StartEditor(char_t* filename)
 // Free all the dynamically allocated memory
 static void FreeEditorMemory(void)
 {
+    ArenaDestroy(cfg.frameArena);
+    cfg.frameArena = NULL;
+
     if (cfg.fullFilePath != NULL)
     {
         free(cfg.fullFilePath);
@@ -213,6 +227,7 @@ static void InitEditorConfig(void)
     cfg.statusmsg[0] = CHAR_NULL;
     cfg.statusmsgTime = 0;
     cfg.dirty = FALSE;
+    cfg.frameArena = NULL;
 }
 
 // Return value of TRUE means success, FALSE means failure
@@ -393,7 +408,16 @@ static void AppendEditorWelcomeMessage(buffer_s* buf)
 
 static void EditorRefreshScreen(void)
 {
+    // Every row is at most a screen row wide and ends with a newline, so the frame
+    // normally fits in the first allocation and is released with a single reset
     buffer_s buf = BUF_INIT;
+    buf.arena = cfg.frameArena;
+    buf.cap = cfg.editorRows * (cfg.editorCols + 1) + 1;
+    buf.b = ArenaAlloc(buf.arena, buf.cap);
+    if (buf.b == NULL)
+    {
+        buf.cap = 0;
+    }
 
     EditorScroll();
     EditorDrawRows(&buf);
@@ -410,7 +434,7 @@ static void EditorRefreshScreen(void)
     ST->ConOut->SetCursorPosition(ST->ConOut, cfg.rx - cfg.colOffset, cfg.cy - cfg.rowOffset);
     ST->ConOut->EnableCursor(ST->ConOut, TRUE);
 
-    FreeBuffer(&buf);
+    ArenaReset(cfg.frameArena);
 }
 
 static void EditorDrawRows(buffer_s* buf)
@@ -649,7 +673,7 @@ static void EditorSetStatusMessage(const char_t* fmt, ...)
     {
         cfg.statusmsg[cfg.editorCols - 1] = CHAR_NULL;
     }
-    cfg.statusmsgTime = time(NULL);
+    cfg.statusmsgTime = GetMicrosecondsSinceInit();
 }
 
 static void EditorDrawMessageBar(void)
@@ -662,7 +686,7 @@ static void EditorDrawMessageBar(void)
 
     // Remove the status message after 5 seconds
     if (cfg.statusmsg[0] != CHAR_NULL &&
-        time(NULL) - cfg.statusmsgTime < EDITOR_STATUS_MSG_TIMEOUT)
+        GetMicrosecondsSinceInit() - cfg.statusmsgTime < EDITOR_STATUS_MSG_TIMEOUT)
     {
         printf("%s", cfg.statusmsg);
     }
@@ -1032,6 +1056,7 @@ static void EditorFindCallback(char_t* query, efi_input_key_t key)
     }
     // Index of the current row we are searching
     int32_t current = lastMatch;
+    size_t queryLen = strlen(query);
 
     for (intn_t i = 0; i < cfg.numRows; i++)
     {
@@ -1047,7 +1072,7 @@ static void EditorFindCallback(char_t* query, efi_input_key_t key)
         }
 
         text_row_s* row = &cfg.row[current];
-        char_t* match = strstr(row->render, query);
+        char_t* match = memmem(row->render, row->rsize, query, queryLen);
 
         if (match != NULL)
         {
@@ -1062,11 +1087,35 @@ static void EditorFindCallback(char_t* query, efi_input_key_t key)
 
 void AppendToBuffer(buffer_s* buf, const char_t* str, uint32_t len)
 {
-    // Resize the string
-    char* new = realloc(buf->b, buf->len + len + 1);
-    if (new == NULL)
+    char* new = buf->b;
+    if (buf->arena != NULL)
     {
-        return;
+        // Grow the buffer inside the arena, the old space is reclaimed when the arena is reset
+        if (buf->len + len + 1 > (uint32_t)buf->cap)
+        {
+            int32_t newCap = buf->cap * 2;
+            if (newCap < (int32_t)(buf->len + len + 1))
+            {
+                newCap = buf->len + len + 1;
+            }
+
+            new = ArenaAlloc(buf->arena, newCap);
+            if (new == NULL)
+            {
+                return;
+            }
+            memcpy(new, buf->b, buf->len);
+            buf->cap = newCap;
+        }
+    }
+    else
+    {
+        // Resize the string
+        new = realloc(buf->b, buf->len + len + 1);
+        if (new == NULL)
+        {
+            return;
+        }
     }
 
     // Update the buffer struct with the new bigger string
@@ -1078,7 +1127,11 @@ void AppendToBuffer(buffer_s* buf, const char_t* str, uint32_t len)
 
 void FreeBuffer(buffer_s* buf)
 {
-    free(buf->b);
+    // Arena buffers are released together with the arena
+    if (buf->arena == NULL)
+    {
+        free(buf->b);
+    }
 }
 
 void PrintBuffer(buffer_s* buf)
@@ -0,0 +1,963 @@
+#include "extentmap.h"
+#include "bootutils.h"
+#include "logger.h"
+#include "hash.h"
+
+#define EXTENT_CACHE_PATH    ("\\EFI\\lucidloader\\extents.bin")
+#define EXTENT_CACHE_MAGIC   (0x50414d5458454c4cULL) // "LLEXTMAP"
+#define EXTENT_CACHE_VERSION (1)
+#define MAX_CACHED_FILES     (32)
+#define EXTENT_PATH_MAX      (256)
+// The first and the last sector of a file are checksummed to tell if its extents are still right
+#define EXTENT_CHECK_SIZE    (512)
+
+#define FAT_BOOT_SECTOR_SIZE  (512)
+#define FAT_DIR_ENTRY_SIZE    (32)
+#define FAT_MAX_DIR_SIZE      (65536 * FAT_DIR_ENTRY_SIZE)
+#define FAT_WINDOW_SIZE       (64 * 1024)
+#define FAT12_MAX_CLUSTERS    (4085)
+#define FAT16_MAX_CLUSTERS    (65525)
+#define FAT_FIRST_CLUSTER     (2)
+
+#define FAT_ATTR_VOLUME_ID    (0x08)
+#define FAT_ATTR_DIRECTORY    (0x10)
+#define FAT_ATTR_LFN          (0x0F)
+#define FAT_ATTR_MASK         (0x3F)
+#define FAT_ENTRY_END         (0x00)
+#define FAT_ENTRY_FREE        (0xE5)
+#define FAT_ENTRY_ESCAPED_E5  (0x05)
+
+#define FAT_LFN_LAST          (0x40)
+#define FAT_LFN_SEQ_MASK      (0x1F)
+#define FAT_LFN_CHARS         (13)
+#define FAT_LFN_MAX_ENTRIES   (20)
+#define FAT_SHORT_NAME_LEN    (11)
+
+typedef enum fat_type_t
+{
+    FAT_TYPE_12,
+    FAT_TYPE_16,
+    FAT_TYPE_32
+} fat_type_t;
+
+// The layout of the FAT volume the boot manager was loaded from, all offsets are in bytes on the partition
+typedef struct fat_volume_s
+{
+    efi_block_io_t* blockIo;
+    efi_disk_io_protocol_t* diskIo;
+    uint32_t mediaId;
+
+    fat_type_t type;
+    uint32_t bytesPerSector;
+    uint32_t clusterSize;
+    uint32_t clusterCount;
+    uint64_t fatOffset;
+    uint64_t fatSize;
+    uint64_t rootDirOffset; // FAT12 and FAT16 have a fixed root directory
+    uint64_t rootDirSize;
+    uint32_t rootCluster; // FAT32 keeps it in a cluster chain
+    uint64_t dataOffset;
+
+    // The part of the FAT that was read last, the clusters of a file are usually close to each other
+    uint8_t* fatWindow;
+    uint64_t fatWindowStart;
+    uint64_t fatWindowSize;
+} fat_volume_s;
+
+// A file in the cache file, it is only used while the file keeps its size and modification time
+typedef struct extent_record_s
+{
+    char_t path[EXTENT_PATH_MAX];
+    uint64_t fileSize;
+    efi_time_t modificationTime;
+    uint32_t firstSectorCrc;
+    uint32_t lastSectorCrc;
+    uint32_t extentCount;
+    uint32_t reserved;
+    file_extent_s extents[MAX_FILE_EXTENTS];
+} extent_record_s;
+
+typedef struct extent_cache_header_s
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t count;
+} extent_cache_header_s;
+
+static void LoadExtentCache(void);
+static int32_t FindRecord(const char_t* path);
+static void StoreRecord(const extent_record_s* record);
+static void DropRecord(int32_t index);
+static boolean_t IsRecordValid(const extent_record_s* record);
+static boolean_t IsSameTime(const efi_time_t* a, const efi_time_t* b);
+
+static efi_status_t GetVolumeProtocols(efi_block_io_t** blockIo, efi_disk_io_protocol_t** diskIo,
+    efi_disk_io2_protocol_t** diskIo2);
+static boolean_t CanReadDirectly(const extent_map_s* map, uint32_t ioAlign);
+static boolean_t ReadMappedRange(efi_disk_io_protocol_t* diskIo, const extent_map_s* map, uint64_t position,
+    void* buffer, uintn_t length);
+static boolean_t ChecksumFileEnds(efi_disk_io_protocol_t* diskIo, const extent_map_s* map, efi_file_handle_t* file,
+    uint32_t* firstCrc, uint32_t* lastCrc);
+static boolean_t ChecksumFileRange(efi_disk_io_protocol_t* diskIo, const extent_map_s* map, efi_file_handle_t* file,
+    uint64_t position, uintn_t length, uint32_t* crc);
+
+static boolean_t OpenFatVolume(fat_volume_s* vol);
+static void CloseFatVolume(fat_volume_s* vol);
+static boolean_t ReadFatEntry(fat_volume_s* vol, uint32_t cluster, uint32_t* next);
+static boolean_t IsEndOfChain(fat_volume_s* vol, uint32_t cluster);
+static boolean_t MapClusterChain(fat_volume_s* vol, uint32_t cluster, uint64_t byteCount, file_extent_s* extents,
+    uint32_t* extentCount, uint64_t* mappedSize);
+static boolean_t FindFatFile(fat_volume_s* vol, const char_t* path, uint32_t* firstCluster, uint64_t* fileSize);
+static uint8_t* ReadDirectory(fat_volume_s* vol, const file_extent_s* extents, uint32_t extentCount, uint64_t size);
+static boolean_t FindDirEntry(const uint8_t* dir, uint64_t dirSize, const wchar_t* name, uintn_t nameLen,
+    uint8_t entry[FAT_DIR_ENTRY_SIZE]);
+static void GetShortName(const uint8_t* entry, wchar_t name[FAT_SHORT_NAME_LEN + 2]);
+static uint8_t ShortNameChecksum(const uint8_t* entry);
+static boolean_t NameEquals(const wchar_t* name, const wchar_t* other, uintn_t otherLen);
+static inline boolean_t IsPathSeparator(wchar_t c);
+static inline uint16_t ReadLe16(const uint8_t* p);
+static inline uint32_t ReadLe32(const uint8_t* p);
+
+static boolean_t cacheEnabled = FALSE;
+static boolean_t cacheLoaded = FALSE;
+static boolean_t cacheDirty = FALSE;
+static uint32_t cachedCount = 0;
+static extent_record_s cachedFiles[MAX_CACHED_FILES];
+
+
+void SetExtentCacheEnabled(boolean_t enabled)
+{
+    cacheEnabled = enabled;
+}
+
+boolean_t IsExtentCacheEnabled(void)
+{
+    return cacheEnabled;
+}
+
+// Fills the map from the cache if the file still has the size and the modification time it had when it was mapped,
+// and its first and last sectors on the disk still have the same checksums. A record that doesn't match is dropped
+boolean_t LoadExtentMap(const char_t* path, efi_file_handle_t* file, extent_map_s* map)
+{
+    LoadExtentCache();
+    int32_t index = FindRecord(path);
+    if (index < 0)
+    {
+        return FALSE;
+    }
+    extent_record_s* record = &cachedFiles[index];
+
+    efi_file_info_t info;
+    efi_block_io_t* blockIo = NULL;
+    efi_disk_io_protocol_t* diskIo = NULL;
+    efi_disk_io2_protocol_t* diskIo2 = NULL;
+    if (EFI_ERROR(GetFileInfo(file, &info)) || EFI_ERROR(GetVolumeProtocols(&blockIo, &diskIo, &diskIo2)))
+    {
+        return FALSE;
+    }
+
+    memset(map, 0, sizeof(extent_map_s));
+    map->blockIo = blockIo;
+    map->diskIo2 = diskIo2;
+    map->mediaId = blockIo->Media->MediaId;
+    map->blockSize = blockIo->Media->BlockSize;
+    map->fileSize = record->fileSize;
+    map->extentCount = record->extentCount;
+    memcpy(map->extents, record->extents, record->extentCount * sizeof(file_extent_s));
+
+    uint32_t firstCrc = 0;
+    uint32_t lastCrc = 0;
+    if (info.FileSize != record->fileSize || !IsSameTime(&info.ModificationTime, &record->modificationTime) ||
+        !ChecksumFileEnds(diskIo, map, NULL, &firstCrc, &lastCrc) ||
+        firstCrc != record->firstSectorCrc || lastCrc != record->lastSectorCrc)
+    {
+        Log(LL_INFO, 0, "The cached extents of '%s' are out of date.", path);
+        DropRecord(index);
+        return FALSE;
+    }
+
+    if (!CanReadDirectly(map, blockIo->Media->IoAlign))
+    {
+        Log(LL_INFO, 0, "The extents of '%s' aren't aligned to the blocks of the disk.", path);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Maps a file that was just read through the file system, so the next boot can read it from the disk directly
+// The map is only kept if the sectors it points to hold the same data that the file system read
+void RecordExtentMap(const char_t* path, efi_file_handle_t* file)
+{
+    efi_file_info_t info;
+    if (strlen(path) >= EXTENT_PATH_MAX || EFI_ERROR(GetFileInfo(file, &info)) || info.FileSize == 0)
+    {
+        return;
+    }
+
+    LoadExtentCache();
+    fat_volume_s vol;
+    if (!OpenFatVolume(&vol))
+    {
+        return;
+    }
+
+    extent_map_s map;
+    memset(&map, 0, sizeof(extent_map_s));
+    map.mediaId = vol.mediaId;
+    map.blockSize = vol.blockIo->Media->BlockSize;
+    uint32_t ioAlign = vol.blockIo->Media->IoAlign;
+    uint32_t firstCluster = 0;
+    uint64_t mappedSize = 0;
+    uint32_t firstCrc = 0;
+    uint32_t lastCrc = 0;
+    boolean_t mapped = FindFatFile(&vol, path, &firstCluster, &map.fileSize) && map.fileSize == info.FileSize &&
+        MapClusterChain(&vol, firstCluster, map.fileSize, map.extents, &map.extentCount, &mappedSize) &&
+        ChecksumFileEnds(vol.diskIo, &map, file, &firstCrc, &lastCrc);
+    CloseFatVolume(&vol);
+    if (!mapped)
+    {
+        Log(LL_WARNING, 0, "Failed to map the extents of '%s', it is read through the file system.", path);
+        return;
+    }
+    if (!CanReadDirectly(&map, ioAlign))
+    {
+        // It would be mapped again on every boot
+        Log(LL_INFO, 0, "The extents of '%s' aren't aligned to the blocks of the disk.", path);
+        return;
+    }
+
+    extent_record_s record;
+    memset(&record, 0, sizeof(extent_record_s));
+    strcpy(record.path, path);
+    record.fileSize = map.fileSize;
+    record.modificationTime = info.ModificationTime;
+    record.firstSectorCrc = firstCrc;
+    record.lastSectorCrc = lastCrc;
+    record.extentCount = map.extentCount;
+    memcpy(record.extents, map.extents, map.extentCount * sizeof(file_extent_s));
+    StoreRecord(&record);
+    Log(LL_INFO, 0, "Mapped '%s' to %d extents on the disk.", path, map.extentCount);
+}
+
+// Used when the data read through the extents failed a check, like the digest of the file
+void DropExtentMap(const char_t* path)
+{
+    LoadExtentCache();
+    int32_t index = FindRecord(path);
+    if (index >= 0)
+    {
+        DropRecord(index);
+    }
+}
+
+// Writes the cache file if a record was added or dropped since it was read
+void SaveExtentCache(void)
+{
+    if (!cacheDirty)
+    {
+        return;
+    }
+    cacheDirty = FALSE;
+
+    FILE* fp = fopen(EXTENT_CACHE_PATH, "w");
+    if (fp == NULL)
+    {
+        Log(LL_WARNING, 0, "Failed to open '%s' to save the extent cache.", EXTENT_CACHE_PATH);
+        return;
+    }
+
+    // A file that is cut short is ignored when it is read, so a failed write only loses the cache
+    extent_cache_header_s header = { EXTENT_CACHE_MAGIC, EXTENT_CACHE_VERSION, cachedCount };
+    boolean_t written = fwrite(&header, 1, sizeof(header), fp) == sizeof(header) &&
+        (cachedCount == 0 || fwrite(cachedFiles, sizeof(extent_record_s), cachedCount, fp) == cachedCount);
+    fclose(fp);
+    if (!written)
+    {
+        Log(LL_WARNING, 0, "Failed to save the extent cache to '%s'.", EXTENT_CACHE_PATH);
+    }
+}
+
+// Returns the offset on the disk of a position in the file, contiguous is the number of bytes
+// from there to the end of its extent, 0 if the position is past the end of the file
+uint64_t ExtentMapLookup(const extent_map_s* map, uint64_t position, uint64_t* contiguous)
+{
+    for (uint32_t i = 0; i < map->extentCount; i++)
+    {
+        if (position < map->extents[i].length)
+        {
+            *contiguous = map->extents[i].length - position;
+            return map->extents[i].offset + position;
+        }
+        position -= map->extents[i].length;
+    }
+    *contiguous = 0;
+    return 0;
+}
+
+// The cache file is read once, a missing or unknown cache file is the same as an empty cache
+static void LoadExtentCache(void)
+{
+    if (cacheLoaded)
+    {
+        return;
+    }
+    cacheLoaded = TRUE;
+
+    FILE* fp = fopen(EXTENT_CACHE_PATH, "r");
+    if (fp == NULL)
+    {
+        return;
+    }
+
+    extent_cache_header_s header;
+    if (fread(&header, 1, sizeof(header), fp) == sizeof(header) && header.magic == EXTENT_CACHE_MAGIC &&
+        header.version == EXTENT_CACHE_VERSION && header.count <= MAX_CACHED_FILES &&
+        (header.count == 0 || fread(cachedFiles, sizeof(extent_record_s), header.count, fp) == header.count))
+    {
+        cachedCount = header.count;
+    }
+    else
+    {
+        Log(LL_WARNING, 0, "Ignoring the extent cache '%s', it isn't valid.", EXTENT_CACHE_PATH);
+        // The next save replaces it
+        cacheDirty = TRUE;
+    }
+    fclose(fp);
+}
+
+static int32_t FindRecord(const char_t* path)
+{
+    for (uint32_t i = 0; i < cachedCount; i++)
+    {
+        if (IsRecordValid(&cachedFiles[i]) && strcmp(cachedFiles[i].path, path) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Replaces the record of the same file, or makes room for it by dropping the oldest record
+static void StoreRecord(const extent_record_s* record)
+{
+    int32_t index = FindRecord(record->path);
+    if (index < 0)
+    {
+        if (cachedCount == MAX_CACHED_FILES)
+        {
+            DropRecord(0);
+        }
+        index = cachedCount++;
+    }
+    cachedFiles[index] = *record;
+    cacheDirty = TRUE;
+}
+
+static void DropRecord(int32_t index)
+{
+    memmove(&cachedFiles[index], &cachedFiles[index + 1], (cachedCount - index - 1) * sizeof(extent_record_s));
+    cachedCount--;
+    cacheDirty = TRUE;
+}
+
+// The cache file could have been damaged, so a record is checked before its extents are trusted
+static boolean_t IsRecordValid(const extent_record_s* record)
+{
+    if (memchr(record->path, 0, EXTENT_PATH_MAX) == NULL || record->extentCount == 0 ||
+        record->extentCount > MAX_FILE_EXTENTS)
+    {
+        return FALSE;
+    }
+
+    uint64_t size = 0;
+    for (uint32_t i = 0; i < record->extentCount; i++)
+    {
+        size += record->extents[i].length;
+    }
+    return size == record->fileSize;
+}
+
+static boolean_t IsSameTime(const efi_time_t* a, const efi_time_t* b)
+{
+    return a->Year == b->Year && a->Month == b->Month && a->Day == b->Day && a->Hour == b->Hour &&
+        a->Minute == b->Minute && a->Second == b->Second && a->Nanosecond == b->Nanosecond;
+}
+
+// The boot manager opens every file on the volume it was loaded from, so that is the volume that is mapped
+static efi_status_t GetVolumeProtocols(efi_block_io_t** blockIo, efi_disk_io_protocol_t** diskIo,
+    efi_disk_io2_protocol_t** diskIo2)
+{
+    efi_guid_t blockIoGuid = EFI_BLOCK_IO_PROTOCOL_GUID;
+    efi_guid_t diskIoGuid = EFI_DISK_IO_PROTOCOL_GUID;
+    efi_guid_t diskIo2Guid = EFI_DISK_IO2_PROTOCOL_GUID;
+
+    efi_status_t status = BS->HandleProtocol(LIP->DeviceHandle, &blockIoGuid, (void**)blockIo);
+    if (!EFI_ERROR(status))
+    {
+        status = BS->HandleProtocol(LIP->DeviceHandle, &diskIoGuid, (void**)diskIo);
+    }
+    if (EFI_ERROR(status))
+    {
+        Log(LL_WARNING, status, "Failed to get the block IO and disk IO protocols of the boot manager's volume.");
+        return status;
+    }
+
+    // Disk IO 2 is optional, without it the blocks are read synchronously
+    if (EFI_ERROR(BS->HandleProtocol(LIP->DeviceHandle, &diskIo2Guid, (void**)diskIo2)))
+    {
+        *diskIo2 = NULL;
+    }
+    return EFI_SUCCESS;
+}
+
+// The chunks are read straight into page aligned buffers, in whole blocks. A chunk never crosses the end
+// of an extent, so every extent has to start on a block, and every extent but the last has to end on one
+static boolean_t CanReadDirectly(const extent_map_s* map, uint32_t ioAlign)
+{
+    uint32_t granularity = map->blockSize > ioAlign ? map->blockSize : ioAlign;
+    if (map->blockSize == 0 || EFI_PAGE_SIZE % granularity != 0)
+    {
+        return FALSE;
+    }
+
+    for (uint32_t i = 0; i < map->extentCount; i++)
+    {
+        if (map->extents[i].offset % map->blockSize != 0 ||
+            (i + 1 < map->extentCount && map->extents[i].length % granularity != 0))
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static boolean_t ReadMappedRange(efi_disk_io_protocol_t* diskIo, const extent_map_s* map, uint64_t position,
+    void* buffer, uintn_t length)
+{
+    uint8_t* dest = buffer;
+    while (length > 0)
+    {
+        uint64_t contiguous = 0;
+        uint64_t offset = ExtentMapLookup(map, position, &contiguous);
+        if (contiguous == 0)
+        {
+            return FALSE;
+        }
+
+        uintn_t readSize = length < contiguous ? length : contiguous;
+        efi_status_t status = diskIo->ReadDisk(diskIo, map->mediaId, offset, readSize, dest);
+        if (EFI_ERROR(status))
+        {
+            Log(LL_WARNING, status, "Failed to read %d bytes at offset %d of the disk.", readSize, offset);
+            return FALSE;
+        }
+        dest += readSize;
+        position += readSize;
+        length -= readSize;
+    }
+    return TRUE;
+}
+
+// Checksums the first and the last sector of a file, as they are on the disk
+// With a file handle they are also compared with what the file system reads, which proves that the extents are right
+static boolean_t ChecksumFileEnds(efi_disk_io_protocol_t* diskIo, const extent_map_s* map, efi_file_handle_t* file,
+    uint32_t* firstCrc, uint32_t* lastCrc)
+{
+    uint64_t firstLength = map->fileSize < EXTENT_CHECK_SIZE ? map->fileSize : EXTENT_CHECK_SIZE;
+    uint64_t lastStart = (map->fileSize - 1) / EXTENT_CHECK_SIZE * EXTENT_CHECK_SIZE;
+    return ChecksumFileRange(diskIo, map, file, 0, firstLength, firstCrc) &&
+        ChecksumFileRange(diskIo, map, file, lastStart, map->fileSize - lastStart, lastCrc);
+}
+
+static boolean_t ChecksumFileRange(efi_disk_io_protocol_t* diskIo, const extent_map_s* map, efi_file_handle_t* file,
+    uint64_t position, uintn_t length, uint32_t* crc)
+{
+    uint8_t fromDisk[EXTENT_CHECK_SIZE];
+    if (!ReadMappedRange(diskIo, map, position, fromDisk, length))
+    {
+        return FALSE;
+    }
+
+    if (file != NULL)
+    {
+        uint8_t fromFile[EXTENT_CHECK_SIZE];
+        uintn_t readSize = length;
+        efi_status_t status = file->SetPosition(file, position);
+        if (!EFI_ERROR(status))
+        {
+            status = file->Read(file, &readSize, fromFile);
+        }
+        if (EFI_ERROR(status) || readSize != length || memcmp(fromDisk, fromFile, length) != 0)
+        {
+            return FALSE;
+        }
+    }
+
+    *crc = Crc32c(0, fromDisk, length);
+    return TRUE;
+}
+
+// Reads the boot sector and works out where the FATs, the root directory and the clusters are
+static boolean_t OpenFatVolume(fat_volume_s* vol)
+{
+    memset(vol, 0, sizeof(fat_volume_s));
+    efi_disk_io2_protocol_t* diskIo2 = NULL;
+    if (EFI_ERROR(GetVolumeProtocols(&vol->blockIo, &vol->diskIo, &diskIo2)))
+    {
+        return FALSE;
+    }
+    vol->mediaId = vol->blockIo->Media->MediaId;
+
+    uint8_t bootSector[FAT_BOOT_SECTOR_SIZE];
+    efi_status_t status = vol->diskIo->ReadDisk(vol->diskIo, vol->mediaId, 0, sizeof(bootSector), bootSector);
+    if (EFI_ERROR(status))
+    {
+        Log(LL_WARNING, status, "Failed to read the boot sector of the boot manager's volume.");
+        return FALSE;
+    }
+
+    uint32_t bytesPerSector = ReadLe16(bootSector + 11);
+    uint32_t sectorsPerCluster = bootSector[13];
+    uint32_t reservedSectors = ReadLe16(bootSector + 14);
+    uint32_t fatCount = bootSector[16];
+    uint32_t rootEntries = ReadLe16(bootSector + 17);
+    uint64_t totalSectors = ReadLe16(bootSector + 19) != 0 ? ReadLe16(bootSector + 19) : ReadLe32(bootSector + 32);
+    uint64_t fatSectors = ReadLe16(bootSector + 22) != 0 ? ReadLe16(bootSector + 22) : ReadLe32(bootSector + 36);
+
+    uint64_t rootDirSectors = (rootEntries * FAT_DIR_ENTRY_SIZE + bytesPerSector - 1) / bytesPerSector;
+    uint64_t metadataSectors = reservedSectors + fatCount * fatSectors + rootDirSectors;
+    boolean_t valid = bootSector[510] == 0x55 && bootSector[511] == 0xAA &&
+        bytesPerSector >= 512 && bytesPerSector <= 4096 && (bytesPerSector & (bytesPerSector - 1)) == 0 &&
+        sectorsPerCluster != 0 && (sectorsPerCluster & (sectorsPerCluster - 1)) == 0 &&
+        reservedSectors != 0 && fatCount != 0 && fatSectors != 0 && totalSectors > metadataSectors;
+    if (!valid)
+    {
+        Log(LL_WARNING, 0, "The boot manager's volume doesn't have a FAT boot sector that can be mapped.");
+        return FALSE;
+    }
+
+    vol->bytesPerSector = bytesPerSector;
+    vol->clusterSize = bytesPerSector * sectorsPerCluster;
+    vol->clusterCount = (totalSectors - metadataSectors) / sectorsPerCluster;
+    vol->fatOffset = (uint64_t)reservedSectors * bytesPerSector;
+    vol->fatSize = fatSectors * bytesPerSector;
+    vol->rootDirOffset = (reservedSectors + fatCount * fatSectors) * bytesPerSector;
+    vol->rootDirSize = (uint64_t)rootEntries * FAT_DIR_ENTRY_SIZE;
+    vol->rootCluster = ReadLe32(bootSector + 44);
+    vol->dataOffset = metadataSectors * bytesPerSector;
+
+    // The type only depends on the number of clusters, and the FAT has to have an entry for each of them
+    uint64_t fatBytesNeeded = 0;
+    if (vol->clusterCount < FAT12_MAX_CLUSTERS)
+    {
+        vol->type = FAT_TYPE_12;
+        fatBytesNeeded = ((uint64_t)vol->clusterCount + FAT_FIRST_CLUSTER) * 3 / 2 + 1;
+    }
+    else if (vol->clusterCount < FAT16_MAX_CLUSTERS)
+    {
+        vol->type = FAT_TYPE_16;
+        fatBytesNeeded = ((uint64_t)vol->clusterCount + FAT_FIRST_CLUSTER) * 2;
+    }
+    else
+    {
+        vol->type = FAT_TYPE_32;
+        fatBytesNeeded = ((uint64_t)vol->clusterCount + FAT_FIRST_CLUSTER) * 4;
+    }
+    if (vol->fatSize < fatBytesNeeded || (vol->type == FAT_TYPE_32) != (rootEntries == 0))
+    {
+        Log(LL_WARNING, 0, "The FAT of the boot manager's volume is too small for its clusters.");
+        return FALSE;
+    }
+
+    vol->fatWindow = malloc(FAT_WINDOW_SIZE);
+    if (vol->fatWindow == NULL)
+    {
+        Log(LL_WARNING, 0, "Failed to allocate %d bytes for the FAT.", FAT_WINDOW_SIZE);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void CloseFatVolume(fat_volume_s* vol)
+{
+    free(vol->fatWindow);
+    vol->fatWindow = NULL;
+}
+
+// Only the first FAT is read, the others are copies of it
+static boolean_t ReadFatEntry(fat_volume_s* vol, uint32_t cluster, uint32_t* next)
+{
+    uint64_t offset = 0;
+    uint32_t entrySize = 0;
+    switch (vol->type)
+    {
+    case FAT_TYPE_12:
+        // Entries are 12 bits, two of them share 3 bytes
+        offset = (uint64_t)cluster + cluster / 2;
+        entrySize = 2;
+        break;
+    case FAT_TYPE_16:
+        offset = (uint64_t)cluster * 2;
+        entrySize = 2;
+        break;
+    case FAT_TYPE_32:
+        offset = (uint64_t)cluster * 4;
+        entrySize = 4;
+        break;
+    }
+
+    if (offset < vol->fatWindowStart || offset + entrySize > vol->fatWindowStart + vol->fatWindowSize)
+    {
+        uint64_t start = offset / vol->bytesPerSector * vol->bytesPerSector;
+        uint64_t size = vol->fatSize - start < FAT_WINDOW_SIZE ? vol->fatSize - start : FAT_WINDOW_SIZE;
+        efi_status_t status = vol->diskIo->ReadDisk(vol->diskIo, vol->mediaId, vol->fatOffset + start, size,
+            vol->fatWindow);
+        if (EFI_ERROR(status))
+        {
+            Log(LL_WARNING, status, "Failed to read the FAT of the boot manager's volume.");
+            vol->fatWindowSize = 0;
+            return FALSE;
+        }
+        vol->fatWindowStart = start;
+        vol->fatWindowSize = size;
+    }
+
+    const uint8_t* entry = vol->fatWindow + (offset - vol->fatWindowStart);
+    switch (vol->type)
+    {
+    case FAT_TYPE_12:
+        *next = (cluster & 1) ? ReadLe16(entry) >> 4 : ReadLe16(entry) & 0xFFF;
+        break;
+    case FAT_TYPE_16:
+        *next = ReadLe16(entry);
+        break;
+    case FAT_TYPE_32:
+        // The top 4 bits are reserved
+        *next = ReadLe32(entry) & 0x0FFFFFFF;
+        break;
+    }
+    return TRUE;
+}
+
+static boolean_t IsEndOfChain(fat_volume_s* vol, uint32_t cluster)
+{
+    switch (vol->type)
+    {
+    case FAT_TYPE_12:
+        return cluster >= 0xFF8;
+    case FAT_TYPE_16:
+        return cluster >= 0xFFF8;
+    default:
+        return cluster >= 0x0FFFFFF8;
+    }
+}
+
+// Follows a cluster chain and merges the clusters that follow each other on the disk into extents
+// A file is mapped up to byteCount bytes, a directory (byteCount 0) up to the end of its chain
+// A chain that points outside the volume or is shorter than the file means the volume is damaged
+static boolean_t MapClusterChain(fat_volume_s* vol, uint32_t cluster, uint64_t byteCount, file_extent_s* extents,
+    uint32_t* extentCount, uint64_t* mappedSize)
+{
+    uint64_t limit = byteCount != 0 ? byteCount : FAT_MAX_DIR_SIZE;
+    uint64_t mapped = 0;
+    uint32_t count = 0;
+    while (mapped < limit)
+    {
+        if (cluster < FAT_FIRST_CLUSTER || cluster - FAT_FIRST_CLUSTER >= vol->clusterCount)
+        {
+            return FALSE;
+        }
+
+        uint64_t offset = vol->dataOffset + (uint64_t)(cluster - FAT_FIRST_CLUSTER) * vol->clusterSize;
+        if (count > 0 && extents[count - 1].offset + extents[count - 1].length == offset)
+        {
+            extents[count - 1].length += vol->clusterSize;
+        }
+        else if (count < MAX_FILE_EXTENTS)
+        {
+            extents[count].offset = offset;
+            extents[count].length = vol->clusterSize;
+            count++;
+        }
+        else
+        {
+            // Too fragmented
+            return FALSE;
+        }
+        mapped += vol->clusterSize;
+
+        uint32_t next = 0;
+        if (mapped < limit && !ReadFatEntry(vol, cluster, &next))
+        {
+            return FALSE;
+        }
+        if (mapped < limit && IsEndOfChain(vol, next))
+        {
+            if (byteCount != 0)
+            {
+                return FALSE;
+            }
+            break;
+        }
+        cluster = next;
+    }
+
+    // The last cluster of a file is usually only partly used
+    if (byteCount != 0)
+    {
+        extents[count - 1].length -= mapped - byteCount;
+        mapped = byteCount;
+    }
+    *extentCount = count;
+    *mappedSize = mapped;
+    return TRUE;
+}
+
+// Walks the directories of the path from the root, the path can start with a separator or without one
+static boolean_t FindFatFile(fat_volume_s* vol, const char_t* path, uint32_t* firstCluster, uint64_t* fileSize)
+{
+    wchar_t* widePath = StringToWideString((char_t*)path);
+    if (widePath == NULL)
+    {
+        return FALSE;
+    }
+
+    file_extent_s dirExtents[MAX_FILE_EXTENTS];
+    uint32_t dirExtentCount = 1;
+    uint64_t dirSize = vol->rootDirSize;
+    dirExtents[0].offset = vol->rootDirOffset;
+    dirExtents[0].length = vol->rootDirSize;
+    boolean_t found = vol->type != FAT_TYPE_32 ||
+        MapClusterChain(vol, vol->rootCluster, 0, dirExtents, &dirExtentCount, &dirSize);
+
+    wchar_t* component = widePath;
+    while (found)
+    {
+        found = FALSE;
+        while (IsPathSeparator(*component))
+        {
+            component++;
+        }
+        uintn_t len = 0;
+        while (component[len] != 0 && !IsPathSeparator(component[len]))
+        {
+            len++;
+        }
+        wchar_t* rest = component + len;
+        while (IsPathSeparator(*rest))
+        {
+            rest++;
+        }
+        if (len == 0)
+        {
+            // The path ends with a directory
+            break;
+        }
+        if (len == 1 && component[0] == L'.')
+        {
+            component = rest;
+            found = TRUE;
+            continue;
+        }
+
+        uint8_t entry[FAT_DIR_ENTRY_SIZE];
+        uint8_t* dir = ReadDirectory(vol, dirExtents, dirExtentCount, dirSize);
+        boolean_t exists = dir != NULL && FindDirEntry(dir, dirSize, component, len, entry);
+        free(dir);
+        if (!exists)
+        {
+            break;
+        }
+
+        uint32_t cluster = ReadLe16(entry + 26);
+        if (vol->type == FAT_TYPE_32)
+        {
+            cluster |= (uint32_t)ReadLe16(entry + 20) << 16;
+        }
+        boolean_t isDirectory = (entry[11] & FAT_ATTR_DIRECTORY) != 0;
+        if (*rest == 0)
+        {
+            found = !isDirectory;
+            *firstCluster = cluster;
+            *fileSize = ReadLe32(entry + 28);
+            break;
+        }
+
+        found = isDirectory && MapClusterChain(vol, cluster, 0, dirExtents, &dirExtentCount, &dirSize);
+        component = rest;
+    }
+
+    free(widePath);
+    return found;
+}
+
+static uint8_t* ReadDirectory(fat_volume_s* vol, const file_extent_s* extents, uint32_t extentCount, uint64_t size)
+{
+    uint8_t* dir = malloc(size);
+    if (dir == NULL)
+    {
+        return NULL;
+    }
+
+    uint64_t position = 0;
+    for (uint32_t i = 0; i < extentCount; i++)
+    {
+        efi_status_t status = vol->diskIo->ReadDisk(vol->diskIo, vol->mediaId, extents[i].offset,
+            extents[i].length, dir + position);
+        if (EFI_ERROR(status))
+        {
+            Log(LL_WARNING, status, "Failed to read a directory of the boot manager's volume.");
+            free(dir);
+            return NULL;
+        }
+        position += extents[i].length;
+    }
+    return dir;
+}
+
+// Looks for a name in a directory, it is compared with the long name and the 8.3 name of every entry, ignoring case
+// The long name is stored in entries before the short one, the last part first, and they all carry its checksum
+static boolean_t FindDirEntry(const uint8_t* dir, uint64_t dirSize, const wchar_t* name, uintn_t nameLen,
+    uint8_t entry[FAT_DIR_ENTRY_SIZE])
+{
+    // Where the 13 characters of a long name entry are
+    static const uint8_t lfnCharOffsets[FAT_LFN_CHARS] = { 1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30 };
+
+    wchar_t longName[FAT_LFN_CHARS * FAT_LFN_MAX_ENTRIES + 1];
+    boolean_t hasLongName = FALSE;
+    uint8_t longNameChecksum = 0;
+    uint32_t longNameSeq = 0;
+
+    for (uint64_t offset = 0; offset + FAT_DIR_ENTRY_SIZE <= dirSize; offset += FAT_DIR_ENTRY_SIZE)
+    {
+        const uint8_t* current = dir + offset;
+        if (current[0] == FAT_ENTRY_END)
+        {
+            break;
+        }
+        if (current[0] == FAT_ENTRY_FREE)
+        {
+            hasLongName = FALSE;
+            continue;
+        }
+
+        if ((current[11] & FAT_ATTR_MASK) == FAT_ATTR_LFN)
+        {
+            // Every part of a long name is numbered from 1, a damaged entry must not be written outside the buffer
+            uint32_t seq = current[0] & FAT_LFN_SEQ_MASK;
+            boolean_t validSeq = seq >= 1 && seq <= FAT_LFN_MAX_ENTRIES;
+            if (current[0] & FAT_LFN_LAST)
+            {
+                hasLongName = validSeq;
+                longNameChecksum = current[13];
+                if (hasLongName)
+                {
+                    longName[seq * FAT_LFN_CHARS] = 0;
+                }
+            }
+            else
+            {
+                hasLongName = hasLongName && validSeq && seq + 1 == longNameSeq && current[13] == longNameChecksum;
+            }
+            longNameSeq = seq;
+
+            for (uint32_t i = 0; hasLongName && i < FAT_LFN_CHARS; i++)
+            {
+                uint32_t index = (seq - 1) * FAT_LFN_CHARS + i;
+                if (index >= FAT_LFN_CHARS * FAT_LFN_MAX_ENTRIES)
+                {
+                    hasLongName = FALSE;
+                    break;
+                }
+                longName[index] = ReadLe16(current + lfnCharOffsets[i]);
+            }
+            continue;
+        }
+
+        if (current[11] & FAT_ATTR_VOLUME_ID)
+        {
+            hasLongName = FALSE;
+            continue;
+        }
+
+        wchar_t shortName[FAT_SHORT_NAME_LEN + 2];
+        GetShortName(current, shortName);
+        boolean_t matches = NameEquals(shortName, name, nameLen) ||
+            (hasLongName && longNameSeq == 1 && longNameChecksum == ShortNameChecksum(current) &&
+            NameEquals(longName, name, nameLen));
+        hasLongName = FALSE;
+        if (matches)
+        {
+            memcpy(entry, current, FAT_DIR_ENTRY_SIZE);
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+// The 8.3 name is padded with spaces, and the dot isn't stored
+static void GetShortName(const uint8_t* entry, wchar_t name[FAT_SHORT_NAME_LEN + 2])
+{
+    uintn_t len = 0;
+    for (uintn_t i = 0; i < 8 && entry[i] != ' '; i++)
+    {
+        name[len++] = (i == 0 && entry[i] == FAT_ENTRY_ESCAPED_E5) ? FAT_ENTRY_FREE : entry[i];
+    }
+    if (entry[8] != ' ')
+    {
+        name[len++] = L'.';
+        for (uintn_t i = 8; i < FAT_SHORT_NAME_LEN && entry[i] != ' '; i++)
+        {
+            name[len++] = entry[i];
+        }
+    }
+    name[len] = 0;
+}
+
+static uint8_t ShortNameChecksum(const uint8_t* entry)
+{
+    uint8_t sum = 0;
+    for (uintn_t i = 0; i < FAT_SHORT_NAME_LEN; i++)
+    {
+        sum = ((sum & 1) << 7) + (sum >> 1) + entry[i];
+    }
+    return sum;
+}
+
+// Only ASCII letters are compared without case
+static boolean_t NameEquals(const wchar_t* name, const wchar_t* other, uintn_t otherLen)
+{
+    for (uintn_t i = 0; i < otherLen; i++)
+    {
+        wchar_t a = name[i];
+        wchar_t b = other[i];
+        if (a >= L'a' && a <= L'z')
+        {
+            a -= L'a' - L'A';
+        }
+        if (b >= L'a' && b <= L'z')
+        {
+            b -= L'a' - L'A';
+        }
+        if (a != b || a == 0)
+        {
+            return FALSE;
+        }
+    }
+    return name[otherLen] == 0;
+}
+
+static inline boolean_t IsPathSeparator(wchar_t c)
+{
+    return c == L'\\' || c == L'/';
+}
+
+static inline uint16_t ReadLe16(const uint8_t* p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t ReadLe32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
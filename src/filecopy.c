@@ -0,0 +1,208 @@
+#include "filecopy.h"
+#include "bootutils.h"
+#include "shellerr.h"
+#include "logger.h"
+#include "clock.h"
+
+// The copy buffer is sized after the file, within these limits
+#define COPY_MIN_BUFFER_SIZE (64 * 1024)
+#define COPY_MAX_BUFFER_SIZE (4 * 1024 * 1024)
+// Smaller files are copied too quickly for a progress indicator to be useful
+#define COPY_PROGRESS_MIN_SIZE (1024 * 1024)
+
+#define BYTES_IN_KIB (1024)
+
+typedef struct copy_buffer_s
+{
+    uint8_t* data;
+    uintn_t size;
+} copy_buffer_s;
+
+static boolean_t AllocateCopyBuffer(copy_buffer_s* buffer, uint64_t fileSize);
+static void FreeCopyBuffer(copy_buffer_s* buffer);
+static int32_t VerifyCopy(FILE* destFP, copy_buffer_s* buffer, const uint32_t* chunkCrcs, uint64_t fileSize);
+static void PrintCopyProgress(uint64_t copied, uint64_t total);
+static void PrintCopySummary(uint64_t bytes, uint64_t microseconds);
+
+
+// Copies a file through a page aligned buffer of up to COPY_MAX_BUFFER_SIZE bytes,
+// so even large kernels and initrds only take a few firmware calls
+// Returns 0 on success, otherwise an error code that can be passed to PrintCommandError
+int32_t CopyFileEx(const char_t* src, const char_t* dest, uint32_t flags)
+{
+    FILE* srcFP = fopen(src, "r");
+    if (srcFP == NULL)
+    {
+        return errno;
+    }
+    FILE* destFP = fopen(dest, "w");
+    if (destFP == NULL)
+    {
+        fclose(srcFP);
+        return errno;
+    }
+
+    int32_t res = CopyFileStreams(srcFP, destFP, flags);
+    fclose(destFP);
+    fclose(srcFP);
+    return res;
+}
+
+// Same as CopyFileEx, for files that are already open. destFP must be opened for writing and reading
+// The streams are left open
+int32_t CopyFileStreams(FILE* srcFP, FILE* destFP, uint32_t flags)
+{
+    int32_t res = CMD_SUCCESS;
+    uint32_t* chunkCrcs = NULL;
+    uint64_t srcSize = GetFileSize(srcFP);
+
+    copy_buffer_s buffer = {0};
+    if (!AllocateCopyBuffer(&buffer, srcSize))
+    {
+        res = CMD_OUT_OF_MEMORY;
+        goto cleanup;
+    }
+
+    // The checksum of every chunk is kept, the firmware can't continue a CRC across buffers
+    uint64_t chunkCount = (srcSize + buffer.size - 1) / buffer.size;
+    if ((flags & COPY_VERIFY) && chunkCount != 0)
+    {
+        chunkCrcs = malloc(chunkCount * sizeof(uint32_t));
+        if (chunkCrcs == NULL)
+        {
+            res = CMD_OUT_OF_MEMORY;
+            goto cleanup;
+        }
+    }
+
+    boolean_t showProgress = (flags & COPY_SHOW_PROGRESS) && srcSize >= COPY_PROGRESS_MIN_SIZE;
+    uint64_t startTime = GetMicrosecondsSinceInit();
+
+    for (uint64_t i = 0, chunk = 0; i < srcSize; i += buffer.size, chunk++)
+    {
+        uintn_t bytesToCopy = srcSize - i < buffer.size ? srcSize - i : buffer.size;
+        if (fread(buffer.data, 1, bytesToCopy, srcFP) != bytesToCopy ||
+            fwrite(buffer.data, 1, bytesToCopy, destFP) != bytesToCopy)
+        {
+            // errno may change here after each call if there is no more space left on disk
+            res = errno != 0 ? errno : EIO;
+            Log(LL_ERROR, 0, "Error during file copy: %s", GetCommandErrorInfo(res));
+            goto cleanup;
+        }
+
+        if (chunkCrcs != NULL)
+        {
+            BS->CalculateCrc32(buffer.data, bytesToCopy, &chunkCrcs[chunk]);
+        }
+        if (showProgress)
+        {
+            PrintCopyProgress(i + bytesToCopy, srcSize);
+        }
+    }
+
+    if (showProgress)
+    {
+        PrintCopySummary(srcSize, GetMicrosecondsSinceInit() - startTime);
+    }
+    if (chunkCrcs != NULL)
+    {
+        res = VerifyCopy(destFP, &buffer, chunkCrcs, srcSize);
+    }
+
+cleanup:
+    free(chunkCrcs);
+    FreeCopyBuffer(&buffer);
+    return res;
+}
+
+// Allocates a buffer that fits the whole file if possible, halving it while the pages can't be allocated
+static boolean_t AllocateCopyBuffer(copy_buffer_s* buffer, uint64_t fileSize)
+{
+    uint64_t size = fileSize < COPY_MAX_BUFFER_SIZE ? fileSize : COPY_MAX_BUFFER_SIZE;
+    size = EFI_SIZE_TO_PAGES(size) * EFI_PAGE_SIZE;
+    if (size == 0)
+    {
+        size = EFI_PAGE_SIZE;
+    }
+
+    while (TRUE)
+    {
+        efi_physical_address_t addr = 0;
+        efi_status_t status = BS->AllocatePages(AllocateAnyPages, EfiLoaderData, EFI_SIZE_TO_PAGES(size), &addr);
+        if (!EFI_ERROR(status))
+        {
+            buffer->data = (uint8_t*)addr;
+            buffer->size = size;
+            return TRUE;
+        }
+
+        if (size <= COPY_MIN_BUFFER_SIZE)
+        {
+            Log(LL_ERROR, status, "Failed to allocate a %d bytes copy buffer.", size);
+            return FALSE;
+        }
+        size /= 2;
+    }
+}
+
+static void FreeCopyBuffer(copy_buffer_s* buffer)
+{
+    if (buffer->data != NULL)
+    {
+        BS->FreePages((efi_physical_address_t)buffer->data, EFI_SIZE_TO_PAGES(buffer->size));
+    }
+}
+
+// Reads the copy back with the same chunk size and compares the checksum of every chunk
+static int32_t VerifyCopy(FILE* fp, copy_buffer_s* buffer, const uint32_t* chunkCrcs, uint64_t fileSize)
+{
+    // The copy is flushed first so it is read back from the file system
+    if (!fflush(fp) || fseek(fp, 0, SEEK_SET) != 0)
+    {
+        return errno != 0 ? errno : EIO;
+    }
+
+    int32_t res = CMD_SUCCESS;
+    if (GetFileSize(fp) != fileSize)
+    {
+        res = CMD_VERIFY_FAIL;
+    }
+
+    for (uint64_t i = 0, chunk = 0; i < fileSize && res == CMD_SUCCESS; i += buffer->size, chunk++)
+    {
+        uintn_t bytesToRead = fileSize - i < buffer->size ? fileSize - i : buffer->size;
+        if (fread(buffer->data, 1, bytesToRead, fp) != bytesToRead)
+        {
+            res = errno != 0 ? errno : EIO;
+            break;
+        }
+
+        uint32_t crc = 0;
+        BS->CalculateCrc32(buffer->data, bytesToRead, &crc);
+        if (crc != chunkCrcs[chunk])
+        {
+            res = CMD_VERIFY_FAIL;
+        }
+    }
+
+    if (res == CMD_VERIFY_FAIL)
+    {
+        Log(LL_ERROR, 0, "A copy of %d bytes doesn't match its source.", fileSize);
+    }
+    return res;
+}
+
+static void PrintCopyProgress(uint64_t copied, uint64_t total)
+{
+    printf("\r%d%% (%d/%d KiB)", copied * 100 / total, copied / BYTES_IN_KIB, total / BYTES_IN_KIB);
+}
+
+static void PrintCopySummary(uint64_t bytes, uint64_t microseconds)
+{
+    if (microseconds == 0)
+    {
+        microseconds = 1;
+    }
+    printf("\rCopied %d KiB in %d ms (%d KiB/s)\n", bytes / BYTES_IN_KIB,
+        microseconds / US_IN_MILLISECOND, bytes * US_IN_SECOND / microseconds / BYTES_IN_KIB);
+}
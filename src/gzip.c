@@ -0,0 +1,821 @@
+#include "gzip.h"
+#include "bootutils.h"
+#include "hash.h"
+
+#define GZIP_ID1            (0x1f)
+#define GZIP_ID2            (0x8b)
+#define GZIP_METHOD_DEFLATE (8)
+#define GZIP_FIXED_FIELDS   (6) // The modification time, the extra flags and the OS after the flags byte
+
+#define GZIP_FLAG_HCRC      (1 << 1)
+#define GZIP_FLAG_EXTRA     (1 << 2)
+#define GZIP_FLAG_NAME      (1 << 3)
+#define GZIP_FLAG_COMMENT   (1 << 4)
+#define GZIP_FLAG_RESERVED  (0xe0)
+
+#define BLOCK_STORED  (0)
+#define BLOCK_FIXED   (1)
+#define BLOCK_DYNAMIC (2)
+
+#define MAX_CODE_LENGTH     (15)
+// Codes up to this length are decoded with a single table lookup, the longer ones are rare
+#define FAST_BITS           (10)
+#define FAST_MASK           ((1 << FAST_BITS) - 1)
+#define LITLEN_SYMBOLS      (288)
+#define CODE_LENGTH_SYMBOLS (19)
+#define MAX_LITLEN_CODES    (286)
+#define MAX_DIST_CODES      (30)
+#define END_OF_BLOCK        (256)
+// A literal/length code with its extra bits and a distance code with its extra bits
+#define MAX_SEQUENCE_BITS   (15 + 5 + 15 + 13)
+// A code length code with its extra bits
+#define MAX_LENGTH_CODE_BITS (7 + 7)
+// Matches are copied 8 bytes at a time, so they can write this far past their end
+#define COPY_SLACK          (8)
+
+typedef enum gzip_state_t
+{
+    GZIP_MEMBER_HEADER,
+    GZIP_HEADER_FIELDS, // Picks the next optional field from the flags
+    GZIP_EXTRA_LENGTH,
+    GZIP_SKIP_BYTES,
+    GZIP_SKIP_STRING,
+    BLOCK_HEADER,
+    STORED_LENGTH,
+    STORED_COPY,
+    TABLE_COUNTS,
+    TABLE_CODE_LENGTHS,
+    TABLE_LENGTHS,
+    BLOCK_DATA,
+    GZIP_TRAILER_CRC,
+    GZIP_TRAILER_SIZE,
+    GZIP_NEXT_MEMBER,
+    GZIP_DONE,
+} gzip_state_t;
+
+// A canonical Huffman code, deflate sends the bits of its codes in reverse
+typedef struct huffman_s
+{
+    uint16_t fast[1 << FAST_BITS]; // The symbol shifted left by 4 and the code length, 0 for longer codes
+    uint16_t counts[MAX_CODE_LENGTH + 1]; // The number of codes of every length
+    uint16_t symbols[LITLEN_SYMBOLS]; // In the order of their codes
+} huffman_s;
+
+// Everything is kept between the chunks, a chunk can end anywhere, even in the middle of a code
+typedef struct gzip_s
+{
+    gzip_state_t state;
+
+    const uint8_t* next;
+    const uint8_t* end;
+    boolean_t last; // No input comes after the current chunk
+    uint64_t bits; // Read from the low end, the bits above bitCount are 0 or the bytes after next
+    uint32_t bitCount;
+    uint32_t paddingBits; // Zeros that were added after the end of the input, a valid stream never uses them
+
+    uint32_t flags;
+    uint32_t remaining; // Header bytes to skip or stored bytes to copy
+    boolean_t lastBlock;
+
+    uint32_t litLenCount;
+    uint32_t distCount;
+    uint32_t codeLengthCount;
+    uint32_t lengthIndex;
+    uint8_t lengths[MAX_LITLEN_CODES + MAX_DIST_CODES];
+    huffman_s codeLengthCodes;
+    huffman_s litLen;
+    huffman_s dist;
+
+    uint64_t memberStart; // Where the output of the current member starts
+    uint64_t crcDone; // How much of the member's output the CRC covers
+    uint32_t crc;
+    uint32_t expectedCrc;
+} gzip_s;
+
+static boolean_t InflateStep(gzip_s* g, decompress_s* dec);
+static boolean_t InflateBlockData(gzip_s* g, decompress_s* dec);
+static boolean_t ReadDynamicLengths(gzip_s* g, decompress_s* dec);
+static void StartMember(gzip_s* g, decompress_s* dec);
+static void UpdateCrc(gzip_s* g, decompress_s* dec);
+static void FillBits(gzip_s* g);
+static boolean_t EnsureBits(gzip_s* g, uint32_t count);
+static uint32_t GetBits(gzip_s* g, uint32_t count);
+static uint32_t RealBits(gzip_s* g);
+static boolean_t BuildHuffman(huffman_s* h, const uint8_t* lengths, uint32_t count);
+static int32_t DecodeSlow(const huffman_s* h, uint64_t* bits, uint32_t* bitCount);
+static int32_t DecodeSymbol(const huffman_s* h, uint64_t* bits, uint32_t* bitCount);
+static uint32_t ReverseBits(uint32_t code, uint32_t length);
+
+static const uint16_t lengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t lengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t distBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t distExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+// The order the code lengths of the code length code are sent in
+static const uint8_t codeLengthOrder[CODE_LENGTH_SYMBOLS] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+
+void* GzipCreate(void)
+{
+    gzip_s* g = malloc(sizeof(gzip_s));
+    if (g == NULL)
+    {
+        return NULL;
+    }
+    memset(g, 0, sizeof(gzip_s));
+    g->state = GZIP_MEMBER_HEADER;
+    return g;
+}
+
+void GzipDestroy(void* state)
+{
+    free(state);
+}
+
+// Decodes as much of the chunk as it can, a code that continues in the next chunk is kept in the bit buffer
+efi_status_t GzipDecode(decompress_s* dec, const uint8_t* data, uintn_t length, boolean_t last)
+{
+    gzip_s* g = dec->state;
+    g->next = data;
+    g->end = data + length;
+    g->last = last;
+
+    while (!EFI_ERROR(dec->status) && InflateStep(g, dec));
+
+    // The CRC of the new output is calculated while the next chunk is being read
+    UpdateCrc(g, dec);
+    if (last && !EFI_ERROR(dec->status) && g->state != GZIP_DONE)
+    {
+        DecompressFail(dec, EFI_END_OF_FILE, "The gzip stream is truncated.");
+    }
+    return dec->status;
+}
+
+// The size of the last member is in the trailer, it is the whole size unless the file has more members
+// or is larger than 4 GiB
+uint64_t GzipSizeHint(const uint8_t* header, uintn_t headerLength, const uint8_t trailer[COMPRESSION_TRAILER_SIZE])
+{
+    return (uint64_t)trailer[0] | ((uint64_t)trailer[1] << 8) | ((uint64_t)trailer[2] << 16) | ((uint64_t)trailer[3] << 24);
+}
+
+// Returns FALSE when the chunk is used up or the stream is done
+static boolean_t InflateStep(gzip_s* g, decompress_s* dec)
+{
+    switch (g->state)
+    {
+        case GZIP_MEMBER_HEADER:
+        {
+            if (!EnsureBits(g, 32))
+            {
+                return FALSE;
+            }
+            uint32_t id1 = GetBits(g, 8);
+            uint32_t id2 = GetBits(g, 8);
+            uint32_t method = GetBits(g, 8);
+            g->flags = GetBits(g, 8);
+            if (id1 != GZIP_ID1 || id2 != GZIP_ID2 || method != GZIP_METHOD_DEFLATE || (g->flags & GZIP_FLAG_RESERVED) != 0)
+            {
+                DecompressFail(dec, EFI_COMPROMISED_DATA, "Invalid gzip header.");
+                return FALSE;
+            }
+            StartMember(g, dec);
+            g->remaining = GZIP_FIXED_FIELDS;
+            g->state = GZIP_SKIP_BYTES;
+            return TRUE;
+        }
+
+        case GZIP_HEADER_FIELDS:
+            // The optional fields are in this order, every flag is cleared once its field is skipped
+            if (g->flags & GZIP_FLAG_EXTRA)
+            {
+                g->flags &= ~GZIP_FLAG_EXTRA;
+                g->state = GZIP_EXTRA_LENGTH;
+            }
+            else if (g->flags & GZIP_FLAG_NAME)
+            {
+                g->flags &= ~GZIP_FLAG_NAME;
+                g->state = GZIP_SKIP_STRING;
+            }
+            else if (g->flags & GZIP_FLAG_COMMENT)
+            {
+                g->flags &= ~GZIP_FLAG_COMMENT;
+                g->state = GZIP_SKIP_STRING;
+            }
+            else if (g->flags & GZIP_FLAG_HCRC)
+            {
+                g->flags &= ~GZIP_FLAG_HCRC;
+                g->remaining = 2;
+                g->state = GZIP_SKIP_BYTES;
+            }
+            else
+            {
+                g->state = BLOCK_HEADER;
+            }
+            return TRUE;
+
+        case GZIP_EXTRA_LENGTH:
+            if (!EnsureBits(g, 16))
+            {
+                return FALSE;
+            }
+            g->remaining = GetBits(g, 16);
+            g->state = GZIP_SKIP_BYTES;
+            return TRUE;
+
+        case GZIP_SKIP_BYTES:
+            for (; g->remaining > 0; g->remaining--)
+            {
+                if (!EnsureBits(g, 8))
+                {
+                    return FALSE;
+                }
+                GetBits(g, 8);
+            }
+            g->state = GZIP_HEADER_FIELDS;
+            return TRUE;
+
+        case GZIP_SKIP_STRING:
+            do
+            {
+                if (!EnsureBits(g, 8))
+                {
+                    return FALSE;
+                }
+            } while (GetBits(g, 8) != 0);
+            g->state = GZIP_HEADER_FIELDS;
+            return TRUE;
+
+        case BLOCK_HEADER:
+        {
+            if (!EnsureBits(g, 3))
+            {
+                return FALSE;
+            }
+            g->lastBlock = GetBits(g, 1);
+            uint32_t type = GetBits(g, 2);
+            if (type == BLOCK_STORED)
+            {
+                g->state = STORED_LENGTH;
+            }
+            else if (type == BLOCK_FIXED)
+            {
+                uint8_t lengths[LITLEN_SYMBOLS];
+                memset(lengths, 8, 144);
+                memset(lengths + 144, 9, 256 - 144);
+                memset(lengths + 256, 7, 280 - 256);
+                memset(lengths + 280, 8, LITLEN_SYMBOLS - 280);
+                BuildHuffman(&g->litLen, lengths, LITLEN_SYMBOLS);
+                memset(lengths, 5, MAX_DIST_CODES);
+                BuildHuffman(&g->dist, lengths, MAX_DIST_CODES);
+                g->state = BLOCK_DATA;
+            }
+            else if (type == BLOCK_DYNAMIC)
+            {
+                g->state = TABLE_COUNTS;
+            }
+            else
+            {
+                DecompressFail(dec, EFI_COMPROMISED_DATA, "Invalid deflate block type.");
+                return FALSE;
+            }
+            return TRUE;
+        }
+
+        case STORED_LENGTH:
+        {
+            // The lengths start at the next byte
+            GetBits(g, g->bitCount % 8);
+            if (!EnsureBits(g, 32))
+            {
+                return FALSE;
+            }
+            uint32_t length = GetBits(g, 16);
+            if ((GetBits(g, 16) ^ 0xffff) != length)
+            {
+                DecompressFail(dec, EFI_COMPROMISED_DATA, "Invalid stored deflate block length.");
+                return FALSE;
+            }
+            g->remaining = length;
+            g->state = STORED_COPY;
+            return TRUE;
+        }
+
+        case STORED_COPY:
+        {
+            if (!DecompressReserve(dec, g->remaining))
+            {
+                return FALSE;
+            }
+            // The bit buffer holds whole bytes now, they come before the rest of the chunk
+            while (g->remaining > 0 && RealBits(g) >= 8 && g->bitCount >= 8)
+            {
+                dec->output[dec->outputSize++] = (uint8_t)GetBits(g, 8);
+                g->remaining--;
+            }
+            if (g->remaining == 0)
+            {
+                g->state = g->lastBlock ? GZIP_TRAILER_CRC : BLOCK_HEADER;
+                return TRUE;
+            }
+            // The bit buffer is empty, the bytes after next it may still hold are copied from the chunk instead
+            g->bits = 0;
+            uintn_t available = g->end - g->next;
+            uintn_t length = g->remaining < available ? g->remaining : available;
+            memcpy(dec->output + dec->outputSize, g->next, length);
+            dec->outputSize += length;
+            g->next += length;
+            g->remaining -= length;
+            if (g->remaining > 0)
+            {
+                return FALSE;
+            }
+            g->state = g->lastBlock ? GZIP_TRAILER_CRC : BLOCK_HEADER;
+            return TRUE;
+        }
+
+        case TABLE_COUNTS:
+            if (!EnsureBits(g, 14))
+            {
+                return FALSE;
+            }
+            g->litLenCount = GetBits(g, 5) + 257;
+            g->distCount = GetBits(g, 5) + 1;
+            g->codeLengthCount = GetBits(g, 4) + 4;
+            if (g->litLenCount > MAX_LITLEN_CODES || g->distCount > MAX_DIST_CODES)
+            {
+                DecompressFail(dec, EFI_COMPROMISED_DATA, "Invalid deflate code counts.");
+                return FALSE;
+            }
+            memset(g->lengths, 0, CODE_LENGTH_SYMBOLS);
+            g->lengthIndex = 0;
+            g->state = TABLE_CODE_LENGTHS;
+            return TRUE;
+
+        case TABLE_CODE_LENGTHS:
+            for (; g->lengthIndex < g->codeLengthCount; g->lengthIndex++)
+            {
+                if (!EnsureBits(g, 3))
+                {
+                    return FALSE;
+                }
+                g->lengths[codeLengthOrder[g->lengthIndex]] = (uint8_t)GetBits(g, 3);
+            }
+            if (!BuildHuffman(&g->codeLengthCodes, g->lengths, CODE_LENGTH_SYMBOLS))
+            {
+                DecompressFail(dec, EFI_COMPROMISED_DATA, "Invalid deflate code length code.");
+                return FALSE;
+            }
+            g->lengthIndex = 0;
+            g->state = TABLE_LENGTHS;
+            return TRUE;
+
+        case TABLE_LENGTHS:
+            if (!ReadDynamicLengths(g, dec))
+            {
+                return FALSE;
+            }
+            g->state = BLOCK_DATA;
+            return TRUE;
+
+        case BLOCK_DATA:
+            return InflateBlockData(g, dec);
+
+        case GZIP_TRAILER_CRC:
+            GetBits(g, g->bitCount % 8);
+            if (!EnsureBits(g, 32))
+            {
+                return FALSE;
+            }
+            g->expectedCrc = GetBits(g, 32);
+            g->state = GZIP_TRAILER_SIZE;
+            return TRUE;
+
+        case GZIP_TRAILER_SIZE:
+        {
+            if (!EnsureBits(g, 32))
+            {
+                return FALSE;
+            }
+            uint32_t size = GetBits(g, 32);
+            if (g->paddingBits > g->bitCount)
+            {
+                DecompressFail(dec, EFI_END_OF_FILE, "The gzip stream is truncated.");
+                return FALSE;
+            }
+            UpdateCrc(g, dec);
+            if (g->crc != g->expectedCrc || size != (uint32_t)(dec->outputSize - g->memberStart))
+            {
+                DecompressFail(dec, EFI_CRC_ERROR, "The gzip CRC or size doesn't match the data.");
+                return FALSE;
+            }
+            g->state = GZIP_NEXT_MEMBER;
+            return TRUE;
+        }
+
+        case GZIP_NEXT_MEMBER:
+        {
+            // Another member may follow, otherwise only padding may be left
+            FillBits(g);
+            uint32_t realBits = RealBits(g);
+            if (realBits < 16 && !g->last)
+            {
+                return FALSE;
+            }
+            if (realBits >= 16 && (g->bits & 0xffff) == (GZIP_ID1 | (GZIP_ID2 << 8)))
+            {
+                g->state = GZIP_MEMBER_HEADER;
+                return TRUE;
+            }
+            g->state = GZIP_DONE;
+            return TRUE;
+        }
+
+        case GZIP_DONE:
+        {
+            // The padding must be zeros, other data would be left out of the output without a word,
+            // like an uncompressed cpio that is appended to a gzip initrd
+            // The bit buffer only holds bytes that come after the stream
+            boolean_t zeros = g->bits == 0;
+            for (; zeros && g->next < g->end; g->next++)
+            {
+                zeros = *g->next == 0;
+            }
+            if (!zeros)
+            {
+                DecompressFail(dec, EFI_COMPROMISED_DATA, "The gzip stream is followed by data that isn't zero padding.");
+            }
+            g->bits = 0;
+            return FALSE;
+        }
+    }
+    return FALSE;
+}
+
+// The hot loop keeps the bit buffer and the output position in locals
+static boolean_t InflateBlockData(gzip_s* g, decompress_s* dec)
+{
+    uint64_t bits = g->bits;
+    uint32_t bitCount = g->bitCount;
+    uint8_t* out = dec->output;
+    uint64_t pos = dec->outputSize;
+    uint64_t capacity = dec->outputCapacity;
+    boolean_t progress = TRUE;
+
+    while (TRUE)
+    {
+        if (bitCount < MAX_SEQUENCE_BITS && g->end - g->next >= 8)
+        {
+            // Loads 8 bytes and keeps as many of them as fit, the rest are loaded again next time
+            uint64_t word;
+            memcpy(&word, g->next, sizeof(word));
+            bits |= word << bitCount;
+            g->next += (63 - bitCount) >> 3;
+            bitCount |= 56;
+        }
+        else if (bitCount < MAX_SEQUENCE_BITS)
+        {
+            // A code that used the zeros after the end of the input means the stream was cut short
+            if (bitCount < g->paddingBits)
+            {
+                DecompressFail(dec, EFI_END_OF_FILE, "The gzip stream is truncated.");
+                progress = FALSE;
+                break;
+            }
+            g->bits = bits;
+            g->bitCount = bitCount;
+            boolean_t ready = EnsureBits(g, MAX_SEQUENCE_BITS);
+            bits = g->bits;
+            bitCount = g->bitCount;
+            if (!ready)
+            {
+                progress = FALSE;
+                break;
+            }
+        }
+
+        int32_t symbol = DecodeSymbol(&g->litLen, &bits, &bitCount);
+        if (symbol < END_OF_BLOCK && symbol >= 0)
+        {
+            if (pos >= capacity)
+            {
+                dec->outputSize = pos;
+                if (!DecompressReserve(dec, 1))
+                {
+                    progress = FALSE;
+                    break;
+                }
+                out = dec->output;
+                capacity = dec->outputCapacity;
+            }
+            out[pos++] = (uint8_t)symbol;
+            continue;
+        }
+        else if (symbol == END_OF_BLOCK)
+        {
+            g->state = g->lastBlock ? GZIP_TRAILER_CRC : BLOCK_HEADER;
+            break;
+        }
+
+        symbol -= END_OF_BLOCK + 1;
+        if (symbol < 0 || symbol >= (int32_t)sizeof(lengthBase) / (int32_t)sizeof(lengthBase[0]))
+        {
+            DecompressFail(dec, EFI_COMPROMISED_DATA, "Invalid deflate literal/length code.");
+            progress = FALSE;
+            break;
+        }
+        uint32_t length = lengthBase[symbol] + (uint32_t)(bits & ((1u << lengthExtra[symbol]) - 1));
+        bits >>= lengthExtra[symbol];
+        bitCount -= lengthExtra[symbol];
+
+        int32_t distSymbol = DecodeSymbol(&g->dist, &bits, &bitCount);
+        if (distSymbol < 0 || distSymbol >= MAX_DIST_CODES)
+        {
+            DecompressFail(dec, EFI_COMPROMISED_DATA, "Invalid deflate distance code.");
+            progress = FALSE;
+            break;
+        }
+        uint32_t distance = distBase[distSymbol] + (uint32_t)(bits & ((1u << distExtra[distSymbol]) - 1));
+        bits >>= distExtra[distSymbol];
+        bitCount -= distExtra[distSymbol];
+        if (distance > pos - g->memberStart)
+        {
+            DecompressFail(dec, EFI_COMPROMISED_DATA, "A deflate distance is too far back.");
+            progress = FALSE;
+            break;
+        }
+
+        if (pos + length > capacity)
+        {
+            dec->outputSize = pos;
+            if (!DecompressReserve(dec, length))
+            {
+                progress = FALSE;
+                break;
+            }
+            out = dec->output;
+            capacity = dec->outputCapacity;
+        }
+
+        uint8_t* dst = out + pos;
+        const uint8_t* src = dst - distance;
+        if (distance >= 8 && pos + length + COPY_SLACK <= capacity)
+        {
+            // The bytes written past the end are overwritten by the next output
+            uint8_t* stop = dst + length;
+            do
+            {
+                memcpy(dst, src, 8);
+                dst += 8;
+                src += 8;
+            } while (dst < stop);
+        }
+        else if (distance == 1)
+        {
+            memset(dst, *src, length);
+        }
+        else
+        {
+            for (uint32_t i = 0; i < length; i++)
+            {
+                dst[i] = src[i];
+            }
+        }
+        pos += length;
+    }
+
+    g->bits = bits;
+    g->bitCount = bitCount;
+    dec->outputSize = pos;
+    return progress && !EFI_ERROR(dec->status);
+}
+
+// The code lengths of the literal/length and distance codes, coded with the code length code
+static boolean_t ReadDynamicLengths(gzip_s* g, decompress_s* dec)
+{
+    uint32_t total = g->litLenCount + g->distCount;
+    while (g->lengthIndex < total)
+    {
+        if (!EnsureBits(g, MAX_LENGTH_CODE_BITS))
+        {
+            return FALSE;
+        }
+        int32_t symbol = DecodeSymbol(&g->codeLengthCodes, &g->bits, &g->bitCount);
+        if (symbol < 0)
+        {
+            DecompressFail(dec, EFI_COMPROMISED_DATA, "Invalid deflate code length.");
+            return FALSE;
+        }
+        if (symbol < 16)
+        {
+            g->lengths[g->lengthIndex++] = (uint8_t)symbol;
+            continue;
+        }
+
+        // 16 repeats the previous length, 17 and 18 are runs of zeros
+        uint8_t value = 0;
+        uint32_t repeat = 0;
+        if (symbol == 16)
+        {
+            if (g->lengthIndex == 0)
+            {
+                DecompressFail(dec, EFI_COMPROMISED_DATA, "Invalid deflate code length.");
+                return FALSE;
+            }
+            value = g->lengths[g->lengthIndex - 1];
+            repeat = 3 + GetBits(g, 2);
+        }
+        else if (symbol == 17)
+        {
+            repeat = 3 + GetBits(g, 3);
+        }
+        else
+        {
+            repeat = 11 + GetBits(g, 7);
+        }
+        if (g->lengthIndex + repeat > total)
+        {
+            DecompressFail(dec, EFI_COMPROMISED_DATA, "Invalid deflate code length.");
+            return FALSE;
+        }
+        memset(g->lengths + g->lengthIndex, value, repeat);
+        g->lengthIndex += repeat;
+    }
+
+    if (g->lengths[END_OF_BLOCK] == 0 ||
+        !BuildHuffman(&g->litLen, g->lengths, g->litLenCount) ||
+        !BuildHuffman(&g->dist, g->lengths + g->litLenCount, g->distCount))
+    {
+        DecompressFail(dec, EFI_COMPROMISED_DATA, "Invalid deflate Huffman code.");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void StartMember(gzip_s* g, decompress_s* dec)
+{
+    g->memberStart = dec->outputSize;
+    g->crcDone = dec->outputSize;
+    g->crc = 0;
+}
+
+static void UpdateCrc(gzip_s* g, decompress_s* dec)
+{
+    if (dec->outputSize > g->crcDone)
+    {
+        g->crc = Crc32(g->crc, dec->output + g->crcDone, dec->outputSize - g->crcDone);
+        g->crcDone = dec->outputSize;
+    }
+}
+
+static void FillBits(gzip_s* g)
+{
+    while (g->bitCount <= 56 && g->next < g->end)
+    {
+        g->bits |= (uint64_t)*g->next++ << g->bitCount;
+        g->bitCount += 8;
+    }
+}
+
+// Returns FALSE if the chunk ends first, with the last chunk the missing bits are zeros
+static boolean_t EnsureBits(gzip_s* g, uint32_t count)
+{
+    FillBits(g);
+    if (g->bitCount >= count)
+    {
+        return TRUE;
+    }
+    if (!g->last)
+    {
+        return FALSE;
+    }
+    // Whole bytes are added, so the bit count still tells where the byte boundaries are
+    while (g->bitCount < count)
+    {
+        g->bitCount += 8;
+        g->paddingBits += 8;
+    }
+    return TRUE;
+}
+
+static uint32_t GetBits(gzip_s* g, uint32_t count)
+{
+    uint32_t value = (uint32_t)(g->bits & ((1ull << count) - 1));
+    g->bits >>= count;
+    g->bitCount -= count;
+    return value;
+}
+
+// The bits in the buffer that came from the input
+static uint32_t RealBits(gzip_s* g)
+{
+    return g->bitCount > g->paddingBits ? g->bitCount - g->paddingBits : 0;
+}
+
+// Returns FALSE if the lengths give more codes than there are, codes that are missing fail to decode
+static boolean_t BuildHuffman(huffman_s* h, const uint8_t* lengths, uint32_t count)
+{
+    memset(h->counts, 0, sizeof(h->counts));
+    for (uint32_t i = 0; i < count; i++)
+    {
+        h->counts[lengths[i]]++;
+    }
+    h->counts[0] = 0;
+
+    int32_t left = 1;
+    for (uint32_t len = 1; len <= MAX_CODE_LENGTH; len++)
+    {
+        left = (left << 1) - h->counts[len];
+        if (left < 0)
+        {
+            return FALSE;
+        }
+    }
+
+    // The codes are assigned in the order of the lengths, and in the order of the symbols within a length
+    uint16_t offsets[MAX_CODE_LENGTH + 1];
+    offsets[1] = 0;
+    for (uint32_t len = 1; len < MAX_CODE_LENGTH; len++)
+    {
+        offsets[len + 1] = offsets[len] + h->counts[len];
+    }
+    for (uint32_t symbol = 0; symbol < count; symbol++)
+    {
+        if (lengths[symbol] != 0)
+        {
+            h->symbols[offsets[lengths[symbol]]++] = (uint16_t)symbol;
+        }
+    }
+
+    memset(h->fast, 0, sizeof(h->fast));
+    uint32_t code = 0;
+    uint32_t index = 0;
+    for (uint32_t len = 1; len <= FAST_BITS; len++)
+    {
+        for (uint32_t i = 0; i < h->counts[len]; i++, index++, code++)
+        {
+            // Every entry whose low bits are the code decodes to the symbol
+            uint16_t entry = (uint16_t)((h->symbols[index] << 4) | len);
+            for (uint32_t j = ReverseBits(code, len); j < (1 << FAST_BITS); j += 1 << len)
+            {
+                h->fast[j] = entry;
+            }
+        }
+        code <<= 1;
+    }
+    return TRUE;
+}
+
+static int32_t DecodeSymbol(const huffman_s* h, uint64_t* bits, uint32_t* bitCount)
+{
+    uint32_t entry = h->fast[*bits & FAST_MASK];
+    if (entry == 0)
+    {
+        return DecodeSlow(h, bits, bitCount);
+    }
+    *bits >>= entry & 0xf;
+    *bitCount -= entry & 0xf;
+    return (int32_t)(entry >> 4);
+}
+
+// Walks the code one bit at a time, only codes longer than FAST_BITS get here
+static int32_t DecodeSlow(const huffman_s* h, uint64_t* bits, uint32_t* bitCount)
+{
+    int32_t code = 0;
+    int32_t first = 0;
+    int32_t index = 0;
+    for (uint32_t len = 1; len <= MAX_CODE_LENGTH; len++)
+    {
+        code |= (int32_t)((*bits >> (len - 1)) & 1);
+        int32_t count = h->counts[len];
+        if (code - first < count)
+        {
+            *bits >>= len;
+            *bitCount -= len;
+            return h->symbols[index + code - first];
+        }
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+static uint32_t ReverseBits(uint32_t code, uint32_t length)
+{
+    uint32_t reversed = 0;
+    for (uint32_t i = 0; i < length; i++)
+    {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    return reversed;
+}
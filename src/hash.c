@@ -0,0 +1,836 @@
+#include "hash.h"
+#include "bootutils.h"
+#include "logger.h"
+#include "clock.h"
+#include "mpjobs.h"
+
+// CPU features the hardware implementations need
+#define HASH_FEATURE_SHA    (1 << 0) // SHA extensions, with the SSSE3 and SSE4.1 shuffles they are used with
+#define HASH_FEATURE_SSE42  (1 << 1) // The crc32 instruction
+#define HASH_FEATURE_PCLMUL (1 << 2) // Carry-less multiplication
+
+#define CPUID_FEATURES                  (1)
+#define CPUID_FEATURES_ECX_SSSE3        (1 << 9)
+#define CPUID_FEATURES_ECX_SSE41        (1 << 19)
+#define CPUID_FEATURES_ECX_SSE42        (1 << 20)
+#define CPUID_FEATURES_ECX_PCLMUL       (1 << 1)
+#define CPUID_EXTENDED_FEATURES         (7)
+#define CPUID_EXTENDED_FEATURES_EBX_SHA (1 << 29)
+
+// The Castagnoli polynomial in the bit reflected order the crc32 instruction uses
+#define CRC32C_POLYNOMIAL (0x82F63B78)
+// The IEEE polynomial of gzip and zip, also bit reflected
+#define CRC32_POLYNOMIAL  (0xEDB88320)
+// The hardware CRC runs three independent streams of this size, so the crc32 instructions can overlap
+// The streams are joined with a carry-less multiplication
+#define CRC32C_STREAM_SIZE (4096)
+
+// Size of the buffer that is hashed over and over for the benchmark
+#define BENCHMARK_BUFFER_SIZE (4 * 1024 * 1024)
+#define BENCHMARK_MIN_US      (250000)
+#define BYTES_IN_MIB          (1024 * 1024)
+
+// Compared against the scalar implementation by the self test
+#define CROSS_CHECK_BUFFER_SIZE (64 * 1024)
+
+#define ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define ARRAY_COUNT(array) (sizeof(array) / sizeof((array)[0]))
+
+typedef void (*sha256_blocks_t)(uint32_t state[8], const uint8_t* data, uintn_t blocks);
+// Works on the CRC register without the initial and final inversion
+typedef uint32_t (*crc32c_update_t)(uint32_t crc, const uint8_t* data, uintn_t length);
+
+typedef struct sha256_impl_s
+{
+    const char_t* name;
+    uint32_t features;
+    sha256_blocks_t blocks;
+} sha256_impl_s;
+
+typedef struct crc32c_impl_s
+{
+    const char_t* name;
+    uint32_t features;
+    crc32c_update_t update;
+} crc32c_impl_s;
+
+typedef struct sha256_tree_job_s
+{
+    const uint8_t* data;
+    uintn_t length;
+    uint8_t (*leaves)[SHA256_DIGEST_SIZE];
+} sha256_tree_job_s;
+
+typedef struct sha256_known_answer_s
+{
+    const char_t* message;
+    uintn_t repeat; // The message is hashed this many times in a row
+    const char_t* digest;
+} sha256_known_answer_s;
+
+static void Sha256UpdateWith(sha256_ctx_s* ctx, const void* data, uintn_t length, sha256_blocks_t blocks);
+static void Sha256FinalWith(sha256_ctx_s* ctx, uint8_t digest[SHA256_DIGEST_SIZE], sha256_blocks_t blocks);
+static void Sha256BlocksScalar(uint32_t state[8], const uint8_t* data, uintn_t blocks);
+static void HashTreeLeaf(void* context, uintn_t item);
+static void HashTreeChunk(const uint8_t* data, uintn_t length, uintn_t item, uint8_t leaf[SHA256_DIGEST_SIZE]);
+static uint32_t Crc32cUpdateTable(uint32_t crc, const uint8_t* data, uintn_t length);
+static uint32_t CrcUpdateSlicing(uint32_t table[8][256], uint32_t crc, const uint8_t* data, uintn_t length);
+static void InitCrc32cTables(void);
+static void BuildCrcTables(uint32_t table[8][256], uint32_t polynomial);
+static uint32_t MultiplyByXPower(uint32_t value, uint64_t power);
+static boolean_t TestSha256Impl(const sha256_impl_s* impl);
+static boolean_t TestCrc32cImpl(const crc32c_impl_s* impl);
+static void FillTestData(uint8_t* data, uintn_t length);
+static uint32_t DetectCpuFeatures(void);
+
+#if defined(__x86_64__)
+typedef int v4si_t __attribute__((vector_size(16)));
+typedef long long v2di_t __attribute__((vector_size(16)));
+typedef short v8hi_t __attribute__((vector_size(16)));
+typedef char v16qi_t __attribute__((vector_size(16)));
+typedef v4si_t v4siu_t __attribute__((aligned(1), may_alias));
+typedef v16qi_t v16qiu_t __attribute__((aligned(1), may_alias));
+
+static void Sha256BlocksShaNi(uint32_t state[8], const uint8_t* data, uintn_t blocks);
+static uint32_t Crc32cUpdateSse42(uint32_t crc, const uint8_t* data, uintn_t length);
+static uint32_t Crc32cUpdatePclmul(uint32_t crc, const uint8_t* data, uintn_t length);
+#endif
+
+static const sha256_impl_s sha256Impls[] = {
+    {"scalar", 0, Sha256BlocksScalar},
+#if defined(__x86_64__)
+    {"SHA-NI", HASH_FEATURE_SHA, Sha256BlocksShaNi},
+#endif
+};
+
+static const crc32c_impl_s crc32cImpls[] = {
+    {"table", 0, Crc32cUpdateTable},
+#if defined(__x86_64__)
+    {"SSE4.2", HASH_FEATURE_SSE42, Crc32cUpdateSse42},
+    {"SSE4.2+PCLMUL", HASH_FEATURE_SSE42 | HASH_FEATURE_PCLMUL, Crc32cUpdatePclmul},
+#endif
+};
+
+static const sha256_known_answer_s sha256KnownAnswers[] = {
+    {"", 1, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+    {"abc", 1, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"},
+    {"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1,
+        "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"},
+    {"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa", 10000,
+        "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0"},
+};
+
+#define CRC32C_CHECK_MESSAGE ("123456789")
+#define CRC32C_CHECK_VALUE   (0xE3069283)
+#define CRC32_CHECK_VALUE    (0xCBF43926)
+
+static const uint32_t sha256RoundConstants[64] __attribute__((aligned(16))) = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static const uint32_t sha256InitialState[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+static uint32_t cpuFeatures = 0;
+static const sha256_impl_s* sha256Impl = &sha256Impls[0];
+static const crc32c_impl_s* crc32cImpl = &crc32cImpls[0];
+
+// Slicing by 8, crc32cTable[k][b] is the CRC of byte b followed by k zero bytes
+static uint32_t crc32cTable[8][256];
+static uint32_t crc32Table[8][256];
+// Carry-less multiplication constants that move a CRC over one and two streams of zeros
+static uint64_t crc32cStreamShift = 0;
+static uint64_t crc32cDoubleStreamShift = 0;
+
+
+// Picks the fastest implementations the CPU supports, each one has to pass the known answer tests first
+// Returns FALSE if a hardware implementation failed its test and the slower fallback is used instead
+boolean_t InitHash(void)
+{
+    InitCrc32cTables();
+    BuildCrcTables(crc32Table, CRC32_POLYNOMIAL);
+    cpuFeatures = DetectCpuFeatures();
+
+    boolean_t success = TRUE;
+    for (uintn_t i = 1; i < ARRAY_COUNT(sha256Impls); i++)
+    {
+        if ((sha256Impls[i].features & cpuFeatures) != sha256Impls[i].features)
+        {
+            continue;
+        }
+        if (!TestSha256Impl(&sha256Impls[i]))
+        {
+            Log(LL_ERROR, 0, "The %s SHA-256 implementation failed its self test, using %s.",
+                sha256Impls[i].name, sha256Impl->name);
+            success = FALSE;
+            continue;
+        }
+        sha256Impl = &sha256Impls[i];
+    }
+
+    for (uintn_t i = 1; i < ARRAY_COUNT(crc32cImpls); i++)
+    {
+        if ((crc32cImpls[i].features & cpuFeatures) != crc32cImpls[i].features)
+        {
+            continue;
+        }
+        if (!TestCrc32cImpl(&crc32cImpls[i]))
+        {
+            Log(LL_ERROR, 0, "The %s CRC32C implementation failed its self test, using %s.",
+                crc32cImpls[i].name, crc32cImpl->name);
+            success = FALSE;
+            continue;
+        }
+        crc32cImpl = &crc32cImpls[i];
+    }
+    return success;
+}
+
+void Sha256Init(sha256_ctx_s* ctx)
+{
+    memcpy(ctx->state, sha256InitialState, sizeof(ctx->state));
+    ctx->length = 0;
+    ctx->blockLength = 0;
+}
+
+void Sha256Update(sha256_ctx_s* ctx, const void* data, uintn_t length)
+{
+    Sha256UpdateWith(ctx, data, length, sha256Impl->blocks);
+}
+
+void Sha256Final(sha256_ctx_s* ctx, uint8_t digest[SHA256_DIGEST_SIZE])
+{
+    Sha256FinalWith(ctx, digest, sha256Impl->blocks);
+}
+
+void Sha256ToString(const uint8_t digest[SHA256_DIGEST_SIZE], char_t str[SHA256_DIGEST_SIZE * 2 + 1])
+{
+    static const char_t hexDigits[] = "0123456789abcdef";
+    for (uintn_t i = 0; i < SHA256_DIGEST_SIZE; i++)
+    {
+        str[i * 2] = hexDigits[digest[i] >> 4];
+        str[i * 2 + 1] = hexDigits[digest[i] & 0xf];
+    }
+    str[SHA256_DIGEST_SIZE * 2] = CHAR_NULL;
+}
+
+// Parses the 64 hex digits of a digest, upper or lower case
+boolean_t Sha256FromString(const char_t* str, uint8_t digest[SHA256_DIGEST_SIZE])
+{
+    for (uintn_t i = 0; i < SHA256_DIGEST_SIZE * 2; i++)
+    {
+        char_t c = str[i];
+        uint8_t value = 0;
+        if (c >= '0' && c <= '9')
+        {
+            value = c - '0';
+        }
+        else if (c >= 'a' && c <= 'f')
+        {
+            value = c - 'a' + 10;
+        }
+        else if (c >= 'A' && c <= 'F')
+        {
+            value = c - 'A' + 10;
+        }
+        else
+        {
+            return FALSE;
+        }
+        digest[i / 2] = (i % 2 == 0) ? value << 4 : digest[i / 2] | value;
+    }
+    return str[SHA256_DIGEST_SIZE * 2] == CHAR_NULL;
+}
+
+// Adds the digests of the chunks of the data to the root of a tree hash, the chunks are hashed on all the processors
+// The root is started with Sha256Init and finished with Sha256Final,
+// and the length has to be a multiple of SHA256_TREE_CHUNK_SIZE except in the last call
+void Sha256TreeUpdate(sha256_ctx_s* root, const void* data, uintn_t length)
+{
+    uintn_t count = (length + SHA256_TREE_CHUNK_SIZE - 1) / SHA256_TREE_CHUNK_SIZE;
+    sha256_tree_job_s tree = { data, length, malloc(count * SHA256_DIGEST_SIZE) };
+    if (tree.leaves == NULL)
+    {
+        // One leaf at a time on the BSP gives the same digest
+        uint8_t leaf[SHA256_DIGEST_SIZE];
+        for (uintn_t i = 0; i < count; i++)
+        {
+            HashTreeChunk(data, length, i, leaf);
+            Sha256Update(root, leaf, SHA256_DIGEST_SIZE);
+        }
+        return;
+    }
+
+    RunMpJob(HashTreeLeaf, &tree, count);
+    Sha256Update(root, tree.leaves, count * SHA256_DIGEST_SIZE);
+    free(tree.leaves);
+}
+
+// Returns the CRC32C of the data, a previous result can be passed as crc to continue it, start with 0
+uint32_t Crc32c(uint32_t crc, const void* data, uintn_t length)
+{
+    return ~crc32cImpl->update(~crc, data, length);
+}
+
+// The CRC-32 of gzip and zip, chained the same way as Crc32c
+uint32_t Crc32(uint32_t crc, const void* data, uintn_t length)
+{
+    return ~CrcUpdateSlicing(crc32Table, ~crc, data, length);
+}
+
+// Runs the known answer tests on every implementation the CPU supports
+// The hardware implementations are also compared with the portable one over random data
+boolean_t HashSelfTest(hash_algorithm_t algorithm, boolean_t verbose)
+{
+    boolean_t success = TRUE;
+    uintn_t count = algorithm == HASH_SHA256 ? ARRAY_COUNT(sha256Impls) : ARRAY_COUNT(crc32cImpls);
+    for (uintn_t i = 0; i < count; i++)
+    {
+        const char_t* name = NULL;
+        uint32_t features = 0;
+        boolean_t passed = FALSE;
+        if (algorithm == HASH_SHA256)
+        {
+            name = sha256Impls[i].name;
+            features = sha256Impls[i].features;
+        }
+        else
+        {
+            name = crc32cImpls[i].name;
+            features = crc32cImpls[i].features;
+        }
+
+        if ((features & cpuFeatures) != features)
+        {
+            if (verbose)
+            {
+                printf("%s: not supported by this CPU\n", name);
+            }
+            continue;
+        }
+
+        passed = algorithm == HASH_SHA256 ? TestSha256Impl(&sha256Impls[i]) : TestCrc32cImpl(&crc32cImpls[i]);
+        if (verbose)
+        {
+            printf("%s: %s\n", name, passed ? "passed" : "FAILED");
+        }
+        if (!passed)
+        {
+            success = FALSE;
+        }
+    }
+    return success;
+}
+
+// Prints the throughput of every implementation the CPU supports
+void HashBenchmark(hash_algorithm_t algorithm)
+{
+    if (GetClockFrequency() == 0)
+    {
+        printf("The benchmark needs a calibrated clock.\n");
+        return;
+    }
+
+    uint8_t* buffer = malloc(BENCHMARK_BUFFER_SIZE);
+    if (buffer == NULL)
+    {
+        printf("Not enough memory for the benchmark.\n");
+        return;
+    }
+    FillTestData(buffer, BENCHMARK_BUFFER_SIZE);
+
+    uintn_t count = algorithm == HASH_SHA256 ? ARRAY_COUNT(sha256Impls) : ARRAY_COUNT(crc32cImpls);
+    for (uintn_t i = 0; i < count; i++)
+    {
+        uint32_t features = algorithm == HASH_SHA256 ? sha256Impls[i].features : crc32cImpls[i].features;
+        if ((features & cpuFeatures) != features)
+        {
+            continue;
+        }
+
+        // The buffer is hashed until enough time passed for a stable result
+        uint64_t bytes = 0;
+        uint64_t start = ReadClockTicks();
+        uint64_t elapsedUs = 0;
+        do
+        {
+            if (algorithm == HASH_SHA256)
+            {
+                sha256_ctx_s ctx;
+                uint8_t digest[SHA256_DIGEST_SIZE];
+                Sha256Init(&ctx);
+                Sha256UpdateWith(&ctx, buffer, BENCHMARK_BUFFER_SIZE, sha256Impls[i].blocks);
+                Sha256FinalWith(&ctx, digest, sha256Impls[i].blocks);
+            }
+            else
+            {
+                crc32cImpls[i].update(0, buffer, BENCHMARK_BUFFER_SIZE);
+            }
+            bytes += BENCHMARK_BUFFER_SIZE;
+            elapsedUs = TicksToMicroseconds(ReadClockTicks() - start);
+        } while (elapsedUs < BENCHMARK_MIN_US);
+
+        const char_t* name = algorithm == HASH_SHA256 ? sha256Impls[i].name : crc32cImpls[i].name;
+        boolean_t selected = algorithm == HASH_SHA256 ? sha256Impl == &sha256Impls[i] : crc32cImpl == &crc32cImpls[i];
+        printf("%s: %d MiB/s%s\n", name, bytes * US_IN_SECOND / elapsedUs / BYTES_IN_MIB, selected ? " (in use)" : "");
+    }
+    free(buffer);
+}
+
+// Runs on any processor
+static void HashTreeLeaf(void* context, uintn_t item)
+{
+    sha256_tree_job_s* tree = context;
+    HashTreeChunk(tree->data, tree->length, item, tree->leaves[item]);
+}
+
+static void HashTreeChunk(const uint8_t* data, uintn_t length, uintn_t item, uint8_t leaf[SHA256_DIGEST_SIZE])
+{
+    uintn_t offset = item * SHA256_TREE_CHUNK_SIZE;
+    uintn_t chunkLength = length - offset < SHA256_TREE_CHUNK_SIZE ? length - offset : SHA256_TREE_CHUNK_SIZE;
+
+    sha256_ctx_s ctx;
+    Sha256Init(&ctx);
+    Sha256Update(&ctx, data + offset, chunkLength);
+    Sha256Final(&ctx, leaf);
+}
+
+static void Sha256UpdateWith(sha256_ctx_s* ctx, const void* data, uintn_t length, sha256_blocks_t blocks)
+{
+    const uint8_t* bytes = data;
+    ctx->length += length;
+
+    if (ctx->blockLength > 0)
+    {
+        uintn_t toCopy = SHA256_BLOCK_SIZE - ctx->blockLength;
+        if (toCopy > length)
+        {
+            toCopy = length;
+        }
+        memcpy(ctx->block + ctx->blockLength, bytes, toCopy);
+        ctx->blockLength += toCopy;
+        bytes += toCopy;
+        length -= toCopy;
+        if (ctx->blockLength < SHA256_BLOCK_SIZE)
+        {
+            return;
+        }
+        blocks(ctx->state, ctx->block, 1);
+        ctx->blockLength = 0;
+    }
+
+    // Whole blocks are hashed straight from the caller's buffer
+    if (length >= SHA256_BLOCK_SIZE)
+    {
+        blocks(ctx->state, bytes, length / SHA256_BLOCK_SIZE);
+        bytes += length - length % SHA256_BLOCK_SIZE;
+        length %= SHA256_BLOCK_SIZE;
+    }
+
+    memcpy(ctx->block, bytes, length);
+    ctx->blockLength = length;
+}
+
+static void Sha256FinalWith(sha256_ctx_s* ctx, uint8_t digest[SHA256_DIGEST_SIZE], sha256_blocks_t blocks)
+{
+    uint64_t bitLength = ctx->length * 8;
+
+    // A one bit, zeros and the big endian length in bits fill the last block
+    ctx->block[ctx->blockLength++] = 0x80;
+    if (ctx->blockLength > SHA256_BLOCK_SIZE - sizeof(uint64_t))
+    {
+        memset(ctx->block + ctx->blockLength, 0, SHA256_BLOCK_SIZE - ctx->blockLength);
+        blocks(ctx->state, ctx->block, 1);
+        ctx->blockLength = 0;
+    }
+    memset(ctx->block + ctx->blockLength, 0, SHA256_BLOCK_SIZE - sizeof(uint64_t) - ctx->blockLength);
+    for (uintn_t i = 0; i < sizeof(uint64_t); i++)
+    {
+        ctx->block[SHA256_BLOCK_SIZE - 1 - i] = (uint8_t)(bitLength >> (i * 8));
+    }
+    blocks(ctx->state, ctx->block, 1);
+
+    for (uintn_t i = 0; i < 8; i++)
+    {
+        digest[i * 4] = (uint8_t)(ctx->state[i] >> 24);
+        digest[i * 4 + 1] = (uint8_t)(ctx->state[i] >> 16);
+        digest[i * 4 + 2] = (uint8_t)(ctx->state[i] >> 8);
+        digest[i * 4 + 3] = (uint8_t)ctx->state[i];
+    }
+}
+
+static void Sha256BlocksScalar(uint32_t state[8], const uint8_t* data, uintn_t blocks)
+{
+    uint32_t w[64];
+    for (; blocks > 0; blocks--, data += SHA256_BLOCK_SIZE)
+    {
+        for (uintn_t i = 0; i < 16; i++)
+        {
+            w[i] = ((uint32_t)data[i * 4] << 24) | ((uint32_t)data[i * 4 + 1] << 16) |
+                ((uint32_t)data[i * 4 + 2] << 8) | data[i * 4 + 3];
+        }
+        for (uintn_t i = 16; i < 64; i++)
+        {
+            uint32_t s0 = ROTR32(w[i - 15], 7) ^ ROTR32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = ROTR32(w[i - 2], 17) ^ ROTR32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (uintn_t i = 0; i < 64; i++)
+        {
+            uint32_t s1 = ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25);
+            uint32_t ch = (e & f) ^ (~e & g);
+            uint32_t t1 = h + s1 + ch + sha256RoundConstants[i] + w[i];
+            uint32_t s0 = ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22);
+            uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = s0 + maj;
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+static uint32_t Crc32cUpdateTable(uint32_t crc, const uint8_t* data, uintn_t length)
+{
+    return CrcUpdateSlicing(crc32cTable, crc, data, length);
+}
+
+static uint32_t CrcUpdateSlicing(uint32_t table[8][256], uint32_t crc, const uint8_t* data, uintn_t length)
+{
+    for (; length >= 8; length -= 8, data += 8)
+    {
+        uint32_t low = crc ^ ((uint32_t)data[0] | ((uint32_t)data[1] << 8) |
+            ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24));
+        crc = table[7][low & 0xff] ^ table[6][(low >> 8) & 0xff] ^
+            table[5][(low >> 16) & 0xff] ^ table[4][low >> 24] ^
+            table[3][data[4]] ^ table[2][data[5]] ^ table[1][data[6]] ^ table[0][data[7]];
+    }
+    for (; length > 0; length--, data++)
+    {
+        crc = table[0][(crc ^ *data) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+static void InitCrc32cTables(void)
+{
+    BuildCrcTables(crc32cTable, CRC32C_POLYNOMIAL);
+
+    // The product of the carry-less multiplication is reduced by a crc32 instruction,
+    // which multiplies by x^32 and loses one more bit to the reflected order
+    crc32cStreamShift = MultiplyByXPower(1u << 31, CRC32C_STREAM_SIZE * 8 - 33);
+    crc32cDoubleStreamShift = MultiplyByXPower(1u << 31, CRC32C_STREAM_SIZE * 2 * 8 - 33);
+}
+
+static void BuildCrcTables(uint32_t table[8][256], uint32_t polynomial)
+{
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t crc = i;
+        for (uintn_t bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ polynomial : crc >> 1;
+        }
+        table[0][i] = crc;
+    }
+    for (uintn_t k = 1; k < 8; k++)
+    {
+        for (uintn_t i = 0; i < 256; i++)
+        {
+            table[k][i] = table[0][table[k - 1][i] & 0xff] ^ (table[k - 1][i] >> 8);
+        }
+    }
+}
+
+// Multiplies a bit reflected polynomial by x^power modulo the CRC polynomial
+static uint32_t MultiplyByXPower(uint32_t value, uint64_t power)
+{
+    for (; power > 0; power--)
+    {
+        value = (value & 1) ? (value >> 1) ^ CRC32C_POLYNOMIAL : value >> 1;
+    }
+    return value;
+}
+
+static boolean_t TestSha256Impl(const sha256_impl_s* impl)
+{
+    for (uintn_t i = 0; i < ARRAY_COUNT(sha256KnownAnswers); i++)
+    {
+        const sha256_known_answer_s* answer = &sha256KnownAnswers[i];
+        sha256_ctx_s ctx;
+        uint8_t digest[SHA256_DIGEST_SIZE];
+        char_t digestStr[SHA256_DIGEST_SIZE * 2 + 1];
+
+        Sha256Init(&ctx);
+        for (uintn_t j = 0; j < answer->repeat; j++)
+        {
+            Sha256UpdateWith(&ctx, answer->message, strlen(answer->message), impl->blocks);
+        }
+        Sha256FinalWith(&ctx, digest, impl->blocks);
+        Sha256ToString(digest, digestStr);
+        if (strcmp(digestStr, answer->digest) != 0)
+        {
+            return FALSE;
+        }
+    }
+
+    if (impl->blocks == Sha256BlocksScalar)
+    {
+        return TRUE;
+    }
+
+    uint8_t* data = malloc(CROSS_CHECK_BUFFER_SIZE);
+    if (data == NULL)
+    {
+        return FALSE;
+    }
+    FillTestData(data, CROSS_CHECK_BUFFER_SIZE);
+
+    // Uneven lengths split the data between the block buffer and the caller's buffer in different ways
+    boolean_t success = TRUE;
+    for (uintn_t length = 1; length <= CROSS_CHECK_BUFFER_SIZE && success; length = length * 3 + 7)
+    {
+        sha256_ctx_s ctx;
+        uint8_t expected[SHA256_DIGEST_SIZE];
+        uint8_t digest[SHA256_DIGEST_SIZE];
+
+        Sha256Init(&ctx);
+        Sha256UpdateWith(&ctx, data, length, Sha256BlocksScalar);
+        Sha256FinalWith(&ctx, expected, Sha256BlocksScalar);
+
+        Sha256Init(&ctx);
+        Sha256UpdateWith(&ctx, data, length / 3, impl->blocks);
+        Sha256UpdateWith(&ctx, data + length / 3, length - length / 3, impl->blocks);
+        Sha256FinalWith(&ctx, digest, impl->blocks);
+        success = memcmp(expected, digest, SHA256_DIGEST_SIZE) == 0;
+    }
+    free(data);
+    return success;
+}
+
+static boolean_t TestCrc32cImpl(const crc32c_impl_s* impl)
+{
+    uint32_t crc = ~impl->update(~0u, (const uint8_t*)CRC32C_CHECK_MESSAGE, strlen(CRC32C_CHECK_MESSAGE));
+    if (crc != CRC32C_CHECK_VALUE)
+    {
+        return FALSE;
+    }
+
+    if (impl->update == Crc32cUpdateTable)
+    {
+        // The gzip CRC shares the table code, so its check value is tested with it
+        return Crc32(0, CRC32C_CHECK_MESSAGE, strlen(CRC32C_CHECK_MESSAGE)) == CRC32_CHECK_VALUE;
+    }
+
+    uint8_t* data = malloc(CROSS_CHECK_BUFFER_SIZE);
+    if (data == NULL)
+    {
+        return FALSE;
+    }
+    FillTestData(data, CROSS_CHECK_BUFFER_SIZE);
+
+    // Odd offsets and lengths cover the unaligned heads and the tails after the streams
+    boolean_t success = TRUE;
+    for (uintn_t length = 1; length <= CROSS_CHECK_BUFFER_SIZE - 3 && success; length = length * 3 + 5)
+    {
+        for (uintn_t offset = 0; offset < 3 && success; offset++)
+        {
+            success = Crc32cUpdateTable(0x12345678, data + offset, length) ==
+                impl->update(0x12345678, data + offset, length);
+        }
+    }
+    free(data);
+    return success;
+}
+
+// Fills the buffer with repeatable pseudo random bytes
+static void FillTestData(uint8_t* data, uintn_t length)
+{
+    uint32_t seed = 0x2545F491;
+    for (uintn_t i = 0; i < length; i++)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        data[i] = (uint8_t)seed;
+    }
+}
+
+static uint32_t DetectCpuFeatures(void)
+{
+    uint32_t features = 0;
+#if defined(__x86_64__)
+    uint32_t eax = CPUID_FEATURES, ebx = 0, ecx = 0, edx = 0;
+    __asm__ __volatile__ ("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+    uint32_t maxLeaf = 0;
+    uint32_t featuresEcx = ecx;
+
+    eax = 0;
+    ecx = 0;
+    __asm__ __volatile__ ("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+    maxLeaf = eax;
+
+    if (featuresEcx & CPUID_FEATURES_ECX_SSE42)
+    {
+        features |= HASH_FEATURE_SSE42;
+    }
+    if (featuresEcx & CPUID_FEATURES_ECX_PCLMUL)
+    {
+        features |= HASH_FEATURE_PCLMUL;
+    }
+
+    if (maxLeaf >= CPUID_EXTENDED_FEATURES)
+    {
+        eax = CPUID_EXTENDED_FEATURES;
+        ecx = 0;
+        __asm__ __volatile__ ("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+        if ((ebx & CPUID_EXTENDED_FEATURES_EBX_SHA) &&
+            (featuresEcx & CPUID_FEATURES_ECX_SSSE3) && (featuresEcx & CPUID_FEATURES_ECX_SSE41))
+        {
+            features |= HASH_FEATURE_SHA;
+        }
+    }
+#endif
+    return features;
+}
+
+#if defined(__x86_64__)
+// Four rounds per sha256rnds2 pair, the state is kept as ABEF and CDGH like the instructions want it
+__attribute__((target("sha,sse4.1,ssse3")))
+static void Sha256BlocksShaNi(uint32_t state[8], const uint8_t* data, uintn_t blocks)
+{
+    // Swaps the bytes of every word, the message words are big endian
+    const v16qi_t byteSwap = {3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12};
+
+    v4si_t tmp = __builtin_ia32_pshufd(*(const v4siu_t*)&state[0], 0xB1); // CDAB
+    v4si_t state1 = __builtin_ia32_pshufd(*(const v4siu_t*)&state[4], 0x1B); // EFGH
+    v4si_t state0 = (v4si_t)__builtin_ia32_palignr128((v2di_t)tmp, (v2di_t)state1, 64); // ABEF
+    state1 = (v4si_t)__builtin_ia32_pblendw128((v8hi_t)state1, (v8hi_t)tmp, 0xF0); // CDGH
+
+    for (; blocks > 0; blocks--, data += SHA256_BLOCK_SIZE)
+    {
+        v4si_t saved0 = state0;
+        v4si_t saved1 = state1;
+        v4si_t msg[4];
+        for (uintn_t i = 0; i < 4; i++)
+        {
+            msg[i] = (v4si_t)__builtin_ia32_pshufb128(*(const v16qiu_t*)(data + i * 16), byteSwap);
+        }
+
+        for (uintn_t i = 0; i < 16; i++)
+        {
+            v4si_t wk = msg[i & 3] + *(const v4si_t*)&sha256RoundConstants[i * 4];
+            state1 = __builtin_ia32_sha256rnds2(state1, state0, wk);
+            // The schedule of the next words overlaps with the rounds
+            if (i >= 3 && i < 15)
+            {
+                tmp = (v4si_t)__builtin_ia32_palignr128((v2di_t)msg[i & 3], (v2di_t)msg[(i - 1) & 3], 32);
+                msg[(i + 1) & 3] = __builtin_ia32_sha256msg2(msg[(i + 1) & 3] + tmp, msg[i & 3]);
+            }
+            wk = __builtin_ia32_pshufd(wk, 0x0E);
+            state0 = __builtin_ia32_sha256rnds2(state0, state1, wk);
+            if (i >= 1 && i < 13)
+            {
+                msg[(i - 1) & 3] = __builtin_ia32_sha256msg1(msg[(i - 1) & 3], msg[i & 3]);
+            }
+        }
+
+        state0 += saved0;
+        state1 += saved1;
+    }
+
+    tmp = __builtin_ia32_pshufd(state0, 0x1B); // FEBA
+    state1 = __builtin_ia32_pshufd(state1, 0xB1); // DCHG
+    state0 = (v4si_t)__builtin_ia32_pblendw128((v8hi_t)tmp, (v8hi_t)state1, 0xF0); // DCBA
+    state1 = (v4si_t)__builtin_ia32_palignr128((v2di_t)state1, (v2di_t)tmp, 64); // HGFE
+    *(v4siu_t*)&state[0] = state0;
+    *(v4siu_t*)&state[4] = state1;
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t Crc32cUpdateSse42(uint32_t crc, const uint8_t* data, uintn_t length)
+{
+    uint64_t crc64 = crc;
+    for (; length > 0 && ((uintn_t)data & 7) != 0; length--, data++)
+    {
+        crc64 = __builtin_ia32_crc32qi((uint32_t)crc64, *data);
+    }
+    for (; length >= 8; length -= 8, data += 8)
+    {
+        crc64 = __builtin_ia32_crc32di(crc64, *(const uint64_t*)data);
+    }
+    for (; length > 0; length--, data++)
+    {
+        crc64 = __builtin_ia32_crc32qi((uint32_t)crc64, *data);
+    }
+    return (uint32_t)crc64;
+}
+
+// Moves a CRC over the given zeros with one carry-less multiplication and one crc32 instruction
+__attribute__((target("sse4.2,pclmul")))
+static inline uint64_t ShiftCrc32c(uint64_t crc, uint64_t shift)
+{
+    v2di_t product = __builtin_ia32_pclmulqdq128((v2di_t){(long long)crc, 0}, (v2di_t){(long long)shift, 0}, 0x00);
+    return __builtin_ia32_crc32di(0, (uint64_t)product[0]);
+}
+
+// The crc32 instruction has a latency of three cycles but can start every cycle,
+// three independent streams keep it busy and are joined at the end of every group
+__attribute__((target("sse4.2,pclmul")))
+static uint32_t Crc32cUpdatePclmul(uint32_t crc, const uint8_t* data, uintn_t length)
+{
+    uint64_t crc64 = crc;
+    for (; length > 0 && ((uintn_t)data & 7) != 0; length--, data++)
+    {
+        crc64 = __builtin_ia32_crc32qi((uint32_t)crc64, *data);
+    }
+
+    for (; length >= CRC32C_STREAM_SIZE * 3; length -= CRC32C_STREAM_SIZE * 3, data += CRC32C_STREAM_SIZE * 3)
+    {
+        const uint64_t* words = (const uint64_t*)data;
+        uint64_t crc1 = 0;
+        uint64_t crc2 = 0;
+        for (uintn_t i = 0; i < CRC32C_STREAM_SIZE / 8; i++)
+        {
+            crc64 = __builtin_ia32_crc32di(crc64, words[i]);
+            crc1 = __builtin_ia32_crc32di(crc1, words[i + CRC32C_STREAM_SIZE / 8]);
+            crc2 = __builtin_ia32_crc32di(crc2, words[i + CRC32C_STREAM_SIZE / 4]);
+        }
+        crc64 = ShiftCrc32c(crc64, crc32cDoubleStreamShift) ^ ShiftCrc32c(crc1, crc32cStreamShift) ^ crc2;
+    }
+
+    for (; length >= 8; length -= 8, data += 8)
+    {
+        crc64 = __builtin_ia32_crc32di(crc64, *(const uint64_t*)data);
+    }
+    for (; length > 0; length--, data++)
+    {
+        crc64 = __builtin_ia32_crc32qi((uint32_t)crc64, *data);
+    }
+    return (uint32_t)crc64;
+}
+#endif
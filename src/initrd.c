@@ -0,0 +1,120 @@
+#include "initrd.h"
+#include "logger.h"
+#include "bootutils.h"
+
+// The vendor media device path the Linux EFI stub (5.8 and later) loads its initrd from
+#define LINUX_EFI_INITRD_MEDIA_GUID { 0x5568e427, 0x68fc, 0x4f3d, {0xac, 0x74, 0xca, 0x55, 0x52, 0x31, 0xcc, 0x68} }
+
+typedef struct initrd_device_path_s
+{
+    efi_vendor_device_path_t vendor;
+    efi_device_path_t end;
+} initrd_device_path_s;
+
+static efi_status_t EFIAPI LoadInitrdFile(efi_load_file2_protocol_t* this, efi_device_path_t* filePath,
+    boolean_t bootPolicy, uintn_t* bufferSize, void* buffer);
+
+static initrd_device_path_s initrdDevicePath = {
+    { { MEDIA_DEVICE_PATH, MEDIA_VENDOR_DP, { sizeof(efi_vendor_device_path_t), 0 } }, LINUX_EFI_INITRD_MEDIA_GUID },
+    { END_DEVICE_PATH_TYPE, END_ENTIRE_DEVICE_PATH_SUBTYPE, { sizeof(efi_device_path_t), 0 } }
+};
+static efi_load_file2_protocol_t initrdLoadFile = { LoadInitrdFile };
+
+static efi_handle_t initrdHandle = NULL;
+static initrd_part_s initrdParts[MAX_INITRD_PARTS];
+static uintn_t initrdPartCount = 0;
+static uint64_t initrdSize = 0;
+
+
+// Serves initrds that are already in memory to the kernel, so the bytes the kernel gets are the ones that were read
+// The parts are concatenated like the kernel does with several initrds, they don't have to be next to each other
+// The data has to stay allocated until UninstallInitrd is called
+efi_status_t InstallInitrd(const initrd_part_s* parts, uintn_t count)
+{
+    if (count > MAX_INITRD_PARTS)
+    {
+        return EFI_INVALID_PARAMETER;
+    }
+    memcpy(initrdParts, parts, sizeof(initrd_part_s) * count);
+    initrdPartCount = count;
+    initrdSize = 0;
+    for (uintn_t i = 0; i < count; i++)
+    {
+        initrdSize += parts[i].size;
+    }
+    if (initrdHandle != NULL)
+    {
+        return EFI_SUCCESS;
+    }
+
+    efi_guid_t devPathGuid = EFI_DEVICE_PATH_PROTOCOL_GUID;
+    efi_guid_t loadFileGuid = EFI_LOAD_FILE2_PROTOCOL_GUID;
+    efi_status_t status = BS->InstallProtocolInterface(&initrdHandle, &devPathGuid, EFI_NATIVE_INTERFACE,
+        &initrdDevicePath);
+    if (EFI_ERROR(status))
+    {
+        // Usually another loader already installed one
+        Log(LL_ERROR, status, "Failed to install the initrd device path.");
+        initrdHandle = NULL;
+        return status;
+    }
+
+    status = BS->InstallProtocolInterface(&initrdHandle, &loadFileGuid, EFI_NATIVE_INTERFACE, &initrdLoadFile);
+    if (EFI_ERROR(status))
+    {
+        Log(LL_ERROR, status, "Failed to install the initrd load file protocol.");
+        BS->UninstallProtocolInterface(initrdHandle, &devPathGuid, &initrdDevicePath);
+        initrdHandle = NULL;
+    }
+    return status;
+}
+
+void UninstallInitrd(void)
+{
+    if (initrdHandle == NULL)
+    {
+        return;
+    }
+
+    efi_guid_t devPathGuid = EFI_DEVICE_PATH_PROTOCOL_GUID;
+    efi_guid_t loadFileGuid = EFI_LOAD_FILE2_PROTOCOL_GUID;
+    BS->UninstallProtocolInterface(initrdHandle, &loadFileGuid, &initrdLoadFile);
+    BS->UninstallProtocolInterface(initrdHandle, &devPathGuid, &initrdDevicePath);
+    initrdHandle = NULL;
+    initrdPartCount = 0;
+    initrdSize = 0;
+}
+
+// Called by the kernel, first without a buffer to get the size and then again to copy the initrd
+static efi_status_t EFIAPI LoadInitrdFile(efi_load_file2_protocol_t* this, efi_device_path_t* filePath,
+    boolean_t bootPolicy, uintn_t* bufferSize, void* buffer)
+{
+    if (bufferSize == NULL)
+    {
+        return EFI_INVALID_PARAMETER;
+    }
+    // LoadFile2 never loads boot options
+    if (bootPolicy)
+    {
+        return EFI_UNSUPPORTED;
+    }
+    if (initrdPartCount == 0)
+    {
+        return EFI_NOT_FOUND;
+    }
+
+    if (buffer == NULL || *bufferSize < initrdSize)
+    {
+        *bufferSize = initrdSize;
+        return EFI_BUFFER_TOO_SMALL;
+    }
+
+    uint8_t* pos = buffer;
+    for (uintn_t i = 0; i < initrdPartCount; i++)
+    {
+        memcpy(pos, initrdParts[i].data, initrdParts[i].size);
+        pos += initrdParts[i].size;
+    }
+    *bufferSize = initrdSize;
+    return EFI_SUCCESS;
+}
@@ -1,103 +1,463 @@
 #include "logger.h"
 #include "shellutils.h"
+#include "shellerr.h"
+#include "bootutils.h"
 #include "version.h"
+#include "clock.h"
+#include "logviewer.h"
 
 #define LOG_PATH        ("\\EFI\\lucidloader\\log.txt")
-#define OLD_LOG_PATH    ("\\EFI\\lucidloader\\log.txt.old")
-
-#define SECONDS_IN_DAY (86400)
-#define SECONDS_IN_HOUR (3600)
-#define SECONDS_IN_MINUTE (60)
+#define LOG_FILE_NAME   ("log.txt")
+// Shown by the viewer in place of the path in memory mode
+#define LOG_MEMORY_NAME ("log in memory")
+
+// Old logs are kept as log.txt.1 (newest) up to log.txt.N (oldest)
+#define DEFAULT_LOG_RETENTION (3)
+#define MAX_LOG_RETENTION (99)
+#define LOG_GENERATION_PATH_MAX (64)
+
+// Log records are kept in a RAM buffer and written to the log file in batches
+#define LOG_BUFFER_SIZE (EFI_PAGE_SIZE * 4)
+// The buffer is flushed early once this many bytes are waiting to be written
+#define LOG_FLUSH_THRESHOLD (LOG_BUFFER_SIZE / 4 * 3)
+// While the records can't be written the buffer grows in pages up to this size, later records are dropped
+// The last record's worth of it is kept for the note that says how many were dropped
+#define LOG_BUFFER_MAX (EFI_PAGE_SIZE * 256)
+// Longer records are truncated
+#define LOG_RECORD_MAX (512)
+
+// In memory mode the log is handed to the OS in this volatile variable
+#define LOG_VARIABLE_NAME (L"LucidLoaderLog")
+// The published log is halved until the firmware accepts it, but not below this size
+#define LOG_VARIABLE_MIN_SIZE (1024)
 
 static efi_time_t timeSinceInit = {0};
 
-
-// Creates an empty log file and initializes the timeSinceInit variable
+log_level_t runtimeLogLevel = LL_INFO;
+
+static char_t initialLogBuffer[LOG_BUFFER_SIZE];
+static char_t* logBuffer = initialLogBuffer;
+static uintn_t logBufferSize = LOG_BUFFER_SIZE;
+static uintn_t logBufferPages = 0; // Not 0 once the buffer has grown into pages
+static uintn_t logPending = 0; // Bytes of records that are not in the log file yet, the whole log in memory mode
+static uintn_t logWritten = 0; // Bytes at the start of the memory log that LogFlushToFile() already wrote
+static uint64_t droppedRecords = 0;
+static boolean_t reportingDrops = FALSE;
+static boolean_t flushing = FALSE;
+
+static log_mode_t logMode = LOG_MODE_FILE;
+// Nothing is written until the config says where the log goes, the records are held in the buffer until then
+static boolean_t logModeKnown = FALSE;
+// The logs are only rotated and the log file truncated by the first flush
+static boolean_t logFileStarted = FALSE;
+static uint32_t logRetention = DEFAULT_LOG_RETENTION;
+static uint64_t logMaxSize = 0; // 0 means that the log file size isn't limited
+static uint64_t logFileSize = 0; // Bytes written to the current log file
+
+static void AppendToBuffer(const char_t* record, uintn_t len);
+static boolean_t GrowLogBuffer(uintn_t needed);
+static void ShrinkLogBuffer(void);
+static void ReportDroppedRecords(void);
+static boolean_t WriteLogFile(boolean_t keepRecords);
+static FILE* OpenLogFile(void);
+static void RotateLogs(void);
+static void PublishLogVariable(void);
+
+#ifdef LUCIDLOADER_DEBUG
+static void LogLeakedBuffer(void* ptr, size_t size, const char* file, int line, void* data);
+#endif
+
+
+// Initializes the timeSinceInit variable, the log file isn't touched until the first flush
+// because the config may ask for the log to stay in memory
 // Returns 1 on success and 0 on failure
 int8_t InitLogger(void)
 {
-    // If a log file already exists, keep it as an old log
-    FILE* fp = fopen(LOG_PATH, "r");
-    if (fp != NULL)
+    efi_status_t status = RT->GetTime(&timeSinceInit, NULL);
+    if (EFI_ERROR(status) || timeSinceInit.Day == 0)
     {
-        fclose(fp);
-        CopyFile(LOG_PATH, OLD_LOG_PATH);
+        return 0;
     }
 
-    fp = fopen(LOG_PATH, "w");
-    if (fp != NULL)
-    {
-        fclose(fp);
-        RT->GetTime(&timeSinceInit, NULL);
+    // Print the date of the log and the version of the boot manager
+    // These are always logged, whatever the log level is
+    LogMessage(LL_INFO, 0, "Starting %s v%s", LUCIDLOADER_NAME_STR, LUCIDLOADER_VERSION);
+    LogMessage(LL_INFO, 0, "Log date: %02d/%02d/%04d %02d:%02d:%02d.", 
+        timeSinceInit.Day, timeSinceInit.Month, timeSinceInit.Year,
+        timeSinceInit.Hour, timeSinceInit.Minute, timeSinceInit.Second);
 
-        // Print the date of the log and the version of the boot manager
-        Log(LL_INFO, 0, "Starting %s v%s", LUCIDLOADER_NAME_STR, LUCIDLOADER_VERSION);
-        Log(LL_INFO, 0, "Log date: %02d/%02d/%04d %02d:%02d:%02d.", 
-            timeSinceInit.Day, timeSinceInit.Month, timeSinceInit.Year,
-            timeSinceInit.Hour, timeSinceInit.Minute, timeSinceInit.Second);
+    return 1;
+}
 
-        return 1;
+// LOG_MODE_MEMORY keeps the whole log in RAM, LogFlush() doesn't write anything in that mode
+// and LogHandOff() publishes the log as a UEFI variable instead
+// The records that were held until the mode was set are written by the next flush in LOG_MODE_FILE
+void SetLogMode(log_mode_t mode)
+{
+    logMode = mode;
+    logModeKnown = TRUE;
+}
+
+log_mode_t GetLogMode(void)
+{
+    return logMode;
+}
+
+// Sets how many old logs are kept, 0 keeps none
+void SetLogRetention(uint32_t count)
+{
+    if (count > MAX_LOG_RETENTION)
+    {
+        Log(LL_WARNING, 0, "Log retention %d is too high, keeping %d old logs.", count, MAX_LOG_RETENTION);
+        count = MAX_LOG_RETENTION;
     }
-    return 0;
+    logRetention = count;
+}
+
+// The logs are rotated once the log file reaches maxSize bytes, even in the middle of a session
+// A maxSize of 0 disables the limit
+void SetLogMaxSize(uint64_t maxSize)
+{
+    logMaxSize = maxSize;
 }
 
 // The status parameter is optional and can be set to 0 if unneeded
 // fmtMessage should be a string literal (with optional formatting like printf)
 // the last ... are for formatting fmtMessage
-void Log(log_level_t loglevel, efi_status_t status, const char_t* fmtMessage, ...)
+// The record is only stored in memory, it reaches the log file on the next LogFlush()
+// Use the Log() macro instead, it skips records below the configured levels without formatting them
+void LogMessage(log_level_t loglevel, efi_status_t status, const char_t* fmtMessage, ...)
 {
-    FILE* log = fopen(LOG_PATH, "a");
-    // Don't log if the logger hasn't been initialized (or file is not writable)
-    if (log == NULL || timeSinceInit.Day == 0)
+    // Don't log if the logger hasn't been initialized
+    if (timeSinceInit.Day == 0)
     {
         return;
     }
-    
-    // Print the seconds since launch and log level
-    fprintf(log, "[%04ds] [%s] ", GetSecondsSinceInit(), LogLevelString(loglevel));
+
+    char_t record[LOG_RECORD_MAX];
+
+    // Print the time since launch with microsecond resolution and the log level
+    uint64_t now = GetMicrosecondsSinceInit();
+    int len = snprintf(record, LOG_RECORD_MAX, "[%04d.%06ds] [%s] ",
+        now / US_IN_SECOND, now % US_IN_SECOND, LogLevelString(loglevel));
 
     // Print the string and add formatting (if there is any)
     va_list args;
     va_start(args, fmtMessage);
-    vfprintf(log, fmtMessage, args);
+    len += vsnprintf(record + len, LOG_RECORD_MAX - len, fmtMessage, args);
     va_end(args);
 
     // Append a UEFI error message if the status argument is an error status
     if (EFI_ERROR(status))
     {
-        fprintf(log, " (EFI Error: %s)", EfiErrorString(status));
+        len += snprintf(record + len, LOG_RECORD_MAX - len, " (EFI Error: %s)", EfiErrorString(status));
+    }
+
+    // Truncated records still have to end with a newline
+    if (len > LOG_RECORD_MAX - 3)
+    {
+        len = LOG_RECORD_MAX - 3;
+    }
+    len += snprintf(record + len, LOG_RECORD_MAX - len, "\n");
+
+    AppendToBuffer(record, len);
+}
+
+// Writes every pending record to the log file with a single open and close
+// Returns FALSE if the log file couldn't be written, the records stay pending in that case
+boolean_t LogFlush(void)
+{
+    if (logMode == LOG_MODE_MEMORY || !logModeKnown)
+    {
+        return TRUE;
+    }
+    return WriteLogFile(FALSE);
+}
+
+// Writes the log file in either mode, for failures that make the log worth the write
+// The log mode doesn't change, a memory log is kept whole and is still published at hand off
+// The records are only written once, a later call appends the ones that were logged since
+boolean_t LogFlushToFile(void)
+{
+    // The config wasn't read, so the log goes to the file like it does by default
+    logModeKnown = TRUE;
+    return WriteLogFile(logMode == LOG_MODE_MEMORY);
+}
+
+// Called right before another image is started, which may never return
+void LogHandOff(void)
+{
+    if (logMode == LOG_MODE_MEMORY)
+    {
+        PublishLogVariable();
     }
+    else
+    {
+        LogFlush();
+    }
+}
 
-    fprintf(log, "\n");
-    fclose(log);
+// Appends the records that aren't in the log file yet, keepRecords leaves them in the buffer for the memory log
+static boolean_t WriteLogFile(boolean_t keepRecords)
+{
+    if (logPending == logWritten || flushing)
+    {
+        return TRUE;
+    }
+    flushing = TRUE;
+
+    // Opening the file may log, those records are written too
+    boolean_t success = FALSE;
+    uintn_t end = 0;
+    FILE* log = OpenLogFile();
+    if (log != NULL)
+    {
+        end = logPending;
+        success = fwrite(logBuffer + logWritten, 1, end - logWritten, log) == end - logWritten;
+        fclose(log);
+    }
+
+    if (success)
+    {
+        logFileSize += end - logWritten;
+        logWritten = end;
+        if (!keepRecords)
+        {
+            // Records logged while the file was written stay pending
+            logPending -= end;
+            logWritten = 0;
+            memmove(logBuffer, logBuffer + end, logPending);
+            // The buffer only grew because the records couldn't be written
+            ShrinkLogBuffer();
+        }
+
+        // The next flush starts a new log file
+        if (logMaxSize != 0 && logFileSize >= logMaxSize)
+        {
+            logFileStarted = FALSE;
+        }
+    }
+    flushing = FALSE;
+
+    if (success)
+    {
+        ReportDroppedRecords();
+    }
+    return success;
+}
+
+// The first flush of the session (or after the size limit was hit) rotates the logs and starts a new one
+static FILE* OpenLogFile(void)
+{
+    if (logFileStarted)
+    {
+        return fopen(LOG_PATH, "a");
+    }
+
+    RotateLogs();
+
+    FILE* fp = fopen(LOG_PATH, "w");
+    if (fp != NULL)
+    {
+        logFileStarted = TRUE;
+        logFileSize = 0;
+    }
+    return fp;
 }
 
-time_t GetSecondsSinceInit(void)
+// Drops the oldest log, moves every other old log one generation up and the log file to log.txt.1
+// Renaming only changes directory entries, so the cost doesn't depend on the size of the logs
+static void RotateLogs(void)
 {
-    efi_time_t currTime = {0};
-    efi_status_t status = RT->GetTime(&currTime, NULL);
+    // The log file is simply truncated when no old logs are kept
+    FILE* fp = fopen(LOG_PATH, "r");
+    if (fp == NULL || logRetention == 0)
+    {
+        if (fp != NULL)
+        {
+            fclose(fp);
+        }
+        return;
+    }
+    fclose(fp);
+
+    char_t path[LOG_GENERATION_PATH_MAX];
+    char_t newName[LOG_GENERATION_PATH_MAX];
+
+    snprintf(path, LOG_GENERATION_PATH_MAX, "%s.%d", LOG_PATH, logRetention);
+    remove(path);
+
+    // Missing generations are skipped, the rename simply fails for them
+    for (int32_t i = logRetention - 1; i >= 1; i--)
+    {
+        snprintf(path, LOG_GENERATION_PATH_MAX, "%s.%d", LOG_PATH, i);
+        snprintf(newName, LOG_GENERATION_PATH_MAX, "%s.%d", LOG_FILE_NAME, i + 1);
+        RenameFile(path, newName);
+    }
+
+    snprintf(newName, LOG_GENERATION_PATH_MAX, "%s.1", LOG_FILE_NAME);
+    efi_status_t status = RenameFile(LOG_PATH, newName);
     if (EFI_ERROR(status))
     {
-        return 0;
+        // Fall back to copying if the firmware can't rename files
+        snprintf(path, LOG_GENERATION_PATH_MAX, "%s.1", LOG_PATH);
+        CopyFile(LOG_PATH, path);
+    }
+}
+
+// Copies the whole log to a volatile variable the OS can read
+// The oldest records are dropped if the firmware rejects the size of the variable
+static void PublishLogVariable(void)
+{
+    ReportDroppedRecords();
+
+    efi_guid_t logGuid = LOG_VARIABLE_GUID;
+    efi_status_t status = EFI_SUCCESS;
+    uintn_t size = logPending;
+    do
+    {
+        status = RT->SetVariable(LOG_VARIABLE_NAME, &logGuid,
+            EFI_VARIABLE_BOOTSERVICE_ACCESS | EFI_VARIABLE_RUNTIME_ACCESS,
+            size, logBuffer + logPending - size);
+
+        size /= 2;
+    } while ((status == EFI_OUT_OF_RESOURCES || status == EFI_INVALID_PARAMETER) && size >= LOG_VARIABLE_MIN_SIZE);
+}
+
+static void AppendToBuffer(const char_t* record, uintn_t len)
+{
+    // Make room for the record, the buffer grows if the records can't be written yet
+    if (logPending + len > logBufferSize)
+    {
+        LogFlush();
+    }
+    uintn_t limit = reportingDrops ? LOG_BUFFER_MAX : LOG_BUFFER_MAX - LOG_RECORD_MAX;
+    if (logPending + len > limit || (logPending + len > logBufferSize && !GrowLogBuffer(logPending + len)))
+    {
+        droppedRecords++;
+        return;
+    }
+
+    memcpy(logBuffer + logPending, record, len);
+    logPending += len;
+
+    if (logPending >= LOG_FLUSH_THRESHOLD)
+    {
+        LogFlush();
+    }
+}
+
+// The buffer is doubled, the pages aren't allocated from the heap so they don't show up in the heap statistics
+static boolean_t GrowLogBuffer(uintn_t needed)
+{
+    uintn_t newSize = logBufferSize;
+    while (newSize < needed)
+    {
+        newSize *= 2;
+    }
+    if (newSize > LOG_BUFFER_MAX)
+    {
+        newSize = LOG_BUFFER_MAX;
     }
 
-    time_t seconds = 0;
-    seconds += (currTime.Day - timeSinceInit.Day) * SECONDS_IN_DAY;
-    seconds += (currTime.Hour - timeSinceInit.Hour) * SECONDS_IN_HOUR;
-    seconds += (currTime.Minute - timeSinceInit.Minute) * SECONDS_IN_MINUTE;
-    seconds += currTime.Second - timeSinceInit.Second;
-    
-    return seconds;
+    efi_physical_address_t addr = 0;
+    if (EFI_ERROR(BS->AllocatePages(AllocateAnyPages, EfiLoaderData, EFI_SIZE_TO_PAGES(newSize), &addr)))
+    {
+        return FALSE;
+    }
+    memcpy((char_t*)addr, logBuffer, logPending);
+    if (logBufferPages != 0)
+    {
+        BS->FreePages((efi_physical_address_t)logBuffer, logBufferPages);
+    }
+    logBuffer = (char_t*)addr;
+    logBufferSize = newSize;
+    logBufferPages = EFI_SIZE_TO_PAGES(newSize);
+    return TRUE;
+}
+
+// Goes back to the initial buffer once the pending records fit in it
+static void ShrinkLogBuffer(void)
+{
+    if (logBufferPages == 0 || logPending > LOG_BUFFER_SIZE)
+    {
+        return;
+    }
+    memcpy(initialLogBuffer, logBuffer, logPending);
+    BS->FreePages((efi_physical_address_t)logBuffer, logBufferPages);
+    logBuffer = initialLogBuffer;
+    logBufferSize = LOG_BUFFER_SIZE;
+    logBufferPages = 0;
+}
+
+// Records how many records didn't fit, the end of the largest buffer is kept for this record
+static void ReportDroppedRecords(void)
+{
+    if (droppedRecords == 0)
+    {
+        return;
+    }
+    uint64_t count = droppedRecords;
+    droppedRecords = 0;
+    reportingDrops = TRUE;
+    LogMessage(LL_WARNING, 0, "%d log records were dropped, the log buffer was full.", count);
+    reportingDrops = FALSE;
+}
+
+// Opens the current log in the log viewer, the log file or, in memory mode, the records in the buffer
+// Returns 0 on success, otherwise an error code that can be passed to PrintCommandError
+int32_t ViewLogFile(log_filter_t filter)
+{
+    if (logMode == LOG_MODE_FILE && logModeKnown)
+    {
+        // The viewer reads the file, so the pending records have to be in it
+        LogFlush();
+        return StartLogViewer(LOG_PATH, filter);
+    }
+
+    // log.txt is from an earlier session, the viewer gets a copy because the buffer moves when it grows
+    uintn_t size = logPending;
+    char_t* copy = malloc(size + 1);
+    if (copy == NULL)
+    {
+        return CMD_OUT_OF_MEMORY;
+    }
+    memcpy(copy, logBuffer, size);
+    int32_t res = StartLogViewerInMemory(LOG_MEMORY_NAME, copy, size, filter);
+    free(copy);
+    return res;
+}
+
+#ifdef LUCIDLOADER_DEBUG
+uint64_t HeapCheckpoint(void)
+{
+    heap_stats_t stats;
+    heap_stats(&stats);
+    return stats.seq;
+}
+
+// Logs every buffer that was allocated after the checkpoint and is still alive
+void LogHeapLeaks(uint64_t checkpoint, const char_t* scope)
+{
+    uint64_t leakedBytes = 0;
+    heap_walk(checkpoint, LogLeakedBuffer, &leakedBytes);
+
+    if (leakedBytes != 0)
+    {
+        Log(LL_WARNING, 0, "The %s leaked %d bytes in total.", scope, leakedBytes);
+    }
 }
 
-void PrintLogFile(void)
+static void LogLeakedBuffer(void* ptr, size_t size, const char* file, int line, void* data)
 {
-    uint8_t res = PrintFileContent(LOG_PATH);
-    if (res != 0)
+    *(uint64_t*)data += size;
+    if (file == NULL)
     {
-        printf("Failed to open log file!\n");
+        file = "untagged";
     }
+    Log(LL_WARNING, 0, "Leaked %d bytes at %p (allocated at %s:%d)", size, ptr, file, line);
 }
+#endif
 
 const char_t* LogLevelString(log_level_t loglevel)
 {
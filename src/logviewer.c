@@ -0,0 +1,563 @@
+#include "logviewer.h"
+#include "bootutils.h"
+#include "shellutils.h"
+#include "shellerr.h"
+#include "editor.h"
+#include "screen.h"
+#include "clock.h"
+
+// The only part of the file that is held in memory
+#define VIEWER_WINDOW_SIZE (64 * 1024)
+// The offset of every Nth shown line is indexed, the lines in between are found by reading forward
+#define LINE_INDEX_STRIDE (64)
+#define LINE_INDEX_INITIAL_CAPACITY (64)
+
+#define TIMESTAMP_INPUT_SIZE (16)
+#define IS_DIGIT(c) ((c) >= '0' && (c) <= '9')
+
+#define QUIT_CHAR           ('q')
+#define LINE_DOWN_CHAR      ('j')
+#define LINE_UP_CHAR        ('k')
+#define PAGE_DOWN_CHAR      (' ')
+#define PAGE_UP_CHAR        ('b')
+#define TOP_CHAR            ('g')
+#define END_CHAR            ('G')
+#define FILTER_ALL_CHAR     ('a')
+#define FILTER_WARNING_CHAR ('w')
+#define FILTER_ERROR_CHAR   ('e')
+#define TIMESTAMP_CHAR      ('t')
+
+typedef struct log_viewer_s
+{
+    const char_t* path; // Shown in the status bar, the name of the log if it is in memory
+    FILE* file; // NULL if the log is in memory
+    const char_t* data; // The log in memory, only used without a file
+    uint64_t fileSize;
+
+    char_t* window; // A bounded window of the file
+    uint64_t windowStart; // The file offset of window[0]
+    uintn_t windowLen;
+
+    log_filter_t filter;
+    uint64_t* index; // Offsets of every LINE_INDEX_STRIDE-th line that passes the filter
+    uintn_t indexCount;
+    uintn_t indexCap;
+    uint64_t lineCount; // Lines that pass the filter
+
+    uint64_t topLine; // The first line on the screen
+    uintn_t rows; // Rows for lines, the last row of the screen is the status bar
+    uintn_t cols;
+    char_t* rowBuf;
+} log_viewer_s;
+
+static int32_t RunLogViewer(log_viewer_s* viewer);
+
+/* File access */
+static boolean_t FillWindow(log_viewer_s* viewer, uint64_t offset);
+static boolean_t ReadLine(log_viewer_s* viewer, uint64_t offset, const char_t** line, uintn_t* len, uint64_t* next);
+static boolean_t FindShownLine(log_viewer_s* viewer, uint64_t* offset, const char_t** line, uintn_t* len, uint64_t* next);
+static boolean_t LinePassesFilter(log_filter_t filter, const char_t* line, uintn_t len);
+
+/* Line index */
+static boolean_t BuildLineIndex(log_viewer_s* viewer);
+static uint64_t GetLineOffset(log_viewer_s* viewer, uint64_t lineNum);
+
+/* Navigation */
+static void ScrollTo(log_viewer_s* viewer, int64_t lineNum);
+static void JumpToTimestamp(log_viewer_s* viewer);
+static boolean_t ParseTimestamp(const char_t* line, uintn_t len, uint64_t* us);
+static boolean_t GetFirstTimestamp(log_viewer_s* viewer, uint64_t lineNum, uint64_t* us);
+
+/* Output */
+static void DrawViewer(log_viewer_s* viewer);
+static void DrawStatusBar(log_viewer_s* viewer, const char_t* prompt);
+static const char_t* FilterString(log_filter_t filter);
+
+
+// Shows a file in pages, the viewer starts at the end of the file because that's where the latest records are
+// Returns 0 on success, otherwise an error code that can be passed to PrintCommandError
+int32_t StartLogViewer(char_t* path, log_filter_t filter)
+{
+    log_viewer_s viewer = {0};
+    viewer.path = path;
+    viewer.filter = filter;
+
+    viewer.file = fopen(path, "r");
+    if (viewer.file == NULL)
+    {
+        return errno;
+    }
+    viewer.fileSize = GetFileSize(viewer.file);
+
+    int32_t res = RunLogViewer(&viewer);
+    fclose(viewer.file);
+    return res;
+}
+
+// Shows a log that is held in memory the same way, name takes the place of the path in the status bar
+// The data has to stay unchanged until the viewer returns
+int32_t StartLogViewerInMemory(const char_t* name, const char_t* data, uint64_t size, log_filter_t filter)
+{
+    log_viewer_s viewer = {0};
+    viewer.path = name;
+    viewer.filter = filter;
+    viewer.data = data;
+    viewer.fileSize = size;
+    return RunLogViewer(&viewer);
+}
+
+static int32_t RunLogViewer(log_viewer_s* viewer)
+{
+    viewer->rows = (screenModeSet ? screenRows : DEFAULT_CONSOLE_ROWS) - 1;
+    viewer->cols = screenModeSet ? screenCols : DEFAULT_CONSOLE_COLUMNS;
+
+    int32_t res = CMD_SUCCESS;
+    viewer->window = malloc(VIEWER_WINDOW_SIZE);
+    viewer->rowBuf = malloc(viewer->cols + 1);
+    if (viewer->window == NULL || viewer->rowBuf == NULL || !BuildLineIndex(viewer))
+    {
+        res = CMD_OUT_OF_MEMORY;
+        goto cleanup;
+    }
+
+    ST->ConOut->ClearScreen(ST->ConOut);
+    ST->ConOut->EnableCursor(ST->ConOut, FALSE);
+    ScrollTo(viewer, viewer->lineCount);
+
+    boolean_t quit = FALSE;
+    while (!quit)
+    {
+        DrawViewer(viewer);
+
+        efi_input_key_t key = GetInputKey();
+        switch (key.ScanCode)
+        {
+            case UP_ARROW_SCANCODE:
+                ScrollTo(viewer, (int64_t)viewer->topLine - 1);
+                break;
+            case DOWN_ARROW_SCANCODE:
+                ScrollTo(viewer, viewer->topLine + 1);
+                break;
+            case PAGEUP_KEY_SCANCODE:
+                ScrollTo(viewer, (int64_t)viewer->topLine - viewer->rows);
+                break;
+            case PAGEDOWN_KEY_SCANCODE:
+                ScrollTo(viewer, viewer->topLine + viewer->rows);
+                break;
+            case HOME_KEY_SCANCODE:
+                ScrollTo(viewer, 0);
+                break;
+            case END_KEY_SCANCODE:
+                ScrollTo(viewer, viewer->lineCount);
+                break;
+            case ESCAPE_KEY_SCANCODE:
+                quit = TRUE;
+                break;
+
+            default:
+                switch (key.UnicodeChar)
+                {
+                    case LINE_UP_CHAR:
+                        ScrollTo(viewer, (int64_t)viewer->topLine - 1);
+                        break;
+                    case LINE_DOWN_CHAR:
+                        ScrollTo(viewer, viewer->topLine + 1);
+                        break;
+                    case PAGE_UP_CHAR:
+                        ScrollTo(viewer, (int64_t)viewer->topLine - viewer->rows);
+                        break;
+                    case PAGE_DOWN_CHAR:
+                        ScrollTo(viewer, viewer->topLine + viewer->rows);
+                        break;
+                    case TOP_CHAR:
+                        ScrollTo(viewer, 0);
+                        break;
+                    case END_CHAR:
+                        ScrollTo(viewer, viewer->lineCount);
+                        break;
+
+                    case FILTER_ALL_CHAR:
+                    case FILTER_WARNING_CHAR:
+                    case FILTER_ERROR_CHAR:
+                        viewer->filter = key.UnicodeChar == FILTER_ALL_CHAR ? LOG_FILTER_ALL :
+                            key.UnicodeChar == FILTER_WARNING_CHAR ? LOG_FILTER_WARNINGS : LOG_FILTER_ERRORS;
+                        if (!BuildLineIndex(viewer))
+                        {
+                            res = CMD_OUT_OF_MEMORY;
+                            quit = TRUE;
+                            break;
+                        }
+                        ScrollTo(viewer, viewer->lineCount);
+                        break;
+
+                    case TIMESTAMP_CHAR:
+                        JumpToTimestamp(viewer);
+                        break;
+
+                    case QUIT_CHAR:
+                        quit = TRUE;
+                        break;
+
+                    default:
+                        // Nothing
+                        break;
+                }
+        }
+    }
+    ST->ConOut->ClearScreen(ST->ConOut);
+
+cleanup:
+    free(viewer->window);
+    free(viewer->rowBuf);
+    free(viewer->index);
+    return res;
+}
+
+// Moves the window to start at offset, returns FALSE if nothing could be read
+static boolean_t FillWindow(log_viewer_s* viewer, uint64_t offset)
+{
+    viewer->windowStart = offset;
+    viewer->windowLen = 0;
+    if (viewer->file == NULL)
+    {
+        uint64_t left = offset < viewer->fileSize ? viewer->fileSize - offset : 0;
+        viewer->windowLen = left < VIEWER_WINDOW_SIZE ? left : VIEWER_WINDOW_SIZE;
+        memcpy(viewer->window, viewer->data + offset, viewer->windowLen);
+        return viewer->windowLen != 0;
+    }
+    if (fseek(viewer->file, offset, SEEK_SET) != 0)
+    {
+        return FALSE;
+    }
+    viewer->windowLen = fread(viewer->window, 1, VIEWER_WINDOW_SIZE, viewer->file);
+    return viewer->windowLen != 0;
+}
+
+// Gets the line that starts at offset and the offset of the line after it
+// Lines longer than the window are split, the line pointer is valid until the window moves
+static boolean_t ReadLine(log_viewer_s* viewer, uint64_t offset, const char_t** line, uintn_t* len, uint64_t* next)
+{
+    if (offset >= viewer->fileSize)
+    {
+        return FALSE;
+    }
+
+    if (offset < viewer->windowStart || offset >= viewer->windowStart + viewer->windowLen)
+    {
+        if (!FillWindow(viewer, offset))
+        {
+            return FALSE;
+        }
+    }
+
+    uintn_t pos = offset - viewer->windowStart;
+    char_t* newline = memchr(viewer->window + pos, '\n', viewer->windowLen - pos);
+    if (newline == NULL && pos != 0 && viewer->windowStart + viewer->windowLen < viewer->fileSize)
+    {
+        // The line continues past the window, move the window to the start of the line
+        if (!FillWindow(viewer, offset))
+        {
+            return FALSE;
+        }
+        pos = 0;
+        newline = memchr(viewer->window, '\n', viewer->windowLen);
+    }
+
+    uintn_t end = newline != NULL ? (uintn_t)(newline - viewer->window) : viewer->windowLen;
+    *line = viewer->window + pos;
+    *len = end - pos;
+    *next = viewer->windowStart + end + (newline != NULL ? 1 : 0);
+
+    // The log is written with CRLF line endings
+    if (*len > 0 && (*line)[*len - 1] == '\r')
+    {
+        (*len)--;
+    }
+    return TRUE;
+}
+
+// Finds the first line at or after *offset that passes the filter, *offset is set to the start of that line
+static boolean_t FindShownLine(log_viewer_s* viewer, uint64_t* offset, const char_t** line, uintn_t* len, uint64_t* next)
+{
+    while (ReadLine(viewer, *offset, line, len, next))
+    {
+        if (LinePassesFilter(viewer->filter, *line, *len))
+        {
+            return TRUE;
+        }
+        *offset = *next;
+    }
+    return FALSE;
+}
+
+static boolean_t LinePassesFilter(log_filter_t filter, const char_t* line, uintn_t len)
+{
+    switch (filter)
+    {
+        case LOG_FILTER_ERRORS:
+            return memmem(line, len, "[ERROR]", 7) != NULL;
+
+        case LOG_FILTER_WARNINGS:
+            return memmem(line, len, "[ERROR]", 7) != NULL || memmem(line, len, "[WARNING]", 9) != NULL;
+
+        default:
+            return TRUE;
+    }
+}
+
+// Reads the whole file once and records the offset of every LINE_INDEX_STRIDE-th line that passes the filter
+static boolean_t BuildLineIndex(log_viewer_s* viewer)
+{
+    viewer->indexCount = 0;
+    viewer->lineCount = 0;
+    viewer->topLine = 0;
+
+    const char_t* line;
+    uintn_t len;
+    uint64_t offset = 0;
+    uint64_t next = 0;
+    while (FindShownLine(viewer, &offset, &line, &len, &next))
+    {
+        if (viewer->lineCount % LINE_INDEX_STRIDE == 0)
+        {
+            if (viewer->indexCount == viewer->indexCap)
+            {
+                uintn_t newCap = viewer->indexCap == 0 ? LINE_INDEX_INITIAL_CAPACITY : viewer->indexCap * 2;
+                uint64_t* newIndex = realloc(viewer->index, newCap * sizeof(uint64_t));
+                if (newIndex == NULL)
+                {
+                    return FALSE;
+                }
+                viewer->index = newIndex;
+                viewer->indexCap = newCap;
+            }
+            viewer->index[viewer->indexCount++] = offset;
+        }
+        viewer->lineCount++;
+        offset = next;
+    }
+    return TRUE;
+}
+
+// Returns the file offset of a line that passes the filter, lineNum must be lower than lineCount
+static uint64_t GetLineOffset(log_viewer_s* viewer, uint64_t lineNum)
+{
+    uint64_t offset = viewer->index[lineNum / LINE_INDEX_STRIDE];
+
+    const char_t* line;
+    uintn_t len;
+    uint64_t next = 0;
+    for (uint64_t i = 0; i < lineNum % LINE_INDEX_STRIDE; i++)
+    {
+        if (!FindShownLine(viewer, &offset, &line, &len, &next))
+        {
+            break;
+        }
+        offset = next;
+    }
+    return offset;
+}
+
+// Scrolls so lineNum is the top line, without scrolling past the last page
+static void ScrollTo(log_viewer_s* viewer, int64_t lineNum)
+{
+    int64_t lastTop = (int64_t)viewer->lineCount - viewer->rows;
+    if (lineNum > lastTop)
+    {
+        lineNum = lastTop;
+    }
+    if (lineNum < 0)
+    {
+        lineNum = 0;
+    }
+    viewer->topLine = lineNum;
+}
+
+// Asks for a time since launch and scrolls to the first line logged at or after it
+// The log is written in order, so the index is binary searched by the time of its lines
+static void JumpToTimestamp(log_viewer_s* viewer)
+{
+    DrawStatusBar(viewer, "Go to second: ");
+    ST->ConOut->EnableCursor(ST->ConOut, TRUE);
+    char_t input[TIMESTAMP_INPUT_SIZE] = {0};
+    GetInputString(input, TIMESTAMP_INPUT_SIZE, FALSE);
+    ST->ConOut->EnableCursor(ST->ConOut, FALSE);
+
+    // Accept fractions of a second, like 12.5
+    uint64_t target = 0;
+    uintn_t inputLen = strlen(input);
+    char_t timestamp[TIMESTAMP_INPUT_SIZE + 3];
+    snprintf(timestamp, sizeof(timestamp), "[%ss]", input);
+    if (inputLen == 0 || !ParseTimestamp(timestamp, strlen(timestamp), &target))
+    {
+        return;
+    }
+
+    // Find the last index block that starts before the target
+    uintn_t low = 0;
+    uintn_t high = viewer->indexCount;
+    while (low + 1 < high)
+    {
+        uintn_t mid = (low + high) / 2;
+        uint64_t us = 0;
+        if (!GetFirstTimestamp(viewer, mid * LINE_INDEX_STRIDE, &us) || us <= target)
+        {
+            low = mid;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    // Read forward from the start of the block until the target time
+    uint64_t lineNum = low * LINE_INDEX_STRIDE;
+    uint64_t offset = viewer->indexCount != 0 ? viewer->index[low] : 0;
+    const char_t* line;
+    uintn_t len;
+    uint64_t next = 0;
+    while (FindShownLine(viewer, &offset, &line, &len, &next))
+    {
+        uint64_t us = 0;
+        if (ParseTimestamp(line, len, &us) && us >= target)
+        {
+            break;
+        }
+        lineNum++;
+        offset = next;
+    }
+    ScrollTo(viewer, lineNum);
+}
+
+// Gets the time of the first line with a timestamp in the index block that starts at lineNum
+static boolean_t GetFirstTimestamp(log_viewer_s* viewer, uint64_t lineNum, uint64_t* us)
+{
+    uint64_t offset = viewer->index[lineNum / LINE_INDEX_STRIDE];
+    const char_t* line;
+    uintn_t len;
+    uint64_t next = 0;
+    for (uintn_t i = 0; i < LINE_INDEX_STRIDE && FindShownLine(viewer, &offset, &line, &len, &next); i++)
+    {
+        if (ParseTimestamp(line, len, us))
+        {
+            return TRUE;
+        }
+        offset = next;
+    }
+    return FALSE;
+}
+
+// Parses the "[ssss.uuuuuus]" timestamp at the start of a log record into microseconds
+static boolean_t ParseTimestamp(const char_t* line, uintn_t len, uint64_t* us)
+{
+    uintn_t i = 0;
+    if (len == 0 || line[i++] != '[')
+    {
+        return FALSE;
+    }
+
+    uint64_t seconds = 0;
+    uintn_t digits = 0;
+    for (; i < len && IS_DIGIT(line[i]); i++, digits++)
+    {
+        seconds = seconds * 10 + (line[i] - '0');
+    }
+
+    uint64_t fraction = 0;
+    uint64_t scale = US_IN_SECOND;
+    if (i < len && line[i] == '.')
+    {
+        for (i++; i < len && IS_DIGIT(line[i]); i++, digits++)
+        {
+            if (scale > 1)
+            {
+                scale /= 10;
+                fraction += (line[i] - '0') * scale;
+            }
+        }
+    }
+
+    if (digits == 0 || i >= len || line[i] != 's')
+    {
+        return FALSE;
+    }
+    *us = seconds * US_IN_SECOND + fraction;
+    return TRUE;
+}
+
+static void DrawViewer(log_viewer_s* viewer)
+{
+    PrepareScreenForRedraw();
+
+    const char_t* line;
+    uintn_t len;
+    uint64_t next = 0;
+    uint64_t offset = viewer->topLine < viewer->lineCount ? GetLineOffset(viewer, viewer->topLine) : viewer->fileSize;
+    for (uintn_t row = 0; row < viewer->rows; row++)
+    {
+        uintn_t printLen = 0;
+        if (FindShownLine(viewer, &offset, &line, &len, &next))
+        {
+            // Cut the line at the edge of the screen and hide characters that would break the layout
+            printLen = len < viewer->cols - 1 ? len : viewer->cols - 1;
+            for (uintn_t i = 0; i < printLen; i++)
+            {
+                viewer->rowBuf[i] = IsPrintableChar(line[i]) ? line[i] : ' ';
+            }
+            offset = next;
+        }
+        viewer->rowBuf[printLen] = CHAR_NULL;
+        printf("%s", viewer->rowBuf);
+        PadRow();
+    }
+    DrawStatusBar(viewer, NULL);
+}
+
+// The status bar is on the last row, it is one character short so the screen doesn't scroll
+static void DrawStatusBar(log_viewer_s* viewer, const char_t* prompt)
+{
+    ST->ConOut->SetCursorPosition(ST->ConOut, 0, viewer->rows);
+    ST->ConOut->SetAttribute(ST->ConOut, EFI_TEXT_ATTR(EFI_BLACK, EFI_LIGHTGRAY));
+
+    const uintn_t width = viewer->cols - 1;
+    if (prompt != NULL)
+    {
+        snprintf(viewer->rowBuf, width + 1, "%s", prompt);
+    }
+    else
+    {
+        uint64_t lastShown = viewer->topLine + viewer->rows;
+        if (lastShown > viewer->lineCount)
+        {
+            lastShown = viewer->lineCount;
+        }
+        snprintf(viewer->rowBuf, width + 1, " %s | %d-%d/%d | %s | q:quit g/G:top/end a/w/e:filter t:time",
+            viewer->path, viewer->lineCount == 0 ? 0 : viewer->topLine + 1, lastShown, viewer->lineCount,
+            FilterString(viewer->filter));
+    }
+
+    // Pad the bar to the full width
+    uintn_t len = strlen(viewer->rowBuf);
+    if (prompt == NULL)
+    {
+        memset(viewer->rowBuf + len, ' ', width - len);
+        viewer->rowBuf[width] = CHAR_NULL;
+    }
+    printf("%s", viewer->rowBuf);
+    ST->ConOut->SetAttribute(ST->ConOut, EFI_TEXT_ATTR(EFI_LIGHTGRAY, EFI_BLACK));
+}
+
+static const char_t* FilterString(log_filter_t filter)
+{
+    switch (filter)
+    {
+        case LOG_FILTER_WARNINGS:
+        return "warnings";
+
+        case LOG_FILTER_ERRORS:
+        return "errors";
+
+        default:
+        return "all";
+    }
+}
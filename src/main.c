@@ -1,14 +1,31 @@
 #include "logger.h"
 #include "bootmenu.h"
 #include "screen.h"
+#include "clock.h"
+#include "hash.h"
+#include "mpjobs.h"
 
 int main(int argc, char** argv)
 {
+    // The logger timestamps its records with the clock
+    boolean_t clockCalibrated = InitClock();
+
     if(!InitLogger())
     {
         printf("Failed to initialize logger. Logging disabled.\n");
     }
 
+    if (!clockCalibrated)
+    {
+        Log(LL_WARNING, 0, "The CPU counter can't be used as a reliable clock, timing may be inaccurate.");
+    }
+
+    // Picks the hashing implementations, a failed hardware one is already logged
+    InitHash();
+
+    // Without the MP services every job runs on the BSP, there is nothing to warn about
+    InitMpJobs();
+
     // Try to set max console size and store the size in global variables
     if (!SetMaxConsoleSize())
     {
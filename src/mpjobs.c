@@ -0,0 +1,205 @@
+#include "mpjobs.h"
+#include "bootutils.h"
+#include "logger.h"
+
+// Processors past this number are left idle
+#define MP_MAX_WORKERS (64)
+#define CACHE_LINE_SIZE (64)
+
+// MpZeroMemory hands out the buffer in pieces of this size
+#define ZERO_CHUNK_SIZE (4 * 1024 * 1024)
+
+// The items a worker starts with, the owner takes them from the head and the other workers steal from the tail
+// Both ends are in one word, so a single compare and swap takes an item from either side
+typedef struct mp_queue_s
+{
+    uint64_t range; // The head is in the low 32 bits and the tail in the high 32 bits
+    uint8_t padding[CACHE_LINE_SIZE - sizeof(uint64_t)]; // Every queue has a cache line of its own
+} mp_queue_s;
+
+typedef struct mp_job_s
+{
+    mp_queue_s queues[MP_MAX_WORKERS];
+    mp_job_item_t function;
+    void* context;
+    uint32_t workerCount;
+    uint32_t nextWorker; // The processors take their queues in the order they start
+} mp_job_s;
+
+typedef struct zero_job_s
+{
+    uint8_t* buffer;
+    uint64_t size;
+} zero_job_s;
+
+static void EFIAPI ApWorker(void* argument);
+static void RunWorker(mp_job_s* job);
+static boolean_t TakeItem(mp_queue_s* queue, boolean_t fromTail, uintn_t* item);
+static void ZeroMemoryItem(void* context, uintn_t item);
+
+static efi_mp_services_protocol_t* mpServices = NULL; // NULL if every job runs on the BSP
+static uintn_t workerCount = 1;
+
+
+// Finds the application processors, without them the jobs run on the BSP alone
+// Returns FALSE if there is only one processor to run jobs on
+boolean_t InitMpJobs(void)
+{
+    efi_guid_t mpGuid = EFI_MP_SERVICES_PROTOCOL_GUID;
+    efi_status_t status = BS->LocateProtocol(&mpGuid, NULL, (void**)&mpServices);
+    if (EFI_ERROR(status))
+    {
+        mpServices = NULL;
+        return FALSE;
+    }
+
+    uintn_t totalCount = 0;
+    uintn_t enabledCount = 0;
+    status = mpServices->GetNumberOfProcessors(mpServices, &totalCount, &enabledCount);
+    if (EFI_ERROR(status) || enabledCount < 2)
+    {
+        mpServices = NULL;
+        return FALSE;
+    }
+
+    workerCount = enabledCount < MP_MAX_WORKERS ? enabledCount : MP_MAX_WORKERS;
+    Log(LL_INFO, 0, "Running jobs on %d of %d processors.", workerCount, totalCount);
+    return TRUE;
+}
+
+// The number of processors a job is split between, the BSP included
+uintn_t GetMpWorkerCount(void)
+{
+    return workerCount;
+}
+
+// Calls the function for every item, spread over all the processors, and returns when all of them are done
+void RunMpJob(mp_job_item_t function, void* context, uintn_t itemCount)
+{
+    uintn_t workers = itemCount < workerCount ? itemCount : workerCount;
+    mp_job_s* job = workers > 1 ? malloc(sizeof(mp_job_s)) : NULL;
+    if (job == NULL)
+    {
+        for (uintn_t i = 0; i < itemCount; i++)
+        {
+            function(context, i);
+        }
+        return;
+    }
+
+    job->function = function;
+    job->context = context;
+    job->workerCount = workers;
+    job->nextWorker = 0;
+    // Every worker starts with an equal slice of the items
+    for (uintn_t i = 0; i < workers; i++)
+    {
+        uint64_t head = itemCount * i / workers;
+        uint64_t tail = itemCount * (i + 1) / workers;
+        job->queues[i].range = head | (tail << 32);
+    }
+
+    // The APs are started without waiting for them, so the BSP can take its share of the items
+    efi_event_t doneEvent = NULL;
+    efi_status_t status = BS->CreateEvent(0, 0, NULL, NULL, &doneEvent);
+    if (!EFI_ERROR(status))
+    {
+        status = mpServices->StartupAllAPs(mpServices, ApWorker, FALSE, doneEvent, 0, job, NULL);
+        if (EFI_ERROR(status))
+        {
+            BS->CloseEvent(doneEvent);
+            doneEvent = NULL;
+        }
+    }
+
+    if (doneEvent == NULL)
+    {
+        // Some firmwares can only run the APs while the BSP waits for them
+        status = mpServices->StartupAllAPs(mpServices, ApWorker, FALSE, NULL, 0, job, NULL);
+        if (EFI_ERROR(status))
+        {
+            Log(LL_WARNING, status, "Failed to start the application processors, the job runs on the BSP.");
+        }
+        // Whatever the APs didn't get to is left for the BSP
+        RunWorker(job);
+    }
+    else
+    {
+        RunWorker(job);
+        uintn_t index = 0;
+        BS->WaitForEvent(1, &doneEvent, &index);
+        BS->CloseEvent(doneEvent);
+    }
+
+    // The results the APs wrote are visible before the job's memory is handed back
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    free(job);
+}
+
+// Fills a large buffer with zeros on all the processors
+void MpZeroMemory(void* buffer, uint64_t size)
+{
+    zero_job_s zero = { buffer, size };
+    RunMpJob(ZeroMemoryItem, &zero, (size + ZERO_CHUNK_SIZE - 1) / ZERO_CHUNK_SIZE);
+}
+
+// Runs on the APs, nothing here may call into the firmware
+static void EFIAPI ApWorker(void* argument)
+{
+    RunWorker(argument);
+}
+
+// Empties the worker's own queue first and then steals from the others until every queue is empty
+// Items are never added to a queue, so a queue that was found empty once stays empty
+static void RunWorker(mp_job_s* job)
+{
+    uint32_t slot = __atomic_fetch_add(&job->nextWorker, 1, __ATOMIC_RELAXED);
+    uintn_t item = 0;
+    if (slot < job->workerCount)
+    {
+        while (TakeItem(&job->queues[slot], FALSE, &item))
+        {
+            job->function(job->context, item);
+        }
+    }
+
+    // Starting after its own queue spreads the thieves over the queues
+    for (uint32_t i = 1; i <= job->workerCount; i++)
+    {
+        mp_queue_s* victim = &job->queues[(slot + i) % job->workerCount];
+        while (TakeItem(victim, TRUE, &item))
+        {
+            job->function(job->context, item);
+        }
+    }
+}
+
+static boolean_t TakeItem(mp_queue_s* queue, boolean_t fromTail, uintn_t* item)
+{
+    uint64_t range = __atomic_load_n(&queue->range, __ATOMIC_ACQUIRE);
+    while (TRUE)
+    {
+        uint32_t head = (uint32_t)range;
+        uint32_t tail = (uint32_t)(range >> 32);
+        if (head >= tail)
+        {
+            return FALSE;
+        }
+
+        uint64_t newRange = fromTail ? (head | ((uint64_t)(tail - 1) << 32)) : ((head + 1) | ((uint64_t)tail << 32));
+        // On failure the range is reloaded and the loop tries again
+        if (__atomic_compare_exchange_n(&queue->range, &range, newRange, FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            *item = fromTail ? tail - 1 : head;
+            return TRUE;
+        }
+    }
+}
+
+static void ZeroMemoryItem(void* context, uintn_t item)
+{
+    zero_job_s* zero = context;
+    uint64_t offset = (uint64_t)item * ZERO_CHUNK_SIZE;
+    uint64_t length = zero->size - offset < ZERO_CHUNK_SIZE ? zero->size - offset : ZERO_CHUNK_SIZE;
+    memset(zero->buffer + offset, 0, length);
+}
@@ -0,0 +1,170 @@
+#include "pager.h"
+#include "screen.h"
+#include "shellutils.h"
+#include "bootutils.h"
+#include "editor.h"
+
+#define PAGER_PROMPT ("-- More -- space: next page, enter: next line, q: quit")
+
+static void PutChar(pager_s* pager, wchar_t c);
+static uintn_t DecodeUtf8(const uint8_t* s, uintn_t length, wchar_t* c);
+static void EndRow(pager_s* pager);
+static void ShowPrompt(pager_s* pager);
+
+
+void PagerInit(pager_s* pager, boolean_t paged)
+{
+    pager->length = 0;
+    pager->paged = paged;
+    pager->quit = FALSE;
+    pager->rows = 0;
+    pager->column = 0;
+    pager->screenRows = screenModeSet ? screenRows : DEFAULT_CONSOLE_ROWS;
+    pager->screenCols = screenModeSet ? screenCols : DEFAULT_CONSOLE_COLUMNS;
+}
+
+// Prints raw bytes, every byte is shown as one character so binary data can't be misread as UTF-8
+// Returns FALSE once the user quit from the pager prompt
+boolean_t PagerWrite(pager_s* pager, const char_t* data, uintn_t length)
+{
+    for (uintn_t i = 0; i < length && !pager->quit; i++)
+    {
+        PutChar(pager, (uint8_t)data[i]);
+    }
+    return !pager->quit;
+}
+
+// Prints UTF-8 text, like the file names readdir returns, the way printf would
+// A byte that doesn't start a valid sequence is shown as it is, like PagerWrite does
+// Returns FALSE once the user quit from the pager prompt
+boolean_t PagerWriteText(pager_s* pager, const char_t* text, uintn_t length)
+{
+    const uint8_t* s = (const uint8_t*)text;
+    for (uintn_t i = 0; i < length && !pager->quit;)
+    {
+        wchar_t c = s[i];
+        uintn_t seqLen = DecodeUtf8(s + i, length - i, &c);
+        PutChar(pager, c);
+        i += seqLen;
+    }
+    return !pager->quit;
+}
+
+void PagerFlush(pager_s* pager)
+{
+    if (pager->length == 0)
+    {
+        return;
+    }
+    pager->buffer[pager->length] = CHAR_NULL;
+    ST->ConOut->OutputString(ST->ConOut, pager->buffer);
+    pager->length = 0;
+}
+
+static void PutChar(pager_s* pager, wchar_t c)
+{
+    if (c == L'\n')
+    {
+        pager->buffer[pager->length++] = L'\r';
+        pager->buffer[pager->length++] = L'\n';
+        EndRow(pager);
+    }
+    else if (c == L'\r')
+    {
+        pager->buffer[pager->length++] = L'\r';
+        pager->column = 0;
+    }
+    // A null character would end the string early
+    else if (c != CHAR_NULL)
+    {
+        pager->buffer[pager->length++] = c;
+        // The console wraps long lines by itself, they still take rows on the screen
+        if (++pager->column >= pager->screenCols)
+        {
+            EndRow(pager);
+        }
+    }
+
+    if (pager->length >= PAGER_BUFFER_SIZE)
+    {
+        PagerFlush(pager);
+    }
+}
+
+// Returns the length of the sequence at s and sets c to its character, or 1 if it isn't valid UTF-8
+// Characters outside of the BMP can't be shown in UCS-2, they become U+FFFD like in utf8_to_ucs2
+static uintn_t DecodeUtf8(const uint8_t* s, uintn_t length, wchar_t* c)
+{
+    uintn_t seqLen = (s[0] & 0xE0) == 0xC0 ? 2 : (s[0] & 0xF0) == 0xE0 ? 3 : (s[0] & 0xF8) == 0xF0 ? 4 : 1;
+    if (seqLen == 1 || seqLen > length)
+    {
+        return 1;
+    }
+    for (uintn_t i = 1; i < seqLen; i++)
+    {
+        if ((s[i] & 0xC0) != 0x80)
+        {
+            return 1;
+        }
+    }
+
+    if (seqLen == 2)
+    {
+        *c = ((s[0] & 0x1F) << 6) | (s[1] & 0x3F);
+    }
+    else if (seqLen == 3)
+    {
+        *c = ((s[0] & 0xF) << 12) | ((s[1] & 0x3F) << 6) | (s[2] & 0x3F);
+    }
+    else
+    {
+        *c = 0xFFFD;
+    }
+    return seqLen;
+}
+
+static void EndRow(pager_s* pager)
+{
+    pager->column = 0;
+    if (!pager->paged)
+    {
+        return;
+    }
+
+    // The last row is kept for the prompt
+    if (++pager->rows >= pager->screenRows - 1)
+    {
+        ShowPrompt(pager);
+    }
+}
+
+// Waits for the user before the screen scrolls, nothing more is read until then
+static void ShowPrompt(pager_s* pager)
+{
+    PagerFlush(pager);
+
+    ST->ConOut->SetAttribute(ST->ConOut, EFI_TEXT_ATTR(EFI_BLACK, EFI_LIGHTGRAY));
+    printf("%s", PAGER_PROMPT);
+    ST->ConOut->SetAttribute(ST->ConOut, EFI_TEXT_ATTR(EFI_LIGHTGRAY, EFI_BLACK));
+
+    efi_input_key_t key = GetInputKey();
+
+    // Erase the prompt, the next row is printed in its place
+    printf("\r");
+    PadRow();
+    printf("\r");
+
+    if (key.UnicodeChar == 'q' || key.ScanCode == ESCAPE_KEY_SCANCODE)
+    {
+        pager->quit = TRUE;
+    }
+    else if (key.UnicodeChar == CHAR_CARRIAGE_RETURN || key.ScanCode == DOWN_ARROW_SCANCODE)
+    {
+        // Only one more row
+        pager->rows = pager->screenRows - 2;
+    }
+    else
+    {
+        pager->rows = 0;
+    }
+}
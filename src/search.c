@@ -0,0 +1,137 @@
+#include "search.h"
+#include "bootutils.h"
+
+#define ASCII_CASE_BIT (0x20)
+
+#if defined(__x86_64__) || defined(__aarch64__)
+// 16 byte vectors are always there, SSE2 on x86_64 and NEON on aarch64
+#define SEARCH_HAVE_VECTORS
+typedef uint8_t v16_t __attribute__((vector_size(16)));
+typedef v16_t v16u_t __attribute__((aligned(1), may_alias));
+typedef uint64_t v2q_t __attribute__((vector_size(16)));
+#endif
+
+static inline uint8_t FoldCase(uint8_t c);
+static boolean_t IsAsciiLetter(uint8_t c);
+static const uint8_t* FindFirstByte(const search_pattern_s* search, const uint8_t* data, uintn_t length);
+static boolean_t MatchesAt(const search_pattern_s* search, const uint8_t* data);
+
+
+// Prepares the shift table, returns FALSE if the pattern is empty or longer than SEARCH_MAX_PATTERN_LENGTH
+boolean_t SearchInit(search_pattern_s* search, const char_t* pattern, boolean_t ignoreCase)
+{
+    uintn_t length = strlen(pattern);
+    if (length == 0 || length > SEARCH_MAX_PATTERN_LENGTH)
+    {
+        return FALSE;
+    }
+    search->length = length;
+    search->ignoreCase = ignoreCase;
+
+    for (uintn_t i = 0; i < length; i++)
+    {
+        search->pattern[i] = ignoreCase ? FoldCase((uint8_t)pattern[i]) : (uint8_t)pattern[i];
+    }
+
+    for (uintn_t i = 0; i < 256; i++)
+    {
+        search->shift[i] = length;
+    }
+    for (uintn_t i = 0; i + 1 < length; i++)
+    {
+        search->shift[search->pattern[i]] = length - 1 - i;
+    }
+    return TRUE;
+}
+
+// Returns the first match in data, or NULL
+// Candidates are found with a vectorized scan for the first byte of the pattern,
+// after a mismatch the Horspool shift of the window skips the positions that can't match
+const char_t* SearchFind(const search_pattern_s* search, const char_t* data, uintn_t length)
+{
+    const uintn_t m = search->length;
+    if (length < m)
+    {
+        return NULL;
+    }
+
+    const uint8_t* pos = (const uint8_t*)data;
+    const uint8_t* lastStart = (const uint8_t*)data + length - m;
+    while (pos <= lastStart)
+    {
+        pos = FindFirstByte(search, pos, lastStart - pos + 1);
+        if (pos == NULL)
+        {
+            return NULL;
+        }
+        if (MatchesAt(search, pos))
+        {
+            return (const char_t*)pos;
+        }
+
+        uint8_t windowLast = search->ignoreCase ? FoldCase(pos[m - 1]) : pos[m - 1];
+        pos += search->shift[windowLast];
+    }
+    return NULL;
+}
+
+static inline uint8_t FoldCase(uint8_t c)
+{
+    return (c >= 'A' && c <= 'Z') ? c | ASCII_CASE_BIT : c;
+}
+
+static boolean_t IsAsciiLetter(uint8_t c)
+{
+    c = FoldCase(c);
+    return c >= 'a' && c <= 'z';
+}
+
+// Finds the first position whose byte can start a match
+static const uint8_t* FindFirstByte(const search_pattern_s* search, const uint8_t* data, uintn_t length)
+{
+    const uint8_t first = search->pattern[0];
+    if (!search->ignoreCase || !IsAsciiLetter(first))
+    {
+        // memchr is vectorized already
+        return memchr(data, first, length);
+    }
+
+    // Setting the case bit turns both cases of a letter into the lowercase one, and nothing else into it
+#ifdef SEARCH_HAVE_VECTORS
+    const v16_t caseBit = (v16_t){0} + ASCII_CASE_BIT;
+    const v16_t target = (v16_t){0} + first;
+    for (; length >= 16; length -= 16, data += 16)
+    {
+        v2q_t eq = (v2q_t)((*(const v16u_t*)data | caseBit) == target);
+        if (eq[0] | eq[1])
+        {
+            break;
+        }
+    }
+#endif
+    for (; length > 0; length--, data++)
+    {
+        if ((*data | ASCII_CASE_BIT) == first)
+        {
+            return data;
+        }
+    }
+    return NULL;
+}
+
+static boolean_t MatchesAt(const search_pattern_s* search, const uint8_t* data)
+{
+    if (!search->ignoreCase)
+    {
+        return memcmp(data, search->pattern, search->length) == 0;
+    }
+
+    for (uintn_t i = 0; i < search->length; i++)
+    {
+        if (FoldCase(data[i]) != search->pattern[i])
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
@@ -5,6 +5,7 @@
 #include "shellerr.h"
 #include "logger.h"
 #include "password.h"
+#include "arena.h"
 
 #define SHELL_MAX_INPUT (128)
 
@@ -14,16 +15,15 @@
 #define SHELL_EXIT_STR ("exit")
 
 /* Main shell functions */
-static int8_t ShellLoop(char_t** currPathPtr);
-static int8_t ProcessCommand(char_t buffer[], char_t** currPathPtr);
+static int8_t ShellLoop(char_t** currPathPtr, arena_s* cmdArena);
+static int8_t ProcessCommand(char_t buffer[], char_t** currPathPtr, arena_s* cmdArena);
 
 /* Command and argument processing */
-static char_t* GetCommandFromBuffer(char_t buffer[]);
-static int8_t ParseArgs(char_t* inputArgs, cmd_args_s** outputArgs);
-static int8_t SplitArgsString(char_t buffer[], cmd_args_s** outputArgs);
-static cmd_args_s* InitializeArgsNode(void);
+static char_t* GetCommandFromBuffer(arena_s* cmdArena, char_t buffer[]);
+static int8_t ParseArgs(arena_s* cmdArena, char_t* inputArgs, cmd_args_s** outputArgs);
+static int8_t SplitArgsString(arena_s* cmdArena, char_t buffer[], cmd_args_s** outputArgs);
+static cmd_args_s* InitializeArgsNode(arena_s* cmdArena);
 static void AppendArgsNode(cmd_args_s* head, cmd_args_s* node);
-static void FreeArgs(cmd_args_s* args);
 
 
 int8_t StartShell(void)
@@ -36,6 +36,9 @@ int8_t StartShell(void)
     }
 
     Log(LL_INFO, 0, "Starting the shell.");
+    // The log file may be read from the shell
+    LogFlush();
+    uint64_t heapCheckpoint = HeapCheckpoint();
     ST->ConOut->ClearScreen(ST->ConOut);
     ST->ConOut->EnableCursor(ST->ConOut, TRUE);
     printf("Welcome to the shell!\n"
@@ -54,22 +57,30 @@ int8_t StartShell(void)
     currPath[0] = '\\';
     currPath[1] = CHAR_NULL;
 
-    ST->ConIn->Reset(ST->ConIn, 0); // Reset the input buffer
-    
-    if (ShellLoop(&currPath) == 1)
+    // The command string and the arguments of every command are allocated here
+    arena_s* cmdArena = ArenaCreate(ARENA_DEFAULT_SIZE);
+    if (cmdArena == NULL)
     {
+        Log(LL_ERROR, 0, "Failed to create the command arena during shell initialization.");
+        free(currPath);
         return CMD_OUT_OF_MEMORY;
     }
 
-    // Cleanup
+    ST->ConIn->Reset(ST->ConIn, 0); // Reset the input buffer
+    
+    int8_t status = ShellLoop(&currPath, cmdArena);
+
+    // Cleanup, the path and the arena are freed even if the shell ran out of memory
     Log(LL_INFO, 0, "Closing the shell.");
+    ArenaDestroy(cmdArena);
     free(currPath);
+    LogHeapLeaks(heapCheckpoint, "shell");
     ST->ConOut->EnableCursor(ST->ConOut, FALSE);
     ST->ConOut->ClearScreen(ST->ConOut);
-    return 0;
+    return status;
 }
 
-static int8_t ShellLoop(char_t** currPathPtr)
+static int8_t ShellLoop(char_t** currPathPtr, arena_s* cmdArena)
 {
     while (TRUE)
     {
@@ -82,7 +93,7 @@ static int8_t ShellLoop(char_t** currPathPtr)
         {
             break;
         }
-        if (ProcessCommand(buffer, currPathPtr) == 1)
+        if (ProcessCommand(buffer, currPathPtr, cmdArena) == 1)
         {
             return CMD_OUT_OF_MEMORY;
         }
@@ -90,12 +101,13 @@ static int8_t ShellLoop(char_t** currPathPtr)
     return CMD_SUCCESS;
 }
 
-static int8_t ProcessCommand(char_t buffer[], char_t** currPathPtr)
+// Everything allocated for the command lives in cmdArena, which is reset when the command is done
+static int8_t ProcessCommand(char_t buffer[], char_t** currPathPtr, arena_s* cmdArena)
 {
     buffer = TrimSpaces(buffer);
 
     char_t* args = buffer;
-    char_t* cmd = GetCommandFromBuffer(buffer);
+    char_t* cmd = GetCommandFromBuffer(cmdArena, buffer);
     if (cmd == NULL)
     {
         return 0;
@@ -105,10 +117,11 @@ static int8_t ProcessCommand(char_t buffer[], char_t** currPathPtr)
     cmd_args_s* cmdArgs = NULL;
     if (args != NULL)
     {
-        int8_t res = ParseArgs(args, &cmdArgs);
+        int8_t res = ParseArgs(cmdArena, args, &cmdArgs);
         if (res != CMD_SUCCESS)
         {
             PrintCommandError(cmd, args, res);
+            ArenaReset(cmdArena);
             return res;
         }
     }
@@ -129,12 +142,12 @@ static int8_t ProcessCommand(char_t buffer[], char_t** currPathPtr)
         }
     }
 
-    free(cmd);
-    FreeArgs(cmdArgs);
+    // Releases the command string and all of the argument nodes at once
+    ArenaReset(cmdArena);
     return CMD_SUCCESS;
 }
 
-static char_t* GetCommandFromBuffer(char_t buffer[])
+static char_t* GetCommandFromBuffer(arena_s* cmdArena, char_t buffer[])
 {
     size_t bufferLen = strlen(buffer);
     if (bufferLen == 0)
@@ -146,20 +159,17 @@ static char_t* GetCommandFromBuffer(char_t buffer[])
     int32_t cmdOffset = GetValueOffset(buffer, ' ');
     if (cmdOffset == -1)
     {
-        cmdLen = bufferLen + 1;
+        cmdLen = bufferLen;
     }
     else
     {
-        cmdLen = cmdOffset;
+        cmdLen = cmdOffset - 1;
     }
 
-    char_t* cmd = malloc(cmdLen);
-    strncpy(cmd, buffer, cmdLen - 1);
-
-    return cmd;
+    return ArenaStrndup(cmdArena, buffer, cmdLen);
 }
 
-static int8_t ParseArgs(char_t* inputArgs, cmd_args_s** outputArgs)
+static int8_t ParseArgs(arena_s* cmdArena, char_t* inputArgs, cmd_args_s** outputArgs)
 {
     if (inputArgs == NULL)
     {
@@ -178,7 +188,7 @@ static int8_t ParseArgs(char_t* inputArgs, cmd_args_s** outputArgs)
             // Only if the quotation mark is the last character in the argument
             if (qoutationMarkOpened && (inputArgs[i + 1] == SPACE || inputArgs[i + 1] == CHAR_NULL))
             {
-                int8_t res = SplitArgsString(tempBuffer, outputArgs);
+                int8_t res = SplitArgsString(cmdArena, tempBuffer, outputArgs);
                 if (res != CMD_SUCCESS)
                 {
                     return res;
@@ -205,7 +215,7 @@ static int8_t ParseArgs(char_t* inputArgs, cmd_args_s** outputArgs)
             }
             else
             {
-                int8_t res = SplitArgsString(tempBuffer, outputArgs);
+                int8_t res = SplitArgsString(cmdArena, tempBuffer, outputArgs);
                 if (res != CMD_SUCCESS)
                 {
                     return res;
@@ -222,7 +232,7 @@ static int8_t ParseArgs(char_t* inputArgs, cmd_args_s** outputArgs)
             }
             else
             {
-                int8_t res = SplitArgsString(tempBuffer, outputArgs);
+                int8_t res = SplitArgsString(cmdArena, tempBuffer, outputArgs);
                 if (res != CMD_SUCCESS)
                 {
                     return res;
@@ -239,7 +249,7 @@ static int8_t ParseArgs(char_t* inputArgs, cmd_args_s** outputArgs)
     return CMD_SUCCESS;
 }
 
-static int8_t SplitArgsString(char_t buffer[], cmd_args_s** outputArgs)
+static int8_t SplitArgsString(arena_s* cmdArena, char_t buffer[], cmd_args_s** outputArgs)
 {
     // If the buffer is empty don't do anything
     if (buffer[0] == CHAR_NULL)
@@ -247,21 +257,19 @@ static int8_t SplitArgsString(char_t buffer[], cmd_args_s** outputArgs)
         return CMD_SUCCESS;
     }
 
-    cmd_args_s* node = InitializeArgsNode();
+    cmd_args_s* node = InitializeArgsNode(cmdArena);
     if (node == NULL)
     {
         return CMD_OUT_OF_MEMORY;
     }
 
     // Allocate memory for the argument string and copy the buffer into it
-    const size_t bufferLen = strlen(buffer);
-    node->argString = malloc(bufferLen + 1);
+    node->argString = ArenaStrndup(cmdArena, buffer, strlen(buffer));
     if (node->argString == NULL)
     {
         Log(LL_ERROR, 0, "Failed to allocate memory for the argument string pointer.");
         return CMD_OUT_OF_MEMORY;
     }
-    strncpy(node->argString, buffer, bufferLen);
 
     // Append to the linked list or set the node as the head if it hasn't been initialized yet
     if (*outputArgs == NULL)
@@ -277,9 +285,9 @@ static int8_t SplitArgsString(char_t buffer[], cmd_args_s** outputArgs)
     return CMD_SUCCESS;
 }
 
-static cmd_args_s* InitializeArgsNode(void)
+static cmd_args_s* InitializeArgsNode(arena_s* cmdArena)
 {
-    cmd_args_s* node = malloc(sizeof(cmd_args_s));
+    cmd_args_s* node = ArenaAlloc(cmdArena, sizeof(cmd_args_s));
     if (node == NULL)
     {
         Log(LL_ERROR, 0, "Failed to initialize argument node.");
@@ -302,17 +310,3 @@ static void AppendArgsNode(cmd_args_s* head, cmd_args_s* node)
     }
     copy->next = node;
 }
-
-// Freeing args without recursion
-static void FreeArgs(cmd_args_s* args)
-{
-    while (args != NULL)
-    {
-        cmd_args_s* next = args->next;
-
-        free(args->argString);
-        free(args);
-
-        args = next;
-    }
-}
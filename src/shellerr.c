@@ -173,6 +173,24 @@ const char_t* GetCommandErrorInfo(const uint8_t error)
         case CMD_MISSING_DST_FILE_OPERAND:
         return "missing destination file operand.";
 
+        case CMD_VERIFY_FAIL:
+        return "the copy doesn't match the source.";
+
+        case CMD_DIR_TOO_DEEP:
+        return "the directory tree is too deep.";
+
+        case CMD_NO_PATTERN_SPECIFIED:
+        return "no search pattern specified.";
+
+        case CMD_PATTERN_TOO_LONG:
+        return "the search pattern is too long.";
+
+        case CMD_MISSING_OPTION_VALUE:
+        return "an option is missing its value.";
+
+        case CMD_INVALID_OPTION_VALUE:
+        return "invalid option value.";
+
         default:
         return "unknown error.";
     }
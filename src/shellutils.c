@@ -3,12 +3,17 @@
 #include "bootutils.h"
 #include "shellerr.h"
 #include "screen.h"
+#include "filecopy.h"
+#include "pager.h"
 
 #define DIRECTORY_DELIM ('\\')
 #define DIRECTORY_DELIM_STR ("\\")
 #define CURRENT_DIR (".")
 #define PREVIOUS_DIR ("..")
 
+// Size of the chunks PrintFileContent reads, it is the only buffer used for the file
+#define PRINT_CHUNK_SIZE (16 * 1024)
+
 
 // The returned pointer is allocated dynamically and must be freed by the caller
 char_t* ConcatPaths(const char_t* lhs, const char_t* rhs)
@@ -232,6 +237,8 @@ efi_input_key_t GetInputKey(void)
     efi_input_key_t key = {0};
 
     DisableWatchdogTimer();
+    // Waiting for the user is the cheapest time to write the pending log records
+    LogFlush();
 
     // Make sure we are not returning 0 values in the key struct
     do
@@ -309,6 +316,7 @@ int32_t GetValueOffset(char_t* line, const char_t delimiter)
 
 // Tries to find a flag in the arguments, returns TRUE if it's found, FALSE otherwise
 // Additionally it removes the first instance of the node of the flag from the linked list
+// The nodes belong to the shell's command arena, so they are only unlinked and not freed
 boolean_t FindFlagAndDelete(cmd_args_s** argsHead, const char_t* flagStr)
 {
     // If there are no args, the flag won't be found
@@ -322,8 +330,6 @@ boolean_t FindFlagAndDelete(cmd_args_s** argsHead, const char_t* flagStr)
     if (strcmp(args->argString, flagStr) == 0)
     {
         *argsHead = args->next;
-        free(args->argString);
-        free(args);
         return TRUE;
     }
 
@@ -337,8 +343,6 @@ boolean_t FindFlagAndDelete(cmd_args_s** argsHead, const char_t* flagStr)
         {
             // Deleting the argument node
             prev->next = args->next;
-            free(args->argString);
-            free(args);
             return TRUE;
         }
         // Advancing the list search
@@ -348,79 +352,123 @@ boolean_t FindFlagAndDelete(cmd_args_s** argsHead, const char_t* flagStr)
     return FALSE;
 }
 
-cmd_args_s* GetLastArg(cmd_args_s* head)
+// Same as FindFlagAndDelete, for options that are followed by a value
+// The value is NULL if the option is the last argument
+boolean_t FindOptionAndDelete(cmd_args_s** argsHead, const char_t* optionStr, char_t** value)
 {
-    while (head->next != NULL)
+    *value = NULL;
+    if (optionStr == NULL)
     {
-        head = head->next;
+        return FALSE;
     }
-    return head;
-}
 
-int32_t PrintFileContent(char_t* path)
-{
-    uint64_t fileSize = 0;
-    char_t* buffer = GetFileContent(path, &fileSize);
-    if (buffer == NULL)
+    cmd_args_s** link = argsHead;
+    while (*link != NULL)
     {
-        return errno;
+        cmd_args_s* arg = *link;
+        if (strcmp(arg->argString, optionStr) == 0)
+        {
+            // Delete both the option and its value
+            if (arg->next != NULL)
+            {
+                *value = arg->next->argString;
+                *link = arg->next->next;
+            }
+            else
+            {
+                *link = NULL;
+            }
+            return TRUE;
+        }
+        link = &arg->next;
     }
+    return FALSE;
+}
 
-    // Printing the file like this in order to prevent possible issues when reading binary files
-    for (uint64_t i = 0; i < fileSize; i++)
+cmd_args_s* GetLastArg(cmd_args_s* head)
+{
+    while (head->next != NULL)
     {
-        putchar(buffer[i]);
+        head = head->next;
     }
-    putchar('\n');
-
-    free(buffer);
-    
-    return 0;
+    return head;
 }
 
-int32_t CopyFile(const char_t* src, const char_t* dest)
+// Streams the file to the console in fixed size chunks, so memory use doesn't depend on the file size
+// With PRINT_PAGED the rest of the file is only read after the user asks for the next page
+int32_t PrintFileContent(char_t* path, uint32_t flags)
 {
-    FILE* srcFP = fopen(src, "r");
-    if (srcFP == NULL)
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL)
     {
         return errno;
     }
-    FILE* destFP = fopen(dest, "w");
-    if (destFP == NULL)
+
+    char_t* chunk = malloc(PRINT_CHUNK_SIZE);
+    pager_s* pager = malloc(sizeof(pager_s));
+    if (chunk == NULL || pager == NULL)
     {
-        fclose(srcFP);
-        return errno;
+        free(chunk);
+        free(pager);
+        fclose(fp);
+        return CMD_OUT_OF_MEMORY;
     }
+    PagerInit(pager, (flags & PRINT_PAGED) != 0);
 
-    char_t buf[BUFSIZ];
-    uint64_t srcSize = GetFileSize(srcFP);
-
-    for (uint64_t i = 0; i < srcSize; i += BUFSIZ)
+    int32_t res = CMD_SUCCESS;
+    uint64_t lineNumber = 1;
+    boolean_t lineStart = TRUE;
+    char_t lastChar = '\n';
+    uintn_t bytesRead = 0;
+    while (!pager->quit && (bytesRead = fread(chunk, 1, PRINT_CHUNK_SIZE, fp)) > 0)
     {
-        uint64_t bytesToCopy;
-        if (i + BUFSIZ > srcSize) // Copy the remainder
+        if (!(flags & PRINT_LINE_NUMBERS))
         {
-            bytesToCopy = srcSize - i;
+            PagerWrite(pager, chunk, bytesRead);
         }
-        else // Copy up to 8KiB at a time
+        else
         {
-            bytesToCopy = BUFSIZ;
-        }
+            // Lines can continue in the next chunk, so the number is only printed when a line really starts
+            uintn_t pos = 0;
+            while (pos < bytesRead && !pager->quit)
+            {
+                if (lineStart)
+                {
+                    char_t numberStr[24];
+                    snprintf(numberStr, sizeof(numberStr), "%6d  ", lineNumber++);
+                    PagerWrite(pager, numberStr, strlen(numberStr));
+                }
 
-        if (fread(buf, 1, bytesToCopy, srcFP) != bytesToCopy ||
-            fwrite(buf, 1, bytesToCopy, destFP) != bytesToCopy)
-        {
-            // errno may change here after each call if there is no more space left on disk
-            int32_t err = errno;
-            Log(LL_ERROR, 0, "Error during file copy: %s", GetCommandErrorInfo(err));
-            fclose(destFP);
-            fclose(srcFP);
-            return err;
+                char_t* newline = memchr(chunk + pos, '\n', bytesRead - pos);
+                uintn_t end = newline != NULL ? (uintn_t)(newline - chunk) + 1 : bytesRead;
+                PagerWrite(pager, chunk + pos, end - pos);
+                lineStart = newline != NULL;
+                pos = end;
+            }
         }
+        lastChar = chunk[bytesRead - 1];
+    }
+
+    if (bytesRead == 0 && !feof(fp))
+    {
+        res = errno != 0 ? errno : EIO;
     }
-    fclose(destFP);
-    fclose(srcFP);
-    return 0;
+    // Keep the prompt on its own line
+    if (lastChar != '\n' && !pager->quit)
+    {
+        PagerWrite(pager, "\n", 1);
+    }
+    PagerFlush(pager);
+
+    free(chunk);
+    free(pager);
+    fclose(fp);
+    return res;
+}
+
+int32_t CopyFile(const char_t* src, const char_t* dest)
+{
+    return CopyFileEx(src, dest, 0);
 }
 
 int32_t CreateDirectory(char_t* path)
@@ -448,6 +496,25 @@ int32_t CreateDirectory(char_t* path)
     return CMD_SUCCESS;
 }
 
+// Same as CreateDirectory, but relative to an open directory
+// On success the directory is returned open in outDir
+int32_t CreateDirectoryAt(DIR* parent, const char_t* name, DIR** outDir)
+{
+    *outDir = (DIR*)fopenat(parent, name, "rd");
+    if (*outDir != NULL)
+    {
+        return CMD_DIR_ALREADY_EXISTS;
+    }
+
+    *outDir = (DIR*)fopenat(parent, name, "wd");
+    if (*outDir == NULL)
+    {
+        // Make the error message more sensible
+        return (errno == ENOTDIR) ? EEXIST : errno;
+    }
+    return CMD_SUCCESS;
+}
+
 // Returns a dynamically allocated string (or NULL) where the "pattern" substrings were
 // replaced with "replacement" strings
 char_t* StringReplace(const char_t* orig, const char_t* pattern, const char_t* replacement)
@@ -457,7 +524,7 @@ char_t* StringReplace(const char_t* orig, const char_t* pattern, const char_t* r
         return NULL;
     }
     size_t patternLen = strlen(pattern);
-    if (patternLen == 0) // Empty pattern causes infinite loop with strstr
+    if (patternLen == 0) // Empty pattern causes infinite loop when searching
     {
         return NULL;
     }
@@ -466,16 +533,19 @@ char_t* StringReplace(const char_t* orig, const char_t* pattern, const char_t* r
         replacement = "";
     }
     size_t replacementLen = strlen(replacement);
-    char_t* tmp = NULL; // Used for various things
+    size_t origLen = strlen(orig);
+    const char_t* origEnd = orig + origLen;
     const char_t* ins = orig; // Used as the next insertion point
 
+    // The lengths are known, so the searches never have to rescan the string for its end
     int32_t repCount = 0; // Amount of replacements
-    for (repCount = 0; (tmp = strstr(ins, pattern)) != NULL; repCount++)
+    while ((ins = memmem(ins, origEnd - ins, pattern, patternLen)) != NULL)
     {
-        ins = tmp + patternLen;
+        ins += patternLen;
+        repCount++;
     }
 
-    char_t* result = malloc(strlen(orig) + (replacementLen - patternLen) * repCount + 1);
+    char_t* result = malloc(origLen + (replacementLen - patternLen) * repCount + 1);
     if (result == NULL)
     {
         return NULL;
@@ -484,18 +554,20 @@ char_t* StringReplace(const char_t* orig, const char_t* pattern, const char_t* r
     // tmp points to the end of the result string
     // ins points to the next occurence of the pattern in the original string
     // orig points to the remainder of orig after the end of the pattern
-    tmp = result;
+    char_t* tmp = result;
     while (repCount--)
     {
-        ins = strstr(orig, pattern);
-        int32_t lenUpToPattern = ins - orig;
+        ins = memmem(orig, origEnd - orig, pattern, patternLen);
+        size_t lenUpToPattern = ins - orig;
 
-        tmp = strncpy(tmp, orig, lenUpToPattern) + lenUpToPattern;
-        tmp = strcpy(tmp, replacement) + replacementLen;
+        memcpy(tmp, orig, lenUpToPattern);
+        tmp += lenUpToPattern;
+        memcpy(tmp, replacement, replacementLen);
+        tmp += replacementLen;
 
         orig += lenUpToPattern + patternLen;
     }
-    strcpy(tmp, orig);
+    memcpy(tmp, orig, origEnd - orig + 1); // Including the null terminator
     return result;
 }
 
@@ -0,0 +1,1337 @@
+#include "zstd.h"
+#include "bootutils.h"
+
+#define ZSTD_MAGIC          (0xFD2FB528)
+#define SKIPPABLE_MAGIC     (0x184D2A50) // The low 4 bits can be anything
+#define SKIPPABLE_MASK      (0xFFFFFFF0)
+#define MAGIC_SIZE          (4)
+#define BLOCK_HEADER_SIZE   (3)
+#define CHECKSUM_SIZE       (4)
+#define MAX_BLOCK_SIZE      (128 * 1024)
+
+#define DESCRIPTOR_RESERVED (1 << 3)
+#define DESCRIPTOR_SINGLE_SEGMENT(descriptor) (((descriptor) >> 5) & 1)
+
+#define BLOCK_RAW           (0)
+#define BLOCK_RLE           (1)
+#define BLOCK_COMPRESSED    (2)
+
+#define LITERALS_RAW        (0)
+#define LITERALS_RLE        (1)
+#define LITERALS_COMPRESSED (2)
+#define LITERALS_TREELESS   (3) // Compressed with the Huffman table of the previous block
+
+#define MODE_PREDEFINED     (0)
+#define MODE_RLE            (1)
+#define MODE_FSE            (2)
+#define MODE_REPEAT         (3)
+
+#define HUF_MAX_BITS        (11)
+#define HUF_MAX_SYMBOLS     (256)
+#define FSE_MAX_LOG         (9)
+#define WEIGHT_MAX_LOG      (6)
+#define LL_MAX_LOG          (9)
+#define ML_MAX_LOG          (9)
+#define OF_MAX_LOG          (8)
+#define MAX_LL_CODE         (35)
+#define MAX_ML_CODE         (52)
+#define MAX_OF_CODE         (31)
+#define REPEAT_OFFSETS      (3)
+// Matches are copied 8 bytes at a time, so they can write this far past their end
+#define COPY_SLACK          (8)
+
+#define XXH_PRIME64_1 (0x9E3779B185EBCA87ull)
+#define XXH_PRIME64_2 (0xC2B2AE3D27D4EB4Full)
+#define XXH_PRIME64_3 (0x165667B19E3779F9ull)
+#define XXH_PRIME64_4 (0x85EBCA77C2B2AE63ull)
+#define XXH_PRIME64_5 (0x27D4EB2F165667C5ull)
+#define XXH_STRIPE_SIZE (32)
+#define ROTL64(x, n) (((x) << (n)) | ((x) >> (64 - (n))))
+
+typedef enum zstd_state_t
+{
+    ZSTD_FRAME_MAGIC,
+    ZSTD_FRAME_DESCRIPTOR,
+    ZSTD_FRAME_HEADER,
+    ZSTD_SKIPPABLE_SIZE,
+    ZSTD_SKIP,
+    ZSTD_BLOCK_HEADER,
+    ZSTD_RAW_BLOCK,
+    ZSTD_RLE_BLOCK,
+    ZSTD_COMPRESSED_BLOCK,
+    ZSTD_CHECKSUM,
+} zstd_state_t;
+
+typedef struct fse_entry_s
+{
+    uint16_t baseState;
+    uint8_t symbol;
+    uint8_t bits;
+} fse_entry_s;
+
+// The state after a symbol is baseState plus the next bits of the stream
+typedef struct fse_table_s
+{
+    fse_entry_s entries[1 << FSE_MAX_LOG];
+    uint32_t log;
+    boolean_t valid; // The repeat mode can only use a table from an earlier block of the same frame
+} fse_table_s;
+
+typedef struct huf_entry_s
+{
+    uint8_t symbol;
+    uint8_t bits;
+} huf_entry_s;
+
+// Indexed by the next maxBits bits of the stream
+typedef struct huf_table_s
+{
+    huf_entry_s entries[1 << HUF_MAX_BITS];
+    uint32_t maxBits;
+    boolean_t valid;
+} huf_table_s;
+
+// A stream that is written forwards and read backwards, starting at the last set bit of its last byte
+typedef struct backward_bits_s
+{
+    const uint8_t* data;
+    uintn_t size;
+    int64_t pos; // The bits below this are left to read
+} backward_bits_s;
+
+// XXH64 of a frame's output, the output stays in memory so only the position has to be kept
+typedef struct xxh64_s
+{
+    uint64_t lanes[4];
+    uint64_t hashed; // Bytes from the start of the frame that went into the lanes
+} xxh64_s;
+
+typedef struct zstd_s
+{
+    zstd_state_t state;
+    const uint8_t* next;
+    const uint8_t* end;
+
+    // Headers and compressed blocks that span two chunks are gathered here
+    uint8_t staging[MAX_BLOCK_SIZE];
+    uintn_t stagedLength;
+    uintn_t headerSize;
+    uint32_t remaining; // Bytes of the current raw block or skippable frame
+
+    boolean_t sawFrame;
+    uint8_t descriptor;
+    uint64_t frameStart; // Where the frame's output starts, matches can't reach before it
+    uint64_t contentSize; // (uint64_t)-1 if the frame header doesn't have it
+    boolean_t hasChecksum;
+    xxh64_s xxh;
+    boolean_t lastBlock;
+    uint32_t blockSize;
+
+    uint64_t repeatOffsets[REPEAT_OFFSETS];
+    uint8_t literals[MAX_BLOCK_SIZE];
+    huf_table_s huf;
+    fse_table_s literalLengths;
+    fse_table_s offsets;
+    fse_table_s matchLengths;
+} zstd_s;
+
+static boolean_t ZstdStep(zstd_s* z, decompress_s* dec);
+static const uint8_t* TakeBytes(zstd_s* z, uintn_t count);
+static boolean_t ParseFrameHeader(zstd_s* z, decompress_s* dec, const uint8_t* header);
+static uintn_t FrameHeaderSize(uint8_t descriptor);
+static uintn_t ContentSizeSize(uint8_t descriptor);
+static uint64_t FrameContentSize(uint8_t descriptor, const uint8_t* header);
+static void EndFrame(zstd_s* z, decompress_s* dec);
+static boolean_t DecodeCompressedBlock(zstd_s* z, decompress_s* dec, const uint8_t* src, uintn_t size);
+static intn_t DecodeLiterals(zstd_s* z, decompress_s* dec, const uint8_t* src, uintn_t size,
+    const uint8_t** literals, uintn_t* literalCount);
+static intn_t ReadHuffmanTable(zstd_s* z, const uint8_t* src, uintn_t size);
+static uintn_t DecodeFseWeights(const uint8_t* src, uintn_t size, uint8_t* weights);
+static boolean_t DecodeHuffmanStream(const huf_table_s* huf, const uint8_t* src, uintn_t size, uint8_t* out, uintn_t count);
+static boolean_t DecodeSequences(zstd_s* z, decompress_s* dec, const uint8_t* src, uintn_t size,
+    const uint8_t* literals, uintn_t literalCount);
+static boolean_t ExecuteSequence(zstd_s* z, decompress_s* dec, const uint8_t* literals, uint64_t literalLength,
+    uint64_t offset, uint64_t matchLength);
+static intn_t SetupSequenceTable(fse_table_s* table, uint32_t mode, const uint8_t* src, uintn_t size,
+    const int16_t* defaultCounts, uint32_t defaultSymbols, uint32_t defaultLog, uint32_t maxSymbol, uint32_t maxLog);
+static intn_t ReadFseCounts(const uint8_t* src, uintn_t size, uint32_t maxSymbol, uint32_t maxLog,
+    int16_t* counts, uint32_t* symbolCount, uint32_t* log);
+static boolean_t BuildFseTable(fse_table_s* table, const int16_t* counts, uint32_t symbolCount, uint32_t log);
+static boolean_t InitBackwardBits(backward_bits_s* bits, const uint8_t* data, uintn_t size);
+static uint64_t LookBackward(const backward_bits_s* bits, uint32_t count);
+static uint64_t ReadBackward(backward_bits_s* bits, uint32_t count);
+static uint64_t PeekBits(const uint8_t* data, uintn_t size, uint64_t pos, uint32_t count);
+static uint32_t HighBit(uint64_t value);
+static uint64_t ReadLittleEndian(const uint8_t* data, uintn_t size);
+static void Xxh64Init(xxh64_s* xxh);
+static void Xxh64Update(xxh64_s* xxh, const uint8_t* frame, uint64_t length);
+static uint64_t Xxh64Final(const xxh64_s* xxh, const uint8_t* frame, uint64_t length);
+static uint64_t Xxh64Round(uint64_t acc, uint64_t input);
+
+static const uint32_t literalLengthBase[MAX_LL_CODE + 1] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+    16, 18, 20, 22, 24, 28, 32, 40, 48, 64, 128, 256, 512, 1024, 2048, 4096,
+    8192, 16384, 32768, 65536
+};
+static const uint8_t literalLengthExtra[MAX_LL_CODE + 1] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 1, 1, 2, 2, 3, 3, 4, 6, 7, 8, 9, 10, 11, 12,
+    13, 14, 15, 16
+};
+static const uint32_t matchLengthBase[MAX_ML_CODE + 1] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18,
+    19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34,
+    35, 37, 39, 41, 43, 47, 51, 59, 67, 83, 99, 131, 259, 515, 1027, 2051,
+    4099, 8195, 16387, 32771, 65539
+};
+static const uint8_t matchLengthExtra[MAX_ML_CODE + 1] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 7, 8, 9, 10, 11,
+    12, 13, 14, 15, 16
+};
+
+// The distributions the predefined mode uses, -1 is a symbol with less than one state
+static const int16_t defaultLiteralLengths[MAX_LL_CODE + 1] = {
+    4, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1, 1, 1, 1,
+    -1, -1, -1, -1
+};
+static const int16_t defaultMatchLengths[MAX_ML_CODE + 1] = {
+    1, 4, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1,
+    -1, -1, -1, -1, -1
+};
+static const int16_t defaultOffsets[29] = {
+    1, 1, 1, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1
+};
+// The sizes of the dictionary ID and the content size for every value of their flags
+static const uint8_t dictIdSizes[4] = { 0, 1, 2, 4 };
+static const uint8_t contentSizeSizes[4] = { 1, 2, 4, 8 };
+#define DEFAULT_LL_LOG (6)
+#define DEFAULT_ML_LOG (6)
+#define DEFAULT_OF_LOG (5)
+
+
+void* ZstdCreate(void)
+{
+    zstd_s* z = malloc(sizeof(zstd_s));
+    if (z == NULL)
+    {
+        return NULL;
+    }
+    memset(z, 0, sizeof(zstd_s));
+    z->state = ZSTD_FRAME_MAGIC;
+    return z;
+}
+
+void ZstdDestroy(void* state)
+{
+    free(state);
+}
+
+// Every block is decoded as soon as all of its bytes are there, only a block that spans two chunks is copied
+efi_status_t ZstdDecode(decompress_s* dec, const uint8_t* data, uintn_t length, boolean_t last)
+{
+    zstd_s* z = dec->state;
+    z->next = data;
+    z->end = data + length;
+
+    while (!EFI_ERROR(dec->status) && ZstdStep(z, dec));
+
+    // The checksum of the new output is calculated while the next chunk is being read
+    if (!EFI_ERROR(dec->status) && z->hasChecksum)
+    {
+        Xxh64Update(&z->xxh, dec->output + z->frameStart, dec->outputSize - z->frameStart);
+    }
+    if (last && !EFI_ERROR(dec->status) && (z->state != ZSTD_FRAME_MAGIC || z->stagedLength != 0 || !z->sawFrame))
+    {
+        DecompressFail(dec, EFI_END_OF_FILE, "The zstd stream is truncated.");
+    }
+    return dec->status;
+}
+
+// Only the content size of the first frame is known, it is also the whole size for a file with one frame
+uint64_t ZstdSizeHint(const uint8_t* header, uintn_t headerLength, const uint8_t trailer[COMPRESSION_TRAILER_SIZE])
+{
+    if (headerLength < MAGIC_SIZE + 1 || ReadLittleEndian(header, MAGIC_SIZE) != ZSTD_MAGIC)
+    {
+        return 0;
+    }
+    uint8_t descriptor = header[MAGIC_SIZE];
+    if (headerLength < MAGIC_SIZE + 1 + FrameHeaderSize(descriptor))
+    {
+        return 0;
+    }
+    uint64_t contentSize = FrameContentSize(descriptor, header + MAGIC_SIZE + 1);
+    return contentSize != (uint64_t)-1 ? contentSize : 0;
+}
+
+// Returns FALSE when the chunk is used up
+static boolean_t ZstdStep(zstd_s* z, decompress_s* dec)
+{
+    const uint8_t* bytes = NULL;
+    switch (z->state)
+    {
+        case ZSTD_FRAME_MAGIC:
+        {
+            if (z->next == z->end && z->stagedLength == 0)
+            {
+                return FALSE;
+            }
+            if ((bytes = TakeBytes(z, MAGIC_SIZE)) == NULL)
+            {
+                return FALSE;
+            }
+            uint32_t magic = (uint32_t)ReadLittleEndian(bytes, MAGIC_SIZE);
+            if (magic == ZSTD_MAGIC)
+            {
+                z->state = ZSTD_FRAME_DESCRIPTOR;
+            }
+            else if ((magic & SKIPPABLE_MASK) == SKIPPABLE_MAGIC)
+            {
+                z->state = ZSTD_SKIPPABLE_SIZE;
+            }
+            else
+            {
+                DecompressFail(dec, EFI_COMPROMISED_DATA, "Invalid zstd frame magic.");
+                return FALSE;
+            }
+            return TRUE;
+        }
+
+        case ZSTD_FRAME_DESCRIPTOR:
+        {
+            if ((bytes = TakeBytes(z, 1)) == NULL)
+            {
+                return FALSE;
+            }
+            z->descriptor = bytes[0];
+            z->headerSize = FrameHeaderSize(z->descriptor);
+            z->state = ZSTD_FRAME_HEADER;
+            return TRUE;
+        }
+
+        case ZSTD_FRAME_HEADER:
+            if (z->headerSize > 0 && (bytes = TakeBytes(z, z->headerSize)) == NULL)
+            {
+                return FALSE;
+            }
+            if (!ParseFrameHeader(z, dec, bytes))
+            {
+                return FALSE;
+            }
+            // Every frame starts over, nothing from an earlier frame is used again
+            z->sawFrame = TRUE;
+            z->frameStart = dec->outputSize;
+            z->hasChecksum = (z->descriptor >> 2) & 1;
+            Xxh64Init(&z->xxh);
+            z->repeatOffsets[0] = 1;
+            z->repeatOffsets[1] = 4;
+            z->repeatOffsets[2] = 8;
+            z->huf.valid = FALSE;
+            z->literalLengths.valid = FALSE;
+            z->offsets.valid = FALSE;
+            z->matchLengths.valid = FALSE;
+            z->state = ZSTD_BLOCK_HEADER;
+            return TRUE;
+
+        case ZSTD_SKIPPABLE_SIZE:
+            if ((bytes = TakeBytes(z, 4)) == NULL)
+            {
+                return FALSE;
+            }
+            z->remaining = (uint32_t)ReadLittleEndian(bytes, 4);
+            z->state = ZSTD_SKIP;
+            return TRUE;
+
+        case ZSTD_SKIP:
+        {
+            uintn_t available = z->end - z->next;
+            uintn_t length = z->remaining < available ? z->remaining : available;
+            z->next += length;
+            z->remaining -= length;
+            if (z->remaining > 0)
+            {
+                return FALSE;
+            }
+            z->state = ZSTD_FRAME_MAGIC;
+            return TRUE;
+        }
+
+        case ZSTD_BLOCK_HEADER:
+        {
+            if ((bytes = TakeBytes(z, BLOCK_HEADER_SIZE)) == NULL)
+            {
+                return FALSE;
+            }
+            uint32_t header = (uint32_t)ReadLittleEndian(bytes, BLOCK_HEADER_SIZE);
+            uint32_t type = (header >> 1) & 3;
+            z->lastBlock = header & 1;
+            z->blockSize = header >> 3;
+            if (z->blockSize > MAX_BLOCK_SIZE)
+            {
+                DecompressFail(dec, EFI_COMPROMISED_DATA, "A zstd block is too large.");
+                return FALSE;
+            }
+
+            if (type == BLOCK_RAW)
+            {
+                z->remaining = z->blockSize;
+                z->state = ZSTD_RAW_BLOCK;
+            }
+            else if (type == BLOCK_RLE)
+            {
+                z->state = ZSTD_RLE_BLOCK;
+            }
+            else if (type == BLOCK_COMPRESSED)
+            {
+                z->state = ZSTD_COMPRESSED_BLOCK;
+            }
+            else
+            {
+                DecompressFail(dec, EFI_COMPROMISED_DATA, "Invalid zstd block type.");
+                return FALSE;
+            }
+            return TRUE;
+        }
+
+        case ZSTD_RAW_BLOCK:
+        {
+            // Raw bytes go straight to the output, they are never staged
+            uintn_t available = z->end - z->next;
+            uintn_t length = z->remaining < available ? z->remaining : available;
+            if (!DecompressReserve(dec, length))
+            {
+                return FALSE;
+            }
+            memcpy(dec->output + dec->outputSize, z->next, length);
+            dec->outputSize += length;
+            z->next += length;
+            z->remaining -= length;
+            if (z->remaining > 0)
+            {
+                return FALSE;
+            }
+            EndFrame(z, dec);
+            return TRUE;
+        }
+
+        case ZSTD_RLE_BLOCK:
+            if ((bytes = TakeBytes(z, 1)) == NULL)
+            {
+                return FALSE;
+            }
+            if (!DecompressReserve(dec, z->blockSize))
+            {
+                return FALSE;
+            }
+            memset(dec->output + dec->outputSize, bytes[0], z->blockSize);
+            dec->outputSize += z->blockSize;
+            EndFrame(z, dec);
+            return TRUE;
+
+        case ZSTD_COMPRESSED_BLOCK:
+            if ((bytes = TakeBytes(z, z->blockSize)) == NULL)
+            {
+                return FALSE;
+            }
+            if (!DecodeCompressedBlock(z, dec, bytes, z->blockSize))
+            {
+                return FALSE;
+            }
+            EndFrame(z, dec);
+            return TRUE;
+
+        case ZSTD_CHECKSUM:
+        {
+            if ((bytes = TakeBytes(z, CHECKSUM_SIZE)) == NULL)
+            {
+                return FALSE;
+            }
+            uint64_t frameLength = dec->outputSize - z->frameStart;
+            Xxh64Update(&z->xxh, dec->output + z->frameStart, frameLength);
+            uint32_t checksum = (uint32_t)Xxh64Final(&z->xxh, dec->output + z->frameStart, frameLength);
+            if (checksum != (uint32_t)ReadLittleEndian(bytes, CHECKSUM_SIZE))
+            {
+                DecompressFail(dec, EFI_CRC_ERROR, "The zstd checksum doesn't match the data.");
+                return FALSE;
+            }
+            z->hasChecksum = FALSE;
+            z->state = ZSTD_FRAME_MAGIC;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+// Returns the bytes once all of them are there, they are only copied if they span two chunks
+// The bytes stay valid until the next call
+static const uint8_t* TakeBytes(zstd_s* z, uintn_t count)
+{
+    uintn_t available = z->end - z->next;
+    if (z->stagedLength == 0 && available >= count)
+    {
+        const uint8_t* bytes = z->next;
+        z->next += count;
+        return bytes;
+    }
+
+    uintn_t length = count - z->stagedLength < available ? count - z->stagedLength : available;
+    memcpy(z->staging + z->stagedLength, z->next, length);
+    z->stagedLength += length;
+    z->next += length;
+    if (z->stagedLength < count)
+    {
+        return NULL;
+    }
+    z->stagedLength = 0;
+    return z->staging;
+}
+
+// The header after the descriptor, header is NULL if it is empty
+static boolean_t ParseFrameHeader(zstd_s* z, decompress_s* dec, const uint8_t* header)
+{
+    if (z->descriptor & DESCRIPTOR_RESERVED)
+    {
+        DecompressFail(dec, EFI_COMPROMISED_DATA, "Invalid zstd frame header.");
+        return FALSE;
+    }
+
+    // The window size only matters to decoders that keep a window, the whole output is kept here
+    uint32_t dictFlag = z->descriptor & 3;
+    uintn_t dictPos = DESCRIPTOR_SINGLE_SEGMENT(z->descriptor) ? 0 : 1;
+    if (dictFlag != 0 && ReadLittleEndian(header + dictPos, dictIdSizes[dictFlag]) != 0)
+    {
+        DecompressFail(dec, EFI_UNSUPPORTED, "zstd frames that need a dictionary aren't supported.");
+        return FALSE;
+    }
+    z->contentSize = FrameContentSize(z->descriptor, header);
+    return TRUE;
+}
+
+// The size of the header after the descriptor
+static uintn_t FrameHeaderSize(uint8_t descriptor)
+{
+    return (DESCRIPTOR_SINGLE_SEGMENT(descriptor) ? 0 : 1) + dictIdSizes[descriptor & 3] + ContentSizeSize(descriptor);
+}
+
+static uintn_t ContentSizeSize(uint8_t descriptor)
+{
+    uint32_t fcsFlag = descriptor >> 6;
+    return fcsFlag == 0 ? (DESCRIPTOR_SINGLE_SEGMENT(descriptor) ? 1 : 0) : contentSizeSizes[fcsFlag];
+}
+
+// (uint64_t)-1 if the header doesn't have it, the content size is the last field of the header
+static uint64_t FrameContentSize(uint8_t descriptor, const uint8_t* header)
+{
+    uintn_t size = ContentSizeSize(descriptor);
+    if (size == 0)
+    {
+        return (uint64_t)-1;
+    }
+    uint64_t contentSize = ReadLittleEndian(header + FrameHeaderSize(descriptor) - size, size);
+    // The 2 byte size starts at 256, the smaller ones fit in a byte
+    return size == 2 ? contentSize + 256 : contentSize;
+}
+
+// Called after every block, the frame ends with its last block or its checksum
+static void EndFrame(zstd_s* z, decompress_s* dec)
+{
+    if (!z->lastBlock)
+    {
+        z->state = ZSTD_BLOCK_HEADER;
+        return;
+    }
+
+    if (z->contentSize != (uint64_t)-1 && dec->outputSize - z->frameStart != z->contentSize)
+    {
+        DecompressFail(dec, EFI_COMPROMISED_DATA, "A zstd frame doesn't have the size its header says.");
+        return;
+    }
+    z->state = z->hasChecksum ? ZSTD_CHECKSUM : ZSTD_FRAME_MAGIC;
+}
+
+static boolean_t DecodeCompressedBlock(zstd_s* z, decompress_s* dec, const uint8_t* src, uintn_t size)
+{
+    const uint8_t* literals = NULL;
+    uintn_t literalCount = 0;
+    intn_t used = DecodeLiterals(z, dec, src, size, &literals, &literalCount);
+    if (used < 0)
+    {
+        return FALSE;
+    }
+    return DecodeSequences(z, dec, src + used, size - used, literals, literalCount);
+}
+
+// Returns the size of the literals section, or -1 if it is invalid
+static intn_t DecodeLiterals(zstd_s* z, decompress_s* dec, const uint8_t* src, uintn_t size,
+    const uint8_t** literals, uintn_t* literalCount)
+{
+    if (size < 1)
+    {
+        DecompressFail(dec, EFI_COMPROMISED_DATA, "Invalid zstd literals section.");
+        return -1;
+    }
+    uint32_t type = src[0] & 3;
+    uint32_t sizeFormat = (src[0] >> 2) & 3;
+
+    if (type == LITERALS_RAW || type == LITERALS_RLE)
+    {
+        // The size takes 5, 12 or 20 bits
+        uintn_t headerSize = (sizeFormat & 1) == 0 ? 1 : sizeFormat == 1 ? 2 : 3;
+        if (size < headerSize)
+        {
+            DecompressFail(dec, EFI_COMPROMISED_DATA, "Invalid zstd literals section.");
+            return -1;
+        }
+        uintn_t count = headerSize == 1 ? src[0] >> 3 : ReadLittleEndian(src, headerSize) >> 4;
+        uintn_t dataSize = type == LITERALS_RAW ? count : 1;
+        if (count > MAX_BLOCK_SIZE || size - headerSize < dataSize)
+        {
+            DecompressFail(dec, EFI_COMPROMISED_DATA, "Invalid zstd literals section.");
+            return -1;
+        }
+
+        if (type == LITERALS_RAW)
+        {
+            *literals = src + headerSize;
+        }
+        else
+        {
+            memset(z->literals, src[headerSize], count);
+            *literals = z->literals;
+        }
+        *literalCount = count;
+        return headerSize + dataSize;
+    }
+
+    // Both sizes take 10, 14 or 18 bits, with 1 or 4 streams
+    static const uint8_t headerSizes[4] = { 3, 3, 4, 5 };
+    static const uint8_t sizeBits[4] = { 10, 10, 14, 18 };
+    uintn_t headerSize = headerSizes[sizeFormat];
+    if (size < headerSize)
+    {
+        DecompressFail(dec, EFI_COMPROMISED_DATA, "Invalid zstd literals section.");
+        return -1;
+    }
+    uint64_t header = ReadLittleEndian(src, headerSize);
+    uint64_t mask = (1ull << sizeBits[sizeFormat]) - 1;
+    uintn_t count = (header >> 4) & mask;
+    uintn_t compressedSize = (header >> (4 + sizeBits[sizeFormat])) & mask;
+    if (count > MAX_BLOCK_SIZE || size - headerSize < compressedSize)
+    {
+        DecompressFail(dec, EFI_COMPROMISED_DATA, "Invalid zstd literals section.");
+        return -1;
+    }
+
+    const uint8_t* data = src + headerSize;
+    uintn_t dataSize = compressedSize;
+    if (type == LITERALS_COMPRESSED)
+    {
+        intn_t tableSize = ReadHuffmanTable(z, data, dataSize);
+        if (tableSize < 0)
+        {
+            DecompressFail(dec, EFI_COMPROMISED_DATA, "Invalid zstd Huffman table.");
+            return -1;
+        }
+        data += tableSize;
+        dataSize -= tableSize;
+    }
+    else if (!z->huf.valid)
+    {
+        DecompressFail(dec, EFI_COMPROMISED_DATA, "A zstd block reuses a Huffman table that doesn't exist.");
+        return -1;
+    }
+
+    boolean_t success = FALSE;
+    if (sizeFormat == 0)
+    {
+        success = DecodeHuffmanStream(&z->huf, data, dataSize, z->literals, count);
+    }
+    else if (dataSize >= 6)
+    {
+        // A jump table with the sizes of the first three streams, each stream has a quarter of the literals
+        uintn_t sizes[4];
+        sizes[0] = ReadLittleEndian(data, 2);
+        sizes[1] = ReadLittleEndian(data + 2, 2);
+        sizes[2] = ReadLittleEndian(data + 4, 2);
+        uintn_t total = 6 + sizes[0] + sizes[1] + sizes[2];
+        uintn_t segment = (count + 3) / 4;
+        if (total <= dataSize && count >= segment * 3)
+        {
+            sizes[3] = dataSize - total;
+            const uint8_t* stream = data + 6;
+            success = TRUE;
+            for (uintn_t i = 0; i < 4 && success; i++)
+            {
+                uintn_t streamCount = i < 3 ? segment : count - segment * 3;
+                success = DecodeHuffmanStream(&z->huf, stream, sizes[i], z->literals + segment * i, streamCount);
+                stream += sizes[i];
+            }
+        }
+    }
+    if (!success)
+    {
+        DecompressFail(dec, EFI_COMPROMISED_DATA, "Invalid zstd Huffman stream.");
+        return -1;
+    }
+
+    *literals = z->literals;
+    *literalCount = count;
+    return headerSize + compressedSize;
+}
+
+// The table is sent as the weights of the symbols, the weight of the last symbol is implied
+// Returns the size of the description, or -1 if it is invalid
+static intn_t ReadHuffmanTable(zstd_s* z, const uint8_t* src, uintn_t size)
+{
+    if (size < 1)
+    {
+        return -1;
+    }
+
+    uint8_t weights[HUF_MAX_SYMBOLS];
+    uintn_t weightCount = 0;
+    intn_t used = 0;
+    if (src[0] >= 128)
+    {
+        // Two weights in a byte
+        weightCount = src[0] - 127;
+        uintn_t bytes = (weightCount + 1) / 2;
+        if (size - 1 < bytes)
+        {
+            return -1;
+        }
+        for (uintn_t i = 0; i < weightCount; i++)
+        {
+            weights[i] = (i % 2 == 0) ? src[1 + i / 2] >> 4 : src[1 + i / 2] & 0xf;
+        }
+        used = 1 + bytes;
+    }
+    else
+    {
+        if (size - 1 < src[0])
+        {
+            return -1;
+        }
+        weightCount = DecodeFseWeights(src + 1, src[0], weights);
+        used = 1 + src[0];
+    }
+    if (weightCount == 0 || weightCount >= HUF_MAX_SYMBOLS)
+    {
+        return -1;
+    }
+
+    // The weights add up to a power of two with the last one
+    uint32_t total = 0;
+    for (uintn_t i = 0; i < weightCount; i++)
+    {
+        if (weights[i] > HUF_MAX_BITS)
+        {
+            return -1;
+        }
+        total += weights[i] != 0 ? 1u << (weights[i] - 1) : 0;
+    }
+    if (total == 0)
+    {
+        return -1;
+    }
+    uint32_t maxBits = HighBit(total) + 1;
+    uint32_t rest = (1u << maxBits) - total;
+    if (maxBits > HUF_MAX_BITS || (rest & (rest - 1)) != 0)
+    {
+        return -1;
+    }
+    weights[weightCount++] = (uint8_t)(HighBit(rest) + 1);
+
+    // Every symbol takes 2^(weight-1) entries, the lightest symbols come first
+    uint32_t position = 0;
+    for (uint32_t weight = 1; weight <= maxBits; weight++)
+    {
+        for (uintn_t symbol = 0; symbol < weightCount; symbol++)
+        {
+            if (weights[symbol] != weight)
+            {
+                continue;
+            }
+            huf_entry_s entry = { (uint8_t)symbol, (uint8_t)(maxBits + 1 - weight) };
+            for (uint32_t i = 0; i < (1u << (weight - 1)); i++)
+            {
+                z->huf.entries[position++] = entry;
+            }
+        }
+    }
+    z->huf.maxBits = maxBits;
+    z->huf.valid = TRUE;
+    return used;
+}
+
+// The weights are FSE coded with two interleaved states, returns how many there are or 0 if they are invalid
+static uintn_t DecodeFseWeights(const uint8_t* src, uintn_t size, uint8_t* weights)
+{
+    int16_t counts[HUF_MAX_SYMBOLS];
+    uint32_t symbolCount = 0;
+    uint32_t log = 0;
+    intn_t used = ReadFseCounts(src, size, HUF_MAX_SYMBOLS - 1, WEIGHT_MAX_LOG, counts, &symbolCount, &log);
+    fse_table_s table;
+    backward_bits_s bits;
+    if (used < 0 || !BuildFseTable(&table, counts, symbolCount, log) || !InitBackwardBits(&bits, src + used, size - used))
+    {
+        return 0;
+    }
+
+    uint32_t states[2];
+    states[0] = (uint32_t)ReadBackward(&bits, log);
+    states[1] = (uint32_t)ReadBackward(&bits, log);
+    uintn_t count = 0;
+    // Once the stream is overread, the other state still has its symbol
+    for (uintn_t turn = 0;; turn ^= 1)
+    {
+        if (count >= HUF_MAX_SYMBOLS - 1)
+        {
+            return 0;
+        }
+        fse_entry_s* entry = &table.entries[states[turn]];
+        weights[count++] = entry->symbol;
+        states[turn] = entry->baseState + (uint32_t)ReadBackward(&bits, entry->bits);
+        if (bits.pos < 0)
+        {
+            weights[count++] = table.entries[states[turn ^ 1]].symbol;
+            break;
+        }
+    }
+    return count;
+}
+
+static boolean_t DecodeHuffmanStream(const huf_table_s* huf, const uint8_t* src, uintn_t size, uint8_t* out, uintn_t count)
+{
+    backward_bits_s bits;
+    if (!InitBackwardBits(&bits, src, size))
+    {
+        return FALSE;
+    }
+
+    for (uintn_t i = 0; i < count; i++)
+    {
+        const huf_entry_s* entry = &huf->entries[LookBackward(&bits, huf->maxBits)];
+        out[i] = entry->symbol;
+        bits.pos -= entry->bits;
+    }
+    // The stream has to end exactly with the last symbol
+    return bits.pos == 0;
+}
+
+static boolean_t DecodeSequences(zstd_s* z, decompress_s* dec, const uint8_t* src, uintn_t size,
+    const uint8_t* literals, uintn_t literalCount)
+{
+    uintn_t count = 0;
+    uintn_t pos = 0;
+    if (size >= 1 && src[0] < 128)
+    {
+        count = src[0];
+        pos = 1;
+    }
+    else if (size >= 2 && src[0] < 255)
+    {
+        count = ((src[0] - 128) << 8) + src[1];
+        pos = 2;
+    }
+    else if (size >= 3)
+    {
+        count = src[1] + (src[2] << 8) + 0x7F00;
+        pos = 3;
+    }
+    else
+    {
+        DecompressFail(dec, EFI_COMPROMISED_DATA, "Invalid zstd sequences section.");
+        return FALSE;
+    }
+
+    if (count == 0)
+    {
+        // The block is only literals
+        return ExecuteSequence(z, dec, literals, literalCount, 0, 0);
+    }
+
+    if (size - pos < 1 || (src[pos] & 3) != 0)
+    {
+        DecompressFail(dec, EFI_COMPROMISED_DATA, "Invalid zstd sequences section.");
+        return FALSE;
+    }
+    uint8_t modes = src[pos++];
+
+    intn_t used = SetupSequenceTable(&z->literalLengths, modes >> 6, src + pos, size - pos,
+        defaultLiteralLengths, MAX_LL_CODE + 1, DEFAULT_LL_LOG, MAX_LL_CODE, LL_MAX_LOG);
+    if (used >= 0)
+    {
+        pos += used;
+        used = SetupSequenceTable(&z->offsets, (modes >> 4) & 3, src + pos, size - pos,
+            defaultOffsets, sizeof(defaultOffsets) / sizeof(defaultOffsets[0]), DEFAULT_OF_LOG, MAX_OF_CODE, OF_MAX_LOG);
+    }
+    if (used >= 0)
+    {
+        pos += used;
+        used = SetupSequenceTable(&z->matchLengths, (modes >> 2) & 3, src + pos, size - pos,
+            defaultMatchLengths, MAX_ML_CODE + 1, DEFAULT_ML_LOG, MAX_ML_CODE, ML_MAX_LOG);
+    }
+    backward_bits_s bits;
+    if (used < 0 || !InitBackwardBits(&bits, src + pos + used, size - pos - used))
+    {
+        DecompressFail(dec, EFI_COMPROMISED_DATA, "Invalid zstd sequence tables.");
+        return FALSE;
+    }
+
+    uint32_t literalLengthState = (uint32_t)ReadBackward(&bits, z->literalLengths.log);
+    uint32_t offsetState = (uint32_t)ReadBackward(&bits, z->offsets.log);
+    uint32_t matchLengthState = (uint32_t)ReadBackward(&bits, z->matchLengths.log);
+    uintn_t literalPos = 0;
+    for (uintn_t i = 0; i < count; i++)
+    {
+        const fse_entry_s* literalLengthEntry = &z->literalLengths.entries[literalLengthState];
+        const fse_entry_s* offsetEntry = &z->offsets.entries[offsetState];
+        const fse_entry_s* matchLengthEntry = &z->matchLengths.entries[matchLengthState];
+
+        // The extra bits come in the order offset, match length, literal length
+        uint32_t offsetCode = offsetEntry->symbol;
+        uint64_t offsetValue = (1ull << offsetCode) + ReadBackward(&bits, offsetCode);
+        uint64_t matchLength = matchLengthBase[matchLengthEntry->symbol] +
+            ReadBackward(&bits, matchLengthExtra[matchLengthEntry->symbol]);
+        uint64_t literalLength = literalLengthBase[literalLengthEntry->symbol] +
+            ReadBackward(&bits, literalLengthExtra[literalLengthEntry->symbol]);
+
+        // The three values up to 3 pick one of the recent offsets, one position further when there are no literals
+        uint64_t offset = 0;
+        uint64_t* repeat = z->repeatOffsets;
+        if (offsetValue > REPEAT_OFFSETS)
+        {
+            offset = offsetValue - REPEAT_OFFSETS;
+            repeat[2] = repeat[1];
+            repeat[1] = repeat[0];
+            repeat[0] = offset;
+        }
+        else
+        {
+            uint64_t index = offsetValue - 1 + (literalLength == 0 ? 1 : 0);
+            if (index == 0)
+            {
+                offset = repeat[0];
+            }
+            else
+            {
+                offset = index == 3 ? repeat[0] - 1 : repeat[index];
+                if (index > 1)
+                {
+                    repeat[2] = repeat[1];
+                }
+                repeat[1] = repeat[0];
+                repeat[0] = offset;
+            }
+        }
+
+        if (literalLength > literalCount - literalPos || offset == 0)
+        {
+            DecompressFail(dec, EFI_COMPROMISED_DATA, "Invalid zstd sequence.");
+            return FALSE;
+        }
+        if (!ExecuteSequence(z, dec, literals + literalPos, literalLength, offset, matchLength))
+        {
+            return FALSE;
+        }
+        literalPos += literalLength;
+
+        if (i + 1 < count)
+        {
+            literalLengthState = literalLengthEntry->baseState + (uint32_t)ReadBackward(&bits, literalLengthEntry->bits);
+            matchLengthState = matchLengthEntry->baseState + (uint32_t)ReadBackward(&bits, matchLengthEntry->bits);
+            offsetState = offsetEntry->baseState + (uint32_t)ReadBackward(&bits, offsetEntry->bits);
+        }
+    }
+
+    if (bits.pos != 0)
+    {
+        DecompressFail(dec, EFI_COMPROMISED_DATA, "Invalid zstd sequence stream.");
+        return FALSE;
+    }
+    // The literals after the last match
+    return ExecuteSequence(z, dec, literals + literalPos, literalCount - literalPos, 0, 0);
+}
+
+// Copies the literals and then the match, a match length of 0 copies only the literals
+static boolean_t ExecuteSequence(zstd_s* z, decompress_s* dec, const uint8_t* literals, uint64_t literalLength,
+    uint64_t offset, uint64_t matchLength)
+{
+    if (!DecompressReserve(dec, literalLength + matchLength))
+    {
+        return FALSE;
+    }
+    memcpy(dec->output + dec->outputSize, literals, literalLength);
+    dec->outputSize += literalLength;
+    if (matchLength == 0)
+    {
+        return TRUE;
+    }
+
+    if (offset > dec->outputSize - z->frameStart)
+    {
+        DecompressFail(dec, EFI_COMPROMISED_DATA, "A zstd match offset is too far back.");
+        return FALSE;
+    }
+    uint8_t* dst = dec->output + dec->outputSize;
+    const uint8_t* src = dst - offset;
+    if (offset >= 8 && dec->outputSize + matchLength + COPY_SLACK <= dec->outputCapacity)
+    {
+        // The bytes written past the end are overwritten by the next output
+        uint8_t* stop = dst + matchLength;
+        do
+        {
+            memcpy(dst, src, 8);
+            dst += 8;
+            src += 8;
+        } while (dst < stop);
+    }
+    else if (offset == 1)
+    {
+        memset(dst, *src, matchLength);
+    }
+    else
+    {
+        for (uint64_t i = 0; i < matchLength; i++)
+        {
+            dst[i] = src[i];
+        }
+    }
+    dec->outputSize += matchLength;
+    return TRUE;
+}
+
+// Returns the size of the table description, or -1 if it is invalid
+static intn_t SetupSequenceTable(fse_table_s* table, uint32_t mode, const uint8_t* src, uintn_t size,
+    const int16_t* defaultCounts, uint32_t defaultSymbols, uint32_t defaultLog, uint32_t maxSymbol, uint32_t maxLog)
+{
+    intn_t used = 0;
+    if (mode == MODE_PREDEFINED)
+    {
+        if (!BuildFseTable(table, defaultCounts, defaultSymbols, defaultLog))
+        {
+            return -1;
+        }
+    }
+    else if (mode == MODE_RLE)
+    {
+        // Every sequence has the same symbol
+        if (size < 1 || src[0] > maxSymbol)
+        {
+            return -1;
+        }
+        table->log = 0;
+        table->entries[0].symbol = src[0];
+        table->entries[0].bits = 0;
+        table->entries[0].baseState = 0;
+        used = 1;
+    }
+    else if (mode == MODE_FSE)
+    {
+        int16_t counts[MAX_ML_CODE + 1];
+        uint32_t symbolCount = 0;
+        uint32_t log = 0;
+        used = ReadFseCounts(src, size, maxSymbol, maxLog, counts, &symbolCount, &log);
+        if (used < 0 || !BuildFseTable(table, counts, symbolCount, log))
+        {
+            return -1;
+        }
+    }
+    else if (!table->valid)
+    {
+        return -1;
+    }
+    table->valid = TRUE;
+    return used;
+}
+
+// Reads the normalized counts of an FSE table, a count of -1 is a symbol with less than one state
+// Returns the size of the description, or -1 if it is invalid
+static intn_t ReadFseCounts(const uint8_t* src, uintn_t size, uint32_t maxSymbol, uint32_t maxLog,
+    int16_t* counts, uint32_t* symbolCount, uint32_t* log)
+{
+    if (size < 1)
+    {
+        return -1;
+    }
+    *log = (src[0] & 0xf) + 5;
+    if (*log > maxLog)
+    {
+        return -1;
+    }
+
+    uint64_t pos = 4;
+    int32_t remaining = (1 << *log) + 1;
+    int32_t threshold = 1 << *log;
+    uint32_t bitCount = *log + 1;
+    uint32_t symbol = 0;
+    boolean_t previousZero = FALSE;
+    while (remaining > 1 && symbol <= maxSymbol)
+    {
+        if (previousZero)
+        {
+            // A zero count is followed by 2 bit repeat counts of more zeros, 3 means another one follows
+            uint32_t repeat = 0;
+            do
+            {
+                repeat = (uint32_t)PeekBits(src, size, pos, 2);
+                pos += 2;
+                for (uint32_t i = 0; i < repeat; i++)
+                {
+                    if (symbol > maxSymbol)
+                    {
+                        return -1;
+                    }
+                    counts[symbol++] = 0;
+                }
+            } while (repeat == 3 && pos < size * 8);
+            previousZero = FALSE;
+            continue;
+        }
+
+        // Small values take one bit less
+        int32_t max = (2 * threshold - 1) - remaining;
+        int32_t value = (int32_t)PeekBits(src, size, pos, bitCount);
+        if ((value & (threshold - 1)) < max)
+        {
+            value &= threshold - 1;
+            pos += bitCount - 1;
+        }
+        else
+        {
+            value &= 2 * threshold - 1;
+            if (value >= threshold)
+            {
+                value -= max;
+            }
+            pos += bitCount;
+        }
+
+        int32_t count = value - 1;
+        remaining -= count < 0 ? -count : count;
+        counts[symbol++] = (int16_t)count;
+        previousZero = count == 0;
+        if (remaining < 1)
+        {
+            return -1;
+        }
+        while (remaining < threshold)
+        {
+            bitCount--;
+            threshold >>= 1;
+        }
+    }
+
+    uintn_t used = (pos + 7) / 8;
+    if (remaining != 1 || used > size)
+    {
+        return -1;
+    }
+    *symbolCount = symbol;
+    return used;
+}
+
+// Spreads the symbols over the states, the ones with less than one state take the last states
+static boolean_t BuildFseTable(fse_table_s* table, const int16_t* counts, uint32_t symbolCount, uint32_t log)
+{
+    uint32_t size = 1u << log;
+    uint32_t total = 0;
+    for (uint32_t s = 0; s < symbolCount; s++)
+    {
+        total += counts[s] == -1 ? 1 : counts[s];
+    }
+    if (total != size)
+    {
+        return FALSE;
+    }
+
+    uint32_t highThreshold = size - 1;
+    uint16_t nextState[HUF_MAX_SYMBOLS];
+    for (uint32_t s = 0; s < symbolCount; s++)
+    {
+        if (counts[s] == -1)
+        {
+            table->entries[highThreshold--].symbol = (uint8_t)s;
+            nextState[s] = 1;
+        }
+        else
+        {
+            nextState[s] = (uint16_t)counts[s];
+        }
+    }
+
+    uint32_t step = (size >> 1) + (size >> 3) + 3;
+    uint32_t mask = size - 1;
+    uint32_t position = 0;
+    for (uint32_t s = 0; s < symbolCount; s++)
+    {
+        for (int32_t i = 0; i < counts[s]; i++)
+        {
+            table->entries[position].symbol = (uint8_t)s;
+            do
+            {
+                position = (position + step) & mask;
+            } while (position > highThreshold);
+        }
+    }
+    if (position != 0)
+    {
+        return FALSE;
+    }
+
+    for (uint32_t u = 0; u < size; u++)
+    {
+        uint32_t state = nextState[table->entries[u].symbol]++;
+        uint32_t bits = log - HighBit(state);
+        table->entries[u].bits = (uint8_t)bits;
+        table->entries[u].baseState = (uint16_t)((state << bits) - size);
+    }
+    table->log = log;
+    return TRUE;
+}
+
+static boolean_t InitBackwardBits(backward_bits_s* bits, const uint8_t* data, uintn_t size)
+{
+    if (size == 0 || data[size - 1] == 0)
+    {
+        return FALSE;
+    }
+    bits->data = data;
+    bits->size = size;
+    // The last set bit only marks where the stream starts
+    bits->pos = (int64_t)(size - 1) * 8 + HighBit(data[size - 1]);
+    return TRUE;
+}
+
+// The next count bits, the ones before the start of the stream are zeros
+static uint64_t LookBackward(const backward_bits_s* bits, uint32_t count)
+{
+    if (bits->pos >= (int64_t)count)
+    {
+        return PeekBits(bits->data, bits->size, bits->pos - count, count);
+    }
+    if (bits->pos <= 0)
+    {
+        return 0;
+    }
+    return PeekBits(bits->data, bits->size, 0, (uint32_t)bits->pos) << (count - bits->pos);
+}
+
+static uint64_t ReadBackward(backward_bits_s* bits, uint32_t count)
+{
+    uint64_t value = LookBackward(bits, count);
+    bits->pos -= count;
+    return value;
+}
+
+// The count bits starting at bit pos of a little endian stream, at most 56 of them
+static uint64_t PeekBits(const uint8_t* data, uintn_t size, uint64_t pos, uint32_t count)
+{
+    uintn_t byte = pos / 8;
+    uint64_t word = 0;
+    if (byte + sizeof(word) <= size)
+    {
+        memcpy(&word, data + byte, sizeof(word));
+    }
+    else if (byte < size)
+    {
+        word = ReadLittleEndian(data + byte, size - byte);
+    }
+    return (word >> (pos % 8)) & ((1ull << count) - 1);
+}
+
+static uint32_t HighBit(uint64_t value)
+{
+    return 63 - __builtin_clzll(value);
+}
+
+static uint64_t ReadLittleEndian(const uint8_t* data, uintn_t size)
+{
+    uint64_t value = 0;
+    for (uintn_t i = 0; i < size; i++)
+    {
+        value |= (uint64_t)data[i] << (i * 8);
+    }
+    return value;
+}
+
+static void Xxh64Init(xxh64_s* xxh)
+{
+    xxh->lanes[0] = XXH_PRIME64_1 + XXH_PRIME64_2;
+    xxh->lanes[1] = XXH_PRIME64_2;
+    xxh->lanes[2] = 0;
+    xxh->lanes[3] = 0 - XXH_PRIME64_1;
+    xxh->hashed = 0;
+}
+
+// Takes in the whole stripes of the frame's output that weren't hashed yet
+static void Xxh64Update(xxh64_s* xxh, const uint8_t* frame, uint64_t length)
+{
+    for (; length - xxh->hashed >= XXH_STRIPE_SIZE; xxh->hashed += XXH_STRIPE_SIZE)
+    {
+        for (uintn_t i = 0; i < 4; i++)
+        {
+            uint64_t lane;
+            memcpy(&lane, frame + xxh->hashed + i * 8, sizeof(lane));
+            xxh->lanes[i] = Xxh64Round(xxh->lanes[i], lane);
+        }
+    }
+}
+
+static uint64_t Xxh64Final(const xxh64_s* xxh, const uint8_t* frame, uint64_t length)
+{
+    uint64_t hash = XXH_PRIME64_5;
+    if (length >= XXH_STRIPE_SIZE)
+    {
+        hash = ROTL64(xxh->lanes[0], 1) + ROTL64(xxh->lanes[1], 7) + ROTL64(xxh->lanes[2], 12) + ROTL64(xxh->lanes[3], 18);
+        for (uintn_t i = 0; i < 4; i++)
+        {
+            hash = (hash ^ Xxh64Round(0, xxh->lanes[i])) * XXH_PRIME64_1 + XXH_PRIME64_4;
+        }
+    }
+    hash += length;
+
+    const uint8_t* tail = frame + xxh->hashed;
+    uint64_t tailLength = length - xxh->hashed;
+    for (; tailLength >= 8; tailLength -= 8, tail += 8)
+    {
+        uint64_t lane;
+        memcpy(&lane, tail, sizeof(lane));
+        hash ^= Xxh64Round(0, lane);
+        hash = ROTL64(hash, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+    if (tailLength >= 4)
+    {
+        uint32_t lane;
+        memcpy(&lane, tail, sizeof(lane));
+        hash ^= (uint64_t)lane * XXH_PRIME64_1;
+        hash = ROTL64(hash, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        tailLength -= 4;
+        tail += 4;
+    }
+    for (; tailLength > 0; tailLength--, tail++)
+    {
+        hash ^= *tail * XXH_PRIME64_5;
+        hash = ROTL64(hash, 11) * XXH_PRIME64_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME64_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+static uint64_t Xxh64Round(uint64_t acc, uint64_t input)
+{
+    acc += input * XXH_PRIME64_2;
+    acc = ROTL64(acc, 31);
+    return acc * XXH_PRIME64_1;
+}
@@ -0,0 +1,25 @@
+/* Included before uefi/string.c when it is built for the host, so its routines don't replace the ones of libc
+ * and the tests can compare the two */
+#define __string_init   uefi___string_init
+#define memcpy          uefi_memcpy
+#define memmove         uefi_memmove
+#define memset          uefi_memset
+#define memcmp          uefi_memcmp
+#define memchr          uefi_memchr
+#define memrchr         uefi_memrchr
+#define memmem          uefi_memmem
+#define memrmem         uefi_memrmem
+#define strcpy          uefi_strcpy
+#define strncpy         uefi_strncpy
+#define strcat          uefi_strcat
+#define strcmp          uefi_strcmp
+#define strncat         uefi_strncat
+#define strncmp         uefi_strncmp
+#define strdup          uefi_strdup
+#define strchr          uefi_strchr
+#define strrchr         uefi_strrchr
+#define strstr          uefi_strstr
+#define _strtok_r       uefi__strtok_r
+#define strtok          uefi_strtok
+#define strtok_r        uefi_strtok_r
+#define strlen          uefi_strlen
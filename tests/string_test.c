@@ -0,0 +1,428 @@
+// Compares the string routines of uefi/string.c with the ones of libc, then times both
+// Every routine is checked at every source and destination alignment within 16 bytes and at lengths around
+// the sizes of its vector loops, the buffers end right before an unmapped page so reading too far crashes
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+void uefi___string_init(void);
+void* uefi_memcpy(void* dst, const void* src, size_t n);
+void* uefi_memmove(void* dst, const void* src, size_t n);
+void* uefi_memset(void* s, int c, size_t n);
+int uefi_memcmp(const void* s1, const void* s2, size_t n);
+void* uefi_memchr(const void* s, int c, size_t n);
+void* uefi_memmem(const void* haystack, size_t hl, const void* needle, size_t nl);
+size_t uefi_strlen(const char* s);
+
+#define MAX_ALIGN    (16)
+#define MAX_LEN      (300)
+#define BUFFER_SIZE  (1024 * 1024 + 2 * MAX_ALIGN)
+#define CANARY       (0xA5)
+
+#define SIGN(x) (((x) > 0) - ((x) < 0))
+
+typedef struct guarded_buffer_s
+{
+    uint8_t* start;
+    size_t size;
+} guarded_buffer_s;
+
+typedef struct timed_routine_s
+{
+    const char* name;
+    void (*ours)(uint8_t* a, uint8_t* b, size_t n);
+    void (*libc)(uint8_t* a, uint8_t* b, size_t n);
+} timed_routine_s;
+
+static guarded_buffer_s AllocGuarded(size_t size);
+static uint8_t* BufferEnd(guarded_buffer_s* buffer, size_t len);
+static void FillPattern(uint8_t* p, size_t n, uint32_t seed);
+static void Fail(const char* routine, size_t srcAlign, size_t dstAlign, size_t len);
+
+static void TestMemcpy(void);
+static void TestMemmove(void);
+static void TestMemset(void);
+static void TestMemcmp(void);
+static void TestMemchr(void);
+static void TestMemmem(void);
+static void TestStrlen(void);
+static void TimeRoutines(void);
+
+static guarded_buffer_s bufA;
+static guarded_buffer_s bufB;
+static guarded_buffer_s bufRef;
+static int failures = 0;
+static volatile uintptr_t sink;
+
+
+int main(void)
+{
+    uefi___string_init();
+    bufA = AllocGuarded(BUFFER_SIZE);
+    bufB = AllocGuarded(BUFFER_SIZE);
+    bufRef = AllocGuarded(BUFFER_SIZE);
+
+    TestMemcpy();
+    TestMemmove();
+    TestMemset();
+    TestMemcmp();
+    TestMemchr();
+    TestMemmem();
+    TestStrlen();
+    if (failures != 0)
+    {
+        printf("%d checks failed.\n", failures);
+        return 1;
+    }
+    printf("All checks passed.\n\n");
+
+    TimeRoutines();
+    return 0;
+}
+
+// The page after the buffer is unmapped, a read or write past its end crashes the test
+static guarded_buffer_s AllocGuarded(size_t size)
+{
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    size_t mapped = (size + pageSize - 1) / pageSize * pageSize;
+    uint8_t* p = mmap(NULL, mapped + pageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED || mprotect(p + mapped, pageSize, PROT_NONE) != 0)
+    {
+        perror("mmap");
+        exit(2);
+    }
+    return (guarded_buffer_s){ p, mapped };
+}
+
+// A range of len bytes that ends where the guard page begins
+static uint8_t* BufferEnd(guarded_buffer_s* buffer, size_t len)
+{
+    return buffer->start + buffer->size - len;
+}
+
+static void FillPattern(uint8_t* p, size_t n, uint32_t seed)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        p[i] = (uint8_t)(seed >> 16);
+    }
+}
+
+static void Fail(const char* routine, size_t srcAlign, size_t dstAlign, size_t len)
+{
+    if (failures < 20)
+    {
+        printf("FAIL %s: src align %zu, dst align %zu, length %zu\n", routine, srcAlign, dstAlign, len);
+    }
+    failures++;
+}
+
+// The bytes around the destination must not change
+static void TestMemcpy(void)
+{
+    for (size_t len = 0; len <= MAX_LEN; len++)
+    {
+        for (size_t sa = 0; sa < MAX_ALIGN; sa++)
+        {
+            for (size_t da = 0; da < MAX_ALIGN; da++)
+            {
+                uint8_t* src = bufA.start + sa;
+                uint8_t* dst = bufB.start + da + MAX_ALIGN;
+                FillPattern(src, len, (uint32_t)(len * 31 + sa));
+                memset(bufB.start, CANARY, len + 3 * MAX_ALIGN);
+                memset(bufRef.start, CANARY, len + 3 * MAX_ALIGN);
+                memcpy(bufRef.start + da + MAX_ALIGN, src, len);
+
+                if (uefi_memcpy(dst, src, len) != dst || memcmp(bufB.start, bufRef.start, len + 3 * MAX_ALIGN) != 0)
+                {
+                    Fail("memcpy", sa, da, len);
+                }
+            }
+        }
+    }
+
+    // Large copies take the rep movsb path when the CPU has ERMS, and the end reaches the guard page
+    for (size_t len = 4096; len <= BUFFER_SIZE - MAX_ALIGN; len = len * 3 + 7)
+    {
+        for (size_t sa = 0; sa < MAX_ALIGN; sa += 5)
+        {
+            uint8_t* src = BufferEnd(&bufA, len) - sa;
+            uint8_t* dst = BufferEnd(&bufB, len);
+            FillPattern(src, len, (uint32_t)len);
+            uefi_memcpy(dst, src, len);
+            if (memcmp(dst, src, len) != 0)
+            {
+                Fail("memcpy", sa, 0, len);
+            }
+        }
+    }
+}
+
+// Every overlap in both directions is compared with libc working on a copy of the same buffer
+static void TestMemmove(void)
+{
+    const size_t span = MAX_LEN + 2 * MAX_ALIGN;
+    for (size_t len = 0; len <= MAX_LEN; len += (len < 64 ? 1 : 7))
+    {
+        for (size_t srcOffset = 0; srcOffset < 2 * MAX_ALIGN; srcOffset++)
+        {
+            for (size_t dstOffset = 0; dstOffset < 2 * MAX_ALIGN; dstOffset++)
+            {
+                FillPattern(bufA.start, span, (uint32_t)(len + srcOffset));
+                memcpy(bufRef.start, bufA.start, span);
+                memmove(bufRef.start + dstOffset, bufRef.start + srcOffset, len);
+
+                uint8_t* dst = bufA.start + dstOffset;
+                if (uefi_memmove(dst, bufA.start + srcOffset, len) != dst ||
+                    memcmp(bufA.start, bufRef.start, span) != 0)
+                {
+                    Fail("memmove", srcOffset, dstOffset, len);
+                }
+            }
+        }
+    }
+}
+
+// Only the low byte of the value is stored
+static void TestMemset(void)
+{
+    static const int values[] = { 0, 0x5A, 0xFF, 0x1234, -1 };
+    for (size_t v = 0; v < sizeof(values) / sizeof(values[0]); v++)
+    {
+        for (size_t len = 0; len <= MAX_LEN; len++)
+        {
+            for (size_t da = 0; da < MAX_ALIGN; da++)
+            {
+                uint8_t* dst = bufA.start + da + MAX_ALIGN;
+                memset(bufA.start, CANARY, len + 3 * MAX_ALIGN);
+                memset(bufRef.start, CANARY, len + 3 * MAX_ALIGN);
+                memset(bufRef.start + da + MAX_ALIGN, values[v], len);
+
+                if (uefi_memset(dst, values[v], len) != dst ||
+                    memcmp(bufA.start, bufRef.start, len + 3 * MAX_ALIGN) != 0)
+                {
+                    Fail("memset", 0, da, len);
+                }
+            }
+        }
+    }
+
+    size_t len = BUFFER_SIZE - MAX_ALIGN;
+    uefi_memset(BufferEnd(&bufA, len), 0x3C, len);
+    memset(bufRef.start, 0x3C, len);
+    if (memcmp(BufferEnd(&bufA, len), bufRef.start, len) != 0)
+    {
+        Fail("memset", 0, 0, len);
+    }
+}
+
+// Equal ranges, and a difference at every position in both directions, only the sign of the result matters
+static void TestMemcmp(void)
+{
+    for (size_t len = 0; len <= MAX_LEN / 2; len++)
+    {
+        for (size_t sa = 0; sa < MAX_ALIGN; sa++)
+        {
+            for (size_t da = 0; da < MAX_ALIGN; da += 3)
+            {
+                uint8_t* a = BufferEnd(&bufA, len + sa);
+                uint8_t* b = BufferEnd(&bufB, len + da);
+                FillPattern(a, len, (uint32_t)len);
+                memcpy(b, a, len);
+                if (uefi_memcmp(a, b, len) != 0)
+                {
+                    Fail("memcmp", sa, da, len);
+                }
+
+                for (size_t i = 0; i < len; i++)
+                {
+                    uint8_t saved = b[i];
+                    b[i] = (uint8_t)(a[i] + 1 + (i & 0x7F));
+                    if (SIGN(uefi_memcmp(a, b, len)) != SIGN(memcmp(a, b, len)) ||
+                        SIGN(uefi_memcmp(b, a, len)) != SIGN(memcmp(b, a, len)))
+                    {
+                        Fail("memcmp", sa, da, len);
+                    }
+                    b[i] = saved;
+                }
+            }
+        }
+    }
+}
+
+// The byte is found at every position, the first match wins, and a match right after the range is ignored
+static void TestMemchr(void)
+{
+    for (size_t len = 0; len <= MAX_LEN; len++)
+    {
+        for (size_t sa = 0; sa < MAX_ALIGN; sa++)
+        {
+            uint8_t* s = bufA.start + sa;
+            memset(s, 'x', len + 1);
+            s[len] = 'y';
+            if (uefi_memchr(s, 'y', len) != NULL || uefi_memchr(s, 'x' + 0x100, len) != memchr(s, 'x', len))
+            {
+                Fail("memchr", sa, 0, len);
+            }
+
+            for (size_t i = 0; i < len; i += (len < 64 ? 1 : 5))
+            {
+                s[i] = 'y';
+                if (i + 1 < len)
+                {
+                    s[i + 1] = 'y';
+                }
+                if (uefi_memchr(s, 'y', len) != memchr(s, 'y', len))
+                {
+                    Fail("memchr", sa, i, len);
+                }
+                s[i] = 'x';
+                if (i + 1 < len)
+                {
+                    s[i + 1] = 'x';
+                }
+            }
+
+            // The end of the range is the end of the mapping
+            uint8_t* end = BufferEnd(&bufB, len);
+            memset(end, 'x', len);
+            if (uefi_memchr(end, 'y', len) != NULL)
+            {
+                Fail("memchr", sa, 0, len);
+            }
+        }
+    }
+}
+
+// Texts of a small alphabet have many partial matches, which exercise both the memchr scan and Horspool
+static void TestMemmem(void)
+{
+    uint32_t seed = 1;
+    for (int round = 0; round < 20000; round++)
+    {
+        seed = seed * 1103515245 + 12345;
+        size_t hl = (seed >> 8) % 600;
+        size_t nl = 1 + (seed >> 20) % 24;
+        size_t alphabet = 2 + (round % 4);
+
+        uint8_t* haystack = BufferEnd(&bufA, hl);
+        uint8_t needle[32];
+        for (size_t i = 0; i < hl; i++)
+        {
+            seed = seed * 1103515245 + 12345;
+            haystack[i] = (uint8_t)('a' + (seed >> 16) % alphabet);
+        }
+        for (size_t i = 0; i < nl; i++)
+        {
+            seed = seed * 1103515245 + 12345;
+            needle[i] = (uint8_t)('a' + (seed >> 16) % alphabet);
+        }
+        // Half of the needles are taken from the haystack, so they are found
+        if ((round & 1) && hl >= nl)
+        {
+            memcpy(needle, haystack + (seed >> 4) % (hl - nl + 1), nl);
+        }
+
+        if (uefi_memmem(haystack, hl, needle, nl) != memmem(haystack, hl, needle, nl))
+        {
+            Fail("memmem", hl, nl, round);
+        }
+    }
+}
+
+// Strings end right before the guard page at every alignment, the aligned vector loads must stop at the page
+static void TestStrlen(void)
+{
+    for (size_t len = 0; len <= MAX_LEN; len++)
+    {
+        for (size_t sa = 0; sa < MAX_ALIGN; sa++)
+        {
+            char* s = (char*)BufferEnd(&bufA, len + 1 + sa);
+            memset(s, 'z', len);
+            s[len] = '\0';
+            if (uefi_strlen(s) != len)
+            {
+                Fail("strlen", sa, 0, len);
+            }
+        }
+    }
+}
+
+static void OursMemcpy(uint8_t* a, uint8_t* b, size_t n) { sink += (uintptr_t)uefi_memcpy(a, b, n); }
+static void LibcMemcpy(uint8_t* a, uint8_t* b, size_t n) { sink += (uintptr_t)memcpy(a, b, n); }
+static void OursMemset(uint8_t* a, uint8_t* b, size_t n) { sink += (uintptr_t)uefi_memset(a, 0x42, n); }
+static void LibcMemset(uint8_t* a, uint8_t* b, size_t n) { sink += (uintptr_t)memset(a, 0x42, n); }
+static void OursMemcmp(uint8_t* a, uint8_t* b, size_t n) { sink += (uintptr_t)uefi_memcmp(a, b, n); }
+static void LibcMemcmp(uint8_t* a, uint8_t* b, size_t n) { sink += (uintptr_t)memcmp(a, b, n); }
+static void OursMemchr(uint8_t* a, uint8_t* b, size_t n) { sink += (uintptr_t)uefi_memchr(a, 0, n); }
+static void LibcMemchr(uint8_t* a, uint8_t* b, size_t n) { sink += (uintptr_t)memchr(a, 0, n); }
+static void OursStrlen(uint8_t* a, uint8_t* b, size_t n) { sink += uefi_strlen((char*)a); }
+static void LibcStrlen(uint8_t* a, uint8_t* b, size_t n) { sink += strlen((char*)a); }
+static void OursMemmem(uint8_t* a, uint8_t* b, size_t n) { sink += (uintptr_t)uefi_memmem(a, n, "needle!", 7); }
+static void LibcMemmem(uint8_t* a, uint8_t* b, size_t n) { sink += (uintptr_t)memmem(a, n, "needle!", 7); }
+
+static double SecondsNow(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Runs the routine on n bytes for about 50 ms and returns MB/s
+static double Throughput(void (*routine)(uint8_t*, uint8_t*, size_t), size_t n)
+{
+    uint64_t iterations = 0;
+    double start = SecondsNow();
+    double elapsed = 0;
+    do
+    {
+        for (int i = 0; i < 64; i++)
+        {
+            routine(bufA.start, bufB.start, n);
+        }
+        iterations += 64;
+        elapsed = SecondsNow() - start;
+    } while (elapsed < 0.05);
+    return (double)n * iterations / elapsed / 1e6;
+}
+
+// Every byte is non-zero except the last one, so memchr and strlen scan the whole range, memcmp compares
+// equal ranges and memmem doesn't find its needle
+static void TimeRoutines(void)
+{
+    static const timed_routine_s routines[] = {
+        { "memcpy", OursMemcpy, LibcMemcpy },
+        { "memset", OursMemset, LibcMemset },
+        { "memcmp", OursMemcmp, LibcMemcmp },
+        { "memchr", OursMemchr, LibcMemchr },
+        { "strlen", OursStrlen, LibcStrlen },
+        { "memmem", OursMemmem, LibcMemmem },
+    };
+    static const size_t sizes[] = { 16, 64, 256, 4096, 65536, 1024 * 1024 };
+
+    printf("%-8s %10s %14s %14s\n", "routine", "bytes", "ours MB/s", "libc MB/s");
+    for (size_t r = 0; r < sizeof(routines) / sizeof(routines[0]); r++)
+    {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+        {
+            size_t n = sizes[s];
+            memset(bufA.start, 'a', n);
+            memset(bufB.start, 'a', n);
+            bufA.start[n - 1] = '\0';
+            bufB.start[n - 1] = '\0';
+
+            double ours = Throughput(routines[r].ours, n);
+            // memset overwrote the terminator
+            bufA.start[n - 1] = '\0';
+            double libc = Throughput(routines[r].libc, n);
+            bufA.start[n - 1] = '\0';
+            printf("%-8s %10zu %14.0f %14.0f\n", routines[r].name, n, ours, libc);
+        }
+    }
+}
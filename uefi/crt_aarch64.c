@@ -32,6 +32,7 @@
 
 /* this is implemented by the application */
 extern int main(int argc, char_t **argv);
+extern void __string_init(void);
 
 /* definitions for elf relocations */
 typedef uint64_t Elf64_Xword;
@@ -195,6 +196,7 @@ efi_status_t uefi_init (
     ST = systab;
     BS = systab->BootServices;
     RT = systab->RuntimeServices;
+    __string_init();
     BS->HandleProtocol(image, &lipGuid, (void **)&LIP);
     /* get command line arguments */
     status = BS->OpenProtocol(image, &shpGuid, (void **)&shp, image, NULL, EFI_OPEN_PROTOCOL_GET_PROTOCOL);
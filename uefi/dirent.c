@@ -32,6 +32,7 @@
 
 extern void __stdio_seterrno(efi_status_t status);
 struct dirent __dirent;
+extern time_t __mktime_efi(efi_time_t *t);
 
 DIR *opendir (const char_t *__name)
 {
@@ -46,15 +47,17 @@ struct dirent *readdir (DIR *__dirp)
     efi_file_info_t info;
     uintn_t bs = sizeof(efi_file_info_t);
     memset(&__dirent, 0, sizeof(struct dirent));
-    status = __dirp->Read(__dirp, &bs, &info);
+    status = __dirp->handle->Read(__dirp->handle, &bs, &info);
     if(EFI_ERROR(status) || !bs) {
         if(EFI_ERROR(status)) __stdio_seterrno(status);
         else errno = 0;
         return NULL;
     }
     __dirent.d_type = info.Attribute & EFI_FILE_DIRECTORY ? DT_DIR : DT_REG;
+    __dirent.d_size = info.FileSize;
+    __dirent.d_mtime = __mktime_efi(&info.ModificationTime);
 #ifndef UEFI_NO_UTF8
-    __dirent.d_reclen = wcstombs(__dirent.d_name, info.FileName, FILENAME_MAX - 1);
+    __dirent.d_reclen = ucs2_to_utf8(__dirent.d_name, FILENAME_MAX, info.FileName, (size_t)-1);
 #else
     __dirent.d_reclen = strlen(info.FileName);
     strncpy(__dirent.d_name, info.FileName, FILENAME_MAX - 1);
@@ -65,7 +68,7 @@ struct dirent *readdir (DIR *__dirp)
 void rewinddir (DIR *__dirp)
 {
     if(__dirp)
-        __dirp->SetPosition(__dirp, 0);
+        __dirp->handle->SetPosition(__dirp->handle, 0);
 }
 
 int closedir (DIR *__dirp)
@@ -61,12 +61,115 @@ void __stdio_seterrno(efi_status_t status)
     }
 }
 
-int fstat (FILE *__f, struct stat *__buf)
+/* returns 1 if the stream is a file on the root volume and not one of the fake devices */
+static int __stdio_isfile(FILE *__f)
+{
+    uintn_t i;
+    if(!__f || __f == stdin || __f == stdout || __f == stderr || (__ser && __f == (FILE*)__ser))
+        return 0;
+    for(i = 0; i < __blk_ndevs; i++)
+        if(__f == (FILE*)__blk_devs[i].bio)
+            return 0;
+    return 1;
+}
+
+/* the stream buffer is allocated on the first buffered access, returns 0 if the stream is unbuffered */
+static int __stdio_getbuf(FILE *__f)
+{
+    if(__f->bufmode == _IONBF) return 0;
+    if(!__f->buf) {
+        __f->buf = (uint8_t*)malloc(__f->bufsize);
+        if(!__f->buf) { __f->bufmode = _IONBF; return 0; }
+        __f->bufown = 1;
+    }
+    return 1;
+}
+
+/* writes out the pending bytes. They are dropped on error so a failing volume doesn't fail every later call */
+static int __stdio_flushw(FILE *__f)
+{
+    efi_status_t status;
+    uintn_t bs = __f->wlen;
+    if(!bs) return 0;
+    __f->wlen = 0;
+    status = __f->handle->Write(__f->handle, &bs, __f->buf);
+    if(EFI_ERROR(status)) {
+        __stdio_seterrno(status);
+        return -1;
+    }
+    return 0;
+}
+
+/* drops the unread part of the read-ahead and moves the handle back to the logical position */
+static int __stdio_dropr(FILE *__f)
+{
+    efi_status_t status = EFI_SUCCESS;
+    if(__f->rpos < __f->rlen)
+        status = __f->handle->SetPosition(__f->handle, __f->pos);
+    __f->rpos = __f->rlen = 0;
+    if(EFI_ERROR(status)) {
+        __stdio_seterrno(status);
+        return -1;
+    }
+    return 0;
+}
+
+static uintn_t __stdio_read(FILE *__f, uint8_t *__ptr, uintn_t __bs)
+{
+    efi_status_t status;
+    uintn_t done = 0, bs;
+    if(__stdio_flushw(__f)) return 0;
+    while(done < __bs) {
+        if(__f->rpos < __f->rlen) {
+            bs = __f->rlen - __f->rpos;
+            if(bs > __bs - done) bs = __bs - done;
+            memcpy(__ptr + done, __f->buf + __f->rpos, bs);
+            __f->rpos += bs; __f->pos += bs; done += bs;
+            continue;
+        }
+        __f->rpos = __f->rlen = 0;
+        /* big reads go straight to the caller's buffer, there's nothing to gain from a copy */
+        if(__bs - done >= __f->bufsize || !__stdio_getbuf(__f)) {
+            bs = __bs - done;
+            status = __f->handle->Read(__f->handle, &bs, __ptr + done);
+            if(EFI_ERROR(status)) { __stdio_seterrno(status); break; }
+            __f->pos += bs; done += bs;
+            break;
+        }
+        bs = __f->bufsize;
+        status = __f->handle->Read(__f->handle, &bs, __f->buf);
+        if(EFI_ERROR(status)) { __stdio_seterrno(status); break; }
+        if(!bs) break;
+        __f->rlen = bs;
+    }
+    return done;
+}
+
+static uintn_t __stdio_write(FILE *__f, const uint8_t *__ptr, uintn_t __bs)
 {
-    efi_guid_t infGuid = EFI_FILE_INFO_GUID;
-    efi_file_info_t info;
-    uintn_t fsiz = (uintn_t)sizeof(efi_file_info_t);
     efi_status_t status;
+    uintn_t bs = __bs;
+    if(__stdio_dropr(__f)) return 0;
+    if(__bs >= __f->bufsize || !__stdio_getbuf(__f)) {
+        if(__stdio_flushw(__f)) return 0;
+        status = __f->handle->Write(__f->handle, &bs, (void*)__ptr);
+        if(EFI_ERROR(status)) {
+            __stdio_seterrno(status);
+            return 0;
+        }
+    } else {
+        if(__f->wlen + __bs > __f->bufsize && __stdio_flushw(__f)) return 0;
+        memcpy(__f->buf + __f->wlen, __ptr, __bs);
+        __f->wlen += __bs;
+        if(__f->bufmode == _IOLBF && memchr(__ptr, '\n', __bs) && __stdio_flushw(__f)) return 0;
+    }
+    __f->pos += bs;
+    if(__f->pos > __f->size) __f->size = __f->pos;
+    return bs;
+}
+
+int fstat (FILE *__f, struct stat *__buf)
+{
     int i;
 
     if(!__f || !__buf) {
@@ -93,19 +196,15 @@ int fstat (FILE *__f, struct stat *__buf)
             __buf->st_blocks = __blk_devs[i].bio->Media->LastBlock + 1;
             return 0;
         }
-    status = __f->GetInfo(__f, &infGuid, &fsiz, &info);
-    if(EFI_ERROR(status)) {
-        __stdio_seterrno(status);
-        return -1;
-    }
+    /* served from the info cached by fopen */
     __buf->st_mode = S_IREAD |
-        (info.Attribute & EFI_FILE_READ_ONLY ? 0 : S_IWRITE) |
-        (info.Attribute & EFI_FILE_DIRECTORY ? S_IFDIR : S_IFREG);
-    __buf->st_size = (off_t)info.FileSize;
-    __buf->st_blocks = (blkcnt_t)info.PhysicalSize;
-    __buf->st_atime = __mktime_efi(&info.LastAccessTime);
-    __buf->st_mtime = __mktime_efi(&info.ModificationTime);
-    __buf->st_ctime = __mktime_efi(&info.CreateTime);
+        (__f->attr & EFI_FILE_READ_ONLY ? 0 : S_IWRITE) |
+        (__f->attr & EFI_FILE_DIRECTORY ? S_IFDIR : S_IFREG);
+    __buf->st_size = (off_t)__f->size;
+    __buf->st_blocks = (blkcnt_t)__f->physsize;
+    __buf->st_atime = __mktime_efi(&__f->atime);
+    __buf->st_mtime = __mktime_efi(&__f->mtime);
+    __buf->st_ctime = __mktime_efi(&__f->ctime);
     return 0;
 }
 
@@ -123,9 +222,11 @@ int fclose (FILE *__stream)
     for(i = 0; i < __blk_ndevs; i++)
         if(__stream == (FILE*)__blk_devs[i].bio)
             return 1;
-    status = __stream->Close(__stream);
+    i = __stdio_flushw(__stream);
+    status = __stream->handle->Close(__stream->handle);
+    if(__stream->bufown) free(__stream->buf);
     free(__stream);
-    return !EFI_ERROR(status);
+    return !i && !EFI_ERROR(status);
 }
 
 int fflush (FILE *__stream)
@@ -143,16 +244,30 @@ int fflush (FILE *__stream)
         if(__stream == (FILE*)__blk_devs[i].bio) {
             return 1;
         }
-    status = __stream->Flush(__stream);
+    if(__stdio_flushw(__stream)) return 0;
+    status = __stream->handle->Flush(__stream->handle);
     return !EFI_ERROR(status);
 }
 
+int setvbuf (FILE *__stream, char_t *__buf, int __modes, size_t __n)
+{
+    if(!__stdio_isfile(__stream) || (__modes != _IOFBF && __modes != _IOLBF && __modes != _IONBF)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if(__stdio_flushw(__stream) || __stdio_dropr(__stream)) return -1;
+    if(__stream->bufown) free(__stream->buf);
+    __stream->buf = (uint8_t*)__buf;
+    __stream->bufown = 0;
+    __stream->bufmode = __modes;
+    /* without a caller provided buffer one of the given size is allocated on the first access */
+    __stream->bufsize = __n > 0 ? __n : BUFSIZ;
+    return 0;
+}
+
 int __remove (const char_t *__filename, int isdir)
 {
-    efi_status_t status;
-    efi_guid_t infGuid = EFI_FILE_INFO_GUID;
-    efi_file_info_t info;
-    uintn_t fsiz = (uintn_t)sizeof(efi_file_info_t), i;
+    uintn_t i;
     /* little hack to support read and write mode for Delete() and stat() without create mode or checks */
     FILE *f = fopen(__filename, CL("*"));
     if(errno)
@@ -166,22 +281,30 @@ int __remove (const char_t *__filename, int isdir)
             errno = EBADF;
             return 1;
         }
-    if(isdir != -1) {
-        status = f->GetInfo(f, &infGuid, &fsiz, &info);
-        if(EFI_ERROR(status)) goto err;
-        if(isdir == 0 && (info.Attribute & EFI_FILE_DIRECTORY)) {
-            fclose(f); errno = EISDIR;
-            return -1;
-        }
-        if(isdir == 1 && !(info.Attribute & EFI_FILE_DIRECTORY)) {
-            fclose(f); errno = ENOTDIR;
-            return -1;
-        }
+    if(isdir == 0 && (f->attr & EFI_FILE_DIRECTORY)) {
+        fclose(f); errno = EISDIR;
+        return -1;
     }
-    status = f->Delete(f);
+    if(isdir == 1 && !(f->attr & EFI_FILE_DIRECTORY)) {
+        fclose(f); errno = ENOTDIR;
+        return -1;
+    }
+    return fdelete(f);
+}
+
+int fdelete (FILE *__stream)
+{
+    efi_status_t status;
+    if(!__stdio_isfile(__stream)) {
+        errno = EBADF;
+        return -1;
+    }
+    /* Delete() closes the handle, only the wrapper is left to free. Pending writes are pointless to flush */
+    status = __stream->handle->Delete(__stream->handle);
+    if(__stream->bufown) free(__stream->buf);
+    free(__stream);
     if(EFI_ERROR(status)) {
-err:    __stdio_seterrno(status);
-        fclose(f);
+        __stdio_seterrno(status);
         return -1;
     }
     // Temporary
@@ -189,8 +312,6 @@ err:    __stdio_seterrno(status);
         errno = EISDIR;
         return -1;
     }
-    /* no need for fclose(f); */
-    free(f);
     return 0;
 }
 
@@ -199,18 +320,83 @@ int remove (const char_t *__filename)
     return __remove(__filename, -1);
 }
 
-FILE *fopen (const char_t *__filename, const char_t *__modes)
+/* opens a file relative to a directory handle and caches its info. The modes are validated by the callers */
+static FILE *__stdio_open (efi_file_handle_t *__dir, const char_t *__filename, const char_t *__modes)
 {
     FILE *ret;
+    efi_file_handle_t *h;
     efi_status_t status;
-    efi_guid_t sfsGuid = EFI_SIMPLE_FILE_SYSTEM_PROTOCOL_GUID;
-    efi_simple_file_system_protocol_t *sfs = NULL;
     efi_guid_t infGuid = EFI_FILE_INFO_GUID;
     efi_file_info_t info;
-    uintn_t fsiz = (uintn_t)sizeof(efi_file_info_t), par, i;
+    uintn_t fsiz = (uintn_t)sizeof(efi_file_info_t);
 #ifndef UEFI_NO_UTF8
     wchar_t wcname[BUFSIZ];
 #endif
+    /* the file handle is allocated by the firmware in Open() */
+    h = NULL;
+    /* normally write means read,write,create. But for remove (internal '*' mode), we need read,write without create
+     * also mode 'w' in POSIX means write-only (without read), but that's not working on certain firmware, we must
+     * pass read too. This poses a problem of truncating a write-only file, see issue #26, we have to do that manually */
+#ifndef UEFI_NO_UTF8
+    utf8_to_ucs2((wchar_t*)&wcname, BUFSIZ, __filename, (size_t)-1);
+    status = __dir->Open(__dir, &h, (wchar_t*)&wcname,
+#else
+    status = __dir->Open(__dir, &h, (wchar_t*)__filename,
+#endif
+        __modes[0] == CL('w') || __modes[0] == CL('a') ? (EFI_FILE_MODE_WRITE | EFI_FILE_MODE_READ | EFI_FILE_MODE_CREATE) :
+            EFI_FILE_MODE_READ | (__modes[0] == CL('*') || __modes[1] == CL('+') ? EFI_FILE_MODE_WRITE : 0),
+        __modes[1] == CL('d') ? EFI_FILE_DIRECTORY : 0);
+    if(EFI_ERROR(status)) {
+err:    __stdio_seterrno(status);
+        if(h) h->Close(h);
+        return NULL;
+    }
+    /* this is the only info query, everything else is served from the cache */
+    status = h->GetInfo(h, &infGuid, &fsiz, &info);
+    if(EFI_ERROR(status)) goto err;
+    if(__modes[0] != CL('*')) {
+        if(__modes[1] == CL('d') && !(info.Attribute & EFI_FILE_DIRECTORY)) {
+            h->Close(h); errno = ENOTDIR; return NULL;
+        }
+        if(__modes[1] != CL('d') && (info.Attribute & EFI_FILE_DIRECTORY)) {
+            h->Close(h); errno = EISDIR; return NULL;
+        }
+    }
+    ret = (FILE*)malloc(sizeof(FILE));
+    if(!ret) {
+        h->Close(h); errno = ENOMEM; return NULL;
+    }
+    ret->handle = h;
+    ret->pos = 0;
+    ret->size = info.FileSize;
+    ret->physsize = info.PhysicalSize;
+    ret->attr = info.Attribute;
+    ret->ctime = info.CreateTime;
+    ret->atime = info.LastAccessTime;
+    ret->mtime = info.ModificationTime;
+    ret->buf = NULL;
+    ret->bufsize = BUFSIZ;
+    ret->bufmode = _IOFBF;
+    ret->bufown = 0;
+    ret->rpos = ret->rlen = ret->wlen = 0;
+    if(__modes[0] == CL('a')) fseek(ret, 0, SEEK_END);
+    if(__modes[0] == CL('w') && info.FileSize) {
+        /* manually truncate file size
+         * See https://github.com/tianocore/edk2/blob/master/MdePkg/Library/UefiFileHandleLib/UefiFileHandleLib.c
+         * function FileHandleSetSize */
+        info.FileSize = 0;
+        h->SetInfo(h, &infGuid, fsiz, &info);
+        ret->size = 0;
+    }
+    return ret;
+}
+
+FILE *fopen (const char_t *__filename, const char_t *__modes)
+{
+    efi_status_t status;
+    efi_guid_t sfsGuid = EFI_SIMPLE_FILE_SYSTEM_PROTOCOL_GUID;
+    efi_simple_file_system_protocol_t *sfs = NULL;
+    uintn_t par, i;
     errno = 0;
     if(!__filename || !*__filename || !__modes || (__modes[0] != CL('r') && __modes[0] != CL('w') && __modes[0] != CL('a') &&
       __modes[0] != CL('*')) || (__modes[1] != 0 && __modes[1] != CL('d') && __modes[1] != CL('+'))) {
@@ -278,42 +464,26 @@ FILE *fopen (const char_t *__filename, const char_t *__modes)
         errno = ENODEV;
         return NULL;
     }
-    ret = (FILE*)malloc(sizeof(FILE));
-    if(!ret) return NULL;
-    /* normally write means read,write,create. But for remove (internal '*' mode), we need read,write without create
-     * also mode 'w' in POSIX means write-only (without read), but that's not working on certain firmware, we must
-     * pass read too. This poses a problem of truncating a write-only file, see issue #26, we have to do that manually */
-#ifndef UEFI_NO_UTF8
-    mbstowcs((wchar_t*)&wcname, __filename, BUFSIZ - 1);
-    status = __root_dir->Open(__root_dir, &ret, (wchar_t*)&wcname,
-#else
-    status = __root_dir->Open(__root_dir, &ret, (wchar_t*)__filename,
-#endif
-        __modes[0] == CL('w') || __modes[0] == CL('a') ? (EFI_FILE_MODE_WRITE | EFI_FILE_MODE_READ | EFI_FILE_MODE_CREATE) :
-            EFI_FILE_MODE_READ | (__modes[0] == CL('*') || __modes[1] == CL('+') ? EFI_FILE_MODE_WRITE : 0),
-        __modes[1] == CL('d') ? EFI_FILE_DIRECTORY : 0);
-    if(EFI_ERROR(status)) {
-err:    __stdio_seterrno(status);
-        free(ret); return NULL;
-    }
-    if(__modes[0] == CL('*')) return ret;
-    status = ret->GetInfo(ret, &infGuid, &fsiz, &info);
-    if(EFI_ERROR(status)) goto err;
-    if(__modes[1] == CL('d') && !(info.Attribute & EFI_FILE_DIRECTORY)) {
-        ret->Close(ret); free(ret); errno = ENOTDIR; return NULL;
+    return __stdio_open(__root_dir, __filename, __modes);
+}
+
+FILE *fopenat (DIR *__dirp, const char_t *__filename, const char_t *__modes)
+{
+    errno = 0;
+    if(!__filename || !*__filename || !__modes || (__modes[0] != CL('r') && __modes[0] != CL('w') && __modes[0] != CL('a') &&
+      __modes[0] != CL('*')) || (__modes[1] != 0 && __modes[1] != CL('d') && __modes[1] != CL('+'))) {
+        errno = EINVAL;
+        return NULL;
     }
-    if(__modes[1] != CL('d') && (info.Attribute & EFI_FILE_DIRECTORY)) {
-        ret->Close(ret); free(ret); errno = EISDIR; return NULL;
+    if(!__stdio_isfile(__dirp)) {
+        errno = EBADF;
+        return NULL;
     }
-    if(__modes[0] == CL('a')) fseek(ret, 0, SEEK_END);
-    if(__modes[0] == CL('w')) {
-        /* manually truncate file size
-         * See https://github.com/tianocore/edk2/blob/master/MdePkg/Library/UefiFileHandleLib/UefiFileHandleLib.c
-         * function FileHandleSetSize */
-        info.FileSize = 0;
-        ret->SetInfo(ret, &infGuid, fsiz, &info);
+    if(!(__dirp->attr & EFI_FILE_DIRECTORY)) {
+        errno = ENOTDIR;
+        return NULL;
     }
-    return ret;
+    return __stdio_open(__dirp->handle, __filename, __modes);
 }
 
 size_t fread (void *__ptr, size_t __size, size_t __n, FILE *__stream)
@@ -343,7 +513,7 @@ size_t fread (void *__ptr, size_t __size, size_t __n, FILE *__stream)
                 __blk_devs[i].offset += bs;
                 return bs / __size;
             }
-        status = __stream->Read(__stream, &bs, __ptr);
+        return __stdio_read(__stream, (uint8_t*)__ptr, bs) / __size;
     }
     if(EFI_ERROR(status)) {
         __stdio_seterrno(status);
@@ -379,7 +549,7 @@ size_t fwrite (const void *__ptr, size_t __size, size_t __n, FILE *__stream)
                 __blk_devs[i].offset += bs;
                 return bs / __size;
             }
-        status = __stream->Write(__stream, &bs, (void *)__ptr);
+        return __stdio_write(__stream, (const uint8_t*)__ptr, bs) / __size;
     }
     if(EFI_ERROR(status)) {
         __stdio_seterrno(status);
@@ -392,9 +562,7 @@ int fseek (FILE *__stream, long int __off, int __whence)
 {
     off_t off = 0;
     efi_status_t status;
-    efi_guid_t infoGuid = EFI_FILE_INFO_GUID;
-    efi_file_info_t info;
-    uintn_t fsiz = sizeof(efi_file_info_t), i;
+    uintn_t i;
     if(!__stream || (__whence != SEEK_SET && __whence != SEEK_CUR && __whence != SEEK_END)) {
         errno = EINVAL;
         return -1;
@@ -428,32 +596,35 @@ int fseek (FILE *__stream, long int __off, int __whence)
             return 0;
         }
     switch(__whence) {
-        case SEEK_END:
-            status = __stream->GetInfo(__stream, &infoGuid, &fsiz, &info);
-            if(!EFI_ERROR(status)) {
-                off = info.FileSize + __off;
-                status = __stream->SetPosition(__stream, off);
-            }
-            break;
-        case SEEK_CUR:
-            status = __stream->GetPosition(__stream, &off);
-            if(!EFI_ERROR(status)) {
-                off += __off;
-                status = __stream->SetPosition(__stream, off);
-            }
-            break;
-        default:
-            status = __stream->SetPosition(__stream, __off);
-            break;
+        case SEEK_END: off = __stream->size + __off; break;
+        case SEEK_CUR: off = __stream->pos + __off; break;
+        default: off = __off; break;
+    }
+    if(off < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    /* seeking inside the read-ahead only moves the read pointer */
+    if(__stream->rlen && (uint64_t)off >= __stream->pos - __stream->rpos &&
+      (uint64_t)off < __stream->pos - __stream->rpos + __stream->rlen) {
+        __stream->rpos = off - (__stream->pos - __stream->rpos);
+        __stream->pos = off;
+        return 0;
+    }
+    if(__stdio_flushw(__stream)) return -1;
+    __stream->rpos = __stream->rlen = 0;
+    status = __stream->handle->SetPosition(__stream->handle, off);
+    if(EFI_ERROR(status)) {
+        __stdio_seterrno(status);
+        return -1;
     }
-    return EFI_ERROR(status) ? -1 : 0;
+    __stream->pos = off;
+    return 0;
 }
 
 long int ftell (FILE *__stream)
 {
-    uint64_t off = 0;
     uintn_t i;
-    efi_status_t status;
     if(!__stream) {
         errno = EINVAL;
         return -1;
@@ -470,17 +641,37 @@ long int ftell (FILE *__stream)
         if(__stream == (FILE*)__blk_devs[i].bio) {
             return (long int)__blk_devs[i].offset;
         }
-    status = __stream->GetPosition(__stream, &off);
-    return EFI_ERROR(status) ? -1 : (long int)off;
+    return (long int)__stream->pos;
+}
+
+int fgetc (FILE *__stream)
+{
+    uint8_t c;
+    if(__stdio_isfile(__stream) && __stream->rpos < __stream->rlen) {
+        __stream->pos++;
+        return __stream->buf[__stream->rpos++];
+    }
+    return fread(&c, 1, 1, __stream) == 1 ? c : EOF;
+}
+
+char_t *fgets (char_t *__s, int __n, FILE *__stream)
+{
+    int c, i = 0;
+    if(!__s || __n < 1 || !__stream) {
+        errno = EINVAL;
+        return NULL;
+    }
+    while(i < __n - 1 && (c = fgetc(__stream)) != EOF) {
+        __s[i++] = (char_t)c;
+        if(c == '\n') break;
+    }
+    __s[i] = 0;
+    return i ? __s : NULL;
 }
 
 int feof (FILE *__stream)
 {
-    uint64_t off = 0;
-    efi_guid_t infGuid = EFI_FILE_INFO_GUID;
-    efi_file_info_t info;
-    uintn_t fsiz = (uintn_t)sizeof(efi_file_info_t), i;
-    efi_status_t status;
+    uintn_t i;
     if(!__stream) {
         errno = EINVAL;
         return 0;
@@ -498,15 +689,7 @@ int feof (FILE *__stream)
             errno = EBADF;
             return __blk_devs[i].offset == (off_t)__blk_devs[i].bio->Media->BlockSize * (off_t)__blk_devs[i].bio->Media->LastBlock;
         }
-    status = __stream->GetPosition(__stream, &off);
-    if(EFI_ERROR(status)) {
-err:    __stdio_seterrno(status);
-        return 1;
-    }
-    status = __stream->GetInfo(__stream, &infGuid, &fsiz, &info);
-    if(EFI_ERROR(status)) goto err;
-    __stream->SetPosition(__stream, off);
-    return info.FileSize == off;
+    return __stream->pos >= __stream->size;
 }
 
 int vsnprintf(char_t *dst, size_t maxlen, const char_t *fmt, __builtin_va_list args)
@@ -725,7 +908,7 @@ int vprintf(const char_t* fmt, __builtin_va_list args)
 #ifndef UEFI_NO_UTF8
     char_t tmp[BUFSIZ];
     ret = vsnprintf(tmp, BUFSIZ, fmt, args);
-    mbstowcs(dst, tmp, BUFSIZ - 1);
+    utf8_to_ucs2(dst, BUFSIZ, tmp, ret);
 #else
     ret = vsnprintf(dst, BUFSIZ, fmt, args);
 #endif
@@ -746,8 +929,8 @@ int vfprintf (FILE *__stream, const char_t *__format, __builtin_va_list args)
     char_t tmp[BUFSIZ];
     uintn_t ret, i;
 #ifndef UEFI_NO_UTF8
+    /* only the console needs UCS-2, files and the serial port get the UTF-8 bytes as they are */
     ret = vsnprintf(tmp, BUFSIZ, __format, args);
-    ret = mbstowcs(dst, tmp, BUFSIZ - 1);
 #else
     ret = vsnprintf(dst, BUFSIZ, __format, args);
 #endif
@@ -757,6 +940,10 @@ int vfprintf (FILE *__stream, const char_t *__format, __builtin_va_list args)
             errno = EBADF;
             return -1;
         }
+#ifndef UEFI_NO_UTF8
+    if(__stream == stdout || __stream == stderr)
+        utf8_to_ucs2(dst, BUFSIZ, tmp, ret);
+#endif
     if(__stream == stdout)
         ST->ConOut->OutputString(ST->ConOut, (wchar_t*)&dst);
     else if(__stream == stderr)
@@ -768,9 +955,9 @@ int vfprintf (FILE *__stream, const char_t *__format, __builtin_va_list args)
         __ser->Write(__ser, &ret, (void*)&tmp);
     } else
 #ifndef UEFI_NO_UTF8
-        __stream->Write(__stream, &ret, (void*)&tmp);
+        ret = __stdio_write(__stream, (uint8_t*)&tmp, ret);
 #else
-        __stream->Write(__stream, &ret, (void*)&dst);
+        ret = __stdio_write(__stream, (uint8_t*)&dst, ret);
 #endif
     return ret;
 }
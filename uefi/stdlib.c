@@ -29,14 +29,14 @@
  */
 
 #include <uefi.h>
+/* the tagging macros would rename the functions defined here */
+#undef malloc
+#undef calloc
+#undef realloc
 
 int errno = 0;
 static uint64_t __srand_seed = 6364136223846793005ULL;
 extern void __stdio_cleanup();
-#ifndef UEFI_NO_TRACK_ALLOC
-static uintptr_t *__stdlib_allocs = NULL;
-static uintn_t __stdlib_numallocs = 0;
-#endif
 
 int atoi(const char_t *s)
 {
@@ -77,115 +77,125 @@ int64_t strtol (const char_t *s, char_t **__endptr, int __base)
     return v * sign;
 }
 
-void *malloc (size_t __size)
+/* every buffer starts with this header, it keeps the size for realloc and links the live buffers for statistics */
+typedef struct __heap_hdr_s {
+    struct __heap_hdr_s *prev, *next;
+    size_t size;
+    uint64_t seq;
+    const char *file;
+    uint32_t line;
+    uint32_t magic;
+} __heap_hdr_t;
+#define HEAP_MAGIC 0x50414548   /* "HEAP" */
+#define HEAP_HDR(p) ((__heap_hdr_t*)((uint8_t*)(p) - sizeof(__heap_hdr_t)))
+static __heap_hdr_t *__heap_live = NULL;
+static heap_stats_t __heap_stats = { 0 };
+
+void *__malloc_tag (size_t __size, const char *__file, int __line)
 {
-    void *ret = NULL;
+    __heap_hdr_t *hdr = NULL;
     efi_status_t status;
-#ifndef UEFI_NO_TRACK_ALLOC
-    uintn_t i;
-    for(i = 0; i < __stdlib_numallocs && __stdlib_allocs[i] != 0; i += 2);
-    if(i == __stdlib_numallocs) {
-        /* no free slots found, (re)allocate the housekeeping array */
-        status = BS->AllocatePool(LIP ? LIP->ImageDataType : EfiLoaderData, (__stdlib_numallocs + 2) * sizeof(uintptr_t), &ret);
-        if(EFI_ERROR(status) || !ret) { errno = ENOMEM; return NULL; }
-        if(__stdlib_allocs) memcpy(ret, __stdlib_allocs, __stdlib_numallocs * sizeof(uintptr_t));
-        __stdlib_allocs = (uintptr_t*)ret;
-        __stdlib_allocs[i] = __stdlib_allocs[i + 1] = 0;
-        __stdlib_numallocs += 2;
-        ret = NULL;
-    }
-#endif
-    status = BS->AllocatePool(LIP ? LIP->ImageDataType : EfiLoaderData, __size, &ret);
-    if(EFI_ERROR(status) || !ret) { errno = ENOMEM; ret = NULL; }
-#ifndef UEFI_NO_TRACK_ALLOC
-    __stdlib_allocs[i] = (uintptr_t)ret;
-    __stdlib_allocs[i + 1] = (uintptr_t)__size;
-#endif
-    return ret;
+    __heap_stats.pool_calls++;
+    status = BS->AllocatePool(LIP ? LIP->ImageDataType : EfiLoaderData, sizeof(__heap_hdr_t) + __size, (void**)&hdr);
+    if(EFI_ERROR(status) || !hdr) { errno = ENOMEM; return NULL; }
+    hdr->size = __size;
+    hdr->seq = ++__heap_stats.seq;
+    hdr->file = __file;
+    hdr->line = (uint32_t)__line;
+    hdr->magic = HEAP_MAGIC;
+    hdr->prev = NULL;
+    hdr->next = __heap_live;
+    if(__heap_live) __heap_live->prev = hdr;
+    __heap_live = hdr;
+    __heap_stats.total_allocs++;
+    __heap_stats.live_allocs++;
+    __heap_stats.live_bytes += __size;
+    if(__heap_stats.live_bytes > __heap_stats.peak_bytes) __heap_stats.peak_bytes = __heap_stats.live_bytes;
+    return (void*)(hdr + 1);
 }
 
-void *calloc (size_t __nmemb, size_t __size)
+void *__calloc_tag (size_t __nmemb, size_t __size, const char *__file, int __line)
 {
-    void *ret = malloc(__nmemb * __size);
+    void *ret = __malloc_tag(__nmemb * __size, __file, __line);
     if(ret) memset(ret, 0, __nmemb * __size);
     return ret;
 }
 
-void *realloc (void *__ptr, size_t __size)
+void *__realloc_tag (void *__ptr, size_t __size, const char *__file, int __line)
 {
     void *ret = NULL;
-    efi_status_t status;
-#ifndef UEFI_NO_TRACK_ALLOC
-    uintn_t i;
-#endif
-    if(!__ptr) return malloc(__size);
+    __heap_hdr_t *hdr;
+    if(!__ptr) return __malloc_tag(__size, __file, __line);
     if(!__size) { free(__ptr); return NULL; }
-#ifndef UEFI_NO_TRACK_ALLOC
-    /* get the slot which stores the old size for this buffer */
-    for(i = 0; i < __stdlib_numallocs && __stdlib_allocs[i] != (uintptr_t)__ptr; i += 2);
-    if(i == __stdlib_numallocs) { errno = ENOMEM; return NULL; }
-    /* allocate a new buffer and copy data from old buffer */
-    status = BS->AllocatePool(LIP ? LIP->ImageDataType : EfiLoaderData, __size, &ret);
-    if(EFI_ERROR(status) || !ret) { errno = ENOMEM; ret = NULL; }
-    else {
-        memcpy(ret, (void*)__stdlib_allocs[i], __stdlib_allocs[i + 1] < __size ? __stdlib_allocs[i + 1] : __size);
-        if(__size > __stdlib_allocs[i + 1]) memset((uint8_t*)ret + __stdlib_allocs[i + 1], 0, __size - __stdlib_allocs[i + 1]);
-        /* free old buffer and store new buffer in slot */
-        BS->FreePool((void*)__stdlib_allocs[i]);
-        __stdlib_allocs[i] = (uintptr_t)ret;
-        __stdlib_allocs[i + 1] = (uintptr_t)__size;
-    }
-#else
-    status = BS->AllocatePool(LIP ? LIP->ImageDataType : EfiLoaderData, __size, &ret);
-    if(EFI_ERROR(status) || !ret) { errno = ENOMEM; return NULL; }
-    /* this means out of bounds read, but fine with POSIX as the end of new buffer supposed to be left uninitialized) */
-    memcpy(ret, (void*)__ptr, __size);
-    BS->FreePool((void*)__ptr);
-#endif
+    hdr = HEAP_HDR(__ptr);
+    if(hdr->magic != HEAP_MAGIC) { errno = EINVAL; return NULL; }
+    /* shrinking never needs a new buffer */
+    if(__size <= hdr->size) return __ptr;
+    ret = __malloc_tag(__size, __file, __line);
+    if(!ret) return NULL;
+    memcpy(ret, __ptr, hdr->size);
+    free(__ptr);
     return ret;
 }
 
+void *malloc (size_t __size)
+{
+    return __malloc_tag(__size, NULL, 0);
+}
+
+void *calloc (size_t __nmemb, size_t __size)
+{
+    return __calloc_tag(__nmemb, __size, NULL, 0);
+}
+
+void *realloc (void *__ptr, size_t __size)
+{
+    return __realloc_tag(__ptr, __size, NULL, 0);
+}
+
 void free (void *__ptr)
 {
     efi_status_t status;
-#ifndef UEFI_NO_TRACK_ALLOC
-    uintn_t i;
-#endif
+    __heap_hdr_t *hdr;
     if(!__ptr) { errno = ENOMEM; return; }
-#ifndef UEFI_NO_TRACK_ALLOC
-    /* find and clear the slot */
-    for(i = 0; i < __stdlib_numallocs && __stdlib_allocs[i] != (uintptr_t)__ptr; i += 2);
-    if(i == __stdlib_numallocs) { errno = ENOMEM; return; }
-    __stdlib_allocs[i] = 0;
-    __stdlib_allocs[i + 1] = 0;
-    /* if there are only empty slots, free the housekeeping array too */
-    for(i = 0; i < __stdlib_numallocs && __stdlib_allocs[i] == 0; i += 2);
-    if(i == __stdlib_numallocs) { BS->FreePool(__stdlib_allocs); __stdlib_allocs = NULL; __stdlib_numallocs = 0; }
-#endif
-    status = BS->FreePool(__ptr);
+    hdr = HEAP_HDR(__ptr);
+    /* not allocated by us, don't pass it to the firmware */
+    if(hdr->magic != HEAP_MAGIC) { errno = EINVAL; return; }
+    hdr->magic = 0;
+    if(hdr->prev) hdr->prev->next = hdr->next; else __heap_live = hdr->next;
+    if(hdr->next) hdr->next->prev = hdr->prev;
+    __heap_stats.total_frees++;
+    __heap_stats.live_allocs--;
+    __heap_stats.live_bytes -= hdr->size;
+    __heap_stats.pool_calls++;
+    status = BS->FreePool(hdr);
     if(EFI_ERROR(status)) errno = ENOMEM;
 }
 
+void heap_stats (heap_stats_t *__stats)
+{
+    if(__stats) memcpy(__stats, &__heap_stats, sizeof(heap_stats_t));
+}
+
+void heap_walk (uint64_t __since, heap_walk_t __fn, void *__data)
+{
+    __heap_hdr_t *hdr, *next;
+    if(!__fn) return;
+    /* the list is newest first, so we can stop at the first buffer that's older than the checkpoint */
+    for(hdr = __heap_live; hdr && hdr->seq > __since; hdr = next) {
+        next = hdr->next;
+        __fn((void*)(hdr + 1), hdr->size, hdr->file, (int)hdr->line, __data);
+    }
+}
+
 void abort ()
 {
-#ifndef UEFI_NO_TRACK_ALLOC
-    if(__stdlib_allocs)
-        BS->FreePool(__stdlib_allocs);
-    __stdlib_allocs = NULL;
-    __stdlib_numallocs = 0;
-#endif
     __stdio_cleanup();
     BS->Exit(IM, EFI_ABORTED, 0, NULL);
 }
 
 void exit (int __status)
 {
-#ifndef UEFI_NO_TRACK_ALLOC
-    if(__stdlib_allocs)
-        BS->FreePool(__stdlib_allocs);
-    __stdlib_allocs = NULL;
-    __stdlib_numallocs = 0;
-#endif
     __stdio_cleanup();
     BS->Exit(IM, !__status ? 0 : (__status < 0 ? EFIERR(-__status) : EFIERR(__status)), 0, NULL);
 }
@@ -195,12 +205,6 @@ int exit_bs()
     efi_status_t status;
     efi_memory_descriptor_t *memory_map = NULL;
     uintn_t cnt = 3, memory_map_size=0, map_key=0, desc_size=0;
-#ifndef UEFI_NO_TRACK_ALLOC
-    if(__stdlib_allocs)
-        BS->FreePool(__stdlib_allocs);
-    __stdlib_allocs = NULL;
-    __stdlib_numallocs = 0;
-#endif
     __stdio_cleanup();
     while(cnt--) {
         status = BS->GetMemoryMap(&memory_map_size, memory_map, &map_key, &desc_size, NULL);
@@ -278,34 +282,101 @@ int wctomb (char *s, wchar_t u)
     return ret;
 }
 
+/* 16 ASCII bytes are widened (or 8 ASCII wide chars narrowed) at once, the compiler's vector extension
+ * turns the conversions into punpck/packus on x86_64 and uxtl/xtn on aarch64 */
+#if defined(__x86_64__) || defined(__aarch64__)
+#define __HAVE_V16
+typedef uint8_t __v16 __attribute__((vector_size(16)));
+typedef uint8_t __v8b __attribute__((vector_size(8)));
+typedef uint16_t __v8h __attribute__((vector_size(16)));
+typedef uint64_t __v2q __attribute__((vector_size(16)));
+typedef __v16 __v16u __attribute__((aligned(1), may_alias));
+typedef __v8h __v8hu __attribute__((aligned(1), may_alias));
+typedef __v8b __v8bu __attribute__((aligned(1), may_alias));
+#endif
+
+size_t utf8_to_ucs2 (wchar_t *__dst, size_t __dstmax, const char *__src, size_t __srclen)
+{
+    const uint8_t *s = (const uint8_t*)__src;
+    size_t n = __srclen;    /* (size_t)-1 means zero terminated source, the terminator stops us anyway */
+    wchar_t *d = __dst, *de;
+#ifdef __HAVE_V16
+    __v16 v;
+    __v2q q;
+    int aligned = __srclen == (size_t)-1;   /* the length is unknown, vector loads must not cross a page */
+#endif
+    if(!__dst || !__dstmax) return 0;
+    if(!__src) { *__dst = 0; return 0; }
+    de = __dst + __dstmax - 1;
+    while(n && d < de && *s) {
+#ifdef __HAVE_V16
+        /* ASCII fast path, needs a whole vector with no high bits and no terminator. Without a known length
+         * the loads are aligned like in strlen, so one that reaches past the terminator stays in its page */
+        while(n >= 16 && de - d >= 16 && (!aligned || !((uintptr_t)s & 15))) {
+            v = *(__v16u*)s;
+            q = (__v2q)((v & 0x80) | (__v16)(v == 0));
+            if(q[0] | q[1]) break;
+            *(__v8hu*)d = __builtin_convertvector(*(__v8bu*)s, __v8h);
+            *(__v8hu*)(d + 8) = __builtin_convertvector(*(__v8bu*)(s + 8), __v8h);
+            s += 16; d += 16; n -= 16;
+        }
+        if(!n || d >= de || !*s) break;
+#endif
+        if(*s < 0x80) { *d++ = *s++; n--; continue; }
+        if((*s & 0xE0) == 0xC0 && n > 1) { *d++ = ((s[0] & 0x1F)<<6)|(s[1] & 0x3F); s += 2; n -= 2; } else
+        if((*s & 0xF0) == 0xE0 && n > 2) { *d++ = ((s[0] & 0xF)<<12)|((s[1] & 0x3F)<<6)|(s[2] & 0x3F); s += 3; n -= 3; } else
+        /* outside of the BMP, can't be represented in UCS-2 */
+        if((*s & 0xF8) == 0xF0 && n > 3) { *d++ = 0xFFFD; s += 4; n -= 4; }
+        else { *d = 0; return (size_t)-1; }
+    }
+    *d = 0;
+    return d - __dst;
+}
+
+size_t ucs2_to_utf8 (char *__dst, size_t __dstmax, const wchar_t *__src, size_t __srclen)
+{
+    const wchar_t *s = __src;
+    size_t n = __srclen;
+    uint8_t *d = (uint8_t*)__dst, *de;
+#ifdef __HAVE_V16
+    __v8h v;
+    __v2q q;
+    int aligned = __srclen == (size_t)-1;
+#endif
+    if(!__dst || !__dstmax) return 0;
+    if(!__src) { *__dst = 0; return 0; }
+    de = (uint8_t*)__dst + __dstmax - 1;
+    while(n && *s) {
+#ifdef __HAVE_V16
+        while(n >= 8 && de - d >= 8 && (!aligned || !((uintptr_t)s & 15))) {
+            v = *(__v8hu*)s;
+            q = (__v2q)((v & 0xFF80) | (__v8h)(v == 0));
+            if(q[0] | q[1]) break;
+            *(__v8bu*)d = __builtin_convertvector(v, __v8b);
+            s += 8; d += 8; n -= 8;
+        }
+        if(!n || !*s) break;
+#endif
+        if(*s < 0x80) { if(de - d < 1) break; *d++ = *s; } else
+        if(*s < 0x800) { if(de - d < 2) break; *d++ = ((*s>>6)&0x1F)|0xC0; *d++ = (*s&0x3F)|0x80; }
+        else { if(de - d < 3) break; *d++ = ((*s>>12)&0x0F)|0xE0; *d++ = ((*s>>6)&0x3F)|0x80; *d++ = (*s&0x3F)|0x80; }
+        s++; n--;
+    }
+    *d = 0;
+    return (char*)d - __dst;
+}
+
 size_t mbstowcs (wchar_t *__pwcs, const char *__s, size_t __n)
 {
-    int r;
-    wchar_t *orig = __pwcs;
     if(!__s || !*__s) return 0;
-    while(*__s) {
-        r = mbtowc(__pwcs, __s, __n - (__pwcs - orig));
-        if(r < 0) return (size_t)-1;
-        __pwcs++;
-        __s += r;
-    }
-    *__pwcs = 0;
-    return __pwcs - orig;
+    /* __n doesn't include the terminator */
+    return utf8_to_ucs2(__pwcs, __n + 1, __s, (size_t)-1);
 }
 
 size_t wcstombs (char *__s, const wchar_t *__pwcs, size_t __n)
 {
-    int r;
-    char *orig = __s;
     if(!__s || !__pwcs || !*__pwcs) return 0;
-    while(*__pwcs && (__s - orig + 4 < __n)) {
-        r = wctomb(__s, *__pwcs);
-        if(r < 0) return (size_t)-1;
-        __pwcs++;
-        __s += r;
-    }
-    *__s = 0;
-    return __s - orig;
+    return ucs2_to_utf8(__s, __n, __pwcs, (size_t)-1);
 }
 
 void srand(unsigned int __seed)
@@ -30,32 +30,126 @@
 
 #include <uefi.h>
 
-void *memcpy(void *dst, const void *src, size_t n)
+/* the compiler must not turn the copy and fill loops below back into calls to these very functions */
+#if defined(__clang__)
+#define __NO_LIBCALL __attribute__((no_builtin))
+#elif defined(__GNUC__)
+#define __NO_LIBCALL __attribute__((optimize("no-tree-loop-distribute-patterns")))
+#else
+#define __NO_LIBCALL
+#endif
+
+/* SSE2 is part of x86_64 and NEON is mandatory on aarch64, so 16 byte vectors are always there. The compiler's
+ * vector extension generates the right instructions for both, only the byte mask of a compare is arch specific */
+#if defined(__x86_64__) || defined(__aarch64__)
+#define __HAVE_V16
+typedef uint8_t __v16 __attribute__((vector_size(16)));
+typedef char __v16c __attribute__((vector_size(16)));
+typedef uint64_t __v2q __attribute__((vector_size(16)));
+typedef __v16 __v16u __attribute__((aligned(1), may_alias));
+/* index of the first non-zero byte in a compare result, 16 if there's none */
+static inline int __v16first(__v16 v)
+{
+#ifdef __x86_64__
+    uint32_t m = (uint32_t)__builtin_ia32_pmovmskb128((__v16c)v);
+    return m ? __builtin_ctz(m) : 16;
+#else
+    __v2q q = (__v2q)v;
+    if(q[0]) return __builtin_ctzll(q[0]) >> 3;
+    if(q[1]) return 8 + (__builtin_ctzll(q[1]) >> 3);
+    return 16;
+#endif
+}
+#endif
+typedef uint64_t __u64u __attribute__((aligned(1), may_alias));
+
+#ifdef __x86_64__
+/* Enhanced REP MOVSB/STOSB, detected by __string_init(). Above this size microcoded string ops beat vector loops */
+#define ERMS_THRESHOLD 512
+static int __str_erms = 0;
+#endif
+
+/* called once from uefi_init() before main, picks the implementation the CPU supports */
+void __string_init(void)
+{
+#ifdef __x86_64__
+    uint32_t a, b, c, d;
+    __asm__ __volatile__ ("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "a"(0), "c"(0));
+    if(a >= 7) {
+        __asm__ __volatile__ ("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "a"(7), "c"(0));
+        __str_erms = (b >> 9) & 1;
+    }
+#endif
+}
+
+__NO_LIBCALL void *memcpy(void *dst, const void *src, size_t n)
 {
     uint8_t *a=(uint8_t*)dst,*b=(uint8_t*)src;
     if(src && dst && src != dst && n>0) {
+#ifdef __x86_64__
+        if(__str_erms && n >= ERMS_THRESHOLD) {
+            __asm__ __volatile__ ("rep movsb" : "+D"(a), "+S"(b), "+c"(n) : : "memory");
+            return dst;
+        }
+#endif
+#ifdef __HAVE_V16
+        for(; n >= 64; n -= 64, a += 64, b += 64) {
+            __v16 v0 = *(__v16u*)b, v1 = *(__v16u*)(b + 16), v2 = *(__v16u*)(b + 32), v3 = *(__v16u*)(b + 48);
+            *(__v16u*)a = v0; *(__v16u*)(a + 16) = v1; *(__v16u*)(a + 32) = v2; *(__v16u*)(a + 48) = v3;
+        }
+        for(; n >= 16; n -= 16, a += 16, b += 16) *(__v16u*)a = *(__v16u*)b;
+#else
+        /* align the destination, then copy a word at a time */
+        for(; n && ((uintptr_t)a & 7); n--) *a++ = *b++;
+        for(; n >= 8; n -= 8, a += 8, b += 8) *(uint64_t*)a = *(__u64u*)b;
+#endif
         while(n--) *a++ = *b++;
     }
     return dst;
 }
 
-void *memmove(void *dst, const void *src, size_t n)
+__NO_LIBCALL void *memmove(void *dst, const void *src, size_t n)
 {
     uint8_t *a=(uint8_t*)dst,*b=(uint8_t*)src;
     if(src && dst && src != dst && n>0) {
         if(a>b && a<b+n) {
-            a+=n-1; b+=n-1; while(n-->0) *a--=*b--;
+            /* overlapping with the source behind us, copy backwards */
+            a+=n; b+=n;
+#ifdef __HAVE_V16
+            for(; n >= 16; n -= 16) { a -= 16; b -= 16; *(__v16u*)a = *(__v16u*)b; }
+#else
+            for(; n >= 8; n -= 8) { a -= 8; b -= 8; *(__u64u*)a = *(__u64u*)b; }
+#endif
+            while(n-->0) *--a=*--b;
         } else {
-            while(n--) *a++ = *b++;
+            /* a forward copy reads every source byte before overwriting it */
+            memcpy(dst, src, n);
         }
     }
     return dst;
 }
 
-void *memset(void *s, int c, size_t n)
+__NO_LIBCALL void *memset(void *s, int c, size_t n)
 {
     uint8_t *p=(uint8_t*)s;
     if(s && n>0) {
+#ifdef __x86_64__
+        if(__str_erms && n >= ERMS_THRESHOLD) {
+            __asm__ __volatile__ ("rep stosb" : "+D"(p), "+c"(n) : "a"(c) : "memory");
+            return s;
+        }
+#endif
+#ifdef __HAVE_V16
+        __v16 v = (__v16){0} + (uint8_t)c;
+        for(; n >= 64; n -= 64, p += 64) {
+            *(__v16u*)p = v; *(__v16u*)(p + 16) = v; *(__v16u*)(p + 32) = v; *(__v16u*)(p + 48) = v;
+        }
+        for(; n >= 16; n -= 16, p += 16) *(__v16u*)p = v;
+#else
+        uint64_t w = (uint8_t)c * 0x0101010101010101ULL;
+        for(; n && ((uintptr_t)p & 7); n--) *p++ = c;
+        for(; n >= 8; n -= 8, p += 8) *(uint64_t*)p = w;
+#endif
         while(n--) *p++ = c;
     }
     return s;
@@ -65,6 +159,15 @@ int memcmp(const void *s1, const void *s2, size_t n)
 {
     uint8_t *a=(uint8_t*)s1,*b=(uint8_t*)s2;
     if(s1 && s2 && s1 != s2 && n>0) {
+#ifdef __HAVE_V16
+        for(; n >= 16; n -= 16, a += 16, b += 16) {
+            int i = __v16first((__v16)(*(__v16u*)a != *(__v16u*)b));
+            if(i < 16) return a[i] - b[i];
+        }
+#else
+        /* skip equal words, the differing byte is located by the byte loop */
+        for(; n >= 8 && *(__u64u*)a == *(__u64u*)b; n -= 8, a += 8, b += 8);
+#endif
         while(n--) {
             if(*a != *b) return *a - *b;
             a++; b++;
@@ -77,6 +180,20 @@ void *memchr(const void *s, int c, size_t n)
 {
     uint8_t *e, *p=(uint8_t*)s;
     if(s && n>0) {
+#ifdef __HAVE_V16
+        __v16 v = (__v16){0} + (uint8_t)c;
+        for(; n >= 16; n -= 16, p += 16) {
+            int i = __v16first((__v16)(*(__v16u*)p == v));
+            if(i < 16) return p + i;
+        }
+#else
+        /* a word has a matching byte if xor-ing it with the pattern gives a zero byte */
+        uint64_t w, pat = (uint8_t)c * 0x0101010101010101ULL;
+        for(; n >= 8; n -= 8, p += 8) {
+            w = *(__u64u*)p ^ pat;
+            if((w - 0x0101010101010101ULL) & ~w & 0x8080808080808080ULL) break;
+        }
+#endif
         for(e=p+n; p<e; p++) if(*p==(uint8_t)c) return p;
     }
     return NULL;
@@ -91,14 +208,32 @@ void *memrchr(const void *s, int c, size_t n)
     return NULL;
 }
 
+/* after this many candidates that failed to match the first byte is too common for memchr to help */
+#define MEMMEM_MAX_MISSES 16
+
 void *memmem(const void *haystack, size_t hl, const void *needle, size_t nl)
 {
-    uint8_t *c = (uint8_t*)haystack;
+    uint8_t *c = (uint8_t*)haystack, *e, *n = (uint8_t*)needle, last;
+    size_t shift[256], i, misses = 0;
     if(!haystack || !needle || !hl || !nl || nl > hl) return NULL;
-    hl -= nl - 1;
-    while(hl) {
-        if(!memcmp(c, needle, nl)) return c;
-        c++; hl--;
+    if(nl == 1) return memchr(haystack, *n, hl);
+    /* last possible starting position */
+    e = c + hl - nl;
+    /* let the vectorized memchr skip to the candidates that start with the first byte of the needle */
+    while(c <= e) {
+        c = (uint8_t*)memchr(c, *n, e - c + 1);
+        if(!c) return NULL;
+        if(!memcmp(c + 1, n + 1, nl - 1)) return c;
+        c++;
+        if(++misses > MEMMEM_MAX_MISSES) break;
+    }
+    /* Horspool: compare the last byte of the window and skip by the distance of that byte from the needle's end */
+    for(i = 0; i < 256; i++) shift[i] = nl;
+    for(i = 0; i < nl - 1; i++) shift[n[i]] = nl - 1 - i;
+    last = n[nl - 1];
+    while(c <= e) {
+        if(c[nl - 1] == last && !memcmp(c, n, nl - 1)) return c;
+        c += shift[c[nl - 1]];
     }
     return NULL;
 }
@@ -255,8 +390,21 @@ char_t *strtok_r(char_t *s, const char_t *delim, char_t **ptr)
 size_t strlen (const char_t *__s)
 {
     size_t ret;
+#if defined(__HAVE_V16) && !defined(UEFI_NO_UTF8)
+    const uint8_t *p;
+    int i;
+#endif
 
     if(!__s) return 0;
+#if defined(__HAVE_V16) && !defined(UEFI_NO_UTF8)
+    /* walk to a 16 byte boundary, from there on aligned loads can't cross into an unmapped page */
+    for(p = (const uint8_t*)__s; (uintptr_t)p & 15; p++)
+        if(!*p) return p - (const uint8_t*)__s;
+    for(;; p += 16) {
+        i = __v16first((__v16)(*(const __v16*)p == (__v16){0}));
+        if(i < 16) return p + i - (const uint8_t*)__s;
+    }
+#endif
     for(ret = 0; __s[ret]; ret++);
     return ret;
 }
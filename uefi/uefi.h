@@ -34,7 +34,7 @@
 
 /*** configuration ***/
 /* #define UEFI_NO_UTF8 */                  /* use wchar_t in your application */
-#define UEFI_NO_TRACK_ALLOC           /* do not track allocated buffers' size */
+/* #define UEFI_ALLOC_TAGS */             /* record the call site of every allocation (for heap_walk) */
 /*** configuration ends ***/
 
 #ifdef  __cplusplus
@@ -538,6 +538,10 @@ typedef enum {
     ByProtocol
 } efi_locate_search_type_t;
 
+typedef enum {
+    EFI_NATIVE_INTERFACE
+} efi_interface_type_t;
+
 typedef enum {
     EfiResetCold,
     EfiResetWarm,
@@ -550,6 +554,7 @@ typedef enum {
 #define efi_memory_type_t EFI_MEMORY_TYPE
 #define efi_timer_delay_t EFI_TIMER_DELAY
 #define efi_locate_search_type_t EFI_LOCATE_SEARCH_TYPE
+#define efi_interface_type_t EFI_INTERFACE_TYPE
 #define efi_reset_type_t EFI_RESET_TYPE
 
 #endif
@@ -710,6 +715,9 @@ typedef efi_status_t (EFIAPI *efi_wait_for_event_t)(uintn_t NumberOfEvents, efi_
 typedef efi_status_t (EFIAPI *efi_signal_event_t)(efi_event_t Event);
 typedef efi_status_t (EFIAPI *efi_close_event_t)(efi_event_t Event);
 typedef efi_status_t (EFIAPI *efi_check_event_t)(efi_event_t Event);
+typedef efi_status_t (EFIAPI *efi_install_protocol_interface_t)(efi_handle_t *Handle, efi_guid_t *Protocol,
+    efi_interface_type_t InterfaceType, void *Interface);
+typedef efi_status_t (EFIAPI *efi_uninstall_protocol_interface_t)(efi_handle_t Handle, efi_guid_t *Protocol, void *Interface);
 typedef efi_status_t (EFIAPI *efi_handle_protocol_t)(efi_handle_t Handle, efi_guid_t *Protocol, void **Interface);
 typedef efi_status_t (EFIAPI *efi_register_protocol_notify_t)(efi_guid_t *Protocol, efi_event_t Event, void **Registration);
 typedef efi_status_t (EFIAPI *efi_locate_handle_t)(efi_locate_search_type_t SearchType, efi_guid_t *Protocol,
@@ -763,9 +771,9 @@ typedef struct {
     efi_close_event_t           CloseEvent;
     efi_check_event_t           CheckEvent;
 
-    void*                       InstallProtocolInterface;       /* not defined yet */
-    void*                       ReinstallProtocolInterface;
-    void*                       UninstallProtocolInterface;
+    efi_install_protocol_interface_t InstallProtocolInterface;
+    void*                       ReinstallProtocolInterface;     /* not defined yet */
+    efi_uninstall_protocol_interface_t UninstallProtocolInterface;
     efi_handle_protocol_t       HandleProtocol;
     efi_handle_protocol_t       PCHandleProtocol;
     efi_register_protocol_notify_t RegisterProtocolNotify;
@@ -827,6 +835,54 @@ typedef struct {
 extern efi_loaded_image_protocol_t *LIP;
 extern efi_handle_t IM;
 
+/*** Load File 2 Protocol ***/
+#ifndef EFI_LOAD_FILE2_PROTOCOL_GUID
+#define EFI_LOAD_FILE2_PROTOCOL_GUID { 0x4006c0c1, 0xfcb3, 0x403e, {0x99, 0x6d, 0x4a, 0x6c, 0x87, 0x24, 0xe0, 0x6d} }
+#endif
+
+typedef struct efi_load_file2_protocol_s efi_load_file2_protocol_t;
+typedef efi_status_t (EFIAPI *efi_load_file_t)(efi_load_file2_protocol_t *This, efi_device_path_t *FilePath,
+    boolean_t BootPolicy, uintn_t *BufferSize, void *Buffer);
+
+struct efi_load_file2_protocol_s {
+    efi_load_file_t         LoadFile;
+};
+
+#define MEDIA_DEVICE_PATH                   0x04
+#define MEDIA_VENDOR_DP                     0x03
+
+typedef struct {
+    efi_device_path_t       Header;
+    efi_guid_t              Guid;
+} efi_vendor_device_path_t;
+
+/*** MP Services Protocol ***/
+#ifndef EFI_MP_SERVICES_PROTOCOL_GUID
+#define EFI_MP_SERVICES_PROTOCOL_GUID { 0x3fdda605, 0xa76e, 0x4f46, {0xad, 0x29, 0x12, 0xf4, 0x53, 0x1b, 0x3d, 0x08} }
+#endif
+
+typedef struct efi_mp_services_protocol_s efi_mp_services_protocol_t;
+typedef void (EFIAPI *efi_ap_procedure_t)(void *ProcedureArgument);
+typedef efi_status_t (EFIAPI *efi_mp_get_number_of_processors_t)(efi_mp_services_protocol_t *This,
+    uintn_t *NumberOfProcessors, uintn_t *NumberOfEnabledProcessors);
+typedef efi_status_t (EFIAPI *efi_mp_startup_all_aps_t)(efi_mp_services_protocol_t *This, efi_ap_procedure_t Procedure,
+    boolean_t SingleThread, efi_event_t WaitEvent, uintn_t TimeoutInMicroSeconds, void *ProcedureArgument,
+    uintn_t **FailedCpuList);
+typedef efi_status_t (EFIAPI *efi_mp_startup_this_ap_t)(efi_mp_services_protocol_t *This, efi_ap_procedure_t Procedure,
+    uintn_t ProcessorNumber, efi_event_t WaitEvent, uintn_t TimeoutInMicroseconds, void *ProcedureArgument,
+    boolean_t *Finished);
+typedef efi_status_t (EFIAPI *efi_mp_who_am_i_t)(efi_mp_services_protocol_t *This, uintn_t *ProcessorNumber);
+
+struct efi_mp_services_protocol_s {
+    efi_mp_get_number_of_processors_t GetNumberOfProcessors;
+    void*                   GetProcessorInfo;               /* not defined yet */
+    efi_mp_startup_all_aps_t StartupAllAPs;
+    efi_mp_startup_this_ap_t StartupThisAP;
+    void*                   SwitchBSP;
+    void*                   EnableDisableAP;
+    efi_mp_who_am_i_t       WhoAmI;
+};
+
 /*** System Table ***/
 typedef struct {
     efi_guid_t  VendorGuid;
@@ -877,6 +933,8 @@ extern efi_system_table_t *ST;
 #define EFI_FILE_VALID_ATTR     0x0000000000000037
 
 #define EFI_FILE_PROTOCOL_REVISION         0x00010000
+#define EFI_FILE_PROTOCOL_REVISION2        0x00020000
+#define EFI_FILE_PROTOCOL_LATEST_REVISION  EFI_FILE_PROTOCOL_REVISION2
 #define EFI_FILE_HANDLE_REVISION           EFI_FILE_PROTOCOL_REVISION
 #endif
 
@@ -921,6 +979,20 @@ typedef efi_status_t (EFIAPI *efi_file_set_info_t)(efi_file_handle_t *File, efi_
     void *Buffer);
 typedef efi_status_t (EFIAPI *efi_file_flush_t)(efi_file_handle_t *File);
 
+/* revision 2 of the file protocol, the Ex functions are only present if Revision >= EFI_FILE_PROTOCOL_REVISION2 */
+typedef struct {
+    efi_event_t             Event;
+    efi_status_t            Status;
+    uintn_t                 BufferSize;
+    void                    *Buffer;
+} efi_file_io_token_t;
+
+typedef efi_status_t (EFIAPI *efi_file_open_ex_t)(efi_file_handle_t *File, efi_file_handle_t **NewHandle, wchar_t *FileName,
+    uint64_t OpenMode, uint64_t Attributes, efi_file_io_token_t *Token);
+typedef efi_status_t (EFIAPI *efi_file_read_ex_t)(efi_file_handle_t *File, efi_file_io_token_t *Token);
+typedef efi_status_t (EFIAPI *efi_file_write_ex_t)(efi_file_handle_t *File, efi_file_io_token_t *Token);
+typedef efi_status_t (EFIAPI *efi_file_flush_ex_t)(efi_file_handle_t *File, efi_file_io_token_t *Token);
+
 struct efi_file_handle_s {
     uint64_t                Revision;
     efi_file_open_t         Open;
@@ -933,6 +1005,10 @@ struct efi_file_handle_s {
     efi_file_get_info_t     GetInfo;
     efi_file_set_info_t     SetInfo;
     efi_file_flush_t        Flush;
+    efi_file_open_ex_t      OpenEx;
+    efi_file_read_ex_t      ReadEx;
+    efi_file_write_ex_t     WriteEx;
+    efi_file_flush_ex_t     FlushEx;
 };
 
 /*** Shell Parameter Protocols ***/
@@ -1086,6 +1162,49 @@ typedef struct {
     efi_block_io_t          *bio;
 } block_file_t;
 
+/*** Disk IO Protocol ***/
+#ifndef EFI_DISK_IO_PROTOCOL_GUID
+#define EFI_DISK_IO_PROTOCOL_GUID { 0xce345171, 0xba0b, 0x11d2, {0x8e, 0x4f, 0x0, 0xa0, 0xc9, 0x69, 0x72, 0x3b} }
+#endif
+
+typedef struct efi_disk_io_protocol_s efi_disk_io_protocol_t;
+typedef efi_status_t (EFIAPI *efi_disk_read_t)(efi_disk_io_protocol_t *This, uint32_t MediaId, uint64_t Offset,
+    uintn_t BufferSize, void *Buffer);
+typedef efi_status_t (EFIAPI *efi_disk_write_t)(efi_disk_io_protocol_t *This, uint32_t MediaId, uint64_t Offset,
+    uintn_t BufferSize, void *Buffer);
+
+struct efi_disk_io_protocol_s {
+    uint64_t                Revision;
+    efi_disk_read_t         ReadDisk;
+    efi_disk_write_t        WriteDisk;
+};
+
+/*** Disk IO 2 Protocol ***/
+#ifndef EFI_DISK_IO2_PROTOCOL_GUID
+#define EFI_DISK_IO2_PROTOCOL_GUID { 0x151c8eae, 0x7f2c, 0x472c, {0x9e, 0x54, 0x98, 0x28, 0x19, 0x4f, 0x6a, 0x88} }
+#endif
+
+typedef struct {
+    efi_event_t             Event;
+    efi_status_t            TransactionStatus;
+} efi_disk_io2_token_t;
+
+typedef struct efi_disk_io2_protocol_s efi_disk_io2_protocol_t;
+typedef efi_status_t (EFIAPI *efi_disk_cancel_ex_t)(efi_disk_io2_protocol_t *This);
+typedef efi_status_t (EFIAPI *efi_disk_read_ex_t)(efi_disk_io2_protocol_t *This, uint32_t MediaId, uint64_t Offset,
+    efi_disk_io2_token_t *Token, uintn_t BufferSize, void *Buffer);
+typedef efi_status_t (EFIAPI *efi_disk_write_ex_t)(efi_disk_io2_protocol_t *This, uint32_t MediaId, uint64_t Offset,
+    efi_disk_io2_token_t *Token, uintn_t BufferSize, void *Buffer);
+typedef efi_status_t (EFIAPI *efi_disk_flush_ex_t)(efi_disk_io2_protocol_t *This, efi_disk_io2_token_t *Token);
+
+struct efi_disk_io2_protocol_s {
+    uint64_t                Revision;
+    efi_disk_cancel_ex_t    Cancel;
+    efi_disk_read_ex_t      ReadDiskEx;
+    efi_disk_write_ex_t     WriteDiskEx;
+    efi_disk_flush_ex_t     FlushDiskEx;
+};
+
 /*** Graphics Output Protocol (not used, but could be useful to have) ***/
 #ifndef EFI_GRAPHICS_OUTPUT_PROTOCOL_GUID
 #define EFI_GRAPHICS_OUTPUT_PROTOCOL_GUID { 0x9042a9de, 0x23dc, 0x4a38, {0x96, 0xfb, 0x7a, 0xde, 0xd0, 0x80, 0x51, 0x6a } }
@@ -1241,8 +1360,31 @@ struct dirent {
     unsigned short int d_reclen;
     unsigned char d_type;
     char_t d_name[FILENAME_MAX];
+    /* not POSIX, taken from the same file info record as the name, so listing sizes and times needs no opens */
+    uint64_t d_size;
+    time_t d_mtime;
 };
-typedef struct efi_file_handle_s DIR;
+/* FILE and DIR wrap the firmware file handle. The file info is cached at open time, so size, attribute and
+ * position queries don't need a firmware call. The cache only follows changes made through this FILE */
+struct __file_s {
+    efi_file_handle_t       *handle;
+    uint64_t                pos;
+    uint64_t                size;
+    uint64_t                physsize;
+    uint64_t                attr;
+    efi_time_t              ctime;
+    efi_time_t              atime;
+    efi_time_t              mtime;
+    /* stdio buffer, shared by the pending writes and the read-ahead, only one of them is in use at a time */
+    uint8_t                 *buf;
+    size_t                  bufsize;
+    int                     bufmode;
+    int                     bufown;
+    size_t                  rpos;
+    size_t                  rlen;
+    size_t                  wlen;
+};
+typedef struct __file_s DIR;
 extern DIR *opendir (const char_t *__name);
 extern struct dirent *readdir (DIR *__dirp);
 extern void rewinddir (DIR *__dirp);
@@ -1295,6 +1437,28 @@ extern void *malloc (size_t __size);
 extern void *calloc (size_t __nmemb, size_t __size);
 extern void *realloc (void *__ptr, size_t __size);
 extern void free (void *__ptr);
+/* heap statistics, not part of POSIX */
+typedef struct {
+    uint64_t live_bytes;    /* bytes in buffers that weren't freed yet */
+    uint64_t peak_bytes;    /* highest live_bytes ever */
+    uint64_t live_allocs;   /* number of buffers that weren't freed yet */
+    uint64_t total_allocs;
+    uint64_t total_frees;
+    uint64_t pool_calls;    /* AllocatePool and FreePool calls made by the allocator */
+    uint64_t seq;           /* sequence number of the last allocation, usable as a heap_walk checkpoint */
+} heap_stats_t;
+typedef void (*heap_walk_t) (void *__ptr, size_t __size, const char *__file, int __line, void *__data);
+extern void heap_stats (heap_stats_t *__stats);
+/* calls __fn for every live buffer allocated after the __since sequence number, newest first */
+extern void heap_walk (uint64_t __since, heap_walk_t __fn, void *__data);
+extern void *__malloc_tag (size_t __size, const char *__file, int __line);
+extern void *__calloc_tag (size_t __nmemb, size_t __size, const char *__file, int __line);
+extern void *__realloc_tag (void *__ptr, size_t __size, const char *__file, int __line);
+#ifdef UEFI_ALLOC_TAGS
+#define malloc(s) __malloc_tag((s), __FILE__, __LINE__)
+#define calloc(n,s) __calloc_tag((n), (s), __FILE__, __LINE__)
+#define realloc(p,s) __realloc_tag((p), (s), __FILE__, __LINE__)
+#endif
 extern void abort (void);
 extern void exit (int __status);
 /* exit Boot Services function. Returns 0 on success. */
@@ -1306,6 +1470,10 @@ extern int mbtowc (wchar_t * __pwc, const char * __s, size_t __n);
 extern int wctomb (char *__s, wchar_t __wchar);
 extern size_t mbstowcs (wchar_t *__pwcs, const char *__s, size_t __n);
 extern size_t wcstombs (char *__s, const wchar_t *__pwcs, size_t __n);
+/* bulk conversions, not part of POSIX. Convert at most __srclen units ((size_t)-1 for zero terminated sources),
+ * always terminate __dst which has room for __dstmax units, and return the number of units written */
+extern size_t utf8_to_ucs2 (wchar_t *__dst, size_t __dstmax, const char *__src, size_t __srclen);
+extern size_t ucs2_to_utf8 (char *__dst, size_t __dstmax, const wchar_t *__src, size_t __srclen);
 extern void srand(unsigned int __seed);
 extern int rand(void);
 extern uint8_t *getenv(char_t *name, uintn_t *len);
@@ -1315,22 +1483,32 @@ extern int setenv(char_t *name, uintn_t len, uint8_t *data);
 #ifndef BUFSIZ
 #define BUFSIZ 8192
 #endif
+#define EOF (-1)
+#define _IOFBF 0	/* Fully buffered.  */
+#define _IOLBF 1	/* Line buffered.  */
+#define _IONBF 2	/* No buffering.  */
 #define SEEK_SET	0	/* Seek from beginning of file.  */
 #define SEEK_CUR	1	/* Seek from current position.  */
 #define SEEK_END	2	/* Seek from end of file.  */
 #define stdin (FILE*)ST->ConsoleInHandle
 #define stdout (FILE*)ST->ConsoleOutHandle
 #define stderr (FILE*)ST->ConsoleErrorHandle
-typedef struct efi_file_handle_s FILE;
+typedef struct __file_s FILE;
 extern int fclose (FILE *__stream);
 extern int fflush (FILE *__stream);
+extern int setvbuf (FILE *__stream, char_t *__buf, int __modes, size_t __n);
 extern int remove (const char_t *__filename);
 extern FILE *fopen (const char_t *__filename, const char_t *__modes);
+/* not POSIX, open a path relative to an open directory and delete a file or directory through its open stream */
+extern FILE *fopenat (DIR *__dirp, const char_t *__filename, const char_t *__modes);
+extern int fdelete (FILE *__stream);
 extern size_t fread (void *__ptr, size_t __size, size_t __n, FILE *__stream);
 extern size_t fwrite (const void *__ptr, size_t __size, size_t __n, FILE *__s);
 extern int fseek (FILE *__stream, long int __off, int __whence);
 extern long int ftell (FILE *__stream);
 extern int feof (FILE *__stream);
+extern int fgetc (FILE *__stream);
+extern char_t *fgets (char_t *__s, int __n, FILE *__stream);
 extern int fprintf (FILE *__stream, const char_t *__format, ...);
 extern int printf (const char_t *__format, ...);
 extern int sprintf (char_t *__s, const char_t *__format, ...);